@@ -57,9 +57,11 @@ int main( int argc, char ** argv )
 		return EXIT_FAILURE;
 	}
 
-	// setup the renderer
+	// setup the renderer; models are cached after the first launch, so later ones skip parsing
 	Scene scene;
-	if ( !scene.loadFromFile( filename ) )
+	ObjModel::LoadOptions loadOptions;
+	loadOptions.useCache = true;
+	if ( !scene.loadFromFile( filename, loadOptions ) )
 	{
 		sf::err() << "FATAL ERROR: Failed to load scene file" << std::endl;
 		window.close();
@@ -0,0 +1,183 @@
+/*
+ * Times clustered light assignment as the number of lights grows. The scene's own lights are
+ * replaced by random point and spot lights scattered through its bounds, and the camera frames
+ * the whole scene. Every run is checked for conservativeness: points are sampled inside the
+ * lights' reach (and spotlights' cones), and each light must be listed in the cluster its points
+ * fall in.
+ *
+ * usage: clusterbench file.scene [lights...] [--grid x y slices] [--frames n]
+ */
+
+#include <renderer/camera.hpp>
+#include <renderer/clusters.hpp>
+#include <scene/scene.hpp>
+#include <scene/threadpool.hpp>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+
+namespace
+{
+	unsigned int seed = 12345;
+
+	unsigned int nextRandom()
+	{
+		seed = seed * 1664525u + 1013904223u;
+		return seed >> 8;
+	}
+
+	float randomFloat( float low, float high )
+	{
+		return low + ( high - low ) * ( nextRandom() & 0xFFFF ) / 65535.0f;
+	}
+
+	// how many sampled points inside lights' reach (their cones, for spotlights) land in a cluster
+	// that doesn't list the light
+	size_t countMisses( const LightClusters& clusters, const Scene& scene, const Camera& camera, size_t samples )
+	{
+		const std::vector<Scene::PointLight>& pointlights = scene.getPointLights();
+		const std::vector<Scene::SpotLight>& spotlights = scene.getSpotLights();
+		size_t lights = pointlights.size() + spotlights.size();
+		glm::mat4 view = camera.getViewMatrix();
+		size_t misses = 0;
+		for ( size_t s = 0; s < samples && lights > 0; ++s )
+		{
+			size_t l = nextRandom() % lights;
+			glm::vec3 offset( randomFloat( -1.0f, 1.0f ), randomFloat( -1.0f, 1.0f ), randomFloat( -1.0f, 1.0f ) );
+			if ( glm::length( offset ) > 1.0f )
+				continue;
+			glm::vec3 position;
+			if ( l < pointlights.size() )
+			{
+				position = pointlights[l].position + offset * pointlights[l].range * 0.999f;
+			}
+			else
+			{
+				const Scene::SpotLight& light = spotlights[l - pointlights.size()];
+				if ( light.angle < 180.0f && glm::dot( glm::normalize( offset ), light.direction ) < std::cos( glm::radians( light.angle ) ) )
+					continue;
+				position = light.position + offset * light.range * 0.999f;
+			}
+			size_t cluster = clusters.findCluster( glm::vec3( view * glm::vec4( position, 1.0f ) ) );
+			if ( cluster == clusters.getClusterCount() )
+				continue;
+
+			const unsigned int * list = clusters.getLightIndices().empty() ? NULL : &clusters.getLightIndices()[0];
+			const unsigned int * first = list + clusters.getOffsets()[cluster], * last = first + clusters.getCounts()[cluster];
+			if ( !std::binary_search( first, last, static_cast<unsigned int>( l ) ) )
+				++misses;
+		}
+		return misses;
+	}
+}
+
+int main( int argc, char ** argv )
+{
+	if ( argc < 2 )
+	{
+		std::printf( "usage: clusterbench file.scene [lights...] [--grid x y slices] [--frames n]\n" );
+		return EXIT_FAILURE;
+	}
+
+	LightClusters::Options options;
+	int frames = 20;
+	std::vector<size_t> lightCounts;
+	for ( int i = 2; i < argc; ++i )
+	{
+		if ( std::strcmp( argv[i], "--grid" ) == 0 && i + 3 < argc )
+		{
+			options.tilesX = static_cast<unsigned int>( std::max( 1, std::atoi( argv[++i] ) ) );
+			options.tilesY = static_cast<unsigned int>( std::max( 1, std::atoi( argv[++i] ) ) );
+			options.slices = static_cast<unsigned int>( std::max( 1, std::atoi( argv[++i] ) ) );
+		}
+		else if ( std::strcmp( argv[i], "--frames" ) == 0 && i + 1 < argc )
+		{
+			frames = std::max( 1, std::atoi( argv[++i] ) );
+		}
+		else
+		{
+			lightCounts.push_back( static_cast<size_t>( std::max( 1, std::atoi( argv[i] ) ) ) );
+		}
+	}
+	if ( lightCounts.empty() )
+	{
+		const size_t defaults[] = { 100, 1000, 10000, 100000 };
+		lightCounts.assign( defaults, defaults + 4 );
+	}
+
+	Scene scene;
+	if ( !scene.loadFromFile( argv[1] ) )
+	{
+		std::fprintf( stderr, "loading %s failed\n", argv[1] );
+		return EXIT_FAILURE;
+	}
+
+	glm::vec3 low( 0.0f ), high( 0.0f );
+	const std::vector<Scene::StaticModel>& models = scene.getModels();
+	for ( size_t i = 0; i < models.size(); ++i )
+	{
+		low = i == 0 ? models[i].worldMin : glm::min( low, models[i].worldMin );
+		high = i == 0 ? models[i].worldMax : glm::max( high, models[i].worldMax );
+	}
+	glm::vec3 center = ( low + high ) * 0.5f;
+	float radius = std::max( glm::length( high - low ) * 0.5f, 1.0e-3f );
+	Camera camera( glm::radians( 60.0f ), 16.0f / 9.0f, radius * 0.01f, radius * 10.0f );
+	camera.lookAt( center + glm::vec3( 0.8f, 0.9f, 1.2f ) * radius, center );
+
+	std::printf( "%s: %ux%ux%u clusters, %d frames, %u threads\n", argv[1], options.tilesX, options.tilesY, options.slices, frames,
+				 ThreadPool::shared().concurrency() );
+
+	LightClusters clusters;
+	for ( size_t n = 0; n < lightCounts.size(); ++n )
+	{
+		// lights reach 5% of the scene's size; a quarter of them are spotlights
+		float reach = radius * 0.1f;
+		float Kq = ( 1.0f / scene.getLightThreshold() - 1.0f ) / ( reach * reach );
+		std::vector<Scene::PointLight>& pointlights = scene.getPointLights();
+		std::vector<Scene::SpotLight>& spotlights = scene.getSpotLights();
+		pointlights.resize( lightCounts[n] - lightCounts[n] / 4 );
+		spotlights.resize( lightCounts[n] / 4 );
+		for ( size_t i = 0; i < pointlights.size(); ++i )
+		{
+			Scene::PointLight& light = pointlights[i];
+			light.position = glm::vec3( randomFloat( low.x, high.x ), randomFloat( low.y, high.y ), randomFloat( low.z, high.z ) );
+			light.color = glm::vec3( randomFloat( 0.2f, 1.0f ), randomFloat( 0.2f, 1.0f ), randomFloat( 0.2f, 1.0f ) );
+			light.Kc = 1.0f, light.Kl = 0.0f, light.Kq = Kq;
+		}
+		for ( size_t i = 0; i < spotlights.size(); ++i )
+		{
+			Scene::SpotLight& light = spotlights[i];
+			light.position = glm::vec3( randomFloat( low.x, high.x ), randomFloat( low.y, high.y ), randomFloat( low.z, high.z ) );
+			light.direction = glm::normalize( glm::vec3( randomFloat( -1.0f, 1.0f ), -1.0f, randomFloat( -1.0f, 1.0f ) ) );
+			light.color = glm::vec3( randomFloat( 0.2f, 1.0f ), randomFloat( 0.2f, 1.0f ), randomFloat( 0.2f, 1.0f ) );
+			light.angle = randomFloat( 10.0f, 60.0f );
+			light.exponent = 10.0f;
+			light.length = reach * 2.0f;
+			light.Kc = 1.0f, light.Kl = 0.0f, light.Kq = Kq;
+		}
+		scene.updateLights();
+
+		LightClusters::FrameStats best;
+		for ( int frame = 0; frame < frames; ++frame )
+		{
+			clusters.assign( camera, scene, options );
+			if ( frame == 0 || clusters.getFrameStats().seconds < best.seconds )
+				best = clusters.getFrameStats();
+		}
+
+		size_t misses = countMisses( clusters, scene, camera, 100000 );
+		size_t bytes = ( clusters.getOffsets().size() + clusters.getCounts().size() + clusters.getLightIndices().size() ) * sizeof( unsigned int );
+		std::printf( "%7lu lights  %8.3f ms  (bounds %.3f, assign %.3f)  %lu in view, %lu entries, %.1f per occupied cluster, at most %lu, "
+					 "%lu KB to upload, %lu misses\n",
+					 static_cast<unsigned long>( lightCounts[n] ), best.seconds * 1000.0f, best.boundsSeconds * 1000.0f, best.assignSeconds * 1000.0f,
+					 static_cast<unsigned long>( best.lightsInView ), static_cast<unsigned long>( best.entries ),
+					 best.occupiedClusters > 0 ? double( best.entries ) / best.occupiedClusters : 0.0,
+					 static_cast<unsigned long>( best.maxClusterLights ), static_cast<unsigned long>( bytes / 1024 ),
+					 static_cast<unsigned long>( misses ) );
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,131 @@
+/*
+ * Benchmark for meshcodec. Builds (and cache-optimizes) the Mesh of an .obj file, codes it, and
+ * times decoding with each kernel; every decode is checked bit for bit against the source. The
+ * run also fails if the indexes take more than max-index-bits each (10 by default, against 16 or
+ * 32 raw), which cache-ordered meshes stay well under.
+ *
+ * usage: codecbench directory file.obj [repeats] [max-index-bits]
+ */
+
+#include <scene/meshcodec.hpp>
+#include <scene/meshoptimizer.hpp>
+#include <scene/objmodel.hpp>
+#include <SFML/System/Clock.hpp>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+	const char * kernelName( meshcodec::Kernel kernel )
+	{
+		switch ( kernel )
+		{
+			case meshcodec::SCALAR: return "scalar";
+			case meshcodec::SSSE3: return "ssse3";
+			default: return "auto";
+		}
+	}
+
+	template <typename T>
+	bool sameArray( const std::vector<T>& a, const std::vector<T>& b )
+	{
+		return a.size() == b.size() && ( a.empty() || std::memcmp( &a[0], &b[0], a.size() * sizeof( T ) ) == 0 );
+	}
+
+	bool sameMesh( const Mesh& a, const Mesh& b )
+	{
+		if ( !sameArray( a.vertices, b.vertices ) || !sameArray( a.indices16, b.indices16 ) ||
+			 !sameArray( a.indices32, b.indices32 ) || a.submeshes.size() != b.submeshes.size() )
+			return false;
+		for ( size_t s = 0; s < a.submeshes.size(); ++s )
+		{
+			const Mesh::SubMesh& x = a.submeshes[s];
+			const Mesh::SubMesh& y = b.submeshes[s];
+			if ( x.group != y.group || x.materialID != y.materialID || x.vertexType != y.vertexType ||
+				 x.vertexOffset != y.vertexOffset || x.vertexCount != y.vertexCount ||
+				 x.indexOffset != y.indexOffset || x.indexCount != y.indexCount || x.indexSize != y.indexSize )
+				return false;
+		}
+		return true;
+	}
+}
+
+int main( int argc, char ** argv )
+{
+	if ( argc < 3 )
+	{
+		std::printf( "usage: codecbench directory file.obj [repeats] [max-index-bits]\n" );
+		return EXIT_FAILURE;
+	}
+	int repeats = argc > 3 ? std::atoi( argv[3] ) : 20;
+	double maxIndexBits = argc > 4 ? std::atof( argv[4] ) : 10.0;
+
+	ObjModel model;
+	if ( !model.loadFromFile( argv[1], argv[2] ) )
+		return EXIT_FAILURE;
+
+	Mesh mesh;
+	if ( !mesh.build( model ) )
+		return EXIT_FAILURE;
+	MeshOptimizer optimizer;
+	optimizer.optimize( mesh );
+
+	size_t vertexBytes = mesh.vertices.size() * sizeof( Mesh::Vertex );
+	size_t indexBytes = mesh.indices16.size() * 2 + mesh.indices32.size() * 4;
+
+	sf::Clock clock;
+	std::vector<unsigned char> coded;
+	meshcodec::encodeMesh( mesh, coded );
+	float encodeSeconds = clock.getElapsedTime().asSeconds();
+
+	// the streams on their own, for the per-stream ratios
+	std::vector<unsigned char> vertexStream, indexStream;
+	meshcodec::encodeVertices( mesh.vertices.data(), mesh.vertices.size(), sizeof( Mesh::Vertex ), vertexStream );
+	meshcodec::encodeIndices( mesh.indices16.data(), mesh.indices16.size(), indexStream );
+	meshcodec::encodeIndices( mesh.indices32.data(), mesh.indices32.size(), indexStream );
+
+	std::printf( "%lu vertices, %lu indexes\n", static_cast<unsigned long>( mesh.vertices.size() ),
+				 static_cast<unsigned long>( mesh.indices16.size() + mesh.indices32.size() ) );
+	std::printf( "  vertices %10lu -> %10lu bytes  %5.2fx\n", static_cast<unsigned long>( vertexBytes ),
+				 static_cast<unsigned long>( vertexStream.size() ), vertexBytes / double( vertexStream.size() ) );
+	size_t indexCount = mesh.indices16.size() + mesh.indices32.size();
+	double indexBits = indexCount > 0 ? indexStream.size() * 8.0 / double( indexCount ) : 0.0;
+	bool compact = indexBits <= maxIndexBits;
+	std::printf( "  indexes  %10lu -> %10lu bytes  %5.2fx  %.2f bits per index%s\n", static_cast<unsigned long>( indexBytes ),
+				 static_cast<unsigned long>( indexStream.size() ), indexBytes / double( indexStream.size() ), indexBits,
+				 compact ? "" : "  OVER THE LIMIT" );
+	std::printf( "  mesh     %10lu -> %10lu bytes  %5.2fx, encoded in %.2f ms\n", static_cast<unsigned long>( vertexBytes + indexBytes ),
+				 static_cast<unsigned long>( coded.size() ), ( vertexBytes + indexBytes ) / double( coded.size() ), encodeSeconds * 1000.0f );
+
+	// throughput is measured in decoded bytes, on one thread
+	const meshcodec::Kernel kernels[] = { meshcodec::SCALAR, meshcodec::SSSE3 };
+	bool lossless = true;
+	for ( size_t k = 0; k < 2; ++k )
+	{
+		if ( meshcodec::selectKernel( kernels[k] ) != kernels[k] )
+		{
+			std::printf( "  %-8s not supported here\n", kernelName( kernels[k] ) );
+			continue;
+		}
+
+		Mesh decoded;
+		float best = 0.0f;
+		bool ok = true;
+		for ( int r = 0; r < repeats; ++r )
+		{
+			clock.restart();
+			ok = meshcodec::decodeMesh( coded.data(), coded.size(), decoded, kernels[k] ) && ok;
+			float seconds = clock.getElapsedTime().asSeconds();
+			best = r == 0 ? seconds : std::min( best, seconds );
+		}
+		ok = ok && sameMesh( mesh, decoded );
+		lossless = lossless && ok;
+		std::printf( "  %-8s %8.3f ms  %7.2f GB/s  %s\n", kernelName( kernels[k] ), best * 1000.0f,
+					 ( vertexBytes + indexBytes ) / 1.0e9 / best, ok ? "lossless" : "MISMATCH" );
+	}
+
+	return lossless && compact ? EXIT_SUCCESS : EXIT_FAILURE;
+}
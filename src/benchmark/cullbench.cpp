@@ -0,0 +1,120 @@
+/*
+ * Benchmark for the frustum culling kernels. Scatters random boxes and spheres over a large
+ * square, then times culling them all against a camera's frustum with each kernel, best of a
+ * number of frames, and checks every kernel's visible list against the scalar one. For scale,
+ * the same boxes are also culled through an InstanceBVH.
+ *
+ * usage: cullbench [bounds] [frames]
+ */
+
+#include <renderer/camera.hpp>
+#include <renderer/culling.hpp>
+#include <scene/instancebvh.hpp>
+#include <scene/threadpool.hpp>
+#include <SFML/System/Clock.hpp>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+namespace
+{
+	unsigned int nextRandom( unsigned int& state )
+	{
+		state = state * 1664525u + 1013904223u;
+		return state >> 8;
+	}
+
+	float randomFloat( unsigned int& state, float low, float high )
+	{
+		return low + ( high - low ) * ( nextRandom( state ) & 0xFFFF ) / 65535.0f;
+	}
+
+	const char * kernelName( culling::Kernel kernel )
+	{
+		return kernel == culling::SCALAR ? "scalar" : kernel == culling::SSE2 ? "sse2" : "avx2";
+	}
+}
+
+int main( int argc, char ** argv )
+{
+	size_t count = argc > 1 ? static_cast<size_t>( std::strtoul( argv[1], NULL, 10 ) ) : 100000;
+	int frames = argc > 2 ? std::max( 1, std::atoi( argv[2] ) ) : 50;
+	std::printf( "%lu bounds, %d frames, %u threads\n", static_cast<unsigned long>( count ), frames, ThreadPool::shared().concurrency() );
+
+	unsigned int state = 1;
+	culling::Boxes boxes;
+	culling::Spheres spheres;
+	boxes.resize( count );
+	spheres.resize( count );
+	std::vector<glm::vec3> boxMin( count ), boxMax( count );
+	for ( size_t i = 0; i < count; ++i )
+	{
+		glm::vec3 center( randomFloat( state, -1000.0f, 1000.0f ), randomFloat( state, 0.0f, 50.0f ), randomFloat( state, -1000.0f, 1000.0f ) );
+		glm::vec3 extent( randomFloat( state, 0.5f, 5.0f ), randomFloat( state, 0.5f, 5.0f ), randomFloat( state, 0.5f, 5.0f ) );
+		boxMin[i] = center - extent;
+		boxMax[i] = center + extent;
+		boxes.set( i, boxMin[i], boxMax[i] );
+		spheres.set( i, center, glm::length( extent ) );
+	}
+
+	// a camera in the middle of the field, looking along it
+	Camera camera( glm::radians( 60.0f ), 16.0f / 9.0f, 0.1f, 800.0f );
+	camera.lookAt( glm::vec3( 0.0f, 20.0f, 0.0f ), glm::vec3( 100.0f, 10.0f, 100.0f ) );
+	glm::vec4 planes[6];
+	camera.getFrustumPlanes( planes );
+
+	std::vector<unsigned int> referenceBoxes, referenceSpheres, visible;
+	culling::cullBoxes( planes, boxes, referenceBoxes, culling::SCALAR );
+	culling::cullSpheres( planes, spheres, referenceSpheres, culling::SCALAR );
+	std::printf( "  visible: %lu boxes, %lu spheres\n", static_cast<unsigned long>( referenceBoxes.size() ),
+				 static_cast<unsigned long>( referenceSpheres.size() ) );
+
+	sf::Clock clock;
+	const culling::Kernel kernels[] = { culling::SCALAR, culling::SSE2, culling::AVX2 };
+	for ( size_t k = 0; k < 3; ++k )
+	{
+		if ( culling::selectKernel( kernels[k] ) != kernels[k] )
+		{
+			std::printf( "  %-8s not supported here\n", kernelName( kernels[k] ) );
+			continue;
+		}
+
+		float boxSeconds = 0.0f, sphereSeconds = 0.0f;
+		bool matches = true;
+		for ( int frame = 0; frame < frames; ++frame )
+		{
+			clock.restart();
+			culling::cullBoxes( planes, boxes, visible, kernels[k] );
+			float seconds = clock.getElapsedTime().asSeconds();
+			boxSeconds = frame == 0 ? seconds : std::min( boxSeconds, seconds );
+			matches = matches && visible == referenceBoxes;
+
+			clock.restart();
+			culling::cullSpheres( planes, spheres, visible, kernels[k] );
+			seconds = clock.getElapsedTime().asSeconds();
+			sphereSeconds = frame == 0 ? seconds : std::min( sphereSeconds, seconds );
+			matches = matches && visible == referenceSpheres;
+		}
+		std::printf( "  %-8s boxes %8.3f ms  %7.1f M/s,  spheres %8.3f ms  %7.1f M/s,  %s\n", kernelName( kernels[k] ),
+					 boxSeconds * 1000.0f, count / 1.0e6 / boxSeconds, sphereSeconds * 1000.0f, count / 1.0e6 / sphereSeconds,
+					 matches ? "matches scalar" : "MISMATCH" );
+	}
+
+	InstanceBVH bvh;
+	bvh.build( boxMin, boxMax );
+	std::vector<size_t> found;
+	float bvhSeconds = 0.0f;
+	for ( int frame = 0; frame < frames; ++frame )
+	{
+		found.clear();
+		clock.restart();
+		bvh.queryFrustum( planes, found );
+		float seconds = clock.getElapsedTime().asSeconds();
+		bvhSeconds = frame == 0 ? seconds : std::min( bvhSeconds, seconds );
+	}
+	std::printf( "  bvh      boxes %8.3f ms, %lu visible (built in %.1f ms)\n", bvhSeconds * 1000.0f,
+				 static_cast<unsigned long>( found.size() ), bvh.getBuildStats().seconds * 1000.0f );
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,227 @@
+/*
+ * Times tiled deferred lighting of a software-rasterized G-buffer as the number of lights grows.
+ * The scene's own lights are replaced by random point lights scattered through its bounds, whose
+ * reach shrinks as their number grows, so they cover about as much of the screen however many
+ * there are, the way more, smaller lights fill a bigger scene. Each kernel is checked against the
+ * scalar one, and the tiled lists against listing every light in every tile. --ppm writes the lit
+ * image and the per-tile light counts of the largest run. Pair it with objgen.
+ *
+ * usage: lightbench file.scene [width height] [frames] [--ppm prefix]
+ */
+
+#include <renderer/camera.hpp>
+#include <renderer/rasterizer.hpp>
+#include <renderer/lighting.hpp>
+#include <scene/scene.hpp>
+#include <scene/threadpool.hpp>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+
+namespace
+{
+	unsigned int seed = 12345;
+
+	unsigned int nextRandom()
+	{
+		seed = seed * 1664525u + 1013904223u;
+		return seed >> 8;
+	}
+
+	float randomFloat( float low, float high )
+	{
+		return low + ( high - low ) * ( nextRandom() & 0xFFFF ) / 65535.0f;
+	}
+
+	bool writePPM( const std::string& filename, const std::vector<unsigned char>& rgba, unsigned int width, unsigned int height )
+	{
+		FILE * file = std::fopen( filename.c_str(), "wb" );
+		if ( file == NULL )
+			return false;
+		std::fprintf( file, "P6\n%u %u\n255\n", width, height );
+		for ( size_t i = 0; i < rgba.size(); i += 4 )
+			std::fwrite( &rgba[i], 1, 3, file );
+		std::fclose( file );
+		return true;
+	}
+
+	const char * kernelName( TiledLighting::Kernel kernel )
+	{
+		return kernel == TiledLighting::SCALAR ? "scalar" : kernel == TiledLighting::SSE2 ? "sse2" : "avx2";
+	}
+
+	TiledLighting::FrameStats timeShading( TiledLighting& lighting, const GBuffer& gbuffer, const Scene& scene,
+										   const TiledLighting::Options& options, int frames )
+	{
+		TiledLighting::FrameStats best;
+		for ( int frame = 0; frame < frames; ++frame )
+		{
+			lighting.shade( gbuffer, scene, options );
+			if ( frame == 0 || lighting.getFrameStats().seconds < best.seconds )
+				best = lighting.getFrameStats();
+		}
+		return best;
+	}
+
+	// pixels whose color differs from the reference by more than a small relative error
+	size_t countDifferences( const TiledLighting& lighting, const std::vector<float>& reference )
+	{
+		size_t differ = 0, i = 0;
+		for ( unsigned int y = 0; y < lighting.getHeight(); ++y )
+		{
+			for ( unsigned int x = 0; x < lighting.getWidth(); ++x, i += 3 )
+			{
+				bool same = true;
+				for ( int c = 0; c < 3; ++c )
+				{
+					float value = lighting.get( TiledLighting::Channel( c ), x, y );
+					same = same && std::fabs( value - reference[i + c] ) <= 1.0e-3f * std::max( 1.0f, std::fabs( reference[i + c] ) );
+				}
+				differ += same ? 0 : 1;
+			}
+		}
+		return differ;
+	}
+
+	void readColors( const TiledLighting& lighting, std::vector<float>& colors )
+	{
+		colors.clear();
+		for ( unsigned int y = 0; y < lighting.getHeight(); ++y )
+			for ( unsigned int x = 0; x < lighting.getWidth(); ++x )
+				for ( int c = 0; c < 3; ++c )
+					colors.push_back( lighting.get( TiledLighting::Channel( c ), x, y ) );
+	}
+}
+
+int main( int argc, char ** argv )
+{
+	if ( argc < 2 )
+	{
+		std::printf( "usage: lightbench file.scene [width height] [frames] [--ppm prefix]\n" );
+		return EXIT_FAILURE;
+	}
+
+	unsigned int width = 1280, height = 720;
+	int frames = 5;
+	std::string ppm;
+	std::vector<int> numbers;
+	for ( int i = 2; i < argc; ++i )
+	{
+		if ( std::strcmp( argv[i], "--ppm" ) == 0 && i + 1 < argc )
+			ppm = argv[++i];
+		else
+			numbers.push_back( std::atoi( argv[i] ) );
+	}
+	if ( numbers.size() >= 2 )
+	{
+		width = static_cast<unsigned int>( std::max( 1, numbers[0] ) );
+		height = static_cast<unsigned int>( std::max( 1, numbers[1] ) );
+	}
+	if ( numbers.size() == 1 || numbers.size() >= 3 )
+		frames = std::max( 1, numbers.back() );
+
+	Scene scene;
+	if ( !scene.loadFromFile( argv[1] ) )
+	{
+		std::fprintf( stderr, "loading %s failed\n", argv[1] );
+		return EXIT_FAILURE;
+	}
+
+	SoftwareRasterizer rasterizer;
+	if ( !rasterizer.prepare( scene ) )
+		return EXIT_FAILURE;
+	rasterizer.resize( width, height );
+
+	glm::vec3 low( 0.0f ), high( 0.0f );
+	const std::vector<Scene::StaticModel>& models = scene.getModels();
+	for ( size_t i = 0; i < models.size(); ++i )
+	{
+		low = i == 0 ? models[i].worldMin : glm::min( low, models[i].worldMin );
+		high = i == 0 ? models[i].worldMax : glm::max( high, models[i].worldMax );
+	}
+	glm::vec3 center = ( low + high ) * 0.5f;
+	float radius = std::max( glm::length( high - low ) * 0.5f, 1.0e-3f );
+	Camera camera( glm::radians( 60.0f ), float( width ) / float( height ), radius * 0.01f, radius * 10.0f );
+	camera.lookAt( center + glm::vec3( 0.8f, 0.9f, 1.2f ) * radius, center );
+	rasterizer.render( camera, scene );
+	const GBuffer& gbuffer = rasterizer.getGBuffer();
+
+	std::printf( "%s: %ux%u, %d frames, %u threads\n", argv[1], width, height, frames, ThreadPool::shared().concurrency() );
+
+	TiledLighting::Options options;
+
+	TiledLighting lighting;
+	TiledLighting::Kernel best = TiledLighting::selectKernel( TiledLighting::AUTO );
+	const size_t counts[] = { 16, 64, 256, 1024, 4096, 16384 };
+	for ( size_t n = 0; n < sizeof( counts ) / sizeof( counts[0] ); ++n )
+	{
+		std::vector<Scene::PointLight>& pointlights = scene.getPointLights();
+		scene.getSpotLights().clear();
+		pointlights.resize( counts[n] );
+
+		// sixteen lights reach 5% of the scene's size each; Kq is set so they fall to the threshold there
+		float reach = radius * 0.1f * std::sqrt( 16.0f / counts[n] );
+		float Kq = ( 1.0f / scene.getLightThreshold() - 1.0f ) / ( reach * reach );
+		for ( size_t i = 0; i < pointlights.size(); ++i )
+		{
+			Scene::PointLight& light = pointlights[i];
+			light.position = glm::vec3( randomFloat( low.x, high.x ), randomFloat( low.y, high.y ), randomFloat( low.z, high.z ) );
+			light.color = glm::vec3( randomFloat( 0.2f, 1.0f ), randomFloat( 0.2f, 1.0f ), randomFloat( 0.2f, 1.0f ) );
+			light.Kc = 1.0f, light.Kl = 0.0f, light.Kq = Kq;
+		}
+		scene.updateLights();
+
+		std::printf( "%lu lights\n", static_cast<unsigned long>( counts[n] ) );
+		std::vector<float> reference;
+		const TiledLighting::Kernel kernels[] = { TiledLighting::SCALAR, TiledLighting::SSE2, TiledLighting::AVX2 };
+		for ( size_t k = 0; k < 3; ++k )
+		{
+			if ( TiledLighting::selectKernel( kernels[k] ) != kernels[k] )
+				continue;
+			options.kernel = kernels[k];
+			TiledLighting::FrameStats stats = timeShading( lighting, gbuffer, scene, options, kernels[k] == TiledLighting::SCALAR ? 1 : frames );
+			std::printf( "  %-8s %9.3f ms  (bounds %.3f, bin %.3f, shade %.3f)  %lu in view, %.1f per tile, at most %lu",
+						 kernelName( kernels[k] ), stats.seconds * 1000.0f, stats.boundsSeconds * 1000.0f, stats.binSeconds * 1000.0f,
+						 stats.shadeSeconds * 1000.0f, static_cast<unsigned long>( stats.lightsInView ),
+						 double( stats.tileEntries ) / ( gbuffer.getTileCount() ), static_cast<unsigned long>( stats.maxTileLights ) );
+			if ( reference.empty() )
+				readColors( lighting, reference );
+			else
+				std::printf( ", %lu pixels differ from scalar", static_cast<unsigned long>( countDifferences( lighting, reference ) ) );
+			std::printf( "\n" );
+		}
+
+		// every light in every tile gives the same picture, much more slowly; skip it when it would take long
+		if ( counts[n] <= 1024 )
+		{
+			options.kernel = best;
+			options.cullLights = false;
+			TiledLighting::FrameStats stats = timeShading( lighting, gbuffer, scene, options, 1 );
+			options.cullLights = true;
+			std::printf( "  %-8s %9.3f ms  untiled, %lu pixels differ from the tiled scalar\n", kernelName( best ), stats.seconds * 1000.0f,
+						 static_cast<unsigned long>( countDifferences( lighting, reference ) ) );
+		}
+	}
+
+	if ( !ppm.empty() )
+	{
+		options.kernel = best;
+		lighting.shade( gbuffer, scene, options );
+		const TiledLighting::View views[] = { TiledLighting::SHOW_LIGHTING, TiledLighting::SHOW_LIGHT_COUNTS };
+		const char * names[] = { "lit", "counts" };
+		std::vector<unsigned char> rgba;
+		for ( int v = 0; v < 2; ++v )
+		{
+			lighting.toImage( views[v], rgba );
+			std::string filename = ppm + "_" + names[v] + ".ppm";
+			if ( !writePPM( filename, rgba, width, height ) )
+				std::fprintf( stderr, "couldn't write %s\n", filename.c_str() );
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
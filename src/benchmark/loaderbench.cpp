@@ -0,0 +1,222 @@
+/*
+ * Times Scene::loadFromFile (for a .scene) or ObjModel::loadFromFile (for an .obj), phase by phase,
+ * and prints the results as JSON: MB/s, triangles/s, heap allocations and peak resident memory.
+ * Pair it with objgen for numbers anyone can reproduce.
+ *
+ * The .objcache is off unless --cache is given; with it, the first run writes the caches and the
+ * rest read them. --sort adds the material sort and draw table to every load. Peak memory is the
+ * process's high-water mark, so it covers the largest run.
+ *
+ * usage: loaderbench file.scene|file.obj [repeats] [--cache] [--sort] [--threads n]
+ */
+
+#include <scene/scene.hpp>
+#include <scene/objmodel.hpp>
+#include <scene/processmemory.hpp>
+#include <SFML/System/Clock.hpp>
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+	// every heap allocation in the process goes through the operators below
+	std::atomic<size_t> allocations( 0 );
+	std::atomic<size_t> allocatedBytes( 0 );
+
+	void * countedAllocation( size_t size )
+	{
+		allocations.fetch_add( 1, std::memory_order_relaxed );
+		allocatedBytes.fetch_add( size, std::memory_order_relaxed );
+		void * p = std::malloc( size > 0 ? size : 1 );
+		if ( p == NULL )
+			throw std::bad_alloc();
+		return p;
+	}
+
+	// one load: its totals, and the phases of each model it loaded
+	struct Run
+	{
+		double seconds;
+		size_t allocations;
+		size_t allocatedBytes;
+		size_t fileBytes;
+		size_t triangles;
+		size_t models;
+		bool fromCache;
+		ObjModel::LoadStats phases; // summed over the models
+	};
+
+	void addModel( const ObjModel& model, Run& run )
+	{
+		const ObjModel::LoadStats& stats = model.getLoadStats();
+		for ( size_t g = 0; g < model.getGroups().size(); ++g )
+			run.triangles += model.getGroups()[g].triangles.size();
+		run.fileBytes += stats.fileBytes;
+		run.fromCache = run.fromCache && stats.fromCache;
+		run.models += 1;
+		run.phases.chunks = std::max( run.phases.chunks, stats.chunks );
+		run.phases.mapSeconds += stats.mapSeconds;
+		run.phases.countSeconds += stats.countSeconds;
+		run.phases.parseSeconds += stats.parseSeconds;
+		run.phases.normalSeconds += stats.normalSeconds;
+		run.phases.generatedNormals += stats.generatedNormals;
+		run.phases.sortSeconds += stats.sortSeconds;
+		run.phases.cacheSeconds += stats.cacheSeconds;
+	}
+
+	bool load( const std::string& filename, const ObjModel::LoadOptions& options, Run& run )
+	{
+		run = Run();
+		run.fromCache = true;
+		size_t allocationsBefore = allocations.load(), bytesBefore = allocatedBytes.load();
+		sf::Clock clock;
+
+		bool ok;
+		bool isScene = filename.size() > 6 && filename.compare( filename.size() - 6, 6, ".scene" ) == 0;
+		if ( isScene )
+		{
+			Scene scene;
+			ok = scene.loadFromFile( filename, options );
+			run.seconds = clock.getElapsedTime().asSeconds();
+			const std::unordered_map<std::string, ObjModel>& models = scene.getObjModels();
+			for ( std::unordered_map<std::string, ObjModel>::const_iterator it = models.begin(); it != models.end(); ++it )
+				addModel( it->second, run );
+		}
+		else
+		{
+			size_t split = filename.find_last_of( "\\/" );
+			std::string path = split != std::string::npos ? filename.substr( 0, split + 1 ) : "./";
+			std::string name = split != std::string::npos ? filename.substr( split + 1 ) : filename;
+			ObjModel model;
+			ok = model.loadFromFile( path, name, options );
+			run.seconds = clock.getElapsedTime().asSeconds();
+			addModel( model, run );
+		}
+
+		// allocations are counted up to the end of the load, before the scene is destroyed
+		run.allocations = allocations.load() - allocationsBefore;
+		run.allocatedBytes = allocatedBytes.load() - bytesBefore;
+		return ok;
+	}
+
+	// Windows paths have backslashes, which JSON needs escaped
+	std::string jsonString( const std::string& text )
+	{
+		std::string quoted = "\"";
+		for ( size_t i = 0; i < text.size(); ++i )
+		{
+			if ( text[i] == '"' || text[i] == '\\' )
+				quoted += '\\';
+			quoted += text[i];
+		}
+		return quoted + "\"";
+	}
+
+	void printRun( const Run& run, const char * indent )
+	{
+		double megabytes = run.fileBytes / 1.0e6;
+		std::printf( "%s{ \"seconds\": %.6f, \"MBps\": %.1f, \"trianglesPerSecond\": %.0f, \"fromCache\": %s,\n", indent,
+					 run.seconds, megabytes / run.seconds, run.triangles / run.seconds, run.fromCache ? "true" : "false" );
+		std::printf( "%s  \"allocations\": %lu, \"allocatedBytes\": %lu,\n", indent,
+					 static_cast<unsigned long>( run.allocations ), static_cast<unsigned long>( run.allocatedBytes ) );
+		std::printf( "%s  \"phases\": { \"map\": %.6f, \"count\": %.6f, \"parse\": %.6f, \"normals\": %.6f, \"sort\": %.6f, \"cache\": %.6f },\n",
+					 indent, run.phases.mapSeconds, run.phases.countSeconds, run.phases.parseSeconds, run.phases.normalSeconds,
+					 run.phases.sortSeconds, run.phases.cacheSeconds );
+		std::printf( "%s  \"chunks\": %u, \"generatedNormals\": %lu }", indent, run.phases.chunks,
+					 static_cast<unsigned long>( run.phases.generatedNormals ) );
+	}
+}
+
+void * operator new( size_t size )
+{
+	return countedAllocation( size );
+}
+
+void * operator new[]( size_t size )
+{
+	return countedAllocation( size );
+}
+
+void operator delete( void * p ) noexcept
+{
+	std::free( p );
+}
+
+void operator delete[]( void * p ) noexcept
+{
+	std::free( p );
+}
+
+// sized deletes come here under C++14; without these they'd bypass the replacements above
+void operator delete( void * p, std::size_t ) noexcept
+{
+	operator delete( p );
+}
+
+void operator delete[]( void * p, std::size_t ) noexcept
+{
+	operator delete[]( p );
+}
+
+int main( int argc, char ** argv )
+{
+	if ( argc < 2 )
+	{
+		std::printf( "usage: loaderbench file.scene|file.obj [repeats] [--cache] [--sort] [--threads n]\n" );
+		return EXIT_FAILURE;
+	}
+
+	std::string filename = argv[1];
+	int repeats = 3;
+	ObjModel::LoadOptions options;
+	for ( int i = 2; i < argc; ++i )
+	{
+		if ( std::strcmp( argv[i], "--cache" ) == 0 )
+			options.useCache = true;
+		else if ( std::strcmp( argv[i], "--sort" ) == 0 )
+			options.sortByMaterial = true;
+		else if ( std::strcmp( argv[i], "--threads" ) == 0 && i + 1 < argc )
+			options.threads = static_cast<unsigned>( std::strtoul( argv[++i], NULL, 10 ) );
+		else
+			repeats = std::max( 1, std::atoi( argv[i] ) );
+	}
+
+	std::vector<Run> runs( repeats );
+	size_t best = 0;
+	for ( int r = 0; r < repeats; ++r )
+	{
+		if ( !load( filename, options, runs[r] ) )
+		{
+			std::fprintf( stderr, "loading %s failed\n", filename.c_str() );
+			return EXIT_FAILURE;
+		}
+		if ( runs[r].seconds < runs[best].seconds )
+			best = r;
+	}
+
+	const Run& first = runs[0];
+	std::printf( "{\n  \"file\": %s,\n  \"models\": %lu,\n  \"fileBytes\": %lu,\n  \"triangles\": %lu,\n", jsonString( filename ).c_str(),
+				 static_cast<unsigned long>( first.models ), static_cast<unsigned long>( first.fileBytes ),
+				 static_cast<unsigned long>( first.triangles ) );
+	std::printf( "  \"cache\": %s,\n  \"sort\": %s,\n  \"threads\": %u,\n", options.useCache ? "true" : "false",
+				 options.sortByMaterial ? "true" : "false", options.threads );
+	std::printf( "  \"peakResidentBytes\": %lu,\n", static_cast<unsigned long>( processmemory::peakResidentBytes() ) );
+	std::printf( "  \"best\":\n" );
+	printRun( runs[best], "    " );
+	std::printf( ",\n  \"runs\": [\n" );
+	for ( size_t r = 0; r < runs.size(); ++r )
+	{
+		printRun( runs[r], "    " );
+		std::printf( r + 1 < runs.size() ? ",\n" : "\n" );
+	}
+	std::printf( "  ]\n}\n" );
+	return EXIT_SUCCESS;
+}
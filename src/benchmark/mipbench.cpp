@@ -0,0 +1,141 @@
+/*
+ * Benchmark for MipChain. Builds the full chain of a generated image with each filter and kernel,
+ * and compares the SIMD kernels' output against the scalar reference.
+ *
+ * usage: mipbench [size]
+ */
+
+#include <scene/mipchain.hpp>
+#include <scene/threadpool.hpp>
+#include <SFML/System/Clock.hpp>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+
+namespace
+{
+	unsigned int nextRandom( unsigned int& state )
+	{
+		state = state * 1664525u + 1013904223u;
+		return state >> 8;
+	}
+
+	// smooth gradients, a fine checkerboard (the worst case for aliasing) and some noise
+	std::vector<unsigned char> makeImage( unsigned int width, unsigned int height )
+	{
+		std::vector<unsigned char> rgba( static_cast<size_t>( width ) * height * 4 );
+		unsigned int state = 1;
+		for ( unsigned int y = 0; y < height; ++y )
+		{
+			for ( unsigned int x = 0; x < width; ++x )
+			{
+				unsigned char * p = &rgba[( static_cast<size_t>( y ) * width + x ) * 4];
+				bool checker = ( ( x ^ y ) & 1 ) != 0 && x < width / 4;
+				p[0] = checker ? 255 : static_cast<unsigned char>( x * 255 / width );
+				p[1] = checker ? 0 : static_cast<unsigned char>( y * 255 / height );
+				p[2] = static_cast<unsigned char>( nextRandom( state ) );
+				p[3] = static_cast<unsigned char>( 128 + 127 * std::sin( x * 0.05 ) );
+			}
+		}
+		return rgba;
+	}
+
+	// largest difference between two chains, and how many bytes differ at all
+	void compare( const MipChain& a, const MipChain& b, int& maxDiff, size_t& differing )
+	{
+		maxDiff = 0;
+		differing = 0;
+		const unsigned char * pa = a.getPixels( 0 );
+		const unsigned char * pb = b.getPixels( 0 );
+		for ( size_t i = 0; i < a.byteSize(); ++i )
+		{
+			int diff = std::abs( pa[i] - pb[i] );
+			maxDiff = std::max( maxDiff, diff );
+			differing += diff != 0;
+		}
+	}
+
+	const char * kernelName( MipChain::Kernel kernel )
+	{
+		switch ( kernel )
+		{
+			case MipChain::SCALAR: return "scalar";
+			case MipChain::SSE2: return "sse2";
+			case MipChain::AVX2: return "avx2";
+			default: return "auto";
+		}
+	}
+}
+
+int main( int argc, char ** argv )
+{
+	unsigned int size = argc > 1 ? static_cast<unsigned int>( std::strtoul( argv[1], NULL, 10 ) ) : 2048;
+	std::vector<unsigned char> image = makeImage( size, size );
+	std::printf( "%ux%u RGBA8, %u threads\n", size, size, ThreadPool::shared().concurrency() );
+
+	const MipChain::Filter filters[] = { MipChain::BOX, MipChain::KAISER };
+	const MipChain::Kernel kernels[] = { MipChain::SCALAR, MipChain::SSE2, MipChain::AVX2 };
+
+	for ( size_t f = 0; f < 2; ++f )
+	{
+		std::printf( "%s filter:\n", filters[f] == MipChain::BOX ? "box" : "kaiser" );
+
+		MipChain reference;
+		for ( size_t k = 0; k < 3; ++k )
+		{
+			if ( MipChain::selectKernel( kernels[k] ) != kernels[k] )
+			{
+				std::printf( "  %-8s not supported here\n", kernelName( kernels[k] ) );
+				continue;
+			}
+
+			for ( int parallel = 0; parallel < 2; ++parallel )
+			{
+				MipChain::Options options;
+				options.filter = filters[f];
+				options.kernel = kernels[k];
+				options.parallel = parallel != 0;
+
+				MipChain chain;
+				sf::Clock clock;
+				chain.build( &image[0], size, size, options );
+				float seconds = clock.getElapsedTime().asSeconds();
+
+				std::printf( "  %-8s %-8s %8.2f ms  %8.1f Mpixel/s", kernelName( kernels[k] ), parallel ? "threads" : "serial",
+							 seconds * 1000.0f, size * static_cast<double>( size ) / 1.0e6 / seconds );
+				if ( kernels[k] == MipChain::SCALAR && !parallel )
+				{
+					reference = chain;
+					std::printf( "  (reference, %lu levels)\n", static_cast<unsigned long>( chain.levelCount() ) );
+				}
+				else
+				{
+					int maxDiff;
+					size_t differing;
+					compare( reference, chain, maxDiff, differing );
+					std::printf( "  max diff %d, %lu bytes differ\n", maxDiff, static_cast<unsigned long>( differing ) );
+				}
+			}
+		}
+	}
+
+	// a black and white checkerboard should average to mid-grey light, not mid-grey bytes
+	std::vector<unsigned char> checker( 4 * 4 * 4 );
+	for ( size_t i = 0; i < 16; ++i )
+	{
+		unsigned char value = ( ( i ^ ( i / 4 ) ) & 1 ) ? 255 : 0;
+		checker[i * 4] = checker[i * 4 + 1] = checker[i * 4 + 2] = value;
+		checker[i * 4 + 3] = 255;
+	}
+	MipChain::Options linear;
+	linear.srgb = false;
+	MipChain gamma, naive;
+	gamma.build( &checker[0], 4, 4 );
+	naive.build( &checker[0], 4, 4, linear );
+	std::printf( "checkerboard average: %u with sRGB decoding (expect 188), %u without\n",
+				 gamma.getPixels( 2 )[0], naive.getPixels( 2 )[0] );
+
+	return EXIT_SUCCESS;
+}
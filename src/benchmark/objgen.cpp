@@ -0,0 +1,309 @@
+/*
+ * Writes a synthetic scene for the loader benchmarks, so loader numbers can be reproduced
+ * without sharing real assets:
+ *   grid.obj   - a rippled height field, with positions, texcoords and normals for every vertex
+ *   sphere.obj - an octahedron subdivided and pushed out onto the unit sphere
+ *   synth.mtl  - the materials both models use
+ *   synth.scene - two instances of the grid (loaded once) and the sphere, plus some lights
+ * Each model has roughly the requested number of triangles. Its faces are split into groups, and
+ * every group is cut into bands that change material and smoothing group, and that cycle through
+ * the v, v/vt, v//vn and v/vt/vn face formats - the mix real exports have. Files are streamed out,
+ * so even 10^8 triangles only need a few buffers of memory.
+ *
+ * usage: objgen directory [triangles] [groups] [materials]
+ */
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+
+namespace
+{
+	// buffered output with hand-rolled integer formatting; face lines are mostly integers
+	class Writer
+	{
+	public:
+		explicit Writer( const std::string& filename ) : file( std::fopen( filename.c_str(), "wb" ) )
+		{
+			buffer.reserve( 1 << 20 );
+		}
+
+		~Writer()
+		{
+			flush();
+			if ( file != NULL )
+				std::fclose( file );
+		}
+
+		bool good() const { return file != NULL; }
+
+		Writer& operator<<( const char * text )
+		{
+			while ( *text != '\0' )
+				buffer.push_back( *text++ );
+			return spill();
+		}
+
+		Writer& operator<<( const std::string& text )
+		{
+			buffer.insert( buffer.end(), text.begin(), text.end() );
+			return spill();
+		}
+
+		Writer& operator<<( size_t value )
+		{
+			char digits[24];
+			int count = 0;
+			do
+			{
+				digits[count++] = static_cast<char>( '0' + value % 10 );
+				value /= 10;
+			} while ( value != 0 );
+			while ( count > 0 )
+				buffer.push_back( digits[--count] );
+			return spill();
+		}
+
+		Writer& operator<<( float value )
+		{
+			char text[32];
+			int length = std::snprintf( text, sizeof( text ), "%.6g", value );
+			buffer.insert( buffer.end(), text, text + length );
+			return spill();
+		}
+
+		void flush()
+		{
+			if ( file != NULL && !buffer.empty() )
+				std::fwrite( &buffer[0], 1, buffer.size(), file );
+			buffer.clear();
+		}
+
+	private:
+		std::FILE * file;
+		std::vector<char> buffer;
+
+		Writer& spill()
+		{
+			if ( buffer.size() >= ( 1 << 20 ) - 256 )
+				flush();
+			return *this;
+		}
+	};
+
+	struct Settings
+	{
+		size_t groups;
+		size_t materials;
+	};
+
+	// one corner, in the face format of its band; every vertex has all three attributes, numbered alike
+	void writeCorner( Writer& out, size_t vertex, size_t format )
+	{
+		out << " " << vertex;
+		switch ( format )
+		{
+			case 1: out << "/" << vertex; break;
+			case 2: out << "//" << vertex; break;
+			case 3: out << "/" << vertex << "/" << vertex; break;
+			default: break;
+		}
+	}
+
+	// group, material, smoothing and face format changes at the start of band b of group g
+	void writeBand( Writer& out, const std::string& model, size_t g, size_t b, const Settings& settings )
+	{
+		if ( b == 0 )
+			out << "g " << model << "_" << g << "\n";
+		out << "usemtl m" << ( g * 7 + b ) % settings.materials << "\n";
+		if ( b % 3 == 2 )
+			out << "s off\n";
+		else
+			out << "s " << b % 3 + 1 << "\n";
+	}
+
+	void writeVertex( Writer& out, float x, float y, float z, float u, float v, float nx, float ny, float nz )
+	{
+		out << "v " << x << " " << y << " " << z << "\n";
+		out << "vt " << u << " " << v << "\n";
+		out << "vn " << nx << " " << ny << " " << nz << "\n";
+	}
+
+	// n x n quads, two triangles each; groups take whole rows, and bands are a few rows each
+	bool writeGrid( const std::string& directory, size_t triangles, const Settings& settings )
+	{
+		Writer out( directory + "grid.obj" );
+		if ( !out.good() )
+			return false;
+
+		size_t n = std::max<size_t>( 1, static_cast<size_t>( std::sqrt( triangles / 2.0 ) + 0.5 ) );
+		out << "# synthetic grid, " << 2 * n * n << " triangles\nmtllib synth.mtl\n";
+		for ( size_t y = 0; y <= n; ++y )
+		{
+			for ( size_t x = 0; x <= n; ++x )
+			{
+				float u = float( x ) / n, v = float( y ) / n;
+				float height = 0.05f * std::sin( u * 25.0f ) * std::cos( v * 17.0f );
+				float dx = 0.05f * 25.0f * std::cos( u * 25.0f ) * std::cos( v * 17.0f );
+				float dy = -0.05f * 17.0f * std::sin( u * 25.0f ) * std::sin( v * 17.0f );
+				float length = std::sqrt( dx * dx + dy * dy + 1.0f );
+				writeVertex( out, u * 2.0f - 1.0f, height, v * 2.0f - 1.0f, u, v, -dx / length, 1.0f / length, -dy / length );
+			}
+		}
+
+		size_t groups = std::min( settings.groups, n );
+		for ( size_t g = 0; g < groups; ++g )
+		{
+			size_t firstRow = n * g / groups, lastRow = n * ( g + 1 ) / groups;
+			size_t bandRows = std::max<size_t>( 1, ( lastRow - firstRow + 3 ) / 4 );
+			for ( size_t y = firstRow; y < lastRow; ++y )
+			{
+				size_t band = ( y - firstRow ) / bandRows;
+				if ( ( y - firstRow ) % bandRows == 0 )
+					writeBand( out, "grid", g, band, settings );
+				size_t format = ( g + band ) % 4;
+				for ( size_t x = 0; x < n; ++x )
+				{
+					size_t a = y * ( n + 1 ) + x + 1, b = a + 1, c = a + n + 1, d = c + 1;
+					out << "f";
+					writeCorner( out, a, format );
+					writeCorner( out, c, format );
+					writeCorner( out, b, format );
+					out << "\nf";
+					writeCorner( out, b, format );
+					writeCorner( out, c, format );
+					writeCorner( out, d, format );
+					out << "\n";
+				}
+			}
+		}
+		return true;
+	}
+
+	// each of the octahedron's 8 faces is cut into n^2 triangles; its rows are split between groups
+	bool writeSphere( const std::string& directory, size_t triangles, const Settings& settings )
+	{
+		Writer out( directory + "sphere.obj" );
+		if ( !out.good() )
+			return false;
+
+		size_t n = std::max<size_t>( 1, static_cast<size_t>( std::sqrt( triangles / 8.0 ) + 0.5 ) );
+		out << "# synthetic sphere, " << 8 * n * n << " triangles\nmtllib synth.mtl\n";
+
+		size_t groupsPerFace = std::max<size_t>( 1, std::min( ( settings.groups + 7 ) / 8, n ) );
+		size_t firstVertex = 1;
+		for ( size_t face = 0; face < 8; ++face )
+		{
+			float sx = ( face & 1 ) ? -1.0f : 1.0f, sy = ( face & 2 ) ? -1.0f : 1.0f, sz = ( face & 4 ) ? -1.0f : 1.0f;
+
+			// row i holds i + 1 vertices, between the face's x and y corners at height 1 - i / n in z
+			for ( size_t i = 0; i <= n; ++i )
+			{
+				for ( size_t j = 0; j <= i; ++j )
+				{
+					float x = float( i - j ) / n, y = float( j ) / n, z = 1.0f - float( i ) / n;
+					float length = std::sqrt( x * x + y * y + z * z );
+					x = sx * x / length;
+					y = sy * y / length;
+					z = sz * z / length;
+					float u = 0.5f + std::atan2( y, x ) / 6.2831853f, v = 0.5f + std::asin( z ) / 3.1415927f;
+					writeVertex( out, x, y, z, u, v, x, y, z );
+				}
+			}
+
+			// keep every face wound outward: mirroring an odd number of axes flips it
+			bool flip = ( ( face & 1 ) != 0 ) ^ ( ( face & 2 ) != 0 ) ^ ( ( face & 4 ) != 0 );
+			for ( size_t g = 0; g < groupsPerFace; ++g )
+			{
+				size_t firstRow = n * g / groupsPerFace, lastRow = n * ( g + 1 ) / groupsPerFace;
+				size_t bandRows = std::max<size_t>( 1, ( lastRow - firstRow + 3 ) / 4 );
+				size_t group = face * groupsPerFace + g;
+				for ( size_t i = firstRow; i < lastRow; ++i )
+				{
+					size_t band = ( i - firstRow ) / bandRows;
+					if ( ( i - firstRow ) % bandRows == 0 )
+						writeBand( out, "sphere", group, band, settings );
+					size_t format = ( group + band ) % 4;
+
+					// row i to row i + 1: i + 1 upward triangles and i downward ones
+					size_t top = firstVertex + i * ( i + 1 ) / 2, bottom = firstVertex + ( i + 1 ) * ( i + 2 ) / 2;
+					for ( size_t j = 0; j <= i; ++j )
+					{
+						size_t corners[2][3] = { { top + j, bottom + j, bottom + j + 1 }, { top + j, bottom + j + 1, top + j + 1 } };
+						for ( size_t k = 0; k < ( j < i ? 2u : 1u ); ++k )
+						{
+							out << "f";
+							writeCorner( out, corners[k][0], format );
+							writeCorner( out, corners[k][flip ? 2 : 1], format );
+							writeCorner( out, corners[k][flip ? 1 : 2], format );
+							out << "\n";
+						}
+					}
+				}
+			}
+			firstVertex += ( n + 1 ) * ( n + 2 ) / 2;
+		}
+		return true;
+	}
+
+	bool writeMaterials( const std::string& directory, const Settings& settings )
+	{
+		Writer out( directory + "synth.mtl" );
+		if ( !out.good() )
+			return false;
+		for ( size_t m = 0; m < settings.materials; ++m )
+		{
+			float hue = float( m ) / settings.materials;
+			out << "newmtl m" << m << "\n";
+			out << "Ka 0.1 0.1 0.1\n";
+			out << "Kd " << 0.5f + 0.5f * std::sin( hue * 6.2831853f ) << " " << 0.5f + 0.5f * std::sin( hue * 6.2831853f + 2.1f )
+				<< " " << 0.5f + 0.5f * std::sin( hue * 6.2831853f + 4.2f ) << "\n";
+			out << "Ks 0.5 0.5 0.5\n";
+			out << "Ns " << 10 + m * 10 % 200 << "\n\n";
+		}
+		return true;
+	}
+
+	bool writeScene( const std::string& directory )
+	{
+		Writer out( directory + "synth.scene" );
+		if ( !out.good() )
+			return false;
+		out << "sunlight {\n\tdirection -1 -2 -1\n\tcolor 1 1 1\n\tambient 0.2\n}\n";
+		out << "pointlight {\n\tposition 0 2 0\n\tcolor 1 0.9 0.8\n\tvelocity 0.5\n\tattenuation 1 0.1 0.01\n}\n";
+		out << "spotlight {\n\tposition 3 3 3\n\tdirection -1 -1 -1\n\tcolor 0.8 0.8 1\n\texponent 10\n\tangle 30\n\tlength 10\n\tattenuation 1 0.1 0.01\n}\n";
+		out << "model {\n\tfile \"grid.obj\"\n\tposition 0 0 0\n\torientation 0 0 0\n\tscale 1 1 1\n}\n";
+		out << "model {\n\tfile \"grid.obj\"\n\tposition 3 0 0\n\torientation 0 90 0\n\tscale 1 1 1\n}\n";
+		out << "model {\n\tfile \"sphere.obj\"\n\tposition 0 1 0\n\torientation 0 0 0\n\tscale 1 1 1\n}\n";
+		return true;
+	}
+}
+
+int main( int argc, char ** argv )
+{
+	if ( argc < 2 )
+	{
+		std::printf( "usage: objgen directory [triangles] [groups] [materials]\n" );
+		return EXIT_FAILURE;
+	}
+
+	std::string directory = argv[1];
+	if ( directory.empty() || ( directory[directory.size() - 1] != '/' && directory[directory.size() - 1] != '\\' ) )
+		directory += "/";
+	size_t triangles = argc > 2 ? static_cast<size_t>( std::strtod( argv[2], NULL ) ) : 1000000;
+	Settings settings;
+	settings.groups = argc > 3 ? std::max<size_t>( 1, std::strtoul( argv[3], NULL, 10 ) ) : 64;
+	settings.materials = argc > 4 ? std::max<size_t>( 1, std::strtoul( argv[4], NULL, 10 ) ) : 16;
+
+	if ( !writeMaterials( directory, settings ) || !writeGrid( directory, triangles, settings ) ||
+		 !writeSphere( directory, triangles, settings ) || !writeScene( directory ) )
+	{
+		std::printf( "can't write to %s\n", directory.c_str() );
+		return EXIT_FAILURE;
+	}
+	std::printf( "wrote grid.obj, sphere.obj, synth.mtl and synth.scene to %s\n", directory.c_str() );
+	return EXIT_SUCCESS;
+}
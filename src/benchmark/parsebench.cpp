@@ -0,0 +1,182 @@
+/*
+ * Microbenchmark for the numeric parsing layer used by the .obj and .mtl loaders.
+ * Compares numparse against the stream extraction the loaders used to do (istream >> x),
+ * on the same generated text, and checks that both produce the same values.
+ *
+ * usage: parsebench [count]
+ */
+
+#include <scene/numparse.hpp>
+#include <SFML/System/Clock.hpp>
+#include <glm/glm.hpp>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+	// a cheap deterministic generator, so every run parses the same text
+	unsigned int nextRandom( unsigned int& state )
+	{
+		state = state * 1664525u + 1013904223u;
+		return state >> 8;
+	}
+
+	// numbers in the styles exporters actually write: fixed point, short decimals, integers, exponents
+	std::string makeFloatText( size_t count )
+	{
+		std::string text;
+		unsigned int state = 1;
+		char buffer[64];
+		for ( size_t i = 0; i < count; ++i )
+		{
+			float value = ( nextRandom( state ) % 2000000 ) / 1000.0f - 1000.0f;
+			switch ( nextRandom( state ) % 4 )
+			{
+				case 0: std::snprintf( buffer, sizeof( buffer ), "%.6f", value ); break;
+				case 1: std::snprintf( buffer, sizeof( buffer ), "%.4f", value / 1000.0f ); break;
+				case 2: std::snprintf( buffer, sizeof( buffer ), "%d", static_cast<int>( value ) ); break;
+				default: std::snprintf( buffer, sizeof( buffer ), "%.7e", value ); break;
+			}
+			text += buffer;
+			text += ( i % 3 == 2 ) ? '\n' : ' ';
+		}
+		return text;
+	}
+
+	std::string makeIntText( size_t count )
+	{
+		std::string text;
+		unsigned int state = 2;
+		char buffer[32];
+		for ( size_t i = 0; i < count; ++i )
+		{
+			std::snprintf( buffer, sizeof( buffer ), "%u", nextRandom( state ) % 1000000 + 1 );
+			text += buffer;
+			text += ( i % 3 == 2 ) ? '\n' : '/';
+		}
+		return text;
+	}
+
+	void report( const char * name, size_t bytes, size_t count, float seconds )
+	{
+		std::printf( "  %-24s %8.2f ms  %8.1f MB/s  %8.1f M/s\n", name, seconds * 1000.0f,
+					 bytes / ( 1024.0 * 1024.0 ) / seconds, count / 1.0e6 / seconds );
+	}
+}
+
+int main( int argc, char ** argv )
+{
+	size_t count = argc > 1 ? std::strtoul( argv[1], NULL, 10 ) : 3000000;
+	sf::Clock clock;
+
+	// floats
+	std::string text = makeFloatText( count );
+	std::vector<float> expected( count ), parsed( count );
+	std::printf( "floats: %lu values, %lu bytes\n", static_cast<unsigned long>( count ), static_cast<unsigned long>( text.size() ) );
+
+	clock.restart();
+	{
+		std::istringstream stream( text );
+		for ( size_t i = 0; i < count; ++i )
+			stream >> expected[i];
+	}
+	report( "istream >> float", text.size(), count, clock.restart().asSeconds() );
+
+	{
+		const char * p = text.data();
+		const char * end = p + text.size();
+		for ( size_t i = 0; i < count; ++i )
+		{
+			while ( *p == ' ' || *p == '\n' ) ++p;
+			numparse::parseFloat( p, end, parsed[i] );
+		}
+	}
+	report( "numparse::parseFloat", text.size(), count, clock.restart().asSeconds() );
+
+	size_t mismatches = 0;
+	for ( size_t i = 0; i < count; ++i )
+		mismatches += std::memcmp( &expected[i], &parsed[i], sizeof( float ) ) != 0;
+	std::printf( "  mismatched values: %lu\n", static_cast<unsigned long>( mismatches ) );
+
+	// integers, in the shape of face indexes
+	std::string indexText = makeIntText( count );
+	std::vector<int> expectedInts( count ), parsedInts( count );
+	std::printf( "ints: %lu values, %lu bytes\n", static_cast<unsigned long>( count ), static_cast<unsigned long>( indexText.size() ) );
+
+	clock.restart();
+	{
+		std::istringstream stream( indexText );
+		for ( size_t i = 0; i < count; ++i )
+		{
+			stream >> expectedInts[i];
+			stream.get();
+		}
+	}
+	report( "istream >> int", indexText.size(), count, clock.restart().asSeconds() );
+
+	{
+		const char * p = indexText.data();
+		const char * end = p + indexText.size();
+		for ( size_t i = 0; i < count; ++i )
+		{
+			numparse::parseInt( p, end, parsedInts[i] );
+			++p;
+		}
+	}
+	report( "numparse::parseInt", indexText.size(), count, clock.restart().asSeconds() );
+
+	mismatches = 0;
+	for ( size_t i = 0; i < count; ++i )
+		mismatches += expectedInts[i] != parsedInts[i];
+	std::printf( "  mismatched values: %lu\n", static_cast<unsigned long>( mismatches ) );
+
+	// line scanning
+	size_t lines = 0;
+	std::printf( "line scan: %lu bytes\n", static_cast<unsigned long>( text.size() ) );
+	clock.restart();
+	{
+		std::istringstream stream( text );
+		std::string line;
+		while ( std::getline( stream, line ) )
+			++lines;
+	}
+	report( "std::getline", text.size(), lines, clock.restart().asSeconds() );
+
+	lines = 0;
+	{
+		const char * p = text.data();
+		const char * end = p + text.size();
+		while ( ( p = numparse::findChar( p, end, '\n' ) ) < end )
+		{
+			++p;
+			++lines;
+		}
+	}
+	report( "numparse::findChar", text.size(), lines, clock.restart().asSeconds() );
+
+	// normals
+	std::vector<glm::vec3> normals( count / 3 );
+	for ( size_t i = 0; i < normals.size(); ++i )
+		normals[i] = glm::vec3( expected[i * 3], expected[i * 3 + 1], expected[i * 3 + 2] + 0.5f );
+	std::vector<glm::vec3> batch( normals );
+	std::printf( "normalize: %lu vectors\n", static_cast<unsigned long>( normals.size() ) );
+
+	clock.restart();
+	for ( size_t i = 0; i < normals.size(); ++i )
+		normals[i] = glm::normalize( normals[i] );
+	report( "glm::normalize", normals.size() * sizeof( glm::vec3 ), normals.size(), clock.restart().asSeconds() );
+
+	numparse::normalizeBatch( batch.data(), batch.size() );
+	report( "numparse::normalizeBatch", batch.size() * sizeof( glm::vec3 ), batch.size(), clock.restart().asSeconds() );
+
+	mismatches = 0;
+	for ( size_t i = 0; i < normals.size(); ++i )
+		mismatches += std::memcmp( &normals[i], &batch[i], sizeof( glm::vec3 ) ) != 0;
+	std::printf( "  mismatched values: %lu\n", static_cast<unsigned long>( mismatches ) );
+
+	return EXIT_SUCCESS;
+}
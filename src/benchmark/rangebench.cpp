@@ -0,0 +1,283 @@
+/*
+ * Reports how much shading work cutting lights off at a range saves. The scene is rasterized
+ * into a G-buffer, and for a sweep of luminance thresholds the Scene derives every light's range
+ * (and every spotlight's cone sphere) from its attenuation; then it counts the pixel-light pairs
+ * that are really in reach, the pairs the tiled lighting's lists make it shade, and all of them,
+ * which is what shading has to do with no cutoff. Each threshold's frame is timed as a fraction
+ * of the uncut one, so the saving can be weighed against the light it drops; a cutoff that saves
+ * no pairs is reported as such, since its timing only differs by noise.
+ *
+ * --lights replaces the scene's point and spot lights with random ones scattered through the
+ * scene, a quarter of them spotlights, fading out over 5% to 20% of its size. A scene with only
+ * a handful of lights of its own gets DEFAULT_LIGHTS of them, since a couple can't show a saving.
+ *
+ * usage: rangebench file.scene [width height] [--lights n] [--threshold t...]
+ */
+
+#include <renderer/camera.hpp>
+#include <renderer/rasterizer.hpp>
+#include <renderer/lighting.hpp>
+#include <scene/scene.hpp>
+#include <scene/threadpool.hpp>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <cfloat>
+
+namespace
+{
+	unsigned int seed = 12345;
+
+	// scenes with fewer lights than this get DEFAULT_LIGHTS random ones, unless --lights is given
+	const size_t FEW_LIGHTS = 16;
+	const int DEFAULT_LIGHTS = 256;
+
+	unsigned int nextRandom()
+	{
+		seed = seed * 1664525u + 1013904223u;
+		return seed >> 8;
+	}
+
+	float randomFloat( float low, float high )
+	{
+		return low + ( high - low ) * ( nextRandom() & 0xFFFF ) / 65535.0f;
+	}
+
+	struct Work
+	{
+		size_t pixels;      // drawn pixels
+		size_t reached;     // pixel-light pairs inside a light's range (and cone)
+		size_t listed;      // pairs the tiled lists shade
+		double meanRange;   // over the lights with a finite range
+		float maxError;     // the largest change in any channel of any pixel against no cutoff
+		float seconds;
+
+		Work() : pixels( 0 ), reached( 0 ), listed( 0 ), meanRange( 0.0 ), maxError( 0.0f ), seconds( 0.0f )
+		{
+		}
+	};
+
+	// counts the pairs of the frame the lighting just shaded
+	void countWork( const GBuffer& gbuffer, const Scene& scene, const TiledLighting& lighting, Work& work )
+	{
+		const glm::mat4& projection = gbuffer.projection;
+		float rayScaleX = 2.0f / ( gbuffer.getWidth() * projection[0][0] ), rayOffsetX = ( projection[2][0] - 1.0f ) / projection[0][0];
+		float rayScaleY = -2.0f / ( gbuffer.getHeight() * projection[1][1] ), rayOffsetY = ( projection[2][1] + 1.0f ) / projection[1][1];
+
+		// the lights in view space, the way the shading sees them
+		const std::vector<Scene::PointLight>& pointlights = scene.getPointLights();
+		const std::vector<Scene::SpotLight>& spotlights = scene.getSpotLights();
+		std::vector<glm::vec4> spheres;
+		std::vector<glm::vec4> cones; // direction and cosine of the cutoff; -1 for none
+		glm::mat3 rotation( gbuffer.view );
+		size_t finite = 0;
+		for ( size_t i = 0; i < pointlights.size() + spotlights.size(); ++i )
+		{
+			bool point = i < pointlights.size();
+			glm::vec3 position = point ? pointlights[i].position : spotlights[i - pointlights.size()].position;
+			float range = point ? pointlights[i].range : spotlights[i - pointlights.size()].range;
+			spheres.push_back( glm::vec4( glm::vec3( gbuffer.view * glm::vec4( position, 1.0f ) ), range ) );
+			if ( point || spotlights[i - pointlights.size()].angle >= 180.0f )
+			{
+				cones.push_back( glm::vec4( 0.0f, 0.0f, -1.0f, -1.0f ) );
+			}
+			else
+			{
+				const Scene::SpotLight& spot = spotlights[i - pointlights.size()];
+				cones.push_back( glm::vec4( glm::normalize( rotation * spot.direction ), std::cos( glm::radians( spot.angle ) ) ) );
+			}
+			if ( range < FLT_MAX )
+			{
+				work.meanRange += range;
+				++finite;
+			}
+		}
+		work.meanRange = finite > 0 ? work.meanRange / finite : 0.0;
+
+		for ( size_t tile = 0; tile < gbuffer.getTileCount(); ++tile )
+		{
+			const float * depth = gbuffer.tilePlane( tile, GBuffer::DEPTH );
+			unsigned int originX = static_cast<unsigned int>( tile % gbuffer.getTilesX() ) * GBuffer::TILE_SIZE;
+			unsigned int originY = static_cast<unsigned int>( tile / gbuffer.getTilesX() ) * GBuffer::TILE_SIZE;
+			size_t drawn = 0;
+			for ( unsigned int p = 0; p < GBuffer::TILE_PIXELS; ++p )
+			{
+				if ( depth[p] == GBuffer::EMPTY_DEPTH )
+					continue;
+				++drawn;
+				float x = float( originX + p % GBuffer::TILE_SIZE ) + 0.5f, y = float( originY + p / GBuffer::TILE_SIZE ) + 0.5f;
+				glm::vec3 position = glm::vec3( rayScaleX * x + rayOffsetX, rayScaleY * y + rayOffsetY, -1.0f ) * depth[p];
+				for ( size_t l = 0; l < spheres.size(); ++l )
+				{
+					glm::vec3 toPixel = position - glm::vec3( spheres[l] );
+					float distance2 = glm::dot( toPixel, toPixel );
+					if ( !( distance2 < spheres[l].w * spheres[l].w ) )
+						continue;
+					if ( cones[l].w > -1.0f && glm::dot( toPixel, glm::vec3( cones[l] ) ) < cones[l].w * std::sqrt( distance2 ) )
+						continue;
+					++work.reached;
+				}
+			}
+			work.pixels += drawn;
+			work.listed += drawn * lighting.getTileLights( tile ).size();
+		}
+	}
+
+	float shadeFrame( TiledLighting& lighting, const GBuffer& gbuffer, const Scene& scene, int frames )
+	{
+		float best = 0.0f;
+		for ( int frame = 0; frame < frames; ++frame )
+		{
+			lighting.shade( gbuffer, scene );
+			if ( frame == 0 || lighting.getFrameStats().seconds < best )
+				best = lighting.getFrameStats().seconds;
+		}
+		return best;
+	}
+}
+
+int main( int argc, char ** argv )
+{
+	if ( argc < 2 )
+	{
+		std::printf( "usage: rangebench file.scene [width height] [--lights n] [--threshold t...]\n" );
+		return EXIT_FAILURE;
+	}
+
+	unsigned int width = 1280, height = 720;
+	int lightCount = -1;
+	std::vector<float> thresholds;
+	std::vector<int> numbers;
+	for ( int i = 2; i < argc; ++i )
+	{
+		if ( std::strcmp( argv[i], "--lights" ) == 0 && i + 1 < argc )
+		{
+			lightCount = std::max( 0, std::atoi( argv[++i] ) );
+		}
+		else if ( std::strcmp( argv[i], "--threshold" ) == 0 )
+		{
+			while ( i + 1 < argc && argv[i + 1][0] != '-' )
+				thresholds.push_back( static_cast<float>( std::atof( argv[++i] ) ) );
+		}
+		else
+		{
+			numbers.push_back( std::atoi( argv[i] ) );
+		}
+	}
+	if ( numbers.size() >= 2 )
+	{
+		width = static_cast<unsigned int>( std::max( 1, numbers[0] ) );
+		height = static_cast<unsigned int>( std::max( 1, numbers[1] ) );
+	}
+	if ( thresholds.empty() )
+	{
+		const float defaults[] = { 1.0f / 16.0f, 1.0f / 64.0f, 1.0f / 256.0f, 1.0f / 1024.0f };
+		thresholds.assign( defaults, defaults + 4 );
+	}
+
+	Scene scene;
+	if ( !scene.loadFromFile( argv[1] ) )
+	{
+		std::fprintf( stderr, "loading %s failed\n", argv[1] );
+		return EXIT_FAILURE;
+	}
+
+	SoftwareRasterizer rasterizer;
+	if ( !rasterizer.prepare( scene ) )
+		return EXIT_FAILURE;
+	rasterizer.resize( width, height );
+
+	glm::vec3 low( 0.0f ), high( 0.0f );
+	const std::vector<Scene::StaticModel>& models = scene.getModels();
+	for ( size_t i = 0; i < models.size(); ++i )
+	{
+		low = i == 0 ? models[i].worldMin : glm::min( low, models[i].worldMin );
+		high = i == 0 ? models[i].worldMax : glm::max( high, models[i].worldMax );
+	}
+	glm::vec3 center = ( low + high ) * 0.5f;
+	float radius = std::max( glm::length( high - low ) * 0.5f, 1.0e-3f );
+	Camera camera( glm::radians( 60.0f ), float( width ) / float( height ), radius * 0.01f, radius * 10.0f );
+	camera.lookAt( center + glm::vec3( 0.8f, 0.9f, 1.2f ) * radius, center );
+	rasterizer.render( camera, scene );
+	const GBuffer& gbuffer = rasterizer.getGBuffer();
+
+	if ( lightCount < 0 && scene.getPointLights().size() + scene.getSpotLights().size() < FEW_LIGHTS )
+	{
+		std::printf( "%s has only %lu lights; using %d random ones (pass --lights to choose)\n", argv[1],
+					 static_cast<unsigned long>( scene.getPointLights().size() + scene.getSpotLights().size() ), DEFAULT_LIGHTS );
+		lightCount = DEFAULT_LIGHTS;
+	}
+	if ( lightCount >= 0 )
+	{
+		// Kq is set so each light falls to 1/256 between 5% and 20% of the way across the scene
+		std::vector<Scene::PointLight>& pointlights = scene.getPointLights();
+		std::vector<Scene::SpotLight>& spotlights = scene.getSpotLights();
+		pointlights.resize( lightCount - lightCount / 4 );
+		spotlights.resize( lightCount / 4 );
+		for ( size_t i = 0; i < pointlights.size(); ++i )
+		{
+			Scene::PointLight& light = pointlights[i];
+			float reach = radius * randomFloat( 0.1f, 0.4f );
+			light.position = glm::vec3( randomFloat( low.x, high.x ), randomFloat( low.y, high.y ), randomFloat( low.z, high.z ) );
+			light.color = glm::vec3( randomFloat( 0.2f, 1.0f ), randomFloat( 0.2f, 1.0f ), randomFloat( 0.2f, 1.0f ) );
+			light.Kc = 1.0f, light.Kl = 0.0f, light.Kq = 255.0f / ( reach * reach );
+		}
+		for ( size_t i = 0; i < spotlights.size(); ++i )
+		{
+			Scene::SpotLight& light = spotlights[i];
+			float reach = radius * randomFloat( 0.1f, 0.4f );
+			light.position = glm::vec3( randomFloat( low.x, high.x ), randomFloat( low.y, high.y ), randomFloat( low.z, high.z ) );
+			light.direction = glm::normalize( glm::vec3( randomFloat( -1.0f, 1.0f ), -1.0f, randomFloat( -1.0f, 1.0f ) ) );
+			light.color = glm::vec3( randomFloat( 0.2f, 1.0f ), randomFloat( 0.2f, 1.0f ), randomFloat( 0.2f, 1.0f ) );
+			light.angle = randomFloat( 10.0f, 60.0f );
+			light.exponent = 10.0f;
+			light.Kc = 1.0f, light.Kl = 0.0f, light.Kq = 255.0f / ( reach * reach );
+		}
+	}
+
+	std::printf( "%s: %ux%u, %lu point lights, %lu spotlights, %u threads\n", argv[1], width, height,
+				 static_cast<unsigned long>( scene.getPointLights().size() ), static_cast<unsigned long>( scene.getSpotLights().size() ),
+				 ThreadPool::shared().concurrency() );
+
+	// no cutoff: every light reaches every pixel, which is the work and the picture to compare with
+	TiledLighting lighting;
+	scene.setLightThreshold( 0.0f );
+	Work uncut;
+	uncut.seconds = shadeFrame( lighting, gbuffer, scene, 3 );
+	countWork( gbuffer, scene, lighting, uncut );
+	std::vector<float> reference;
+	for ( unsigned int y = 0; y < lighting.getHeight(); ++y )
+		for ( unsigned int x = 0; x < lighting.getWidth(); ++x )
+			for ( int c = 0; c < 3; ++c )
+				reference.push_back( lighting.get( TiledLighting::Channel( c ), x, y ) );
+	size_t all = std::max<size_t>( uncut.listed, 1 );
+	std::printf( "  threshold     mean range   pairs in reach   pairs shaded         ms   max error\n" );
+	std::printf( "  none                   -   %14lu %14lu  %9.3f           -\n", static_cast<unsigned long>( uncut.reached ),
+				 static_cast<unsigned long>( uncut.listed ), uncut.seconds * 1000.0f );
+
+	for ( size_t t = 0; t < thresholds.size(); ++t )
+	{
+		scene.setLightThreshold( thresholds[t] );
+		Work work;
+		work.seconds = shadeFrame( lighting, gbuffer, scene, 3 );
+		countWork( gbuffer, scene, lighting, work );
+		size_t i = 0;
+		for ( unsigned int y = 0; y < lighting.getHeight(); ++y )
+			for ( unsigned int x = 0; x < lighting.getWidth(); ++x )
+				for ( int c = 0; c < 3; ++c, ++i )
+					work.maxError = std::max( work.maxError, std::fabs( lighting.get( TiledLighting::Channel( c ), x, y ) - reference[i] ) );
+
+		std::printf( "  1/%-9.0f %12.4g   %14lu %14lu  %9.3f   %9.5f   ", 1.0f / thresholds[t], work.meanRange,
+					 static_cast<unsigned long>( work.reached ), static_cast<unsigned long>( work.listed ), work.seconds * 1000.0f, work.maxError );
+		if ( work.listed >= uncut.listed )
+			std::printf( "(shades every pair; the cutoff saves nothing here)\n" );
+		else
+			std::printf( "(%.1f%% of the pairs shaded, in %.2f of the uncut time)\n", 100.0 * work.listed / all,
+						 uncut.seconds > 0.0f ? work.seconds / uncut.seconds : 0.0f );
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,171 @@
+/*
+ * Renders a scene into the software rasterizer's G-buffer with no window, and times each stage of
+ * the frame, best of a number of frames, for each kernel. The camera frames the whole scene from
+ * above and to one side. Coverage and depth of every kernel are checked against the scalar one,
+ * and --ppm writes the albedo, normals and depth as images to look at. Pair it with objgen.
+ *
+ * usage: rasterbench file.scene [width height] [frames] [--ppm prefix]
+ */
+
+#include <renderer/camera.hpp>
+#include <renderer/rasterizer.hpp>
+#include <scene/scene.hpp>
+#include <scene/threadpool.hpp>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+
+namespace
+{
+	bool writePPM( const std::string& filename, const std::vector<unsigned char>& rgba, unsigned int width, unsigned int height )
+	{
+		FILE * file = std::fopen( filename.c_str(), "wb" );
+		if ( file == NULL )
+			return false;
+		std::fprintf( file, "P6\n%u %u\n255\n", width, height );
+		for ( size_t i = 0; i < rgba.size(); i += 4 )
+			std::fwrite( &rgba[i], 1, 3, file );
+		std::fclose( file );
+		return true;
+	}
+
+	const char * kernelName( SoftwareRasterizer::Kernel kernel )
+	{
+		return kernel == SoftwareRasterizer::SCALAR ? "scalar" : "sse2";
+	}
+}
+
+int main( int argc, char ** argv )
+{
+	if ( argc < 2 )
+	{
+		std::printf( "usage: rasterbench file.scene [width height] [frames] [--ppm prefix]\n" );
+		return EXIT_FAILURE;
+	}
+
+	unsigned int width = 1280, height = 720;
+	int frames = 10;
+	std::string ppm;
+	std::vector<int> numbers;
+	for ( int i = 2; i < argc; ++i )
+	{
+		if ( std::strcmp( argv[i], "--ppm" ) == 0 && i + 1 < argc )
+			ppm = argv[++i];
+		else
+			numbers.push_back( std::atoi( argv[i] ) );
+	}
+	if ( numbers.size() >= 2 )
+	{
+		width = static_cast<unsigned int>( std::max( 1, numbers[0] ) );
+		height = static_cast<unsigned int>( std::max( 1, numbers[1] ) );
+	}
+	if ( numbers.size() == 1 || numbers.size() >= 3 )
+		frames = std::max( 1, numbers.back() );
+
+	Scene scene;
+	if ( !scene.loadFromFile( argv[1] ) )
+	{
+		std::fprintf( stderr, "loading %s failed\n", argv[1] );
+		return EXIT_FAILURE;
+	}
+
+	SoftwareRasterizer rasterizer;
+	if ( !rasterizer.prepare( scene ) )
+		return EXIT_FAILURE;
+	rasterizer.resize( width, height );
+
+	// frame everything the scene holds
+	glm::vec3 low( 0.0f ), high( 0.0f );
+	const std::vector<Scene::StaticModel>& models = scene.getModels();
+	for ( size_t i = 0; i < models.size(); ++i )
+	{
+		low = i == 0 ? models[i].worldMin : glm::min( low, models[i].worldMin );
+		high = i == 0 ? models[i].worldMax : glm::max( high, models[i].worldMax );
+	}
+	glm::vec3 center = ( low + high ) * 0.5f;
+	float radius = std::max( glm::length( high - low ) * 0.5f, 1.0e-3f );
+	Camera camera( glm::radians( 60.0f ), float( width ) / float( height ), radius * 0.01f, radius * 10.0f );
+	camera.lookAt( center + glm::vec3( 0.8f, 0.9f, 1.2f ) * radius, center );
+
+	std::printf( "%s: %lu instances, %ux%u, %d frames, %u threads\n", argv[1], static_cast<unsigned long>( models.size() ),
+				 width, height, frames, ThreadPool::shared().concurrency() );
+
+	std::vector<float> referenceDepth;
+	const SoftwareRasterizer::Kernel kernels[] = { SoftwareRasterizer::SCALAR, SoftwareRasterizer::SSE2 };
+	for ( size_t k = 0; k < 2; ++k )
+	{
+		if ( SoftwareRasterizer::selectKernel( kernels[k] ) != kernels[k] )
+		{
+			std::printf( "  %-8s not supported here\n", kernelName( kernels[k] ) );
+			continue;
+		}
+
+		SoftwareRasterizer::Options options;
+		options.kernel = kernels[k];
+		SoftwareRasterizer::FrameStats best;
+		for ( int frame = 0; frame < frames; ++frame )
+		{
+			rasterizer.render( camera, scene, options );
+			if ( frame == 0 || rasterizer.getFrameStats().seconds < best.seconds )
+				best = rasterizer.getFrameStats();
+		}
+
+		// coverage must match exactly; depth to within rounding
+		const GBuffer& gbuffer = rasterizer.getGBuffer();
+		size_t covered = 0, mismatched = 0;
+		std::vector<float> depth( static_cast<size_t>( width ) * height );
+		for ( unsigned int y = 0; y < height; ++y )
+		{
+			for ( unsigned int x = 0; x < width; ++x )
+			{
+				float d = gbuffer.get( GBuffer::DEPTH, x, y );
+				depth[static_cast<size_t>( y ) * width + x] = d;
+				covered += d != GBuffer::EMPTY_DEPTH ? 1 : 0;
+			}
+		}
+		if ( referenceDepth.empty() )
+		{
+			referenceDepth = depth;
+		}
+		else
+		{
+			for ( size_t i = 0; i < depth.size(); ++i )
+			{
+				bool empty = depth[i] == GBuffer::EMPTY_DEPTH, referenceEmpty = referenceDepth[i] == GBuffer::EMPTY_DEPTH;
+				if ( empty != referenceEmpty || ( !empty && std::fabs( depth[i] - referenceDepth[i] ) > 1.0e-4f * referenceDepth[i] ) )
+					++mismatched;
+			}
+		}
+
+		std::printf( "  %-8s %8.3f ms  (transform %.3f, bin %.3f, raster %.3f)  %.1f M triangles/s\n", kernelName( kernels[k] ),
+					 best.seconds * 1000.0f, best.transformSeconds * 1000.0f, best.binSeconds * 1000.0f, best.rasterSeconds * 1000.0f,
+					 best.triangles / 1.0e6 / best.seconds );
+		std::printf( "           %lu visible instances, %lu triangles, %lu after clipping and culling, %lu tile entries, %.1f%% covered",
+					 static_cast<unsigned long>( best.visibleInstances ), static_cast<unsigned long>( best.triangles ),
+					 static_cast<unsigned long>( best.setups ), static_cast<unsigned long>( best.tileEntries ),
+					 100.0 * covered / ( double( width ) * height ) );
+		if ( k > 0 )
+			std::printf( ", %lu pixels differ from scalar", static_cast<unsigned long>( mismatched ) );
+		std::printf( "\n" );
+	}
+
+	if ( !ppm.empty() )
+	{
+		const GBuffer::View views[] = { GBuffer::SHOW_ALBEDO, GBuffer::SHOW_NORMALS, GBuffer::SHOW_DEPTH };
+		const char * names[] = { "albedo", "normals", "depth" };
+		std::vector<unsigned char> rgba;
+		for ( int v = 0; v < 3; ++v )
+		{
+			rasterizer.getGBuffer().toImage( views[v], rgba );
+			std::string filename = ppm + "_" + names[v] + ".ppm";
+			if ( !writePPM( filename, rgba, width, height ) )
+				std::fprintf( stderr, "couldn't write %s\n", filename.c_str() );
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
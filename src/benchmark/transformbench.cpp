@@ -0,0 +1,139 @@
+/*
+ * Benchmark for TransformTable. Fills a table with random instances, then times full rebuilds and
+ * updates of a few dirty instances with each kernel, against building each instance's matrices
+ * with plain glm calls the way a renderer would every frame. Every kernel's output is checked
+ * against those glm matrices.
+ *
+ * usage: transformbench [instances] [dirty percent]
+ */
+
+#include <scene/transformtable.hpp>
+#include <scene/threadpool.hpp>
+#include <SFML/System/Clock.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+
+namespace
+{
+	unsigned int nextRandom( unsigned int& state )
+	{
+		state = state * 1664525u + 1013904223u;
+		return state >> 8;
+	}
+
+	float randomFloat( unsigned int& state, float low, float high )
+	{
+		return low + ( high - low ) * ( nextRandom( state ) & 0xFFFF ) / 65535.0f;
+	}
+
+	// the per-frame matrix a renderer builds without the table: yaw, then pitch, then roll
+	glm::mat4 referenceWorld( const glm::vec3& position, const glm::vec3& orientation, const glm::vec3& scale )
+	{
+		glm::mat4 m = glm::translate( glm::mat4( 1.0f ), position );
+		m = glm::rotate( m, glm::radians( orientation.z ), glm::vec3( 0.0f, 1.0f, 0.0f ) );
+		m = glm::rotate( m, glm::radians( orientation.y ), glm::vec3( 1.0f, 0.0f, 0.0f ) );
+		m = glm::rotate( m, glm::radians( orientation.x ), glm::vec3( 0.0f, 0.0f, 1.0f ) );
+		return glm::scale( m, scale );
+	}
+
+	// largest difference from the glm matrices, over world and normal matrices
+	float maxError( const TransformTable& table )
+	{
+		float error = 0.0f;
+		for ( size_t i = 0; i < table.size(); ++i )
+		{
+			glm::mat4 world = referenceWorld( table.getPosition( i ), table.getOrientation( i ), table.getScale( i ) );
+			glm::mat4 normal = glm::mat4( glm::transpose( glm::inverse( glm::mat3( world ) ) ) );
+			glm::mat4 w = table.getWorldMatrix( i ), n = table.getNormalMatrix( i );
+			for ( int c = 0; c < 4; ++c )
+			{
+				for ( int r = 0; r < 4; ++r )
+				{
+					error = std::max( error, std::fabs( w[c][r] - world[c][r] ) );
+					error = std::max( error, std::fabs( n[c][r] - normal[c][r] ) / std::max( 1.0f, std::fabs( normal[c][r] ) ) );
+				}
+			}
+		}
+		return error;
+	}
+
+	const char * kernelName( TransformTable::Kernel kernel )
+	{
+		return kernel == TransformTable::SCALAR ? "scalar" : "sse2";
+	}
+}
+
+int main( int argc, char ** argv )
+{
+	size_t instances = argc > 1 ? static_cast<size_t>( std::strtoul( argv[1], NULL, 10 ) ) : 100000;
+	double dirtyPercent = argc > 2 ? std::atof( argv[2] ) : 1.0;
+
+	// the pool has at least two threads even on one core, so say how many the machine has
+	std::printf( "%lu instances, %u threads, %u hardware threads\n", static_cast<unsigned long>( instances ), ThreadPool::shared().concurrency(),
+				 std::thread::hardware_concurrency() );
+
+	unsigned int state = 1;
+	TransformTable table;
+	table.reserve( instances );
+	for ( size_t i = 0; i < instances; ++i )
+	{
+		glm::vec3 position( randomFloat( state, -500.0f, 500.0f ), randomFloat( state, 0.0f, 50.0f ), randomFloat( state, -500.0f, 500.0f ) );
+		glm::vec3 orientation( randomFloat( state, -180.0f, 180.0f ), randomFloat( state, -90.0f, 90.0f ), randomFloat( state, -180.0f, 180.0f ) );
+		glm::vec3 scale( randomFloat( state, 0.5f, 4.0f ), randomFloat( state, 0.5f, 4.0f ), randomFloat( state, 0.5f, 4.0f ) );
+		table.add( position, orientation, scale );
+	}
+	table.update();
+
+	// what the table replaces: every instance's matrices rebuilt from its Euler angles
+	sf::Clock clock;
+	std::vector<glm::mat4> perFrame( instances );
+	for ( size_t i = 0; i < instances; ++i )
+	{
+		perFrame[i] = referenceWorld( table.getPosition( i ), table.getOrientation( i ), table.getScale( i ) );
+	}
+	float naive = clock.getElapsedTime().asSeconds();
+	std::printf( "  glm per instance      %8.3f ms\n", naive * 1000.0f );
+
+	size_t dirtyCount = static_cast<size_t>( instances * dirtyPercent / 100.0 );
+	const TransformTable::Kernel kernels[] = { TransformTable::SCALAR, TransformTable::SSE2 };
+	for ( size_t k = 0; k < 2; ++k )
+	{
+		if ( TransformTable::selectKernel( kernels[k] ) != kernels[k] )
+		{
+			std::printf( "  %-8s not supported here\n", kernelName( kernels[k] ) );
+			continue;
+		}
+
+		// best of a few runs, since a full rebuild is only a few milliseconds
+		float full = 0.0f, partial = 0.0f;
+		for ( int run = 0; run < 5; ++run )
+		{
+			table.invalidate();
+			clock.restart();
+			table.update( kernels[k] );
+			float seconds = clock.getElapsedTime().asSeconds();
+			full = run == 0 ? seconds : std::min( full, seconds );
+
+			// move a scattered few instances, as an animated scene would each frame
+			for ( size_t d = 0; d < dirtyCount; ++d )
+			{
+				size_t i = nextRandom( state ) % instances;
+				table.setPosition( i, table.getPosition( i ) + glm::vec3( 0.0f, 0.01f, 0.0f ) );
+			}
+			clock.restart();
+			table.update( kernels[k] );
+			seconds = clock.getElapsedTime().asSeconds();
+			partial = run == 0 ? seconds : std::min( partial, seconds );
+		}
+
+		std::printf( "  %-8s full rebuild  %8.3f ms  %6.1f M instances/s,  %g%% dirty %8.3f ms,  max error %g\n",
+					 kernelName( kernels[k] ), full * 1000.0f, instances / 1.0e6 / full, dirtyPercent, partial * 1000.0f, maxError( table ) );
+	}
+
+	return EXIT_SUCCESS;
+}
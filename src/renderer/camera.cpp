@@ -35,6 +35,41 @@ const glm::mat4& Camera::getProjectionMatrix() const
 
 glm::mat4 Camera::getViewMatrix() const
 {
-	// construct and return a view matrix from your position representation
-	return glm::mat4();
+	return glm::lookAt( eye_pos, eye_pos + view_dir, up_dir );
+}
+
+glm::mat4 Camera::getViewProjectionMatrix() const
+{
+	return proj_mat * getViewMatrix();
+}
+
+void Camera::lookAt( const glm::vec3& eye, const glm::vec3& target, const glm::vec3& up )
+{
+	eye_pos = eye;
+	view_dir = glm::normalize( target - eye );
+	up_dir = up;
+}
+
+void Camera::getFrustumPlanes( glm::vec4 planes[6] ) const
+{
+	extractFrustumPlanes( getViewProjectionMatrix(), planes );
+}
+
+// a point is inside when -w <= x, y, z <= w in clip space; each bound is a sum or difference of
+// the matrix's rows applied to the point (Gribb and Hartmann)
+void Camera::extractFrustumPlanes( const glm::mat4& viewProjection, glm::vec4 planes[6] )
+{
+	glm::mat4 rows = glm::transpose( viewProjection );
+	planes[0] = rows[3] + rows[0];
+	planes[1] = rows[3] - rows[0];
+	planes[2] = rows[3] + rows[1];
+	planes[3] = rows[3] - rows[1];
+	planes[4] = rows[3] + rows[2];
+	planes[5] = rows[3] - rows[2];
+	for ( int i = 0; i < 6; ++i )
+	{
+		float length = glm::length( glm::vec3( planes[i] ) );
+		if ( length > 0.0f )
+			planes[i] /= length;
+	}
 }
\ No newline at end of file
@@ -20,7 +20,22 @@ public:
 
 	const glm::mat4& getProjectionMatrix() const;
 	glm::mat4 getViewMatrix() const;
+	glm::mat4 getViewProjectionMatrix() const;
 	void handleInput( float deltaTime );
+
+	void lookAt( const glm::vec3& eye, const glm::vec3& target, const glm::vec3& up = glm::vec3( 0.0f, 1.0f, 0.0f ) );
+	const glm::vec3& getPosition() const { return eye_pos; }
+	const glm::vec3& getDirection() const { return view_dir; }
+
+	/*
+	 * The six planes of the view frustum in world space, in the order left, right, bottom, top,
+	 * near, far. Each is (normal, d) with a unit normal pointing into the frustum, so
+	 * dot( normal, p ) + d is a point's distance inside the plane.
+	 */
+	void getFrustumPlanes( glm::vec4 planes[6] ) const;
+
+	// the same for any view-projection matrix with OpenGL's -w..w clip depth
+	static void extractFrustumPlanes( const glm::mat4& viewProjection, glm::vec4 planes[6] );
 };
 
 #endif // #ifndef _CAMERA_H_
\ No newline at end of file
@@ -0,0 +1,281 @@
+#include "clusters.hpp"
+#include <scene/threadpool.hpp>
+#include <SFML/System/Clock.hpp>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+
+namespace
+{
+	// slice depths are widened by this much on either side, so a point on a boundary is in both
+	const float SLICE_SLACK = 1.0e-5f;
+
+	// lights boxed together, at most; fewer lights make fewer blocks
+	const size_t LIGHTS_PER_BLOCK = 256;
+
+	// the slice table has this many entries per doubling of depth: the top mantissa bits of a float
+	const unsigned int SLICE_TABLE_SHIFT = 17;
+
+	// the tile a screen coordinate (in tiles) falls in, clamped to one past either edge; rounding
+	// toward zero after the shift is floor, without the library call
+	int clampTile( float tile, float count )
+	{
+		return static_cast<int>( std::min( std::max( tile, -1.0f ), count ) + 1.0f ) - 1;
+	}
+
+	unsigned int floatBits( float value )
+	{
+		unsigned int bits;
+		std::memcpy( &bits, &value, sizeof( bits ) );
+		return bits;
+	}
+}
+
+LightClusters::LightClusters() : tilesX( 0 ), tilesY( 0 ), slices( 0 ), nearDepth( 0.0f ), farDepth( 0.0f ), sliceTableBase( 0 )
+{
+}
+
+int LightClusters::findSlice( float depth ) const
+{
+	// positive floats order like their bits, so the top bits index a table of the slice each
+	// range of depths starts in; a range is usually far narrower than a slice, so the walk is short
+	int k = sliceTable[( floatBits( depth ) >> SLICE_TABLE_SHIFT ) - sliceTableBase];
+	while ( k + 1 < static_cast<int>( slices ) && depth >= sliceDepths[k + 1] )
+		++k;
+	return k;
+}
+
+float LightClusters::getSliceDepth( unsigned int k ) const
+{
+	return sliceDepths[std::min( k, slices )];
+}
+
+size_t LightClusters::findCluster( const glm::vec3& viewPosition ) const
+{
+	float depth = -viewPosition.z;
+	if ( slices == 0 || !( depth >= nearDepth && depth <= farDepth ) )
+		return getClusterCount();
+	float ndcX = viewPosition.x / depth * projection[0][0] - projection[2][0];
+	float ndcY = viewPosition.y / depth * projection[1][1] - projection[2][1];
+	if ( std::fabs( ndcX ) > 1.0f || std::fabs( ndcY ) > 1.0f )
+		return getClusterCount();
+
+	unsigned int column = std::min( static_cast<unsigned int>( ( ndcX + 1.0f ) * 0.5f * tilesX ), tilesX - 1 );
+	unsigned int row = std::min( static_cast<unsigned int>( ( 1.0f - ndcY ) * 0.5f * tilesY ), tilesY - 1 );
+	return ( static_cast<size_t>( findSlice( depth ) ) * tilesY + row ) * tilesX + column;
+}
+
+void LightClusters::assign( const Camera& camera, const Scene& scene, const Options& options )
+{
+	sf::Clock clock, total;
+	stats = FrameStats();
+	tilesX = std::max( options.tilesX, 1u );
+	tilesY = std::max( options.tilesY, 1u );
+	slices = std::max( options.slices, 1u );
+
+	// a perspective projection's near and far planes, from its depth terms
+	projection = camera.getProjectionMatrix();
+	nearDepth = projection[3][2] / ( projection[2][2] - 1.0f );
+	farDepth = projection[3][2] / ( projection[2][2] + 1.0f );
+	sliceDepths.resize( slices + 1 );
+	for ( unsigned int k = 0; k <= slices; ++k )
+		sliceDepths[k] = nearDepth * std::pow( farDepth / nearDepth, float( k ) / float( slices ) );
+	sliceDepths[slices] = farDepth;
+
+	// the slice each table range's smallest depth is in
+	sliceTableBase = floatBits( nearDepth ) >> SLICE_TABLE_SHIFT;
+	sliceTable.resize( ( floatBits( farDepth ) >> SLICE_TABLE_SHIFT ) - sliceTableBase + 1 );
+	for ( size_t i = 0, k = 0; i < sliceTable.size(); ++i )
+	{
+		unsigned int bits = static_cast<unsigned int>( sliceTableBase + i ) << SLICE_TABLE_SHIFT;
+		float depth;
+		std::memcpy( &depth, &bits, sizeof( depth ) );
+		while ( k + 1 < slices && depth >= sliceDepths[k + 1] )
+			++k;
+		sliceTable[i] = static_cast<int>( k );
+	}
+
+	size_t clusterCount = getClusterCount(), perSlice = static_cast<size_t>( tilesX ) * tilesY;
+	offsets.resize( clusterCount );
+	counts.resize( clusterCount );
+	corners.assign( static_cast<size_t>( tilesX + 1 ) * ( tilesY + 1 ) * slices, 0 );
+	sliceEntries.assign( slices + 1, 0 );
+
+	// a slope x / depth lands in column slope * columnScale + columnOffset, and likewise for rows
+	float columnScale = 0.5f * tilesX * projection[0][0], columnOffset = 0.5f * tilesX * ( 1.0f - projection[2][0] );
+	float rowScale = -0.5f * tilesY * projection[1][1], rowOffset = 0.5f * tilesY * ( 1.0f + projection[2][1] );
+	float columnLimit = float( tilesX ), rowLimit = float( tilesY );
+	int columns = static_cast<int>( tilesX ), rows = static_cast<int>( tilesY );
+
+	// lights are boxed in contiguous blocks, a few per thread, and each block keeps its boxes by
+	// slice; a slice reads the blocks' boxes in order, so its lights stay in increasing order
+	const std::vector<Scene::PointLight>& pointlights = scene.getPointLights();
+	const std::vector<Scene::SpotLight>& spotlights = scene.getSpotLights();
+	size_t lightCount = pointlights.size() + spotlights.size();
+	size_t blocks = std::max<size_t>( 1, std::min<size_t>( ( lightCount + LIGHTS_PER_BLOCK - 1 ) / LIGHTS_PER_BLOCK,
+														  ThreadPool::shared().concurrency() * 4 ) );
+	size_t blockSize = ( lightCount + blocks - 1 ) / blocks;
+	blockRects.resize( blocks * slices );
+	stats.lights = lightCount;
+
+	// bounds: each light's view-space sphere, boxed in every slice it reaches; the view is rigid,
+	// so three rows of it are all a position needs
+	glm::mat4 view = camera.getViewMatrix();
+	glm::vec4 rowX( view[0][0], view[1][0], view[2][0], view[3][0] );
+	glm::vec4 rowY( view[0][1], view[1][1], view[2][1], view[3][1] );
+	glm::vec4 rowZ( view[0][2], view[1][2], view[2][2], view[3][2] );
+	ThreadPool::shared().parallelFor( blocks, [&]( size_t firstBlock, size_t lastBlock )
+	{
+		for ( size_t block = firstBlock; block < lastBlock; ++block )
+		{
+			std::vector<Rect> * rects = &blockRects[block * slices];
+			for ( unsigned int k = 0; k < slices; ++k )
+				rects[k].clear();
+
+			size_t end = std::min( lightCount, ( block + 1 ) * blockSize );
+			for ( size_t l = block * blockSize; l < end; ++l )
+			{
+				glm::vec3 position;
+				float radius;
+				if ( l < pointlights.size() )
+				{
+					position = pointlights[l].position;
+					radius = pointlights[l].range;
+				}
+				else
+				{
+					const Scene::SpotLight& spot = spotlights[l - pointlights.size()];
+					position = spot.boundsCenter;
+					radius = spot.boundsRadius;
+				}
+				glm::vec3 center( rowX.x * position.x + rowX.y * position.y + rowX.z * position.z + rowX.w,
+								  rowY.x * position.x + rowY.y * position.y + rowY.z * position.z + rowY.w,
+								  rowZ.x * position.x + rowZ.y * position.y + rowZ.z * position.z + rowZ.w );
+
+				float depth = -center.z;
+				if ( radius <= 0.0f || depth + radius < nearDepth || depth - radius > farDepth )
+					continue;
+				int firstSlice = findSlice( std::max( depth - radius, nearDepth ) );
+				int lastSlice = findSlice( std::min( depth + radius, farDepth ) );
+				for ( int k = firstSlice; k <= lastSlice; ++k )
+				{
+					// the widest cross-section of the sphere between the slice's depths
+					float low = std::max( sliceDepths[k] * ( 1.0f - SLICE_SLACK ), depth - radius );
+					float high = std::min( sliceDepths[k + 1] * ( 1.0f + SLICE_SLACK ), depth + radius );
+					if ( low > high )
+						continue;
+					float offset = depth < low ? low - depth : depth > high ? depth - high : 0.0f;
+					float r = std::sqrt( std::max( radius * radius - offset * offset, 0.0f ) );
+
+					// the extreme slopes x / depth and y / depth over the box, and their tiles
+					float lowX = center.x - r, highX = center.x + r, lowY = center.y - r, highY = center.y + r;
+					float inverse = 1.0f / ( low * high ), nearest = high * inverse, furthest = low * inverse;
+					float slopeLowX = lowX * ( lowX < 0.0f ? nearest : furthest ), slopeHighX = highX * ( highX > 0.0f ? nearest : furthest );
+					float slopeLowY = lowY * ( lowY < 0.0f ? nearest : furthest ), slopeHighY = highY * ( highY > 0.0f ? nearest : furthest );
+					Rect rect;
+					rect.light = static_cast<unsigned int>( l );
+					rect.firstColumn = std::max( clampTile( slopeLowX * columnScale + columnOffset, columnLimit ), 0 );
+					rect.lastColumn = std::min( clampTile( slopeHighX * columnScale + columnOffset, columnLimit ), columns - 1 );
+					rect.firstRow = std::max( clampTile( slopeHighY * rowScale + rowOffset, rowLimit ), 0 );
+					rect.lastRow = std::min( clampTile( slopeLowY * rowScale + rowOffset, rowLimit ), rows - 1 );
+					if ( rect.firstColumn <= rect.lastColumn && rect.firstRow <= rect.lastRow )
+						rects[k].push_back( rect );
+				}
+			}
+		}
+	}, 1 );
+	stats.boundsSeconds = clock.restart().asSeconds();
+
+	// assign: each slice counts its boxes' lights per cluster, by marking each box's corners and
+	// summing them up, which is cheaper than counting cluster by cluster...
+	ThreadPool::shared().parallelFor( slices, [&]( size_t first, size_t last )
+	{
+		for ( size_t k = first; k < last; ++k )
+		{
+			int * sliceCorners = &corners[k * ( columns + 1 ) * ( rows + 1 )];
+			// copies, so stores through sliceCorners don't force reloads
+			int sliceColumns = columns, sliceRows = rows;
+			int stride = sliceColumns + 1;
+			unsigned int entries = 0;
+			for ( size_t block = 0; block < blocks; ++block )
+			{
+				const std::vector<Rect>& rects = blockRects[block * slices + k];
+				for ( size_t r = 0; r < rects.size(); ++r )
+				{
+					Rect rect = rects[r];
+					sliceCorners[rect.firstRow * stride + rect.firstColumn] += 1;
+					sliceCorners[rect.firstRow * stride + rect.lastColumn + 1] -= 1;
+					sliceCorners[( rect.lastRow + 1 ) * stride + rect.firstColumn] -= 1;
+					sliceCorners[( rect.lastRow + 1 ) * stride + rect.lastColumn + 1] += 1;
+					entries += ( rect.lastRow - rect.firstRow + 1 ) * ( rect.lastColumn - rect.firstColumn + 1 );
+				}
+			}
+			sliceEntries[k + 1] = entries;
+
+			// a cluster's count is the sum of the corners above and to the left of it
+			unsigned int * sliceCounts = &counts[k * perSlice];
+			for ( int row = 0; row < sliceRows; ++row )
+			{
+				int sum = 0;
+				for ( int column = 0; column < sliceColumns; ++column )
+				{
+					sum += sliceCorners[row * stride + column];
+					sliceCounts[row * sliceColumns + column] = sum + ( row > 0 ? sliceCounts[( row - 1 ) * sliceColumns + column] : 0 );
+				}
+			}
+		}
+	}, 1 );
+
+	// ...then, with every slice's place in the list known, fills its clusters' lists in place
+	for ( unsigned int k = 0; k < slices; ++k )
+		sliceEntries[k + 1] += sliceEntries[k];
+	indices.resize( sliceEntries[slices] );
+	ThreadPool::shared().parallelFor( slices, [&]( size_t first, size_t last )
+	{
+		for ( size_t k = first; k < last; ++k )
+		{
+			// offsets in the whole list; counts are rebuilt as the lists fill
+			unsigned int * sliceCounts = &counts[k * perSlice];
+			unsigned int * sliceOffsets = &offsets[k * perSlice];
+			int sliceColumns = columns; // as above
+			unsigned int entries = sliceEntries[k];
+			for ( size_t c = 0; c < perSlice; ++c )
+			{
+				sliceOffsets[c] = entries;
+				entries += sliceCounts[c];
+				sliceCounts[c] = 0;
+			}
+
+			for ( size_t block = 0; block < blocks; ++block )
+			{
+				const std::vector<Rect>& rects = blockRects[block * slices + k];
+				for ( size_t r = 0; r < rects.size(); ++r )
+				{
+					Rect rect = rects[r];
+					for ( int row = rect.firstRow; row <= rect.lastRow; ++row )
+					{
+						for ( int column = rect.firstColumn; column <= rect.lastColumn; ++column )
+						{
+							int c = row * sliceColumns + column;
+							indices[sliceOffsets[c] + sliceCounts[c]++] = rect.light;
+						}
+					}
+				}
+			}
+		}
+	}, 1 );
+	stats.assignSeconds = clock.restart().asSeconds();
+	stats.seconds = total.getElapsedTime().asSeconds();
+
+	stats.entries = indices.size();
+	for ( size_t c = 0; c < clusterCount; ++c )
+	{
+		stats.occupiedClusters += counts[c] > 0 ? 1 : 0;
+		stats.maxClusterLights = std::max( stats.maxClusterLights, static_cast<size_t>( counts[c] ) );
+	}
+	std::vector<bool> listed( lightCount, false );
+	for ( size_t i = 0; i < blockRects.size(); ++i )
+		for ( size_t r = 0; r < blockRects[i].size(); ++r )
+			listed[blockRects[i][r].light] = true;
+	stats.lightsInView = std::count( listed.begin(), listed.end(), true );
+}
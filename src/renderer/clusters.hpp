@@ -0,0 +1,112 @@
+#ifndef _CLUSTERS_H_
+#define _CLUSTERS_H_
+
+#include <renderer/camera.hpp>
+#include <scene/scene.hpp>
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstddef>
+
+/*
+ * Clustered light assignment: the camera's view frustum is cut into a grid of tilesX x tilesY
+ * screen tiles by a number of depth slices, and each cluster gets the list of point and spot
+ * lights whose bounds reach into it. Nothing here draws, so the lists serve a GL shader (upload
+ * the three arrays as buffers) as well as a CPU one.
+ *
+ * Slices are spaced exponentially between the projection's near and far planes, so clusters stay
+ * about as deep as they are wide: slice k covers depths near * ( far / near )^( k / slices ) to the
+ * next. Tile rows count down from the top of the screen, as in the GBuffer. A cluster's index is
+ * ( slice * tilesY + row ) * tilesX + column.
+ *
+ * Each light is bounded by the sphere the Scene derived for it (see Scene::updateLights): out to
+ * its range for a point light, around its cone for a spotlight. For every slice the sphere reaches,
+ * the part of it between the slice's depths is boxed and projected, and the light goes in every
+ * cluster of that screen rectangle, so the lists are conservative.
+ *
+ * Both stages run on the shared ThreadPool. Blocks of lights are bounded and boxed in parallel,
+ * keeping their boxes by slice; then each slice counts its clusters' lights from the boxes, and
+ * once every slice's share of the index list is known, fills its clusters' lists in place.
+ *
+ * Light indexes count the scene's point lights first, then its spotlights. Within a cluster they
+ * are in increasing order.
+ */
+class LightClusters
+{
+public:
+	struct Options
+	{
+		unsigned int tilesX, tilesY, slices;
+
+		Options() : tilesX( 16 ), tilesY( 9 ), slices( 24 )
+		{
+		}
+	};
+
+	struct FrameStats
+	{
+		size_t lights;          // point and spot lights in the scene
+		size_t lightsInView;    // listed in at least one cluster
+		size_t entries;         // the length of the index list
+		size_t occupiedClusters;
+		size_t maxClusterLights;
+		float boundsSeconds;
+		float assignSeconds;
+		float seconds;
+
+		FrameStats() : lights( 0 ), lightsInView( 0 ), entries( 0 ), occupiedClusters( 0 ), maxClusterLights( 0 ),
+					   boundsSeconds( 0.0f ), assignSeconds( 0.0f ), seconds( 0.0f )
+		{
+		}
+	};
+
+	LightClusters();
+
+	// rebuilds the lists for the camera's current view and (perspective) projection
+	void assign( const Camera& camera, const Scene& scene, const Options& options = Options() );
+
+	unsigned int getTilesX() const { return tilesX; }
+	unsigned int getTilesY() const { return tilesY; }
+	unsigned int getSlices() const { return slices; }
+	size_t getClusterCount() const { return static_cast<size_t>( tilesX ) * tilesY * slices; }
+
+	// per cluster, where its lights start in the index list, and how many there are
+	const std::vector<unsigned int>& getOffsets() const { return offsets; }
+	const std::vector<unsigned int>& getCounts() const { return counts; }
+	const std::vector<unsigned int>& getLightIndices() const { return indices; }
+
+	// the depth slice k starts at; slices + 1 gives the far plane
+	float getSliceDepth( unsigned int k ) const;
+
+	// the cluster holding a view-space point, or getClusterCount() if it's outside the frustum
+	size_t findCluster( const glm::vec3& viewPosition ) const;
+
+	const FrameStats& getFrameStats() const { return stats; }
+
+private:
+	// a light's tile rectangle in a slice
+	struct Rect
+	{
+		unsigned int light;
+		int firstColumn, lastColumn, firstRow, lastRow;
+	};
+
+	unsigned int tilesX, tilesY, slices;
+	float nearDepth, farDepth;
+	// by a depth's top bits, less sliceTableBase: the slice that range of depths starts in
+	std::vector<int> sliceTable;
+	unsigned int sliceTableBase;
+	glm::mat4 projection;
+	std::vector<unsigned int> offsets, counts, indices;
+	FrameStats stats;
+
+	// the slice a depth between the near and far planes is in
+	int findSlice( float depth ) const;
+
+	// per-frame working memory, kept to avoid reallocating
+	std::vector<float> sliceDepths;              // slices + 1 of them
+	std::vector<std::vector<Rect> > blockRects;  // per block of lights and slice, their rectangles
+	std::vector<int> corners;                    // per slice, the rectangles' corner marks
+	std::vector<unsigned int> sliceEntries;      // where each slice's lists start in the index list
+};
+
+#endif // _CLUSTERS_H_
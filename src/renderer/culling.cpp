@@ -0,0 +1,338 @@
+#include "culling.hpp"
+#include <scene/threadpool.hpp>
+#include <scene/simd.hpp>
+#include <algorithm>
+#include <cstring>
+
+#ifdef SCENE_SSE2
+#include <glm/gtx/simd_vec4.hpp>
+#endif
+
+namespace
+{
+	// bounds per task; batches smaller than two pieces stay on the calling thread
+	const size_t PIECE = 16384;
+
+	/*
+	 * The planes, ready for the kernels: for boxes, whether each plane's normal is positive along
+	 * each axis, which picks the box corner furthest along it.
+	 */
+	struct Planes
+	{
+		glm::vec4 planes[6];
+		bool positive[6][3];
+
+		explicit Planes( const glm::vec4 p[6] )
+		{
+			for ( int i = 0; i < 6; ++i )
+			{
+				planes[i] = p[i];
+				for ( int axis = 0; axis < 3; ++axis )
+					positive[i][axis] = p[i][axis] >= 0.0f;
+			}
+		}
+
+		// per plane and axis, the array of box coordinates on that corner, so kernels read the
+		// corner straight from memory instead of choosing between min and max for every box
+		void corners( const culling::Boxes& boxes, const float * corner[6][3] ) const
+		{
+			const std::vector<float> * lo[3] = { &boxes.minX, &boxes.minY, &boxes.minZ };
+			const std::vector<float> * hi[3] = { &boxes.maxX, &boxes.maxY, &boxes.maxZ };
+			for ( int p = 0; p < 6; ++p )
+				for ( int axis = 0; axis < 3; ++axis )
+					corner[p][axis] = boxes.size() > 0 ? &( positive[p][axis] ? *hi[axis] : *lo[axis] )[0] : NULL;
+		}
+	};
+
+	// the indexes of begin + the set bits of mask, appended without branches
+	size_t compact( unsigned int mask, unsigned int lanes, size_t begin, unsigned int * out )
+	{
+		size_t written = 0;
+		for ( unsigned int j = 0; j < lanes; ++j )
+		{
+			out[written] = static_cast<unsigned int>( begin + j );
+			written += ( mask >> j ) & 1;
+		}
+		return written;
+	}
+
+	size_t boxesScalar( const Planes& planes, const culling::Boxes& boxes, size_t begin, size_t end, unsigned int * out )
+	{
+		const float * corner[6][3];
+		planes.corners( boxes, corner );
+		size_t written = 0;
+		for ( size_t i = begin; i < end; ++i )
+		{
+			bool outside = false;
+			for ( int p = 0; p < 6; ++p )
+			{
+				const glm::vec4& plane = planes.planes[p];
+				float distance = plane.w;
+				for ( int axis = 0; axis < 3; ++axis )
+					distance += plane[axis] * corner[p][axis][i];
+				outside = outside || distance < 0.0f;
+			}
+			out[written] = static_cast<unsigned int>( i );
+			written += outside ? 0 : 1;
+		}
+		return written;
+	}
+
+	size_t spheresScalar( const Planes& planes, const culling::Spheres& spheres, size_t begin, size_t end, unsigned int * out )
+	{
+		size_t written = 0;
+		for ( size_t i = begin; i < end; ++i )
+		{
+			glm::vec3 center( spheres.x[i], spheres.y[i], spheres.z[i] );
+			bool outside = false;
+			for ( int p = 0; p < 6; ++p )
+				outside = outside || glm::dot( glm::vec3( planes.planes[p] ), center ) + planes.planes[p].w < -spheres.radius[i];
+			out[written] = static_cast<unsigned int>( i );
+			written += outside ? 0 : 1;
+		}
+		return written;
+	}
+
+#ifdef SCENE_SSE2
+	typedef glm::simdVec4 Lanes;
+
+	// four boxes per step, one component of four boxes per register; the planes are broadcast once
+	size_t boxesSSE2( const Planes& planes, const culling::Boxes& boxes, size_t begin, size_t end, unsigned int * out )
+	{
+		const float * corner[6][3];
+		planes.corners( boxes, corner );
+		Lanes normal[6][3], offset[6];
+		for ( int p = 0; p < 6; ++p )
+		{
+			offset[p] = Lanes( planes.planes[p].w );
+			for ( int axis = 0; axis < 3; ++axis )
+				normal[p][axis] = Lanes( planes.planes[p][axis] );
+		}
+
+		size_t written = 0, i = begin;
+		for ( ; i + 4 <= end; i += 4 )
+		{
+			__m128 outside = _mm_setzero_ps();
+			for ( int p = 0; p < 6; ++p )
+			{
+				Lanes distance = offset[p] + normal[p][0] * Lanes( _mm_loadu_ps( corner[p][0] + i ) ) +
+								 normal[p][1] * Lanes( _mm_loadu_ps( corner[p][1] + i ) ) + normal[p][2] * Lanes( _mm_loadu_ps( corner[p][2] + i ) );
+				outside = _mm_or_ps( outside, _mm_cmplt_ps( distance.Data, _mm_setzero_ps() ) );
+			}
+			written += compact( ~_mm_movemask_ps( outside ) & 15, 4, i, out + written );
+		}
+		return written + boxesScalar( planes, boxes, i, end, out + written );
+	}
+
+	size_t spheresSSE2( const Planes& planes, const culling::Spheres& spheres, size_t begin, size_t end, unsigned int * out )
+	{
+		size_t written = 0, i = begin;
+		for ( ; i + 4 <= end; i += 4 )
+		{
+			Lanes x( _mm_loadu_ps( &spheres.x[i] ) ), y( _mm_loadu_ps( &spheres.y[i] ) ), z( _mm_loadu_ps( &spheres.z[i] ) );
+			__m128 negativeRadius = _mm_sub_ps( _mm_setzero_ps(), _mm_loadu_ps( &spheres.radius[i] ) );
+			__m128 outside = _mm_setzero_ps();
+			for ( int p = 0; p < 6; ++p )
+			{
+				const glm::vec4& plane = planes.planes[p];
+				Lanes distance = Lanes( plane.x ) * x + Lanes( plane.y ) * y + Lanes( plane.z ) * z + Lanes( plane.w );
+				outside = _mm_or_ps( outside, _mm_cmplt_ps( distance.Data, negativeRadius ) );
+			}
+			written += compact( ~_mm_movemask_ps( outside ) & 15, 4, i, out + written );
+		}
+		return written + spheresScalar( planes, spheres, i, end, out + written );
+	}
+#endif
+
+#ifdef SCENE_AVX2
+	// the same, eight at a time
+	SCENE_TARGET_AVX2 size_t boxesAVX2( const Planes& planes, const culling::Boxes& boxes, size_t begin, size_t end, unsigned int * out )
+	{
+		const float * corner[6][3];
+		planes.corners( boxes, corner );
+		__m256 normal[6][3], offset[6];
+		for ( int p = 0; p < 6; ++p )
+		{
+			offset[p] = _mm256_set1_ps( planes.planes[p].w );
+			for ( int axis = 0; axis < 3; ++axis )
+				normal[p][axis] = _mm256_set1_ps( planes.planes[p][axis] );
+		}
+
+		size_t written = 0, i = begin;
+		for ( ; i + 8 <= end; i += 8 )
+		{
+			__m256 outside = _mm256_setzero_ps();
+			for ( int p = 0; p < 6; ++p )
+			{
+				__m256 distance = _mm256_add_ps( offset[p], _mm256_mul_ps( normal[p][0], _mm256_loadu_ps( corner[p][0] + i ) ) );
+				distance = _mm256_add_ps( distance, _mm256_mul_ps( normal[p][1], _mm256_loadu_ps( corner[p][1] + i ) ) );
+				distance = _mm256_add_ps( distance, _mm256_mul_ps( normal[p][2], _mm256_loadu_ps( corner[p][2] + i ) ) );
+				outside = _mm256_or_ps( outside, _mm256_cmp_ps( distance, _mm256_setzero_ps(), _CMP_LT_OQ ) );
+			}
+			written += compact( ~_mm256_movemask_ps( outside ) & 255, 8, i, out + written );
+		}
+		return written + boxesScalar( planes, boxes, i, end, out + written );
+	}
+
+	SCENE_TARGET_AVX2 size_t spheresAVX2( const Planes& planes, const culling::Spheres& spheres, size_t begin, size_t end, unsigned int * out )
+	{
+		size_t written = 0, i = begin;
+		for ( ; i + 8 <= end; i += 8 )
+		{
+			__m256 x = _mm256_loadu_ps( &spheres.x[i] ), y = _mm256_loadu_ps( &spheres.y[i] ), z = _mm256_loadu_ps( &spheres.z[i] );
+			__m256 negativeRadius = _mm256_sub_ps( _mm256_setzero_ps(), _mm256_loadu_ps( &spheres.radius[i] ) );
+			__m256 outside = _mm256_setzero_ps();
+			for ( int p = 0; p < 6; ++p )
+			{
+				const glm::vec4& plane = planes.planes[p];
+				__m256 distance = _mm256_add_ps( _mm256_mul_ps( _mm256_set1_ps( plane.x ), x ), _mm256_set1_ps( plane.w ) );
+				distance = _mm256_add_ps( distance, _mm256_mul_ps( _mm256_set1_ps( plane.y ), y ) );
+				distance = _mm256_add_ps( distance, _mm256_mul_ps( _mm256_set1_ps( plane.z ), z ) );
+				outside = _mm256_or_ps( outside, _mm256_cmp_ps( distance, negativeRadius, _CMP_LT_OQ ) );
+			}
+			written += compact( ~_mm256_movemask_ps( outside ) & 255, 8, i, out + written );
+		}
+		return written + spheresScalar( planes, spheres, i, end, out + written );
+	}
+#endif
+
+	/*
+	 * Runs a range kernel over [0, count) into visible. Each piece writes its survivors from its own
+	 * first index, which it can't overrun, so the pieces never share memory; afterwards the pieces
+	 * are moved down, in order, to close the gaps.
+	 */
+	template <class Bounds>
+	size_t cull( size_t ( *kernel )( const Planes&, const Bounds&, size_t, size_t, unsigned int * ), const Planes& planes,
+				 const Bounds& bounds, size_t count, std::vector<unsigned int>& visible )
+	{
+		visible.resize( count );
+		if ( count == 0 )
+			return 0;
+
+		size_t pieces = ( count + PIECE - 1 ) / PIECE;
+		if ( pieces < 2 || ThreadPool::shared().concurrency() < 2 )
+		{
+			visible.resize( kernel( planes, bounds, 0, count, &visible[0] ) );
+			return visible.size();
+		}
+
+		std::vector<size_t> written( pieces );
+		ThreadPool::shared().parallelFor( pieces, [&]( size_t first, size_t last )
+		{
+			for ( size_t piece = first; piece < last; ++piece )
+			{
+				size_t begin = piece * PIECE, end = std::min( count, begin + PIECE );
+				written[piece] = kernel( planes, bounds, begin, end, &visible[begin] );
+			}
+		} );
+
+		size_t total = written[0];
+		for ( size_t piece = 1; piece < pieces; ++piece )
+		{
+			if ( written[piece] > 0 )
+				std::memmove( &visible[total], &visible[piece * PIECE], written[piece] * sizeof( unsigned int ) );
+			total += written[piece];
+		}
+		visible.resize( total );
+		return total;
+	}
+}
+
+void culling::Boxes::resize( size_t count )
+{
+	minX.resize( count );
+	minY.resize( count );
+	minZ.resize( count );
+	maxX.resize( count );
+	maxY.resize( count );
+	maxZ.resize( count );
+}
+
+void culling::Boxes::set( size_t i, const glm::vec3& min, const glm::vec3& max )
+{
+	minX[i] = min.x;
+	minY[i] = min.y;
+	minZ[i] = min.z;
+	maxX[i] = max.x;
+	maxY[i] = max.y;
+	maxZ[i] = max.z;
+}
+
+void culling::Spheres::resize( size_t count )
+{
+	x.resize( count );
+	y.resize( count );
+	z.resize( count );
+	radius.resize( count );
+}
+
+void culling::Spheres::set( size_t i, const glm::vec3& center, float r )
+{
+	x[i] = center.x;
+	y[i] = center.y;
+	z[i] = center.z;
+	radius[i] = r;
+}
+
+culling::Kernel culling::selectKernel( Kernel requested )
+{
+#ifdef SCENE_AVX2
+	if ( ( requested == AUTO || requested == AVX2 ) && cpuHasAVX2() )
+		return AVX2;
+#endif
+#ifdef SCENE_SSE2
+	if ( requested != SCALAR )
+		return SSE2;
+#endif
+	return SCALAR;
+}
+
+void culling::gatherInstanceBoxes( const Scene& scene, Boxes& boxes )
+{
+	const std::vector<Scene::StaticModel>& models = scene.getModels();
+	boxes.resize( models.size() );
+	for ( size_t i = 0; i < models.size(); ++i )
+		boxes.set( i, models[i].worldMin, models[i].worldMax );
+}
+
+size_t culling::cullBoxes( const glm::vec4 planes[6], const Boxes& boxes, std::vector<unsigned int>& visible, Kernel kernel )
+{
+	size_t ( *run )( const Planes&, const Boxes&, size_t, size_t, unsigned int * ) = boxesScalar;
+	switch ( selectKernel( kernel ) )
+	{
+#ifdef SCENE_AVX2
+	case AVX2:
+		run = boxesAVX2;
+		break;
+#endif
+#ifdef SCENE_SSE2
+	case SSE2:
+		run = boxesSSE2;
+		break;
+#endif
+	default:
+		break;
+	}
+	return cull( run, Planes( planes ), boxes, boxes.size(), visible );
+}
+
+size_t culling::cullSpheres( const glm::vec4 planes[6], const Spheres& spheres, std::vector<unsigned int>& visible, Kernel kernel )
+{
+	size_t ( *run )( const Planes&, const Spheres&, size_t, size_t, unsigned int * ) = spheresScalar;
+	switch ( selectKernel( kernel ) )
+	{
+#ifdef SCENE_AVX2
+	case AVX2:
+		run = spheresAVX2;
+		break;
+#endif
+#ifdef SCENE_SSE2
+	case SSE2:
+		run = spheresSSE2;
+		break;
+#endif
+	default:
+		break;
+	}
+	return cull( run, Planes( planes ), spheres, spheres.size(), visible );
+}
@@ -0,0 +1,58 @@
+#ifndef _CULLING_H_
+#define _CULLING_H_
+
+#include <scene/scene.hpp>
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstddef>
+
+/*
+ * Batch view frustum culling of world-space boxes and spheres.
+ *
+ * Bounds are kept structure-of-arrays, one array per component, so the kernels test four (SSE2,
+ * with glm's fvec4SIMD) or eight (AVX2) of them against each plane at once. Boxes are tested by
+ * their corner furthest along each plane's normal; spheres by their center's distance to each
+ * plane, which needs the normalized planes Camera::getFrustumPlanes gives. Either way a bound is
+ * kept unless it's wholly outside some plane, so a few boxes near the frustum's edges survive
+ * even though they're outside.
+ *
+ * The survivors' indexes are written in order as a compact list. Large batches are split across
+ * the shared ThreadPool: each piece compacts into its own part of the list, and the parts are
+ * then closed up.
+ */
+namespace culling
+{
+	enum Kernel { AUTO, SCALAR, SSE2, AVX2 };
+
+	struct Boxes
+	{
+		std::vector<float> minX, minY, minZ;
+		std::vector<float> maxX, maxY, maxZ;
+
+		void resize( size_t count );
+		void set( size_t i, const glm::vec3& min, const glm::vec3& max );
+		size_t size() const { return minX.size(); }
+	};
+
+	struct Spheres
+	{
+		std::vector<float> x, y, z, radius;
+
+		void resize( size_t count );
+		void set( size_t i, const glm::vec3& center, float r );
+		size_t size() const { return x.size(); }
+	};
+
+	// the kernel AUTO (or an unsupported request) resolves to on this machine
+	Kernel selectKernel( Kernel requested );
+
+	// the world boxes of every model instance in the scene, by index into Scene::getModels()
+	void gatherInstanceBoxes( const Scene& scene, Boxes& boxes );
+
+	// visible gets the indexes of the bounds at least partly inside all six planes, in increasing order;
+	// returns how many there are. Planes are as from Camera::getFrustumPlanes.
+	size_t cullBoxes( const glm::vec4 planes[6], const Boxes& boxes, std::vector<unsigned int>& visible, Kernel kernel = AUTO );
+	size_t cullSpheres( const glm::vec4 planes[6], const Spheres& spheres, std::vector<unsigned int>& visible, Kernel kernel = AUTO );
+}
+
+#endif // _CULLING_H_
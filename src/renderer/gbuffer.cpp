@@ -0,0 +1,77 @@
+#include "gbuffer.hpp"
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+const float GBuffer::EMPTY_DEPTH = std::numeric_limits<float>::max();
+
+namespace
+{
+	unsigned char toByte( float value )
+	{
+		return static_cast<unsigned char>( std::min( std::max( value, 0.0f ), 1.0f ) * 255.0f + 0.5f );
+	}
+}
+
+GBuffer::GBuffer() : width( 0 ), height( 0 ), tilesX( 0 ), tilesY( 0 )
+{
+}
+
+void GBuffer::resize( unsigned int newWidth, unsigned int newHeight )
+{
+	width = newWidth;
+	height = newHeight;
+	tilesX = ( width + TILE_SIZE - 1 ) / TILE_SIZE;
+	tilesY = ( height + TILE_SIZE - 1 ) / TILE_SIZE;
+	storage.assign( getTileCount() * PLANE_COUNT * TILE_PIXELS, 0.0f );
+	for ( size_t tile = 0; tile < getTileCount(); ++tile )
+		clearTile( tile );
+}
+
+void GBuffer::clearTile( size_t tile )
+{
+	float * planes = &storage[tile * PLANE_COUNT * TILE_PIXELS];
+	std::fill( planes, planes + TILE_PIXELS, EMPTY_DEPTH );
+	std::fill( planes + TILE_PIXELS, planes + PLANE_COUNT * TILE_PIXELS, 0.0f );
+}
+
+float GBuffer::get( Plane plane, unsigned int x, unsigned int y ) const
+{
+	size_t tile = static_cast<size_t>( y / TILE_SIZE ) * tilesX + x / TILE_SIZE;
+	return tilePlane( tile, plane )[( y % TILE_SIZE ) * TILE_SIZE + x % TILE_SIZE];
+}
+
+void GBuffer::toImage( View show, std::vector<unsigned char>& rgba ) const
+{
+	rgba.assign( static_cast<size_t>( width ) * height * 4, 255 );
+	for ( unsigned int y = 0; y < height; ++y )
+	{
+		for ( unsigned int x = 0; x < width; ++x )
+		{
+			unsigned char * pixel = &rgba[( static_cast<size_t>( y ) * width + x ) * 4];
+			float depth = get( DEPTH, x, y );
+			if ( depth == EMPTY_DEPTH )
+			{
+				pixel[0] = pixel[1] = pixel[2] = 0;
+				continue;
+			}
+
+			if ( show == SHOW_ALBEDO )
+			{
+				pixel[0] = toByte( get( ALBEDO_R, x, y ) );
+				pixel[1] = toByte( get( ALBEDO_G, x, y ) );
+				pixel[2] = toByte( get( ALBEDO_B, x, y ) );
+			}
+			else if ( show == SHOW_NORMALS )
+			{
+				pixel[0] = toByte( get( NORMAL_X, x, y ) * 0.5f + 0.5f );
+				pixel[1] = toByte( get( NORMAL_Y, x, y ) * 0.5f + 0.5f );
+				pixel[2] = toByte( get( NORMAL_Z, x, y ) * 0.5f + 0.5f );
+			}
+			else
+			{
+				pixel[0] = pixel[1] = pixel[2] = toByte( 1.0f / std::max( depth, 1.0f ) );
+			}
+		}
+	}
+}
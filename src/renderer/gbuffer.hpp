@@ -0,0 +1,64 @@
+#ifndef _GBUFFER_H_
+#define _GBUFFER_H_
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstddef>
+
+/*
+ * A CPU G-buffer: per pixel, linear view depth, a view-space normal, albedo, and a specular
+ * intensity and exponent.
+ *
+ * Memory is laid out by screen tile, not by row: each TILE_SIZE square tile keeps all of its
+ * planes together (one row-major TILE_SIZE x TILE_SIZE block of floats per plane), so a worker
+ * that owns a tile touches one contiguous range, and lighting code can read a tile's depth, then
+ * its normals, without striding across the screen. The buffer's size is rounded up to whole tiles.
+ *
+ * Depth is the view-space distance along the camera's axis (clip space w); pixels nothing was
+ * drawn to hold EMPTY_DEPTH. The view and projection the frame was drawn with are kept, so view
+ * positions can be rebuilt from depth.
+ */
+class GBuffer
+{
+public:
+	static const unsigned int TILE_SIZE = 32;
+	static const unsigned int TILE_PIXELS = TILE_SIZE * TILE_SIZE;
+	static const float EMPTY_DEPTH;
+
+	enum Plane { DEPTH, NORMAL_X, NORMAL_Y, NORMAL_Z, ALBEDO_R, ALBEDO_G, ALBEDO_B, SPECULAR, SHININESS, PLANE_COUNT };
+
+	// what toImage shows
+	enum View { SHOW_ALBEDO, SHOW_NORMALS, SHOW_DEPTH };
+
+	GBuffer();
+
+	void resize( unsigned int width, unsigned int height );
+
+	// resets one tile: empty depth, zero everything else
+	void clearTile( size_t tile );
+
+	unsigned int getWidth() const { return width; }
+	unsigned int getHeight() const { return height; }
+	unsigned int getTilesX() const { return tilesX; }
+	unsigned int getTilesY() const { return tilesY; }
+	size_t getTileCount() const { return static_cast<size_t>( tilesX ) * tilesY; }
+
+	// one plane of one tile, TILE_PIXELS floats, row-major within the tile
+	float * tilePlane( size_t tile, Plane plane ) { return &storage[( tile * PLANE_COUNT + plane ) * TILE_PIXELS]; }
+	const float * tilePlane( size_t tile, Plane plane ) const { return &storage[( tile * PLANE_COUNT + plane ) * TILE_PIXELS]; }
+
+	float get( Plane plane, unsigned int x, unsigned int y ) const;
+
+	// RGBA8, row-major, width x height; depth is shown as 1 / depth
+	void toImage( View view, std::vector<unsigned char>& rgba ) const;
+
+	glm::mat4 view;
+	glm::mat4 projection;
+
+private:
+	unsigned int width, height;
+	unsigned int tilesX, tilesY;
+	std::vector<float> storage;
+};
+
+#endif // _GBUFFER_H_
@@ -0,0 +1,729 @@
+#include "lighting.hpp"
+#include <scene/threadpool.hpp>
+#include <scene/simd.hpp>
+#include <SFML/System/Clock.hpp>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+namespace
+{
+	typedef TiledLighting::ViewLight ViewLight;
+
+	const float EMPTY_DEPTH = std::numeric_limits<float>::max();
+	const float UNBOUNDED = std::numeric_limits<float>::max();
+
+	// powers of numbers at or under this come out as zero
+	const float TINY = 1.0e-30f;
+
+	// a tile's pixels as the shading kernels see them
+	struct TileShading
+	{
+		const float * in[GBuffer::PLANE_COUNT];
+		float * out[TiledLighting::CHANNEL_COUNT];
+		float originX, originY;   // pixel centers of the tile's first column and row
+		float rayScaleX, rayOffsetX, rayScaleY, rayOffsetY; // view ray at pixel center p is ( scale * p + offset, ..., -1 )
+		const unsigned int * list;
+		size_t count;
+		const ViewLight * lights;
+		bool sun;
+		glm::vec3 sunDirection;   // toward the sun, in view space
+		glm::vec3 sunColor;
+		float ambient;
+	};
+
+	// everything the kernels need from one pixel, and the light it's had so far
+	glm::vec3 shadePixel( const TileShading& t, size_t i, float px, float py )
+	{
+		float depth = t.in[GBuffer::DEPTH][i];
+		glm::vec3 position = depth * glm::vec3( t.rayScaleX * px + t.rayOffsetX, t.rayScaleY * py + t.rayOffsetY, -1.0f );
+		glm::vec3 normal( t.in[GBuffer::NORMAL_X][i], t.in[GBuffer::NORMAL_Y][i], t.in[GBuffer::NORMAL_Z][i] );
+		glm::vec3 albedo( t.in[GBuffer::ALBEDO_R][i], t.in[GBuffer::ALBEDO_G][i], t.in[GBuffer::ALBEDO_B][i] );
+		float specular = t.in[GBuffer::SPECULAR][i], shininess = t.in[GBuffer::SHININESS][i];
+		glm::vec3 eye = glm::normalize( -position );
+
+		glm::vec3 color( 0.0f );
+		if ( t.sun )
+		{
+			color = t.sunColor * albedo * t.ambient;
+			float diffuse = glm::dot( normal, t.sunDirection );
+			if ( diffuse > 0.0f )
+			{
+				float highlight = std::max( glm::dot( normal, glm::normalize( t.sunDirection + eye ) ), 0.0f );
+				color += t.sunColor * ( albedo * diffuse + specular * std::pow( std::max( highlight, TINY ), shininess ) );
+			}
+		}
+
+		for ( size_t l = 0; l < t.count; ++l )
+		{
+			const ViewLight& light = t.lights[t.list[l]];
+			glm::vec3 toLight = light.position - position;
+			float distance2 = glm::dot( toLight, toLight );
+			if ( !( distance2 < light.range * light.range ) )
+				continue;
+			float distance = std::sqrt( distance2 );
+			toLight /= distance;
+			float diffuse = glm::dot( normal, toLight );
+			if ( !( diffuse > 0.0f ) )
+				continue;
+
+			float scale = 1.0f / ( light.Kc + light.Kl * distance + light.Kq * distance2 );
+			if ( light.spot )
+			{
+				float cone = -glm::dot( toLight, light.direction );
+				if ( !( cone >= light.cosCutoff ) )
+					continue;
+				scale *= std::pow( std::max( cone, TINY ), light.exponent );
+			}
+			float highlight = std::max( glm::dot( normal, glm::normalize( toLight + eye ) ), 0.0f );
+			color += light.color * scale * ( albedo * diffuse + specular * std::pow( std::max( highlight, TINY ), shininess ) );
+		}
+		return color;
+	}
+
+	void shadeScalar( const TileShading& t )
+	{
+		for ( unsigned int y = 0; y < GBuffer::TILE_SIZE; ++y )
+		{
+			for ( unsigned int x = 0; x < GBuffer::TILE_SIZE; ++x )
+			{
+				size_t i = y * GBuffer::TILE_SIZE + x;
+				glm::vec3 color( 0.0f );
+				if ( t.in[GBuffer::DEPTH][i] != EMPTY_DEPTH )
+					color = shadePixel( t, i, t.originX + x, t.originY + y );
+				t.out[TiledLighting::RED][i] = color.x;
+				t.out[TiledLighting::GREEN][i] = color.y;
+				t.out[TiledLighting::BLUE][i] = color.z;
+			}
+		}
+	}
+
+#ifdef SCENE_SSE2
+	/*
+	 * exp and log after the Cephes single precision ones, good to a few units in the last place,
+	 * so the kernels' specular highlights match the scalar std::pow ones to well under 1e-4.
+	 */
+	__m128 logSSE2( __m128 x )
+	{
+		x = _mm_max_ps( x, _mm_set1_ps( TINY ) );
+		__m128i bits = _mm_castps_si128( x );
+		__m128 e = _mm_cvtepi32_ps( _mm_sub_epi32( _mm_srli_epi32( bits, 23 ), _mm_set1_epi32( 126 ) ) );
+		x = _mm_or_ps( _mm_and_ps( x, _mm_castsi128_ps( _mm_set1_epi32( 0x007FFFFF ) ) ), _mm_set1_ps( 0.5f ) );
+
+		// mantissas under sqrt( 1/2 ) are doubled, so x - 1 is in [ -0.29, 0.41 ]
+		__m128 doubled = _mm_cmplt_ps( x, _mm_set1_ps( 0.707106781186547524f ) );
+		e = _mm_sub_ps( e, _mm_and_ps( doubled, _mm_set1_ps( 1.0f ) ) );
+		x = _mm_add_ps( _mm_sub_ps( x, _mm_set1_ps( 1.0f ) ), _mm_and_ps( doubled, x ) );
+
+		__m128 z = _mm_mul_ps( x, x );
+		__m128 y = _mm_set1_ps( 7.0376836292e-2f );
+		y = _mm_add_ps( _mm_mul_ps( y, x ), _mm_set1_ps( -1.1514610310e-1f ) );
+		y = _mm_add_ps( _mm_mul_ps( y, x ), _mm_set1_ps( 1.1676998740e-1f ) );
+		y = _mm_add_ps( _mm_mul_ps( y, x ), _mm_set1_ps( -1.2420140846e-1f ) );
+		y = _mm_add_ps( _mm_mul_ps( y, x ), _mm_set1_ps( 1.4249322787e-1f ) );
+		y = _mm_add_ps( _mm_mul_ps( y, x ), _mm_set1_ps( -1.6668057665e-1f ) );
+		y = _mm_add_ps( _mm_mul_ps( y, x ), _mm_set1_ps( 2.0000714765e-1f ) );
+		y = _mm_add_ps( _mm_mul_ps( y, x ), _mm_set1_ps( -2.4999993993e-1f ) );
+		y = _mm_add_ps( _mm_mul_ps( y, x ), _mm_set1_ps( 3.3333331174e-1f ) );
+		y = _mm_mul_ps( _mm_mul_ps( y, x ), z );
+		y = _mm_add_ps( y, _mm_mul_ps( e, _mm_set1_ps( -2.12194440e-4f ) ) );
+		y = _mm_sub_ps( y, _mm_mul_ps( z, _mm_set1_ps( 0.5f ) ) );
+		return _mm_add_ps( _mm_add_ps( x, y ), _mm_mul_ps( e, _mm_set1_ps( 0.693359375f ) ) );
+	}
+
+	__m128 expSSE2( __m128 x )
+	{
+		x = _mm_min_ps( _mm_max_ps( x, _mm_set1_ps( -87.0f ) ), _mm_set1_ps( 88.0f ) );
+
+		// x = n ln 2 + r, with n rounded to nearest
+		__m128 n = _mm_add_ps( _mm_mul_ps( x, _mm_set1_ps( 1.44269504088896341f ) ), _mm_set1_ps( 0.5f ) );
+		__m128 truncated = _mm_cvtepi32_ps( _mm_cvttps_epi32( n ) );
+		n = _mm_sub_ps( truncated, _mm_and_ps( _mm_cmpgt_ps( truncated, n ), _mm_set1_ps( 1.0f ) ) );
+		x = _mm_sub_ps( x, _mm_mul_ps( n, _mm_set1_ps( 0.693359375f ) ) );
+		x = _mm_sub_ps( x, _mm_mul_ps( n, _mm_set1_ps( -2.12194440e-4f ) ) );
+
+		__m128 z = _mm_mul_ps( x, x );
+		__m128 y = _mm_set1_ps( 1.9875691500e-4f );
+		y = _mm_add_ps( _mm_mul_ps( y, x ), _mm_set1_ps( 1.3981999507e-3f ) );
+		y = _mm_add_ps( _mm_mul_ps( y, x ), _mm_set1_ps( 8.3334519073e-3f ) );
+		y = _mm_add_ps( _mm_mul_ps( y, x ), _mm_set1_ps( 4.1665795894e-2f ) );
+		y = _mm_add_ps( _mm_mul_ps( y, x ), _mm_set1_ps( 1.6666665459e-1f ) );
+		y = _mm_add_ps( _mm_mul_ps( y, x ), _mm_set1_ps( 5.0000001201e-1f ) );
+		y = _mm_add_ps( _mm_add_ps( _mm_mul_ps( y, z ), x ), _mm_set1_ps( 1.0f ) );
+		__m128i power = _mm_slli_epi32( _mm_add_epi32( _mm_cvttps_epi32( n ), _mm_set1_epi32( 127 ) ), 23 );
+		return _mm_mul_ps( y, _mm_castsi128_ps( power ) );
+	}
+
+	// x to the power p, for x in [ 0, 1 ] and p >= 0
+	__m128 powSSE2( __m128 x, __m128 p )
+	{
+		return expSSE2( _mm_mul_ps( p, logSSE2( x ) ) );
+	}
+
+	__m128 dotSSE2( __m128 ax, __m128 ay, __m128 az, __m128 bx, __m128 by, __m128 bz )
+	{
+		return _mm_add_ps( _mm_add_ps( _mm_mul_ps( ax, bx ), _mm_mul_ps( ay, by ) ), _mm_mul_ps( az, bz ) );
+	}
+
+	// four pixels per step, lights broadcast one at a time
+	void shadeSSE2( const TileShading& t )
+	{
+		const __m128 lanes = _mm_set_ps( 3.0f, 2.0f, 1.0f, 0.0f );
+		const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps( 1.0f );
+		for ( unsigned int y = 0; y < GBuffer::TILE_SIZE; ++y )
+		{
+			__m128 rayY = _mm_set1_ps( t.rayScaleY * ( t.originY + y ) + t.rayOffsetY );
+			for ( unsigned int x = 0; x < GBuffer::TILE_SIZE; x += 4 )
+			{
+				size_t i = y * GBuffer::TILE_SIZE + x;
+				__m128 depth = _mm_loadu_ps( t.in[GBuffer::DEPTH] + i );
+				__m128 valid = _mm_cmpneq_ps( depth, _mm_set1_ps( EMPTY_DEPTH ) );
+				if ( _mm_movemask_ps( valid ) == 0 )
+				{
+					_mm_storeu_ps( t.out[TiledLighting::RED] + i, zero );
+					_mm_storeu_ps( t.out[TiledLighting::GREEN] + i, zero );
+					_mm_storeu_ps( t.out[TiledLighting::BLUE] + i, zero );
+					continue;
+				}
+				depth = _mm_and_ps( valid, depth );
+
+				__m128 rayX = _mm_add_ps( _mm_mul_ps( _mm_set1_ps( t.rayScaleX ), _mm_add_ps( _mm_set1_ps( t.originX + x ), lanes ) ),
+										  _mm_set1_ps( t.rayOffsetX ) );
+				__m128 px = _mm_mul_ps( depth, rayX ), py = _mm_mul_ps( depth, rayY ), pz = _mm_sub_ps( zero, depth );
+				__m128 nx = _mm_loadu_ps( t.in[GBuffer::NORMAL_X] + i );
+				__m128 ny = _mm_loadu_ps( t.in[GBuffer::NORMAL_Y] + i );
+				__m128 nz = _mm_loadu_ps( t.in[GBuffer::NORMAL_Z] + i );
+				__m128 albedoR = _mm_loadu_ps( t.in[GBuffer::ALBEDO_R] + i );
+				__m128 albedoG = _mm_loadu_ps( t.in[GBuffer::ALBEDO_G] + i );
+				__m128 albedoB = _mm_loadu_ps( t.in[GBuffer::ALBEDO_B] + i );
+				__m128 specular = _mm_loadu_ps( t.in[GBuffer::SPECULAR] + i );
+				__m128 shininess = _mm_loadu_ps( t.in[GBuffer::SHININESS] + i );
+
+				// empty lanes have a zero position; keep them finite
+				__m128 eyeScale = _mm_div_ps( one, _mm_sqrt_ps( _mm_max_ps( dotSSE2( px, py, pz, px, py, pz ), _mm_set1_ps( TINY ) ) ) );
+				__m128 ex = _mm_sub_ps( zero, _mm_mul_ps( px, eyeScale ) );
+				__m128 ey = _mm_sub_ps( zero, _mm_mul_ps( py, eyeScale ) );
+				__m128 ez = _mm_sub_ps( zero, _mm_mul_ps( pz, eyeScale ) );
+
+				__m128 red = zero, green = zero, blue = zero;
+				if ( t.sun )
+				{
+					__m128 sx = _mm_set1_ps( t.sunDirection.x ), sy = _mm_set1_ps( t.sunDirection.y ), sz = _mm_set1_ps( t.sunDirection.z );
+					__m128 diffuse = dotSSE2( nx, ny, nz, sx, sy, sz );
+					__m128 hx = _mm_add_ps( sx, ex ), hy = _mm_add_ps( sy, ey ), hz = _mm_add_ps( sz, ez );
+					__m128 highlight = _mm_div_ps( dotSSE2( nx, ny, nz, hx, hy, hz ), _mm_sqrt_ps( dotSSE2( hx, hy, hz, hx, hy, hz ) ) );
+					__m128 lit = _mm_cmpgt_ps( diffuse, zero );
+					__m128 shine = _mm_and_ps( lit, _mm_mul_ps( specular, powSSE2( _mm_max_ps( highlight, zero ), shininess ) ) );
+					diffuse = _mm_add_ps( _mm_and_ps( lit, diffuse ), _mm_set1_ps( t.ambient ) );
+					red = _mm_mul_ps( _mm_set1_ps( t.sunColor.x ), _mm_add_ps( _mm_mul_ps( albedoR, diffuse ), shine ) );
+					green = _mm_mul_ps( _mm_set1_ps( t.sunColor.y ), _mm_add_ps( _mm_mul_ps( albedoG, diffuse ), shine ) );
+					blue = _mm_mul_ps( _mm_set1_ps( t.sunColor.z ), _mm_add_ps( _mm_mul_ps( albedoB, diffuse ), shine ) );
+				}
+
+				for ( size_t l = 0; l < t.count; ++l )
+				{
+					const ViewLight& light = t.lights[t.list[l]];
+					__m128 lx = _mm_sub_ps( _mm_set1_ps( light.position.x ), px );
+					__m128 ly = _mm_sub_ps( _mm_set1_ps( light.position.y ), py );
+					__m128 lz = _mm_sub_ps( _mm_set1_ps( light.position.z ), pz );
+					__m128 distance2 = dotSSE2( lx, ly, lz, lx, ly, lz );
+					__m128 mask = _mm_and_ps( valid, _mm_cmplt_ps( distance2, _mm_set1_ps( light.range * light.range ) ) );
+					if ( _mm_movemask_ps( mask ) == 0 )
+						continue;
+
+					__m128 distance = _mm_sqrt_ps( distance2 );
+					__m128 inverse = _mm_div_ps( one, distance );
+					lx = _mm_mul_ps( lx, inverse );
+					ly = _mm_mul_ps( ly, inverse );
+					lz = _mm_mul_ps( lz, inverse );
+					__m128 diffuse = dotSSE2( nx, ny, nz, lx, ly, lz );
+					mask = _mm_and_ps( mask, _mm_cmpgt_ps( diffuse, zero ) );
+					if ( _mm_movemask_ps( mask ) == 0 )
+						continue;
+
+					__m128 scale = _mm_div_ps( one, _mm_add_ps( _mm_add_ps( _mm_set1_ps( light.Kc ), _mm_mul_ps( _mm_set1_ps( light.Kl ), distance ) ),
+																_mm_mul_ps( _mm_set1_ps( light.Kq ), distance2 ) ) );
+					if ( light.spot )
+					{
+						__m128 cone = _mm_sub_ps( zero, dotSSE2( lx, ly, lz, _mm_set1_ps( light.direction.x ), _mm_set1_ps( light.direction.y ),
+																   _mm_set1_ps( light.direction.z ) ) );
+						mask = _mm_and_ps( mask, _mm_cmpge_ps( cone, _mm_set1_ps( light.cosCutoff ) ) );
+						if ( _mm_movemask_ps( mask ) == 0 )
+							continue;
+						scale = _mm_mul_ps( scale, powSSE2( cone, _mm_set1_ps( light.exponent ) ) );
+					}
+
+					__m128 hx = _mm_add_ps( lx, ex ), hy = _mm_add_ps( ly, ey ), hz = _mm_add_ps( lz, ez );
+					__m128 highlight = _mm_div_ps( dotSSE2( nx, ny, nz, hx, hy, hz ), _mm_sqrt_ps( dotSSE2( hx, hy, hz, hx, hy, hz ) ) );
+					__m128 shine = _mm_mul_ps( specular, powSSE2( _mm_max_ps( highlight, zero ), shininess ) );
+					scale = _mm_and_ps( mask, scale );
+					red = _mm_add_ps( red, _mm_mul_ps( _mm_mul_ps( _mm_set1_ps( light.color.x ), scale ), _mm_add_ps( _mm_mul_ps( albedoR, diffuse ), shine ) ) );
+					green = _mm_add_ps( green, _mm_mul_ps( _mm_mul_ps( _mm_set1_ps( light.color.y ), scale ), _mm_add_ps( _mm_mul_ps( albedoG, diffuse ), shine ) ) );
+					blue = _mm_add_ps( blue, _mm_mul_ps( _mm_mul_ps( _mm_set1_ps( light.color.z ), scale ), _mm_add_ps( _mm_mul_ps( albedoB, diffuse ), shine ) ) );
+				}
+
+				_mm_storeu_ps( t.out[TiledLighting::RED] + i, _mm_and_ps( valid, red ) );
+				_mm_storeu_ps( t.out[TiledLighting::GREEN] + i, _mm_and_ps( valid, green ) );
+				_mm_storeu_ps( t.out[TiledLighting::BLUE] + i, _mm_and_ps( valid, blue ) );
+			}
+		}
+	}
+#endif
+
+#ifdef SCENE_AVX2
+	// the same exp and log as the SSE2 kernel's, eight wide
+	SCENE_TARGET_AVX2 __m256 logAVX2( __m256 x )
+	{
+		x = _mm256_max_ps( x, _mm256_set1_ps( TINY ) );
+		__m256i bits = _mm256_castps_si256( x );
+		__m256 e = _mm256_cvtepi32_ps( _mm256_sub_epi32( _mm256_srli_epi32( bits, 23 ), _mm256_set1_epi32( 126 ) ) );
+		x = _mm256_or_ps( _mm256_and_ps( x, _mm256_castsi256_ps( _mm256_set1_epi32( 0x007FFFFF ) ) ), _mm256_set1_ps( 0.5f ) );
+
+		__m256 doubled = _mm256_cmp_ps( x, _mm256_set1_ps( 0.707106781186547524f ), _CMP_LT_OQ );
+		e = _mm256_sub_ps( e, _mm256_and_ps( doubled, _mm256_set1_ps( 1.0f ) ) );
+		x = _mm256_add_ps( _mm256_sub_ps( x, _mm256_set1_ps( 1.0f ) ), _mm256_and_ps( doubled, x ) );
+
+		__m256 z = _mm256_mul_ps( x, x );
+		__m256 y = _mm256_set1_ps( 7.0376836292e-2f );
+		y = _mm256_add_ps( _mm256_mul_ps( y, x ), _mm256_set1_ps( -1.1514610310e-1f ) );
+		y = _mm256_add_ps( _mm256_mul_ps( y, x ), _mm256_set1_ps( 1.1676998740e-1f ) );
+		y = _mm256_add_ps( _mm256_mul_ps( y, x ), _mm256_set1_ps( -1.2420140846e-1f ) );
+		y = _mm256_add_ps( _mm256_mul_ps( y, x ), _mm256_set1_ps( 1.4249322787e-1f ) );
+		y = _mm256_add_ps( _mm256_mul_ps( y, x ), _mm256_set1_ps( -1.6668057665e-1f ) );
+		y = _mm256_add_ps( _mm256_mul_ps( y, x ), _mm256_set1_ps( 2.0000714765e-1f ) );
+		y = _mm256_add_ps( _mm256_mul_ps( y, x ), _mm256_set1_ps( -2.4999993993e-1f ) );
+		y = _mm256_add_ps( _mm256_mul_ps( y, x ), _mm256_set1_ps( 3.3333331174e-1f ) );
+		y = _mm256_mul_ps( _mm256_mul_ps( y, x ), z );
+		y = _mm256_add_ps( y, _mm256_mul_ps( e, _mm256_set1_ps( -2.12194440e-4f ) ) );
+		y = _mm256_sub_ps( y, _mm256_mul_ps( z, _mm256_set1_ps( 0.5f ) ) );
+		return _mm256_add_ps( _mm256_add_ps( x, y ), _mm256_mul_ps( e, _mm256_set1_ps( 0.693359375f ) ) );
+	}
+
+	SCENE_TARGET_AVX2 __m256 expAVX2( __m256 x )
+	{
+		x = _mm256_min_ps( _mm256_max_ps( x, _mm256_set1_ps( -87.0f ) ), _mm256_set1_ps( 88.0f ) );
+
+		__m256 n = _mm256_floor_ps( _mm256_add_ps( _mm256_mul_ps( x, _mm256_set1_ps( 1.44269504088896341f ) ), _mm256_set1_ps( 0.5f ) ) );
+		x = _mm256_sub_ps( x, _mm256_mul_ps( n, _mm256_set1_ps( 0.693359375f ) ) );
+		x = _mm256_sub_ps( x, _mm256_mul_ps( n, _mm256_set1_ps( -2.12194440e-4f ) ) );
+
+		__m256 z = _mm256_mul_ps( x, x );
+		__m256 y = _mm256_set1_ps( 1.9875691500e-4f );
+		y = _mm256_add_ps( _mm256_mul_ps( y, x ), _mm256_set1_ps( 1.3981999507e-3f ) );
+		y = _mm256_add_ps( _mm256_mul_ps( y, x ), _mm256_set1_ps( 8.3334519073e-3f ) );
+		y = _mm256_add_ps( _mm256_mul_ps( y, x ), _mm256_set1_ps( 4.1665795894e-2f ) );
+		y = _mm256_add_ps( _mm256_mul_ps( y, x ), _mm256_set1_ps( 1.6666665459e-1f ) );
+		y = _mm256_add_ps( _mm256_mul_ps( y, x ), _mm256_set1_ps( 5.0000001201e-1f ) );
+		y = _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( y, z ), x ), _mm256_set1_ps( 1.0f ) );
+		__m256i power = _mm256_slli_epi32( _mm256_add_epi32( _mm256_cvttps_epi32( n ), _mm256_set1_epi32( 127 ) ), 23 );
+		return _mm256_mul_ps( y, _mm256_castsi256_ps( power ) );
+	}
+
+	SCENE_TARGET_AVX2 __m256 powAVX2( __m256 x, __m256 p )
+	{
+		return expAVX2( _mm256_mul_ps( p, logAVX2( x ) ) );
+	}
+
+	SCENE_TARGET_AVX2 __m256 dotAVX2( __m256 ax, __m256 ay, __m256 az, __m256 bx, __m256 by, __m256 bz )
+	{
+		return _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( ax, bx ), _mm256_mul_ps( ay, by ) ), _mm256_mul_ps( az, bz ) );
+	}
+
+	// the SSE2 kernel, eight pixels per step
+	SCENE_TARGET_AVX2 void shadeAVX2( const TileShading& t )
+	{
+		const __m256 lanes = _mm256_set_ps( 7.0f, 6.0f, 5.0f, 4.0f, 3.0f, 2.0f, 1.0f, 0.0f );
+		const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps( 1.0f );
+		for ( unsigned int y = 0; y < GBuffer::TILE_SIZE; ++y )
+		{
+			__m256 rayY = _mm256_set1_ps( t.rayScaleY * ( t.originY + y ) + t.rayOffsetY );
+			for ( unsigned int x = 0; x < GBuffer::TILE_SIZE; x += 8 )
+			{
+				size_t i = y * GBuffer::TILE_SIZE + x;
+				__m256 depth = _mm256_loadu_ps( t.in[GBuffer::DEPTH] + i );
+				__m256 valid = _mm256_cmp_ps( depth, _mm256_set1_ps( EMPTY_DEPTH ), _CMP_NEQ_UQ );
+				if ( _mm256_movemask_ps( valid ) == 0 )
+				{
+					_mm256_storeu_ps( t.out[TiledLighting::RED] + i, zero );
+					_mm256_storeu_ps( t.out[TiledLighting::GREEN] + i, zero );
+					_mm256_storeu_ps( t.out[TiledLighting::BLUE] + i, zero );
+					continue;
+				}
+				depth = _mm256_and_ps( valid, depth );
+
+				__m256 rayX = _mm256_add_ps( _mm256_mul_ps( _mm256_set1_ps( t.rayScaleX ), _mm256_add_ps( _mm256_set1_ps( t.originX + x ), lanes ) ),
+											 _mm256_set1_ps( t.rayOffsetX ) );
+				__m256 px = _mm256_mul_ps( depth, rayX ), py = _mm256_mul_ps( depth, rayY ), pz = _mm256_sub_ps( zero, depth );
+				__m256 nx = _mm256_loadu_ps( t.in[GBuffer::NORMAL_X] + i );
+				__m256 ny = _mm256_loadu_ps( t.in[GBuffer::NORMAL_Y] + i );
+				__m256 nz = _mm256_loadu_ps( t.in[GBuffer::NORMAL_Z] + i );
+				__m256 albedoR = _mm256_loadu_ps( t.in[GBuffer::ALBEDO_R] + i );
+				__m256 albedoG = _mm256_loadu_ps( t.in[GBuffer::ALBEDO_G] + i );
+				__m256 albedoB = _mm256_loadu_ps( t.in[GBuffer::ALBEDO_B] + i );
+				__m256 specular = _mm256_loadu_ps( t.in[GBuffer::SPECULAR] + i );
+				__m256 shininess = _mm256_loadu_ps( t.in[GBuffer::SHININESS] + i );
+
+				__m256 eyeScale = _mm256_div_ps( one, _mm256_sqrt_ps( _mm256_max_ps( dotAVX2( px, py, pz, px, py, pz ), _mm256_set1_ps( TINY ) ) ) );
+				__m256 ex = _mm256_sub_ps( zero, _mm256_mul_ps( px, eyeScale ) );
+				__m256 ey = _mm256_sub_ps( zero, _mm256_mul_ps( py, eyeScale ) );
+				__m256 ez = _mm256_sub_ps( zero, _mm256_mul_ps( pz, eyeScale ) );
+
+				__m256 red = zero, green = zero, blue = zero;
+				if ( t.sun )
+				{
+					__m256 sx = _mm256_set1_ps( t.sunDirection.x ), sy = _mm256_set1_ps( t.sunDirection.y ), sz = _mm256_set1_ps( t.sunDirection.z );
+					__m256 diffuse = dotAVX2( nx, ny, nz, sx, sy, sz );
+					__m256 hx = _mm256_add_ps( sx, ex ), hy = _mm256_add_ps( sy, ey ), hz = _mm256_add_ps( sz, ez );
+					__m256 highlight = _mm256_div_ps( dotAVX2( nx, ny, nz, hx, hy, hz ), _mm256_sqrt_ps( dotAVX2( hx, hy, hz, hx, hy, hz ) ) );
+					__m256 lit = _mm256_cmp_ps( diffuse, zero, _CMP_GT_OQ );
+					__m256 shine = _mm256_and_ps( lit, _mm256_mul_ps( specular, powAVX2( _mm256_max_ps( highlight, zero ), shininess ) ) );
+					diffuse = _mm256_add_ps( _mm256_and_ps( lit, diffuse ), _mm256_set1_ps( t.ambient ) );
+					red = _mm256_mul_ps( _mm256_set1_ps( t.sunColor.x ), _mm256_add_ps( _mm256_mul_ps( albedoR, diffuse ), shine ) );
+					green = _mm256_mul_ps( _mm256_set1_ps( t.sunColor.y ), _mm256_add_ps( _mm256_mul_ps( albedoG, diffuse ), shine ) );
+					blue = _mm256_mul_ps( _mm256_set1_ps( t.sunColor.z ), _mm256_add_ps( _mm256_mul_ps( albedoB, diffuse ), shine ) );
+				}
+
+				for ( size_t l = 0; l < t.count; ++l )
+				{
+					const ViewLight& light = t.lights[t.list[l]];
+					__m256 lx = _mm256_sub_ps( _mm256_set1_ps( light.position.x ), px );
+					__m256 ly = _mm256_sub_ps( _mm256_set1_ps( light.position.y ), py );
+					__m256 lz = _mm256_sub_ps( _mm256_set1_ps( light.position.z ), pz );
+					__m256 distance2 = dotAVX2( lx, ly, lz, lx, ly, lz );
+					__m256 mask = _mm256_and_ps( valid, _mm256_cmp_ps( distance2, _mm256_set1_ps( light.range * light.range ), _CMP_LT_OQ ) );
+					if ( _mm256_movemask_ps( mask ) == 0 )
+						continue;
+
+					__m256 distance = _mm256_sqrt_ps( distance2 );
+					__m256 inverse = _mm256_div_ps( one, distance );
+					lx = _mm256_mul_ps( lx, inverse );
+					ly = _mm256_mul_ps( ly, inverse );
+					lz = _mm256_mul_ps( lz, inverse );
+					__m256 diffuse = dotAVX2( nx, ny, nz, lx, ly, lz );
+					mask = _mm256_and_ps( mask, _mm256_cmp_ps( diffuse, zero, _CMP_GT_OQ ) );
+					if ( _mm256_movemask_ps( mask ) == 0 )
+						continue;
+
+					__m256 scale = _mm256_div_ps( one, _mm256_add_ps( _mm256_add_ps( _mm256_set1_ps( light.Kc ), _mm256_mul_ps( _mm256_set1_ps( light.Kl ), distance ) ),
+																	  _mm256_mul_ps( _mm256_set1_ps( light.Kq ), distance2 ) ) );
+					if ( light.spot )
+					{
+						__m256 cone = _mm256_sub_ps( zero, dotAVX2( lx, ly, lz, _mm256_set1_ps( light.direction.x ), _mm256_set1_ps( light.direction.y ),
+																	  _mm256_set1_ps( light.direction.z ) ) );
+						mask = _mm256_and_ps( mask, _mm256_cmp_ps( cone, _mm256_set1_ps( light.cosCutoff ), _CMP_GE_OQ ) );
+						if ( _mm256_movemask_ps( mask ) == 0 )
+							continue;
+						scale = _mm256_mul_ps( scale, powAVX2( cone, _mm256_set1_ps( light.exponent ) ) );
+					}
+
+					__m256 hx = _mm256_add_ps( lx, ex ), hy = _mm256_add_ps( ly, ey ), hz = _mm256_add_ps( lz, ez );
+					__m256 highlight = _mm256_div_ps( dotAVX2( nx, ny, nz, hx, hy, hz ), _mm256_sqrt_ps( dotAVX2( hx, hy, hz, hx, hy, hz ) ) );
+					__m256 shine = _mm256_mul_ps( specular, powAVX2( _mm256_max_ps( highlight, zero ), shininess ) );
+					scale = _mm256_and_ps( mask, scale );
+					red = _mm256_add_ps( red, _mm256_mul_ps( _mm256_mul_ps( _mm256_set1_ps( light.color.x ), scale ), _mm256_add_ps( _mm256_mul_ps( albedoR, diffuse ), shine ) ) );
+					green = _mm256_add_ps( green, _mm256_mul_ps( _mm256_mul_ps( _mm256_set1_ps( light.color.y ), scale ), _mm256_add_ps( _mm256_mul_ps( albedoG, diffuse ), shine ) ) );
+					blue = _mm256_add_ps( blue, _mm256_mul_ps( _mm256_mul_ps( _mm256_set1_ps( light.color.z ), scale ), _mm256_add_ps( _mm256_mul_ps( albedoB, diffuse ), shine ) ) );
+				}
+
+				_mm256_storeu_ps( t.out[TiledLighting::RED] + i, _mm256_and_ps( valid, red ) );
+				_mm256_storeu_ps( t.out[TiledLighting::GREEN] + i, _mm256_and_ps( valid, green ) );
+				_mm256_storeu_ps( t.out[TiledLighting::BLUE] + i, _mm256_and_ps( valid, blue ) );
+			}
+		}
+	}
+#endif
+
+	// a plane through the eye, given by its normal, normalized
+	glm::vec3 sidePlane( float x, float y, float z )
+	{
+		return glm::vec3( x, y, z ) / std::sqrt( x * x + y * y + z * z );
+	}
+
+	unsigned char toByte( float value )
+	{
+		return static_cast<unsigned char>( std::min( std::max( value, 0.0f ), 1.0f ) * 255.0f + 0.5f );
+	}
+}
+
+TiledLighting::TiledLighting() : width( 0 ), height( 0 ), tilesX( 0 ), tilesY( 0 )
+{
+}
+
+TiledLighting::Kernel TiledLighting::selectKernel( Kernel requested )
+{
+#ifdef SCENE_AVX2
+	if ( ( requested == AUTO || requested == AVX2 ) && cpuHasAVX2() )
+		return AVX2;
+#endif
+#ifdef SCENE_SSE2
+	if ( requested != SCALAR )
+		return SSE2;
+#endif
+	return SCALAR;
+}
+
+void TiledLighting::shade( const GBuffer& gbuffer, const Scene& scene, const Options& options )
+{
+	sf::Clock clock, total;
+	stats = FrameStats();
+	if ( width != gbuffer.getWidth() || height != gbuffer.getHeight() )
+	{
+		width = gbuffer.getWidth();
+		height = gbuffer.getHeight();
+		tilesX = gbuffer.getTilesX();
+		tilesY = gbuffer.getTilesY();
+		output.assign( gbuffer.getTileCount() * CHANNEL_COUNT * GBuffer::TILE_PIXELS, 0.0f );
+		tileMinDepth.resize( gbuffer.getTileCount() );
+		tileMaxDepth.resize( gbuffer.getTileCount() );
+		tileLights.resize( gbuffer.getTileCount() );
+	}
+	if ( width == 0 || height == 0 )
+		return;
+
+	// the view ray through pixel center p is ( scaleX * p.x + offsetX, scaleY * p.y + offsetY, -1 ),
+	// which a perspective projection scales by depth
+	const glm::mat4& view = gbuffer.view;
+	const glm::mat4& projection = gbuffer.projection;
+	float rayScaleX = 2.0f / ( width * projection[0][0] ), rayOffsetX = ( projection[2][0] - 1.0f ) / projection[0][0];
+	float rayScaleY = -2.0f / ( height * projection[1][1] ), rayOffsetY = ( projection[2][1] + 1.0f ) / projection[1][1];
+
+	// bounds: view space lights, and the tiles each may reach
+	const std::vector<Scene::PointLight>& pointlights = scene.getPointLights();
+	const std::vector<Scene::SpotLight>& spotlights = scene.getSpotLights();
+	lights.resize( pointlights.size() + spotlights.size() );
+	stats.lights = lights.size();
+	glm::mat3 rotation( view );
+	ThreadPool::shared().parallelFor( lights.size(), [&]( size_t begin, size_t end )
+	{
+		for ( size_t i = begin; i < end; ++i )
+		{
+			ViewLight& light = lights[i];
+			float Kc, Kl, Kq;
+			if ( i < pointlights.size() )
+			{
+				const Scene::PointLight& point = pointlights[i];
+				light.position = glm::vec3( view * glm::vec4( point.position, 1.0f ) );
+				light.range = point.range;
+				light.color = point.color;
+				light.direction = glm::vec3( 0.0f, 0.0f, -1.0f );
+				light.cosCutoff = -1.0f;
+				light.exponent = 0.0f;
+				light.spot = false;
+				light.center = light.position;
+				light.radius = point.range;
+				Kc = point.Kc, Kl = point.Kl, Kq = point.Kq;
+			}
+			else
+			{
+				const Scene::SpotLight& spot = spotlights[i - pointlights.size()];
+				light.position = glm::vec3( view * glm::vec4( spot.position, 1.0f ) );
+				light.range = spot.range;
+				light.color = spot.color;
+				light.direction = glm::normalize( rotation * spot.direction );
+				light.spot = spot.angle < 180.0f;
+				light.cosCutoff = light.spot ? std::cos( glm::radians( spot.angle ) ) : -1.0f;
+				light.exponent = spot.exponent;
+				light.center = glm::vec3( view * glm::vec4( spot.boundsCenter, 1.0f ) );
+				light.radius = spot.boundsRadius;
+				Kc = spot.Kc, Kl = spot.Kl, Kq = spot.Kq;
+			}
+
+			// no attenuation at all reads as none, not as infinitely bright
+			if ( Kc <= 0.0f && Kl <= 0.0f && Kq <= 0.0f )
+				Kc = 1.0f;
+			light.Kc = Kc, light.Kl = Kl, light.Kq = Kq;
+
+			light.minTileX = light.minTileY = 0;
+			light.maxTileX = light.maxTileY = -1;
+			float depth = -light.center.z, range = light.radius;
+			if ( range <= 0.0f || depth + range <= 0.0f )
+				continue;
+			if ( range >= UNBOUNDED || depth - range <= 0.0f )
+			{
+				// reaches the eye's plane, so may show anywhere
+				light.maxTileX = static_cast<int>( tilesX ) - 1;
+				light.maxTileY = static_cast<int>( tilesY ) - 1;
+				continue;
+			}
+
+			// the widest slopes x / depth and y / depth over the sphere's box, then their pixels
+			float nearest = depth - range, furthest = depth + range;
+			float lowX = light.center.x - range, highX = light.center.x + range;
+			float lowY = light.center.y - range, highY = light.center.y + range;
+			float slopeLowX = lowX / ( lowX < 0.0f ? nearest : furthest ), slopeHighX = highX / ( highX > 0.0f ? nearest : furthest );
+			float slopeLowY = lowY / ( lowY < 0.0f ? nearest : furthest ), slopeHighY = highY / ( highY > 0.0f ? nearest : furthest );
+			float left = ( slopeLowX - rayOffsetX ) / rayScaleX, right = ( slopeHighX - rayOffsetX ) / rayScaleX;
+			float top = ( slopeHighY - rayOffsetY ) / rayScaleY, bottom = ( slopeLowY - rayOffsetY ) / rayScaleY;
+			if ( right < 0.0f || bottom < 0.0f || left > float( width ) || top > float( height ) )
+				continue;
+			light.minTileX = static_cast<int>( std::max( left, 0.0f ) ) / static_cast<int>( GBuffer::TILE_SIZE );
+			light.minTileY = static_cast<int>( std::max( top, 0.0f ) ) / static_cast<int>( GBuffer::TILE_SIZE );
+			light.maxTileX = static_cast<int>( std::min( right, float( width - 1 ) ) ) / static_cast<int>( GBuffer::TILE_SIZE );
+			light.maxTileY = static_cast<int>( std::min( bottom, float( height - 1 ) ) ) / static_cast<int>( GBuffer::TILE_SIZE );
+		}
+	}, 256 );
+	stats.boundsSeconds = clock.restart().asSeconds();
+
+	// bin: each tile's depth range, then the lights whose spheres reach into its frustum
+	ThreadPool::shared().parallelFor( gbuffer.getTileCount(), [&]( size_t begin, size_t end )
+	{
+		for ( size_t tile = begin; tile < end; ++tile )
+		{
+			const float * depth = gbuffer.tilePlane( tile, GBuffer::DEPTH );
+			float low = EMPTY_DEPTH, high = -EMPTY_DEPTH;
+			for ( unsigned int i = 0; i < GBuffer::TILE_PIXELS; ++i )
+			{
+				if ( depth[i] != EMPTY_DEPTH )
+				{
+					low = std::min( low, depth[i] );
+					high = std::max( high, depth[i] );
+				}
+			}
+			tileMinDepth[tile] = low;
+			tileMaxDepth[tile] = high;
+		}
+	}, 16 );
+	ThreadPool::shared().parallelFor( tilesY, [&]( size_t begin, size_t end )
+	{
+		for ( size_t ty = begin; ty < end; ++ty )
+		{
+			// a row's top and bottom planes, through the edges of its pixels
+			float top = float( ty * GBuffer::TILE_SIZE ), bottom = float( std::min<size_t>( ( ty + 1 ) * GBuffer::TILE_SIZE, height ) );
+			glm::vec3 topPlane = sidePlane( 0.0f, -1.0f, -( rayScaleY * top + rayOffsetY ) );
+			glm::vec3 bottomPlane = sidePlane( 0.0f, 1.0f, rayScaleY * bottom + rayOffsetY );
+			for ( size_t tx = 0; tx < tilesX; ++tx )
+				tileLights[ty * tilesX + tx].clear();
+
+			for ( size_t l = 0; l < lights.size(); ++l )
+			{
+				const ViewLight& light = lights[l];
+				if ( !options.cullLights )
+				{
+					for ( size_t tx = 0; tx < tilesX && light.radius > 0.0f; ++tx )
+						tileLights[ty * tilesX + tx].push_back( static_cast<unsigned int>( l ) );
+					continue;
+				}
+				if ( static_cast<int>( ty ) < light.minTileY || static_cast<int>( ty ) > light.maxTileY )
+					continue;
+				if ( glm::dot( topPlane, light.center ) < -light.radius || glm::dot( bottomPlane, light.center ) < -light.radius )
+					continue;
+				float depth = -light.center.z;
+				for ( int tx = light.minTileX; tx <= light.maxTileX; ++tx )
+				{
+					size_t tile = ty * tilesX + tx;
+					if ( depth + light.radius < tileMinDepth[tile] || depth - light.radius > tileMaxDepth[tile] )
+						continue;
+					float left = float( tx * GBuffer::TILE_SIZE ), right = float( std::min( ( tx + 1 ) * GBuffer::TILE_SIZE, width ) );
+					glm::vec3 leftPlane = sidePlane( 1.0f, 0.0f, rayScaleX * left + rayOffsetX );
+					glm::vec3 rightPlane = sidePlane( -1.0f, 0.0f, -( rayScaleX * right + rayOffsetX ) );
+					if ( glm::dot( leftPlane, light.center ) < -light.radius || glm::dot( rightPlane, light.center ) < -light.radius )
+						continue;
+					tileLights[tile].push_back( static_cast<unsigned int>( l ) );
+				}
+			}
+		}
+	}, 1 );
+
+	std::vector<bool> inView( lights.size(), false );
+	for ( size_t tile = 0; tile < tileLights.size(); ++tile )
+	{
+		stats.tileEntries += tileLights[tile].size();
+		stats.maxTileLights = std::max( stats.maxTileLights, tileLights[tile].size() );
+		for ( size_t l = 0; l < tileLights[tile].size(); ++l )
+			inView[tileLights[tile][l]] = true;
+	}
+	stats.lightsInView = std::count( inView.begin(), inView.end(), true );
+	stats.binSeconds = clock.restart().asSeconds();
+
+	// shade: one tile per task
+	const Scene::DirectionalLight& sunlight = scene.getSunlight();
+	Kernel kernel = selectKernel( options.kernel );
+	std::vector<size_t> shaded( gbuffer.getTileCount(), 0 );
+	ThreadPool::shared().parallelFor( gbuffer.getTileCount(), [&]( size_t begin, size_t end )
+	{
+		TileShading t;
+		t.rayScaleX = rayScaleX, t.rayOffsetX = rayOffsetX;
+		t.rayScaleY = rayScaleY, t.rayOffsetY = rayOffsetY;
+		t.lights = lights.empty() ? NULL : &lights[0];
+		t.sun = options.sunlight;
+		t.sunDirection = glm::normalize( rotation * -sunlight.direction );
+		t.sunColor = sunlight.color;
+		t.ambient = sunlight.ambient;
+		for ( size_t tile = begin; tile < end; ++tile )
+		{
+			for ( int plane = 0; plane < GBuffer::PLANE_COUNT; ++plane )
+				t.in[plane] = gbuffer.tilePlane( tile, GBuffer::Plane( plane ) );
+			for ( int channel = 0; channel < CHANNEL_COUNT; ++channel )
+				t.out[channel] = &output[( tile * CHANNEL_COUNT + channel ) * GBuffer::TILE_PIXELS];
+			if ( tileMinDepth[tile] > tileMaxDepth[tile] )
+			{
+				std::fill( t.out[0], t.out[0] + CHANNEL_COUNT * GBuffer::TILE_PIXELS, 0.0f );
+				continue;
+			}
+
+			t.originX = float( ( tile % tilesX ) * GBuffer::TILE_SIZE ) + 0.5f;
+			t.originY = float( ( tile / tilesX ) * GBuffer::TILE_SIZE ) + 0.5f;
+			t.list = tileLights[tile].empty() ? NULL : &tileLights[tile][0];
+			t.count = tileLights[tile].size();
+			for ( unsigned int i = 0; i < GBuffer::TILE_PIXELS; ++i )
+				shaded[tile] += t.in[GBuffer::DEPTH][i] != EMPTY_DEPTH ? 1 : 0;
+			switch ( kernel )
+			{
+#ifdef SCENE_AVX2
+			case AVX2:
+				shadeAVX2( t );
+				break;
+#endif
+#ifdef SCENE_SSE2
+			case SSE2:
+				shadeSSE2( t );
+				break;
+#endif
+			default:
+				shadeScalar( t );
+				break;
+			}
+		}
+	}, 4 );
+	for ( size_t tile = 0; tile < shaded.size(); ++tile )
+		stats.shadedPixels += shaded[tile];
+	stats.shadeSeconds = clock.restart().asSeconds();
+	stats.seconds = total.getElapsedTime().asSeconds();
+}
+
+float TiledLighting::get( Channel channel, unsigned int x, unsigned int y ) const
+{
+	size_t tile = static_cast<size_t>( y / GBuffer::TILE_SIZE ) * tilesX + x / GBuffer::TILE_SIZE;
+	return output[( tile * CHANNEL_COUNT + channel ) * GBuffer::TILE_PIXELS + ( y % GBuffer::TILE_SIZE ) * GBuffer::TILE_SIZE + x % GBuffer::TILE_SIZE];
+}
+
+void TiledLighting::toImage( View show, std::vector<unsigned char>& rgba ) const
+{
+	rgba.assign( static_cast<size_t>( width ) * height * 4, 255 );
+	size_t most = 1;
+	for ( size_t tile = 0; tile < tileLights.size(); ++tile )
+		most = std::max( most, tileLights[tile].size() );
+
+	for ( unsigned int y = 0; y < height; ++y )
+	{
+		for ( unsigned int x = 0; x < width; ++x )
+		{
+			unsigned char * pixel = &rgba[( static_cast<size_t>( y ) * width + x ) * 4];
+			if ( show == SHOW_LIGHT_COUNTS )
+			{
+				// black for none, then blue through green to red for the most
+				size_t count = tileLights[( y / GBuffer::TILE_SIZE ) * tilesX + x / GBuffer::TILE_SIZE].size();
+				float t = float( count ) / float( most );
+				pixel[0] = count == 0 ? 0 : toByte( 2.0f * t - 1.0f );
+				pixel[1] = count == 0 ? 0 : toByte( 1.0f - std::fabs( 2.0f * t - 1.0f ) );
+				pixel[2] = count == 0 ? 0 : toByte( 1.0f - 2.0f * t );
+				continue;
+			}
+			for ( int channel = 0; channel < CHANNEL_COUNT; ++channel )
+			{
+				float c = std::min( std::max( get( Channel( channel ), x, y ), 0.0f ), 1.0f );
+				pixel[channel] = toByte( c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow( c, 1.0f / 2.4f ) - 0.055f );
+			}
+		}
+	}
+}
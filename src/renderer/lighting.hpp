@@ -0,0 +1,119 @@
+#ifndef _LIGHTING_H_
+#define _LIGHTING_H_
+
+#include <renderer/gbuffer.hpp>
+#include <scene/scene.hpp>
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstddef>
+
+/*
+ * Tiled deferred lighting on the CPU: shades a GBuffer with the scene's sunlight, point lights and
+ * spotlights, touching each pixel only with the lights that can reach it.
+ *
+ * A frame goes through three stages, each split across the shared ThreadPool:
+ *   bounds - every light is moved to view space and bounded by the sphere the Scene derived for it:
+ *            out to its range for a point light, around its cone for a spotlight; the sphere is
+ *            projected to the range of screen tiles it may cover
+ *   bin    - each tile's minimum and maximum depth are read from the G-buffer, and the tile's
+ *            frustum (four side planes through the eye, cut at those depths) is tested against the
+ *            spheres of the lights whose tile range holds it, giving one light list per tile
+ *   shade  - each tile's pixels are shaded against its own list, eight pixels per step with AVX2
+ *            (four with SSE2), positions rebuilt from depth and the projection
+ * Past its radius a light is cut off in the shading too, so tile edges never show. With lights
+ * that are sparse on screen, the work per pixel stays about the same as their number grows.
+ *
+ * Lighting is Blinn-Phong: albedo times N.L, plus specular times N.H to the material's exponent,
+ * scaled by 1 / ( Kc + Kl d + Kq d^2 ). Spotlights work as in fixed-function GL: angle is the
+ * half-angle of the cone in degrees, 180 meaning no cone, and exponent sharpens the falloff.
+ * The sunlight shines along its direction everywhere and adds ambient times albedo. The output is
+ * linear RGB, laid out by tile like the GBuffer; empty pixels stay black.
+ */
+class TiledLighting
+{
+public:
+	enum Kernel { AUTO, SCALAR, SSE2, AVX2 };
+
+	enum Channel { RED, GREEN, BLUE, CHANNEL_COUNT };
+
+	// what toImage shows
+	enum View { SHOW_LIGHTING, SHOW_LIGHT_COUNTS };
+
+	struct Options
+	{
+		bool sunlight;
+		bool cullLights; // false lists every light in every tile, as a reference
+		Kernel kernel;
+
+		Options() : sunlight( true ), cullLights( true ), kernel( AUTO )
+		{
+		}
+	};
+
+	struct FrameStats
+	{
+		size_t lights;         // point and spot lights in the scene
+		size_t lightsInView;   // whose bounds reach at least one tile
+		size_t tileEntries;    // lights summed over the tiles they were listed in
+		size_t maxTileLights;
+		size_t shadedPixels;
+		float boundsSeconds;
+		float binSeconds;
+		float shadeSeconds;
+		float seconds;
+
+		FrameStats() : lights( 0 ), lightsInView( 0 ), tileEntries( 0 ), maxTileLights( 0 ), shadedPixels( 0 ),
+					   boundsSeconds( 0.0f ), binSeconds( 0.0f ), shadeSeconds( 0.0f ), seconds( 0.0f )
+		{
+		}
+	};
+
+	// a point or spot light as the tiles see it, in view space
+	struct ViewLight
+	{
+		glm::vec3 position;
+		float range;          // past this, the light is under the scene's threshold
+		glm::vec3 center;     // the sphere tiles are tested against; around the cone, for spotlights
+		float radius;
+		glm::vec3 color;
+		float Kc, Kl, Kq;
+		glm::vec3 direction;  // spotlights only
+		float cosCutoff;      // -1 for point lights
+		float exponent;
+		bool spot;
+		int minTileX, minTileY, maxTileX, maxTileY; // tiles the sphere may cover; empty if min > max
+	};
+
+	TiledLighting();
+
+	// lights gbuffer, as drawn from its view and (perspective) projection
+	void shade( const GBuffer& gbuffer, const Scene& scene, const Options& options = Options() );
+
+	unsigned int getWidth() const { return width; }
+	unsigned int getHeight() const { return height; }
+	float get( Channel channel, unsigned int x, unsigned int y ) const;
+
+	// the lights listed in a tile, by index into the frame's point lights then spotlights
+	const std::vector<unsigned int>& getTileLights( size_t tile ) const { return tileLights[tile]; }
+
+	// RGBA8, row-major; lighting is clamped and encoded to sRGB, light counts are shown as a heat map
+	void toImage( View view, std::vector<unsigned char>& rgba ) const;
+
+	const FrameStats& getFrameStats() const { return stats; }
+
+	// the kernel AUTO (or an unsupported request) resolves to on this machine
+	static Kernel selectKernel( Kernel requested );
+
+private:
+	unsigned int width, height;
+	unsigned int tilesX, tilesY;
+	std::vector<float> output; // tile-major, CHANNEL_COUNT planes of GBuffer::TILE_PIXELS per tile
+	FrameStats stats;
+
+	// per-frame working memory, kept to avoid reallocating
+	std::vector<ViewLight> lights;
+	std::vector<float> tileMinDepth, tileMaxDepth;
+	std::vector<std::vector<unsigned int> > tileLights;
+};
+
+#endif // _LIGHTING_H_
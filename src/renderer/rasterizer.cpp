@@ -0,0 +1,669 @@
+#include "rasterizer.hpp"
+#include <scene/threadpool.hpp>
+#include <scene/simd.hpp>
+#include <SFML/System/Clock.hpp>
+#include <SFML/System/Err.hpp>
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	// source triangles per bin task; a chunk's setups are addressed with 16 bits, and clipping makes
+	// at most six triangles from one
+	const size_t CHUNK_TRIANGLES = 4096;
+
+	// vertices snap to 1/16 pixel, so edge functions at pixel centers are multiples of 1/256, and
+	// anything smaller than that step can break ties without moving a real edge. Inside the guard
+	// band they need under 40 bits, so they're evaluated exactly in double; float only has the
+	// bits for triangles a few hundred pixels across, and is only used for interpolation
+	const float SUBPIXEL = 16.0f;
+	const float TIE_BIAS = 1.0f / 512.0f;
+
+	// how far past the screen edges triangles may reach before they're clipped, in pixels
+	const float GUARD_BAND = 4096.0f;
+
+	// edge of the square blocks a tile is classified in
+	const unsigned int BLOCK = 8;
+
+	typedef SoftwareRasterizer::ClipVertex ClipVertex;
+	typedef SoftwareRasterizer::Setup Setup;
+	typedef SoftwareRasterizer::Surface Surface;
+
+	struct SrgbTable
+	{
+		float linear[256];
+
+		SrgbTable()
+		{
+			for ( int i = 0; i < 256; ++i )
+			{
+				float c = i / 255.0f;
+				linear[i] = c <= 0.04045f ? c / 12.92f : std::pow( ( c + 0.055f ) / 1.055f, 2.4f );
+			}
+		}
+	};
+
+	const SrgbTable& srgbTable()
+	{
+		static SrgbTable table;
+		return table;
+	}
+
+	ClipVertex lerp( const ClipVertex& a, const ClipVertex& b, float t )
+	{
+		ClipVertex v;
+		v.position = a.position + ( b.position - a.position ) * t;
+		v.normal = a.normal + ( b.normal - a.normal ) * t;
+		v.texcoord = a.texcoord + ( b.texcoord - a.texcoord ) * t;
+		return v;
+	}
+
+	// one Sutherland-Hodgman pass: keeps the part of a convex polygon where dot( plane, position ) >= 0
+	int clipPolygon( const ClipVertex * in, int count, const glm::vec4& plane, ClipVertex * out )
+	{
+		int written = 0;
+		for ( int i = 0; i < count; ++i )
+		{
+			const ClipVertex& a = in[i];
+			const ClipVertex& b = in[( i + 1 ) % count];
+			float da = glm::dot( plane, a.position ), db = glm::dot( plane, b.position );
+			if ( da >= 0.0f )
+				out[written++] = a;
+			if ( ( da >= 0.0f ) != ( db >= 0.0f ) )
+				out[written++] = lerp( a, b, da / ( da - db ) );
+		}
+		return written;
+	}
+
+	float snap( float value )
+	{
+		return std::floor( value * SUBPIXEL + 0.5f ) / SUBPIXEL;
+	}
+
+	// projects, snaps and winds a triangle; false if it's back-facing (when culled), degenerate or covers no pixel centers
+	bool setupTriangle( const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2, unsigned int width, unsigned int height,
+						bool cullBackfaces, int surface, Setup& s )
+	{
+		const ClipVertex * v[3] = { &v0, &v1, &v2 };
+		for ( int i = 0; i < 3; ++i )
+		{
+			const glm::vec4& p = v[i]->position;
+			s.invW[i] = 1.0f / p.w;
+			s.x[i] = snap( ( p.x * s.invW[i] * 0.5f + 0.5f ) * width );
+			s.y[i] = snap( ( 0.5f - p.y * s.invW[i] * 0.5f ) * height );
+		}
+
+		// y points down on screen, so a counter-clockwise (front) face has a negative area here
+		s.area = ( s.x[1] - s.x[0] ) * ( s.y[2] - s.y[0] ) - ( s.x[2] - s.x[0] ) * ( s.y[1] - s.y[0] );
+		if ( s.area == 0.0f || ( s.area > 0.0f && cullBackfaces ) )
+			return false;
+		if ( s.area < 0.0f )
+		{
+			std::swap( s.x[1], s.x[2] );
+			std::swap( s.y[1], s.y[2] );
+			std::swap( s.invW[1], s.invW[2] );
+			std::swap( v[1], v[2] );
+			s.area = -s.area;
+		}
+
+		// a pixel is covered when its center is; bounds are the centers inside the triangle's box
+		float minX = std::min( std::min( s.x[0], s.x[1] ), s.x[2] ), maxX = std::max( std::max( s.x[0], s.x[1] ), s.x[2] );
+		float minY = std::min( std::min( s.y[0], s.y[1] ), s.y[2] ), maxY = std::max( std::max( s.y[0], s.y[1] ), s.y[2] );
+		s.minX = std::max( 0, static_cast<int>( std::ceil( minX - 0.5f ) ) );
+		s.minY = std::max( 0, static_cast<int>( std::ceil( minY - 0.5f ) ) );
+		s.maxX = std::min( static_cast<int>( width ) - 1, static_cast<int>( std::floor( maxX - 0.5f ) ) );
+		s.maxY = std::min( static_cast<int>( height ) - 1, static_cast<int>( std::floor( maxY - 0.5f ) ) );
+		if ( s.minX > s.maxX || s.minY > s.maxY )
+			return false;
+
+		// edge k is opposite vertex k; a neighbor sharing the edge sees it reversed, so exactly one
+		// of the two owns pixel centers lying on it
+		for ( int k = 0; k < 3; ++k )
+		{
+			int a = ( k + 1 ) % 3, b = ( k + 2 ) % 3;
+			float stepX = s.y[a] - s.y[b], stepY = s.x[b] - s.x[a];
+			bool ownsTies = stepX > 0.0f || ( stepX == 0.0f && stepY > 0.0f );
+			s.bias[k] = ownsTies ? 0.0f : TIE_BIAS;
+		}
+		for ( int i = 0; i < 3; ++i )
+		{
+			s.normal[i] = v[i]->normal;
+			s.texcoord[i] = v[i]->texcoord;
+		}
+		s.surface = surface;
+		return true;
+	}
+
+	// edge function k at a pixel center, exactly; positive inside
+	double edge( const Setup& s, int k, double px, double py )
+	{
+		int a = ( k + 1 ) % 3, b = ( k + 2 ) % 3;
+		return ( double( s.x[b] ) - s.x[a] ) * ( py - s.y[a] ) - ( double( s.y[b] ) - s.y[a] ) * ( px - s.x[a] );
+	}
+
+	glm::vec3 sampleAlbedo( const Surface& surface, const glm::vec2& texcoord )
+	{
+		if ( surface.texels == NULL )
+			return surface.albedo;
+		float u = texcoord.x - std::floor( texcoord.x ), v = texcoord.y - std::floor( texcoord.y );
+		unsigned int tx = std::min( static_cast<unsigned int>( u * surface.textureWidth ), surface.textureWidth - 1 );
+		unsigned int ty = std::min( static_cast<unsigned int>( ( 1.0f - v ) * surface.textureHeight ), surface.textureHeight - 1 );
+		const unsigned char * texel = surface.texels + ( static_cast<size_t>( ty ) * surface.textureWidth + tx ) * 4;
+		const float * linear = srgbTable().linear;
+		return surface.albedo * glm::vec3( linear[texel[0]], linear[texel[1]], linear[texel[2]] );
+	}
+
+	struct TilePlanes
+	{
+		float * p[GBuffer::PLANE_COUNT];
+
+		TilePlanes( GBuffer& gbuffer, size_t tile )
+		{
+			for ( int plane = 0; plane < GBuffer::PLANE_COUNT; ++plane )
+				p[plane] = gbuffer.tilePlane( tile, GBuffer::Plane( plane ) );
+		}
+	};
+
+	// the reference: one pixel at a time over the triangle's bounds within the tile
+	void rasterScalar( const Setup& s, const Surface& surface, const TilePlanes& planes, int tileX, int tileY,
+					   int x0, int y0, int x1, int y1 )
+	{
+		for ( int y = y0; y <= y1; ++y )
+		{
+			for ( int x = x0; x <= x1; ++x )
+			{
+				float e[3];
+				bool covered = true;
+				for ( int k = 0; k < 3; ++k )
+				{
+					double exact = edge( s, k, x + 0.5, y + 0.5 );
+					e[k] = static_cast<float>( exact );
+					covered = covered && exact >= s.bias[k];
+				}
+				if ( !covered )
+					continue;
+
+				float a0 = e[0] * s.invW[0], a1 = e[1] * s.invW[1], a2 = e[2] * s.invW[2];
+				float rcp = 1.0f / ( a0 + a1 + a2 ), depth = s.area * rcp;
+				size_t i = static_cast<size_t>( y - tileY ) * GBuffer::TILE_SIZE + ( x - tileX );
+				if ( !( depth < planes.p[GBuffer::DEPTH][i] ) )
+					continue;
+
+				float w0 = a0 * rcp, w1 = a1 * rcp, w2 = a2 * rcp;
+				glm::vec3 normal = s.normal[0] * w0 + s.normal[1] * w1 + s.normal[2] * w2;
+				float length = glm::length( normal );
+				normal = length > 0.0f ? normal / length : normal;
+				glm::vec3 albedo = sampleAlbedo( surface, s.texcoord[0] * w0 + s.texcoord[1] * w1 + s.texcoord[2] * w2 );
+
+				planes.p[GBuffer::DEPTH][i] = depth;
+				planes.p[GBuffer::NORMAL_X][i] = normal.x;
+				planes.p[GBuffer::NORMAL_Y][i] = normal.y;
+				planes.p[GBuffer::NORMAL_Z][i] = normal.z;
+				planes.p[GBuffer::ALBEDO_R][i] = albedo.x;
+				planes.p[GBuffer::ALBEDO_G][i] = albedo.y;
+				planes.p[GBuffer::ALBEDO_B][i] = albedo.z;
+				planes.p[GBuffer::SPECULAR][i] = surface.specular;
+				planes.p[GBuffer::SHININESS][i] = surface.shininess;
+			}
+		}
+	}
+
+#ifdef SCENE_SSE2
+	void blend( float * plane, __m128 pass, __m128 value )
+	{
+		__m128 old = _mm_loadu_ps( plane );
+		_mm_storeu_ps( plane, _mm_or_ps( _mm_and_ps( pass, value ), _mm_andnot_ps( pass, old ) ) );
+	}
+
+	__m128 interpolate( __m128 w0, __m128 w1, __m128 w2, float a0, float a1, float a2 )
+	{
+		return _mm_add_ps( _mm_add_ps( _mm_mul_ps( w0, _mm_set1_ps( a0 ) ), _mm_mul_ps( w1, _mm_set1_ps( a1 ) ) ),
+						   _mm_mul_ps( w2, _mm_set1_ps( a2 ) ) );
+	}
+
+	/*
+	 * Hierarchical coverage, then four pixels per step: each 8x8 block of the triangle's bounds is
+	 * first tested at the corners where each edge function is largest (all outside: skip the block)
+	 * and smallest (all inside: no per-pixel edge tests), then rows are walked four pixels at a time.
+	 * Float edge functions are exact while neither of their products passes 2^16 square pixels,
+	 * which holds when the vertices' box, grown by a block each way, is under that area; past it,
+	 * coverage is stepped in double from each row's start instead.
+	 * Bounds that fit in one block gain nothing from classifying it, and dense meshes are mostly
+	 * made of those, so they take the per-pixel path.
+	 */
+	void rasterSSE2( const Setup& s, const Surface& surface, const TilePlanes& planes, int tileX, int tileY,
+					 int x0, int y0, int x1, int y1 )
+	{
+		if ( x1 - x0 < static_cast<int>( BLOCK ) && y1 - y0 < static_cast<int>( BLOCK ) )
+		{
+			rasterScalar( s, surface, planes, tileX, tileY, x0, y0, x1, y1 );
+			return;
+		}
+
+		const __m128 lanes = _mm_set_ps( 3.5f, 2.5f, 1.5f, 0.5f );
+		const __m128d lanesLow = _mm_set_pd( 1.0, 0.0 ), lanesHigh = _mm_set_pd( 3.0, 2.0 );
+		float spanX = std::max( std::max( s.x[0], s.x[1] ), s.x[2] ) - std::min( std::min( s.x[0], s.x[1] ), s.x[2] ) + BLOCK;
+		float spanY = std::max( std::max( s.y[0], s.y[1] ), s.y[2] ) - std::min( std::min( s.y[0], s.y[1] ), s.y[2] ) + BLOCK;
+		bool exactFloat = spanX * spanY <= 65536.0f;
+		float stepX[3], stepY[3];
+		for ( int k = 0; k < 3; ++k )
+		{
+			int a = ( k + 1 ) % 3, b = ( k + 2 ) % 3;
+			stepX[k] = s.y[a] - s.y[b];
+			stepY[k] = s.x[b] - s.x[a];
+		}
+
+		int blockX0 = tileX + ( ( x0 - tileX ) / BLOCK ) * BLOCK, blockY0 = tileY + ( ( y0 - tileY ) / BLOCK ) * BLOCK;
+		for ( int by = blockY0; by <= y1; by += BLOCK )
+		{
+			for ( int bx = blockX0; bx <= x1; bx += BLOCK )
+			{
+				bool outside = false, inside = true;
+				for ( int k = 0; k < 3; ++k )
+				{
+					double highX = bx + ( stepX[k] > 0.0f ? BLOCK - 0.5 : 0.5 ), highY = by + ( stepY[k] > 0.0f ? BLOCK - 0.5 : 0.5 );
+					double lowX = bx + ( stepX[k] > 0.0f ? 0.5 : BLOCK - 0.5 ), lowY = by + ( stepY[k] > 0.0f ? 0.5 : BLOCK - 0.5 );
+					outside = outside || edge( s, k, highX, highY ) < s.bias[k];
+					inside = inside && edge( s, k, lowX, lowY ) >= s.bias[k];
+				}
+				if ( outside )
+					continue;
+
+				int rowStart = std::max( by, y0 ), rowEnd = std::min( by + static_cast<int>( BLOCK ) - 1, y1 );
+				for ( int y = rowStart; y <= rowEnd; ++y )
+				{
+					__m128 py = _mm_set1_ps( y + 0.5f );
+					double rowEdge[3];
+					for ( int k = 0; k < 3 && !inside && !exactFloat; ++k )
+						rowEdge[k] = edge( s, k, bx + 0.5, y + 0.5 );
+					for ( int x = bx; x < bx + static_cast<int>( BLOCK ); x += 4 )
+					{
+						if ( x > x1 || x + 3 < x0 )
+							continue;
+
+						// lanes outside the triangle's bounds (and so maybe off screen) are never written
+						__m128 px = _mm_add_ps( _mm_set1_ps( static_cast<float>( x ) ), lanes );
+						__m128 covered = _mm_and_ps( _mm_cmpge_ps( px, _mm_set1_ps( x0 + 0.5f ) ), _mm_cmple_ps( px, _mm_set1_ps( x1 + 0.5f ) ) );
+						__m128 e[3];
+						for ( int k = 0; k < 3; ++k )
+						{
+							int a = ( k + 1 ) % 3;
+							e[k] = _mm_sub_ps( _mm_mul_ps( _mm_set1_ps( stepY[k] ), _mm_sub_ps( py, _mm_set1_ps( s.y[a] ) ) ),
+											   _mm_mul_ps( _mm_set1_ps( -stepX[k] ), _mm_sub_ps( px, _mm_set1_ps( s.x[a] ) ) ) );
+							if ( inside )
+								continue;
+							if ( exactFloat )
+							{
+								covered = _mm_and_ps( covered, _mm_cmpge_ps( e[k], _mm_set1_ps( s.bias[k] ) ) );
+								continue;
+							}
+
+							// the low halves of the double masks are the four lanes' masks
+							__m128d start = _mm_set1_pd( rowEdge[k] + double( stepX[k] ) * ( x - bx ) ), step = _mm_set1_pd( stepX[k] );
+							__m128d bias = _mm_set1_pd( s.bias[k] );
+							__m128d low = _mm_cmpge_pd( _mm_add_pd( start, _mm_mul_pd( step, lanesLow ) ), bias );
+							__m128d high = _mm_cmpge_pd( _mm_add_pd( start, _mm_mul_pd( step, lanesHigh ) ), bias );
+							covered = _mm_and_ps( covered, _mm_shuffle_ps( _mm_castpd_ps( low ), _mm_castpd_ps( high ), _MM_SHUFFLE( 2, 0, 2, 0 ) ) );
+						}
+						if ( _mm_movemask_ps( covered ) == 0 )
+							continue;
+
+						__m128 a0 = _mm_mul_ps( e[0], _mm_set1_ps( s.invW[0] ) );
+						__m128 a1 = _mm_mul_ps( e[1], _mm_set1_ps( s.invW[1] ) );
+						__m128 a2 = _mm_mul_ps( e[2], _mm_set1_ps( s.invW[2] ) );
+						__m128 rcp = _mm_div_ps( _mm_set1_ps( 1.0f ), _mm_add_ps( _mm_add_ps( a0, a1 ), a2 ) );
+						__m128 depth = _mm_mul_ps( _mm_set1_ps( s.area ), rcp );
+
+						size_t i = static_cast<size_t>( y - tileY ) * GBuffer::TILE_SIZE + ( x - tileX );
+						__m128 pass = _mm_and_ps( covered, _mm_cmplt_ps( depth, _mm_loadu_ps( planes.p[GBuffer::DEPTH] + i ) ) );
+						int passMask = _mm_movemask_ps( pass );
+						if ( passMask == 0 )
+							continue;
+
+						__m128 w0 = _mm_mul_ps( a0, rcp ), w1 = _mm_mul_ps( a1, rcp ), w2 = _mm_mul_ps( a2, rcp );
+						__m128 nx = interpolate( w0, w1, w2, s.normal[0].x, s.normal[1].x, s.normal[2].x );
+						__m128 ny = interpolate( w0, w1, w2, s.normal[0].y, s.normal[1].y, s.normal[2].y );
+						__m128 nz = interpolate( w0, w1, w2, s.normal[0].z, s.normal[1].z, s.normal[2].z );
+						__m128 length = _mm_sqrt_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( nx, nx ), _mm_mul_ps( ny, ny ) ), _mm_mul_ps( nz, nz ) ) );
+						__m128 scale = _mm_div_ps( _mm_set1_ps( 1.0f ), _mm_max_ps( length, _mm_set1_ps( 1.0e-20f ) ) );
+
+						__m128 red = _mm_set1_ps( surface.albedo.x ), green = _mm_set1_ps( surface.albedo.y ), blue = _mm_set1_ps( surface.albedo.z );
+						if ( surface.texels != NULL )
+						{
+							float u[4], v[4], albedo[3][4];
+							_mm_storeu_ps( u, interpolate( w0, w1, w2, s.texcoord[0].x, s.texcoord[1].x, s.texcoord[2].x ) );
+							_mm_storeu_ps( v, interpolate( w0, w1, w2, s.texcoord[0].y, s.texcoord[1].y, s.texcoord[2].y ) );
+							for ( int j = 0; j < 4; ++j )
+							{
+								glm::vec3 sample = ( passMask & ( 1 << j ) ) ? sampleAlbedo( surface, glm::vec2( u[j], v[j] ) ) : glm::vec3( 0.0f );
+								albedo[0][j] = sample.x;
+								albedo[1][j] = sample.y;
+								albedo[2][j] = sample.z;
+							}
+							red = _mm_loadu_ps( albedo[0] );
+							green = _mm_loadu_ps( albedo[1] );
+							blue = _mm_loadu_ps( albedo[2] );
+						}
+
+						blend( planes.p[GBuffer::DEPTH] + i, pass, depth );
+						blend( planes.p[GBuffer::NORMAL_X] + i, pass, _mm_mul_ps( nx, scale ) );
+						blend( planes.p[GBuffer::NORMAL_Y] + i, pass, _mm_mul_ps( ny, scale ) );
+						blend( planes.p[GBuffer::NORMAL_Z] + i, pass, _mm_mul_ps( nz, scale ) );
+						blend( planes.p[GBuffer::ALBEDO_R] + i, pass, red );
+						blend( planes.p[GBuffer::ALBEDO_G] + i, pass, green );
+						blend( planes.p[GBuffer::ALBEDO_B] + i, pass, blue );
+						blend( planes.p[GBuffer::SPECULAR] + i, pass, _mm_set1_ps( surface.specular ) );
+						blend( planes.p[GBuffer::SHININESS] + i, pass, _mm_set1_ps( surface.shininess ) );
+					}
+				}
+			}
+		}
+	}
+#endif
+}
+
+SoftwareRasterizer::SoftwareRasterizer()
+{
+}
+
+SoftwareRasterizer::~SoftwareRasterizer()
+{
+}
+
+SoftwareRasterizer::Kernel SoftwareRasterizer::selectKernel( Kernel requested )
+{
+#ifdef SCENE_SSE2
+	if ( requested != SCALAR )
+		return SSE2;
+#endif
+	return SCALAR;
+}
+
+bool SoftwareRasterizer::prepare( const Scene& scene )
+{
+	meshes.clear();
+	const std::unordered_map<std::string, ObjModel>& models = scene.getObjModels();
+	for ( std::unordered_map<std::string, ObjModel>::const_iterator it = models.begin(); it != models.end(); ++it )
+	{
+		if ( !meshes[&it->second].build( it->second ) )
+		{
+			sf::err() << "Error building a mesh for model: " << it->first << std::endl;
+			return false;
+		}
+	}
+
+	const ResourceRegistry& resources = scene.getResources();
+	const std::vector<ResourceRegistry::Material>& materials = resources.getMaterials();
+	surfaces.resize( materials.size() + 1 );
+	for ( size_t m = 0; m < materials.size(); ++m )
+	{
+		const ResourceRegistry::Material& material = materials[m];
+		Surface& surface = surfaces[m];
+		surface.albedo = material.Kd;
+		surface.specular = ( material.Ks.x + material.Ks.y + material.Ks.z ) / 3.0f;
+		surface.shininess = material.Ns;
+		surface.texels = NULL;
+		surface.textureWidth = surface.textureHeight = 0;
+		if ( material.map_Kd >= 0 && material.map_Kd < static_cast<int>( resources.getTextures().size() ) )
+		{
+			const ResourceRegistry::Texture& texture = resources.getTextures()[material.map_Kd];
+			if ( texture.basePixels() != NULL )
+			{
+				surface.texels = texture.basePixels();
+				surface.textureWidth = texture.baseWidth();
+				surface.textureHeight = texture.baseHeight();
+			}
+		}
+	}
+
+	// triangles with no material
+	Surface& fallback = surfaces.back();
+	fallback.albedo = glm::vec3( 0.8f, 0.8f, 0.8f );
+	fallback.specular = 0.0f;
+	fallback.shininess = 1.0f;
+	fallback.texels = NULL;
+	fallback.textureWidth = fallback.textureHeight = 0;
+	return true;
+}
+
+void SoftwareRasterizer::resize( unsigned int width, unsigned int height )
+{
+	gbuffer.resize( width, height );
+}
+
+void SoftwareRasterizer::render( const Camera& camera, const Scene& scene, const Options& options )
+{
+	sf::Clock clock, total;
+	stats = FrameStats();
+	unsigned int width = gbuffer.getWidth(), height = gbuffer.getHeight();
+	gbuffer.view = camera.getViewMatrix();
+	gbuffer.projection = camera.getProjectionMatrix();
+	if ( width == 0 || height == 0 )
+		return;
+
+	// instances in view, in scene order so frames are repeatable
+	const std::vector<Scene::StaticModel>& models = scene.getModels();
+	glm::vec4 frustum[6];
+	camera.getFrustumPlanes( frustum );
+	visible.clear();
+	if ( scene.getBVH().size() == models.size() )
+	{
+		scene.getBVH().queryFrustum( frustum, visible );
+		std::sort( visible.begin(), visible.end() );
+	}
+	else
+	{
+		for ( size_t i = 0; i < models.size(); ++i )
+			visible.push_back( i );
+	}
+
+	// lay the visible instances' vertices and submeshes out end to end
+	ranges.clear();
+	std::vector<size_t> vertexStarts( visible.size() + 1, 0 );
+	size_t triangles = 0;
+	for ( size_t v = 0; v < visible.size(); ++v )
+	{
+		vertexStarts[v + 1] = vertexStarts[v];
+		std::unordered_map<const ObjModel *, Mesh>::const_iterator found = meshes.find( models[visible[v]].model );
+		if ( found == meshes.end() )
+			continue;
+		const Mesh& mesh = found->second;
+		for ( size_t m = 0; m < mesh.submeshes.size(); ++m )
+		{
+			const Mesh::SubMesh& submesh = mesh.submeshes[m];
+			DrawRange range;
+			range.mesh = &mesh;
+			range.submesh = &submesh;
+			range.firstVertex = vertexStarts[v] + submesh.vertexOffset;
+			range.firstTriangle = triangles;
+			range.surface = submesh.materialID >= 0 && submesh.materialID + 1 < static_cast<int>( surfaces.size() ) ?
+							submesh.materialID : static_cast<int>( surfaces.size() ) - 1;
+			ranges.push_back( range );
+			triangles += submesh.indexCount / 3;
+		}
+		vertexStarts[v + 1] += mesh.vertices.size();
+	}
+	stats.visibleInstances = visible.size();
+	stats.triangles = triangles;
+
+	// transform: clip space positions and view space normals, instance by instance
+	glm::mat4 viewProjection = gbuffer.projection * gbuffer.view;
+	glm::mat3 viewRotation( gbuffer.view );
+	clipVertices.resize( vertexStarts.back() );
+	const TransformTable& transforms = scene.getTransforms();
+	ThreadPool::shared().parallelFor( visible.size(), [&]( size_t begin, size_t end )
+	{
+		for ( size_t v = begin; v < end; ++v )
+		{
+			const Scene::StaticModel& model = models[visible[v]];
+			std::unordered_map<const ObjModel *, Mesh>::const_iterator found = meshes.find( model.model );
+			if ( found == meshes.end() )
+				continue;
+			glm::mat4 toClip = viewProjection * transforms.getWorldMatrix( model.transform );
+			glm::mat3 toView = viewRotation * glm::mat3( transforms.getNormalMatrix( model.transform ) );
+			const std::vector<Mesh::Vertex>& vertices = found->second.vertices;
+			ClipVertex * out = clipVertices.empty() ? NULL : &clipVertices[vertexStarts[v]];
+			for ( size_t i = 0; i < vertices.size(); ++i )
+			{
+				out[i].position = toClip * glm::vec4( vertices[i].position, 1.0f );
+				out[i].normal = toView * vertices[i].normal;
+				out[i].texcoord = vertices[i].texcoord;
+			}
+		}
+	}, 1 );
+	stats.transformSeconds = clock.restart().asSeconds();
+
+	// bin: clip, set up and list each triangle in the tiles its bounds touch
+	size_t tileCount = gbuffer.getTileCount();
+	size_t chunkCount = ( triangles + CHUNK_TRIANGLES - 1 ) / CHUNK_TRIANGLES;
+	if ( chunks.size() < chunkCount )
+		chunks.resize( chunkCount );
+
+	// the guard band, as clip-space planes beside the near plane; anything inside skips clipping
+	float bandX = 1.0f + GUARD_BAND * 2.0f / width, bandY = 1.0f + GUARD_BAND * 2.0f / height;
+	const glm::vec4 clipPlanes[5] = { glm::vec4( 0.0f, 0.0f, 1.0f, 1.0f ), glm::vec4( -1.0f, 0.0f, 0.0f, bandX ), glm::vec4( 1.0f, 0.0f, 0.0f, bandX ),
+									  glm::vec4( 0.0f, -1.0f, 0.0f, bandY ), glm::vec4( 0.0f, 1.0f, 0.0f, bandY ) };
+	const glm::vec4 viewPlanes[6] = { glm::vec4( 1.0f, 0.0f, 0.0f, 1.0f ), glm::vec4( -1.0f, 0.0f, 0.0f, 1.0f ), glm::vec4( 0.0f, 1.0f, 0.0f, 1.0f ),
+									  glm::vec4( 0.0f, -1.0f, 0.0f, 1.0f ), glm::vec4( 0.0f, 0.0f, 1.0f, 1.0f ), glm::vec4( 0.0f, 0.0f, -1.0f, 1.0f ) };
+	unsigned int tilesX = gbuffer.getTilesX();
+	ThreadPool::shared().parallelFor( chunkCount, [&]( size_t first, size_t last )
+	{
+		for ( size_t c = first; c < last; ++c )
+		{
+			Chunk& chunk = chunks[c];
+			chunk.setups.clear();
+			chunk.entries.clear();
+			chunk.tileCounts.assign( tileCount, 0 );
+
+			size_t begin = c * CHUNK_TRIANGLES, end = std::min( triangles, begin + CHUNK_TRIANGLES );
+			size_t r = std::upper_bound( ranges.begin(), ranges.end(), begin, startsAfter ) - ranges.begin() - 1;
+			ClipVertex polygon[2][9];
+			for ( size_t t = begin; t < end; ++t )
+			{
+				while ( t >= ranges[r].firstTriangle + ranges[r].submesh->indexCount / 3 )
+					++r;
+				const DrawRange& range = ranges[r];
+				size_t local = ( t - range.firstTriangle ) * 3;
+				const ClipVertex * corners[3];
+				for ( int corner = 0; corner < 3; ++corner )
+					corners[corner] = &clipVertices[range.firstVertex + range.mesh->index( *range.submesh, local + corner )];
+
+				// wholly outside one side of the view volume
+				bool rejected = false;
+				for ( int p = 0; p < 6 && !rejected; ++p )
+				{
+					rejected = glm::dot( viewPlanes[p], corners[0]->position ) < 0.0f && glm::dot( viewPlanes[p], corners[1]->position ) < 0.0f &&
+							   glm::dot( viewPlanes[p], corners[2]->position ) < 0.0f;
+				}
+				if ( rejected )
+					continue;
+
+				// most triangles need no clipping, and are set up straight from the transformed vertices
+				bool crosses = false;
+				for ( int p = 0; p < 5 && !crosses; ++p )
+				{
+					for ( int corner = 0; corner < 3; ++corner )
+						crosses = crosses || glm::dot( clipPlanes[p], corners[corner]->position ) < 0.0f;
+				}
+				int count = 3, current = 0;
+				if ( crosses )
+				{
+					for ( int corner = 0; corner < 3; ++corner )
+						polygon[0][corner] = *corners[corner];
+					for ( int p = 0; p < 5 && count >= 3; ++p )
+					{
+						bool clipped = false;
+						for ( int corner = 0; corner < count; ++corner )
+							clipped = clipped || glm::dot( clipPlanes[p], polygon[current][corner].position ) < 0.0f;
+						if ( clipped )
+						{
+							count = clipPolygon( polygon[current], count, clipPlanes[p], polygon[1 - current] );
+							current = 1 - current;
+						}
+					}
+				}
+
+				for ( int fan = 1; fan + 1 < count; ++fan )
+				{
+					Setup setup;
+					const ClipVertex& v0 = crosses ? polygon[current][0] : *corners[0];
+					const ClipVertex& v1 = crosses ? polygon[current][fan] : *corners[1];
+					const ClipVertex& v2 = crosses ? polygon[current][fan + 1] : *corners[2];
+					if ( !setupTriangle( v0, v1, v2, width, height, options.cullBackfaces, range.surface, setup ) )
+						continue;
+
+					unsigned int index = static_cast<unsigned int>( chunk.setups.size() );
+					chunk.setups.push_back( setup );
+					for ( int ty = setup.minY / GBuffer::TILE_SIZE; ty <= setup.maxY / static_cast<int>( GBuffer::TILE_SIZE ); ++ty )
+					{
+						for ( int tx = setup.minX / GBuffer::TILE_SIZE; tx <= setup.maxX / static_cast<int>( GBuffer::TILE_SIZE ); ++tx )
+						{
+							unsigned int tile = ty * tilesX + tx;
+							chunk.entries.push_back( tile );
+							chunk.entries.push_back( index );
+							chunk.tileCounts[tile] += 1;
+						}
+					}
+				}
+			}
+		}
+	}, 1 );
+
+	// merge the chunks' lists: each chunk's count per tile becomes where it writes in that tile
+	tileStarts.assign( tileCount + 1, 0 );
+	unsigned int entries = 0;
+	for ( size_t tile = 0; tile < tileCount; ++tile )
+	{
+		tileStarts[tile] = entries;
+		for ( size_t c = 0; c < chunkCount; ++c )
+		{
+			unsigned int count = chunks[c].tileCounts[tile];
+			chunks[c].tileCounts[tile] = entries;
+			entries += count;
+		}
+	}
+	tileStarts[tileCount] = entries;
+	tileEntries.resize( entries );
+	ThreadPool::shared().parallelFor( chunkCount, [&]( size_t first, size_t last )
+	{
+		for ( size_t c = first; c < last; ++c )
+		{
+			Chunk& chunk = chunks[c];
+			for ( size_t e = 0; e < chunk.entries.size(); e += 2 )
+				tileEntries[chunk.tileCounts[chunk.entries[e]]++] = static_cast<unsigned int>( c << 16 ) | chunk.entries[e + 1];
+		}
+	}, 1 );
+	for ( size_t c = 0; c < chunkCount; ++c )
+		stats.setups += chunks[c].setups.size();
+	stats.tileEntries = entries;
+	stats.binSeconds = clock.restart().asSeconds();
+
+	// raster: one tile per task, in its own block of the G-buffer
+	Kernel kernel = selectKernel( options.kernel );
+	ThreadPool::shared().parallelFor( tileCount, [&]( size_t first, size_t last )
+	{
+		for ( size_t tile = first; tile < last; ++tile )
+		{
+			gbuffer.clearTile( tile );
+			TilePlanes planes( gbuffer, tile );
+			int tileX = static_cast<int>( tile % tilesX ) * GBuffer::TILE_SIZE, tileY = static_cast<int>( tile / tilesX ) * GBuffer::TILE_SIZE;
+			for ( unsigned int e = tileStarts[tile]; e < tileStarts[tile + 1]; ++e )
+			{
+				const Setup& s = chunks[tileEntries[e] >> 16].setups[tileEntries[e] & 0xFFFF];
+				int x0 = std::max( s.minX, tileX ), y0 = std::max( s.minY, tileY );
+				int x1 = std::min( s.maxX, tileX + static_cast<int>( GBuffer::TILE_SIZE ) - 1 );
+				int y1 = std::min( s.maxY, tileY + static_cast<int>( GBuffer::TILE_SIZE ) - 1 );
+#ifdef SCENE_SSE2
+				if ( kernel == SSE2 )
+				{
+					rasterSSE2( s, surfaces[s.surface], planes, tileX, tileY, x0, y0, x1, y1 );
+					continue;
+				}
+#endif
+				rasterScalar( s, surfaces[s.surface], planes, tileX, tileY, x0, y0, x1, y1 );
+			}
+		}
+	}, 1 );
+	stats.rasterSeconds = clock.restart().asSeconds();
+	stats.seconds = total.getElapsedTime().asSeconds();
+}
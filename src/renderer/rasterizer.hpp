@@ -0,0 +1,154 @@
+#ifndef _RASTERIZER_H_
+#define _RASTERIZER_H_
+
+#include <renderer/camera.hpp>
+#include <renderer/gbuffer.hpp>
+#include <scene/scene.hpp>
+#include <scene/mesh.hpp>
+#include <glm/glm.hpp>
+#include <unordered_map>
+#include <vector>
+#include <cstddef>
+
+/*
+ * A multi-threaded software rasterizer that fills a GBuffer from a Scene, so the deferred path
+ * runs (and can be timed) on machines with no GPU.
+ *
+ * A frame goes through three stages, each split across the shared ThreadPool:
+ *   transform - the instances in the view frustum (found through the scene's BVH) have their
+ *               welded meshes transformed to clip space, normals to view space
+ *   bin       - triangles are clipped to the near plane and a guard band, back faces are dropped,
+ *               vertices are snapped to 1/16 pixel, and each triangle is listed in every screen
+ *               tile its bounds touch; chunks of triangles bin independently, and a counting sort
+ *               merges them into one list per tile, in submission order
+ *   raster    - each tile is drawn by one worker, straight into its tile-local block of the
+ *               GBuffer: 8x8 blocks are rejected or accepted whole against the three edge
+ *               functions, and partly covered blocks are tested four pixels at a time with SSE2
+ *               half-space tests, then depth tested and shaded with perspective-correct attributes;
+ *               triangles whose bounds fit in one block are tested pixel by pixel instead
+ * Coverage is decided on exact edge functions anywhere in the guard band, and ties on shared
+ * edges go to exactly one of the two triangles, so closed meshes have no cracks or double-drawn
+ * pixels.
+ *
+ * Albedo is the material's Kd, times its diffuse texture (nearest texel, decoded from sRGB) when
+ * the texture's pixels are in memory. Specular is the mean of Ks, and the exponent is Ns.
+ */
+class SoftwareRasterizer
+{
+public:
+	enum Kernel { AUTO, SCALAR, SSE2 };
+
+	struct Options
+	{
+		bool cullBackfaces;
+		Kernel kernel;
+
+		Options() : cullBackfaces( true ), kernel( AUTO )
+		{
+		}
+	};
+
+	struct FrameStats
+	{
+		size_t visibleInstances;
+		size_t triangles;     // submitted by the visible instances
+		size_t setups;        // left after clipping and culling
+		size_t tileEntries;   // setups summed over the tiles they were binned to
+		float transformSeconds;
+		float binSeconds;
+		float rasterSeconds;
+		float seconds;
+
+		FrameStats() : visibleInstances( 0 ), triangles( 0 ), setups( 0 ), tileEntries( 0 ),
+					   transformSeconds( 0.0f ), binSeconds( 0.0f ), rasterSeconds( 0.0f ), seconds( 0.0f )
+		{
+		}
+	};
+
+	SoftwareRasterizer();
+	~SoftwareRasterizer();
+
+	// welds every model in the scene into a Mesh and reads its materials; call again if they change
+	bool prepare( const Scene& scene );
+
+	void resize( unsigned int width, unsigned int height );
+
+	// draws the scene's instances, as they are in its TransformTable, into the G-buffer
+	void render( const Camera& camera, const Scene& scene, const Options& options = Options() );
+
+	const GBuffer& getGBuffer() const { return gbuffer; }
+	const FrameStats& getFrameStats() const { return stats; }
+
+	// the kernel AUTO (or an unsupported request) resolves to on this machine
+	static Kernel selectKernel( Kernel requested );
+
+	// what a material writes to the G-buffer
+	struct Surface
+	{
+		glm::vec3 albedo;
+		float specular;
+		float shininess;
+		const unsigned char * texels; // RGBA8 diffuse texture, or NULL
+		unsigned int textureWidth, textureHeight;
+	};
+
+	// a vertex after the transform stage
+	struct ClipVertex
+	{
+		glm::vec4 position; // clip space
+		glm::vec3 normal;   // view space
+		glm::vec2 texcoord;
+	};
+
+	// a clipped, snapped screen-space triangle, wound so its area is positive
+	struct Setup
+	{
+		float x[3], y[3];
+		float invW[3];
+		glm::vec3 normal[3];
+		glm::vec2 texcoord[3];
+		float area;      // twice the signed area
+		float bias[3];   // subtracted from each edge function, so ties go to one side only
+		int surface;
+		int minX, minY, maxX, maxY; // covered pixels, inclusive, on screen
+	};
+
+	// one chunk of triangles in the bin stage
+	struct Chunk
+	{
+		std::vector<Setup> setups;
+		std::vector<unsigned int> entries; // pairs of (tile, setup)
+		std::vector<unsigned int> tileCounts;
+	};
+
+private:
+	SoftwareRasterizer( const SoftwareRasterizer& );
+	SoftwareRasterizer& operator=( const SoftwareRasterizer& );
+
+	// a submesh of a visible instance, in triangle order across the frame
+	struct DrawRange
+	{
+		const Mesh * mesh;
+		const Mesh::SubMesh * submesh;
+		size_t firstVertex;   // of the instance, in clipVertices
+		size_t firstTriangle; // counted across the frame
+		int surface;
+	};
+
+	static bool startsAfter( size_t triangle, const DrawRange& range ) { return triangle < range.firstTriangle; }
+
+	std::unordered_map<const ObjModel *, Mesh> meshes;
+	std::vector<Surface> surfaces; // by material handle, plus a default one at the end
+	GBuffer gbuffer;
+	FrameStats stats;
+
+	// per-frame working memory, kept to avoid reallocating
+	std::vector<size_t> visible;
+	std::vector<ClipVertex> clipVertices;
+	std::vector<DrawRange> ranges;
+	std::vector<Chunk> chunks;
+	std::vector<unsigned int> tileStarts;
+	std::vector<unsigned int> tileEntries;
+};
+
+#endif // _RASTERIZER_H_
@@ -0,0 +1,218 @@
+#include "compactmesh.hpp"
+#include "threadpool.hpp"
+#include <SFML/System/Clock.hpp>
+#include <glm/gtc/packing.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+	typedef ObjModel::Triangle Triangle;
+
+	bool hasTexcoords( Triangle::VertexType type )
+	{
+		return type == Triangle::POSITION_TEXCOORD || type == Triangle::POSITION_TEXCOORD_NORMAL;
+	}
+
+	bool hasNormals( Triangle::VertexType type )
+	{
+		return type == Triangle::POSITION_NORMAL || type == Triangle::POSITION_TEXCOORD_NORMAL;
+	}
+
+	// the square of the unit disc folded onto the octahedron's upper half
+	glm::vec2 octWrap( const glm::vec2& v )
+	{
+		return glm::vec2( ( 1.0f - std::fabs( v.y ) ) * ( v.x >= 0.0f ? 1.0f : -1.0f ),
+						  ( 1.0f - std::fabs( v.x ) ) * ( v.y >= 0.0f ? 1.0f : -1.0f ) );
+	}
+
+	// worst errors seen in one submesh
+	struct SubMeshError
+	{
+		float position;
+		float normal; // smallest cosine
+		float texcoord;
+	};
+}
+
+unsigned int CompactMesh::encodeNormal( const glm::vec3& normal )
+{
+	float sum = std::fabs( normal.x ) + std::fabs( normal.y ) + std::fabs( normal.z );
+	if ( sum == 0.0f )
+		return glm::packSnorm2x16( glm::vec2( 0.0f ) );
+
+	glm::vec2 p = glm::vec2( normal.x, normal.y ) / sum;
+	if ( normal.z < 0.0f )
+		p = octWrap( p );
+
+	// rounding each component on its own isn't always the closest code; try the four around p
+	glm::vec3 unit = glm::normalize( normal );
+	glm::vec2 base = glm::floor( glm::clamp( p, -1.0f, 1.0f ) * 32767.0f );
+	unsigned int best = 0;
+	float bestCos = -2.0f;
+	for ( int i = 0; i < 4; ++i )
+	{
+		glm::vec2 candidate = ( base + glm::vec2( float( i & 1 ), float( i >> 1 ) ) ) / 32767.0f;
+		unsigned int code = glm::packSnorm2x16( candidate );
+		float c = glm::dot( decodeNormal( code ), unit );
+		if ( c > bestCos )
+		{
+			bestCos = c;
+			best = code;
+		}
+	}
+	return best;
+}
+
+glm::vec3 CompactMesh::decodeNormal( unsigned int code )
+{
+	glm::vec2 p = glm::unpackSnorm2x16( code );
+	glm::vec3 n( p.x, p.y, 1.0f - std::fabs( p.x ) - std::fabs( p.y ) );
+	if ( n.z < 0.0f )
+	{
+		glm::vec2 folded = octWrap( p );
+		n.x = folded.x;
+		n.y = folded.y;
+	}
+	float length = glm::length( n );
+	return length > 0.0f ? n / length : n;
+}
+
+void CompactMesh::clear()
+{
+	positions.clear();
+	normals.clear();
+	texcoords.clear();
+	indices16.clear();
+	indices32.clear();
+	submeshes.clear();
+	stats = BuildStats();
+}
+
+void CompactMesh::build( const Mesh& mesh )
+{
+	clear();
+	sf::Clock clock;
+
+	// one bounding box per group, so a position shared by two of its submeshes lands on the same code
+	int groupCount = 0;
+	for ( size_t s = 0; s < mesh.submeshes.size(); ++s )
+		groupCount = std::max( groupCount, mesh.submeshes[s].group + 1 );
+	std::vector<glm::vec3> groupMin( groupCount, glm::vec3( std::numeric_limits<float>::max() ) ),
+							   groupMax( groupCount, glm::vec3( -std::numeric_limits<float>::max() ) );
+	for ( size_t s = 0; s < mesh.submeshes.size(); ++s )
+	{
+		const Mesh::SubMesh& source = mesh.submeshes[s];
+		for ( size_t v = 0; v < source.vertexCount; ++v )
+		{
+			const glm::vec3& p = mesh.vertices[source.vertexOffset + v].position;
+			groupMin[source.group] = glm::min( groupMin[source.group], p );
+			groupMax[source.group] = glm::max( groupMax[source.group], p );
+		}
+	}
+
+	// lay out the streams; only submeshes with an attribute get room for it
+	size_t normalTotal = 0, texcoordTotal = 0;
+	for ( size_t s = 0; s < mesh.submeshes.size(); ++s )
+	{
+		const Mesh::SubMesh& source = mesh.submeshes[s];
+		SubMesh submesh;
+		submesh.group = source.group;
+		submesh.materialID = source.materialID;
+		submesh.vertexType = source.vertexType;
+		submesh.boundsMin = groupMin[source.group];
+		submesh.scale = ( groupMax[source.group] - groupMin[source.group] ) / 65535.0f;
+		submesh.vertexOffset = source.vertexOffset;
+		submesh.vertexCount = source.vertexCount;
+		submesh.normalOffset = normalTotal;
+		submesh.texcoordOffset = texcoordTotal;
+		submesh.indexOffset = source.indexOffset;
+		submesh.indexCount = source.indexCount;
+		submesh.indexSize = source.indexSize;
+		submeshes.push_back( submesh );
+
+		if ( hasNormals( source.vertexType ) )
+			normalTotal += source.vertexCount;
+		if ( hasTexcoords( source.vertexType ) )
+			texcoordTotal += source.vertexCount;
+
+		// half a step, plus what float rounding of the decode can add at the box's magnitude
+		glm::vec3 magnitude = glm::max( glm::abs( groupMin[source.group] ), glm::abs( groupMax[source.group] ) );
+		glm::vec3 bound = 0.5f * submesh.scale + 4.0f * std::numeric_limits<float>::epsilon() * magnitude;
+		stats.positionBound = std::max( stats.positionBound, std::max( bound.x, std::max( bound.y, bound.z ) ) );
+	}
+
+	positions.resize( mesh.vertices.size() * 3 );
+	normals.resize( normalTotal );
+	texcoords.resize( texcoordTotal );
+	indices16 = mesh.indices16;
+	indices32 = mesh.indices32;
+
+	std::vector<SubMeshError> errors( submeshes.size() );
+	ThreadPool::shared().parallelFor( submeshes.size(), [&]( size_t begin, size_t end )
+	{
+		for ( size_t s = begin; s < end; ++s )
+		{
+			const SubMesh& submesh = submeshes[s];
+			SubMeshError& error = errors[s];
+			error.position = 0.0f;
+			error.normal = 1.0f;
+			error.texcoord = 0.0f;
+
+			glm::vec3 extent = submesh.scale * 65535.0f;
+			for ( size_t v = 0; v < submesh.vertexCount; ++v )
+			{
+				const Mesh::Vertex& source = mesh.vertices[submesh.vertexOffset + v];
+				unsigned short * q = &positions[( submesh.vertexOffset + v ) * 3];
+				for ( int c = 0; c < 3; ++c )
+					q[c] = extent[c] > 0.0f ? glm::packUnorm1x16( ( source.position[c] - submesh.boundsMin[c] ) / extent[c] ) : 0;
+
+				if ( hasNormals( submesh.vertexType ) )
+					normals[submesh.normalOffset + v] = encodeNormal( source.normal );
+				if ( hasTexcoords( submesh.vertexType ) )
+					texcoords[submesh.texcoordOffset + v] = glm::packHalf2x16( source.texcoord );
+
+				Mesh::Vertex decoded = vertex( submesh, v );
+				glm::vec3 dp = glm::abs( decoded.position - source.position );
+				error.position = std::max( error.position, std::max( dp.x, std::max( dp.y, dp.z ) ) );
+				if ( hasNormals( submesh.vertexType ) && glm::length( source.normal ) > 0.0f )
+					error.normal = std::min( error.normal, glm::dot( decoded.normal, glm::normalize( source.normal ) ) );
+				if ( hasTexcoords( submesh.vertexType ) )
+				{
+					glm::vec2 dt = glm::abs( decoded.texcoord - source.texcoord );
+					error.texcoord = std::max( error.texcoord, std::max( dt.x, dt.y ) );
+				}
+			}
+		}
+	} );
+
+	float normalCos = 1.0f;
+	for ( size_t s = 0; s < errors.size(); ++s )
+	{
+		stats.positionError = std::max( stats.positionError, errors[s].position );
+		stats.texcoordError = std::max( stats.texcoordError, errors[s].texcoord );
+		normalCos = std::min( normalCos, errors[s].normal );
+	}
+	stats.normalError = glm::degrees( std::acos( glm::clamp( normalCos, -1.0f, 1.0f ) ) );
+	stats.sourceBytes = mesh.vertices.size() * sizeof( Mesh::Vertex ) + mesh.indices16.size() * 2 + mesh.indices32.size() * 4;
+	stats.bytes = byteSize();
+	stats.seconds = clock.getElapsedTime().asSeconds();
+}
+
+Mesh::Vertex CompactMesh::vertex( const SubMesh& submesh, size_t i ) const
+{
+	Mesh::Vertex v;
+	const unsigned short * q = &positions[( submesh.vertexOffset + i ) * 3];
+	v.position = submesh.boundsMin + glm::vec3( q[0], q[1], q[2] ) * submesh.scale;
+	v.normal = hasNormals( submesh.vertexType ) ? decodeNormal( normals[submesh.normalOffset + i] ) : glm::vec3( 0.0f );
+	v.texcoord = hasTexcoords( submesh.vertexType ) ? glm::unpackHalf2x16( texcoords[submesh.texcoordOffset + i] ) : glm::vec2( 0.0f );
+	return v;
+}
+
+size_t CompactMesh::byteSize() const
+{
+	return positions.size() * sizeof( unsigned short ) + normals.size() * sizeof( unsigned int ) +
+		   texcoords.size() * sizeof( unsigned int ) + indices16.size() * sizeof( unsigned short ) +
+		   indices32.size() * sizeof( unsigned int ) + submeshes.size() * sizeof( SubMesh );
+}
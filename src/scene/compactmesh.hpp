@@ -0,0 +1,97 @@
+#ifndef _COMPACTMESH_H_
+#define _COMPACTMESH_H_
+
+#include <scene/mesh.hpp>
+#include <vector>
+#include <cstddef>
+#include <glm/glm.hpp>
+
+/*
+ * A quantized copy of a Mesh, for keeping large scenes in memory.
+ *
+ * Attributes are stored in separate streams, and only for the submeshes whose vertex type has them:
+ *   positions - three 16-bit unsigned integers per vertex, relative to the bounding box of the
+ *               submesh's group, so submeshes of one group quantize shared positions identically
+ *   normals   - octahedral encoding in two 16-bit snorms (packSnorm2x16)
+ *   texcoords - two half floats (packHalf2x16)
+ * A fully attributed vertex takes 14 bytes instead of Mesh::Vertex's 32. Indexes are kept as they
+ * are in the Mesh, so submeshes still draw with 16-bit indexes where they can.
+ *
+ * Since the format is fixed per submesh, decoding never looks at a per-triangle vertex type.
+ */
+class CompactMesh
+{
+public:
+	struct SubMesh
+	{
+		int group;
+		int materialID;
+		ObjModel::Triangle::VertexType vertexType;
+
+		// position = boundsMin + quantized * scale
+		glm::vec3 boundsMin;
+		glm::vec3 scale;
+
+		size_t vertexOffset; // into positions (three values per vertex)
+		size_t vertexCount;
+		size_t normalOffset;   // into normals, if the vertex type has them
+		size_t texcoordOffset; // into texcoords, if the vertex type has them
+
+		size_t indexOffset;
+		size_t indexCount;
+		unsigned int indexSize;
+	};
+
+	// what the quantization cost, measured against the source Mesh
+	struct BuildStats
+	{
+		size_t sourceBytes;  // the Mesh's vertices and indexes
+		size_t bytes;        // this mesh's streams and indexes
+		float positionBound; // largest possible position error: half a quantization step, plus float rounding
+		float positionError; // largest error actually seen, per component
+		float normalError;   // largest angle between a source and decoded normal, in degrees
+		float texcoordError; // largest texcoord error, per component
+		float seconds;
+
+		BuildStats() : sourceBytes( 0 ), bytes( 0 ), positionBound( 0.0f ), positionError( 0.0f ),
+					   normalError( 0.0f ), texcoordError( 0.0f ), seconds( 0.0f )
+		{
+		}
+
+		float compressionRatio() const { return bytes > 0 ? float( sourceBytes ) / float( bytes ) : 0.0f; }
+	};
+
+	std::vector<unsigned short> positions;
+	std::vector<unsigned int> normals;
+	std::vector<unsigned int> texcoords;
+	std::vector<unsigned short> indices16;
+	std::vector<unsigned int> indices32;
+	std::vector<SubMesh> submeshes;
+
+	// quantizes every submesh of mesh, in parallel
+	void build( const Mesh& mesh );
+
+	void clear();
+
+	// expands the i'th vertex of a submesh; attributes its vertex type doesn't have are zero
+	Mesh::Vertex vertex( const SubMesh& submesh, size_t i ) const;
+
+	// the i'th index of a submesh, relative to its first vertex
+	unsigned int index( const SubMesh& submesh, size_t i ) const
+	{
+		return submesh.indexSize == 2 ? indices16[submesh.indexOffset + i] : indices32[submesh.indexOffset + i];
+	}
+
+	size_t byteSize() const;
+
+	const BuildStats& getBuildStats() const { return stats; }
+
+	// unit normal <-> octahedral snorm16 pair; encoding picks the closest of the neighbouring codes
+	static unsigned int encodeNormal( const glm::vec3& normal );
+	static glm::vec3 decodeNormal( unsigned int code );
+
+private:
+	BuildStats stats;
+};
+
+#endif // _COMPACTMESH_H_
@@ -0,0 +1,572 @@
+#include "compressedtexture.hpp"
+#include "threadpool.hpp"
+#include "simd.hpp"
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <algorithm>
+
+namespace
+{
+	/*
+	 * Shared by the encoder and decoder, so the encoder's error is measured against exactly
+	 * what will be decoded.
+	 */
+
+	unsigned short pack565( int r, int g, int b )
+	{
+		return static_cast<unsigned short>( ( ( r * 31 + 127 ) / 255 ) << 11 |
+											 ( ( g * 63 + 127 ) / 255 ) << 5 |
+											 ( ( b * 31 + 127 ) / 255 ) );
+	}
+
+	void unpack565( unsigned short color, int rgb[3] )
+	{
+		int r = ( color >> 11 ) & 31, g = ( color >> 5 ) & 63, b = color & 31;
+		rgb[0] = ( r << 3 ) | ( r >> 2 );
+		rgb[1] = ( g << 2 ) | ( g >> 4 );
+		rgb[2] = ( b << 3 ) | ( b >> 2 );
+	}
+
+	// the colors of a BC1 block in index order; BC3 color blocks always use the four-color mode,
+	// BC1 blocks with c0 <= c1 have three colors and transparent black
+	void colorPalette( unsigned short c0, unsigned short c1, bool fourColor, int palette[4][4] )
+	{
+		unpack565( c0, palette[0] );
+		unpack565( c1, palette[1] );
+		fourColor = fourColor || c0 > c1;
+		for ( int c = 0; c < 3; ++c )
+		{
+			palette[2][c] = fourColor ? ( 2 * palette[0][c] + palette[1][c] ) / 3 : ( palette[0][c] + palette[1][c] ) / 2;
+			palette[3][c] = fourColor ? ( palette[0][c] + 2 * palette[1][c] ) / 3 : 0;
+		}
+		palette[0][3] = palette[1][3] = palette[2][3] = 255;
+		palette[3][3] = fourColor ? 255 : 0;
+	}
+
+	// the eight values of a BC4 (single channel) block in index order
+	void singlePalette( int a0, int a1, int palette[8] )
+	{
+		palette[0] = a0;
+		palette[1] = a1;
+		if ( a0 > a1 )
+		{
+			for ( int i = 2; i < 8; ++i )
+				palette[i] = ( ( 8 - i ) * a0 + ( i - 1 ) * a1 ) / 7;
+		}
+		else
+		{
+			for ( int i = 2; i < 6; ++i )
+				palette[i] = ( ( 6 - i ) * a0 + ( i - 1 ) * a1 ) / 5;
+			palette[6] = 0;
+			palette[7] = 255;
+		}
+	}
+
+	unsigned short read16( const unsigned char * p )
+	{
+		return static_cast<unsigned short>( p[0] | ( p[1] << 8 ) );
+	}
+
+	// 3-bit index of texel t in a BC4 block
+	int singleIndex( const unsigned char * block, int t )
+	{
+		int bit = 16 + t * 3;
+		int bits = block[bit >> 3] | ( ( bit >> 3 ) + 1 < 8 ? block[( bit >> 3 ) + 1] << 8 : 0 );
+		return ( bits >> ( bit & 7 ) ) & 7;
+	}
+
+	void decodeColor( const unsigned char * block, bool fourColor, unsigned char rgba[64] )
+	{
+		int palette[4][4];
+		colorPalette( read16( block ), read16( block + 2 ), fourColor, palette );
+		for ( int t = 0; t < 16; ++t )
+		{
+			const int * color = palette[( block[4 + ( t >> 2 )] >> ( ( t & 3 ) * 2 ) ) & 3];
+			for ( int c = 0; c < 4; ++c )
+				rgba[t * 4 + c] = static_cast<unsigned char>( color[c] );
+		}
+	}
+
+	void decodeSingle( const unsigned char * block, int channel, unsigned char rgba[64] )
+	{
+		int palette[8];
+		singlePalette( block[0], block[1], palette );
+		for ( int t = 0; t < 16; ++t )
+			rgba[t * 4 + channel] = static_cast<unsigned char>( palette[singleIndex( block, t )] );
+	}
+
+	/*
+	 * Color encoding.
+	 */
+
+	// picks the closest palette color for each texel (ties go to the lower index); returns the total squared error
+	int selectIndexes( const unsigned char rgba[64], const int palette[4][4], unsigned char indexes[16] )
+	{
+#ifdef SCENE_SSE2
+		// texels as 16-bit r g b 0, two per half register; madd gives (dr^2 + dg^2, db^2) per texel
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i rgbMask = _mm_set1_epi32( 0x00FFFFFF );
+		__m128i lo[4], hi[4], best[4], choice[4];
+		for ( int r = 0; r < 4; ++r )
+		{
+			__m128i row = _mm_and_si128( _mm_loadu_si128( reinterpret_cast<const __m128i *>( rgba + r * 16 ) ), rgbMask );
+			lo[r] = _mm_unpacklo_epi8( row, zero );
+			hi[r] = _mm_unpackhi_epi8( row, zero );
+		}
+		for ( int k = 0; k < 4; ++k )
+		{
+			const int * p = palette[k];
+			__m128i color = _mm_setr_epi16( static_cast<short>( p[0] ), static_cast<short>( p[1] ), static_cast<short>( p[2] ), 0,
+											static_cast<short>( p[0] ), static_cast<short>( p[1] ), static_cast<short>( p[2] ), 0 );
+			__m128i index = _mm_set1_epi32( k );
+			for ( int r = 0; r < 4; ++r )
+			{
+				__m128i dl = _mm_sub_epi16( lo[r], color );
+				__m128i dh = _mm_sub_epi16( hi[r], color );
+				__m128 sl = _mm_castsi128_ps( _mm_madd_epi16( dl, dl ) );
+				__m128 sh = _mm_castsi128_ps( _mm_madd_epi16( dh, dh ) );
+				__m128i distance = _mm_add_epi32( _mm_castps_si128( _mm_shuffle_ps( sl, sh, _MM_SHUFFLE( 2, 0, 2, 0 ) ) ),
+												  _mm_castps_si128( _mm_shuffle_ps( sl, sh, _MM_SHUFFLE( 3, 1, 3, 1 ) ) ) );
+				if ( k == 0 )
+				{
+					best[r] = distance;
+					choice[r] = index;
+					continue;
+				}
+				__m128i closer = _mm_cmplt_epi32( distance, best[r] );
+				best[r] = _mm_or_si128( _mm_and_si128( closer, distance ), _mm_andnot_si128( closer, best[r] ) );
+				choice[r] = _mm_or_si128( _mm_and_si128( closer, index ), _mm_andnot_si128( closer, choice[r] ) );
+			}
+		}
+
+		int errors[16], chosen[16];
+		for ( int r = 0; r < 4; ++r )
+		{
+			_mm_storeu_si128( reinterpret_cast<__m128i *>( errors + r * 4 ), best[r] );
+			_mm_storeu_si128( reinterpret_cast<__m128i *>( chosen + r * 4 ), choice[r] );
+		}
+		int error = 0;
+		for ( int t = 0; t < 16; ++t )
+		{
+			error += errors[t];
+			indexes[t] = static_cast<unsigned char>( chosen[t] );
+		}
+		return error;
+#else
+		int error = 0;
+		for ( int t = 0; t < 16; ++t )
+		{
+			int best = std::numeric_limits<int>::max();
+			for ( int k = 0; k < 4; ++k )
+			{
+				int dr = rgba[t * 4] - palette[k][0];
+				int dg = rgba[t * 4 + 1] - palette[k][1];
+				int db = rgba[t * 4 + 2] - palette[k][2];
+				int distance = dr * dr + dg * dg + db * db;
+				if ( distance < best )
+				{
+					best = distance;
+					indexes[t] = static_cast<unsigned char>( k );
+				}
+			}
+			error += best;
+		}
+		return error;
+#endif
+	}
+
+	// per-channel bounds of the block's colors
+	void colorBounds( const unsigned char rgba[64], int lo[3], int hi[3] )
+	{
+#ifdef SCENE_SSE2
+		const __m128i * rows = reinterpret_cast<const __m128i *>( rgba );
+		__m128i r0 = _mm_loadu_si128( rows ), r1 = _mm_loadu_si128( rows + 1 );
+		__m128i r2 = _mm_loadu_si128( rows + 2 ), r3 = _mm_loadu_si128( rows + 3 );
+		__m128i mn = _mm_min_epu8( _mm_min_epu8( r0, r1 ), _mm_min_epu8( r2, r3 ) );
+		__m128i mx = _mm_max_epu8( _mm_max_epu8( r0, r1 ), _mm_max_epu8( r2, r3 ) );
+		mn = _mm_min_epu8( mn, _mm_shuffle_epi32( mn, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+		mx = _mm_max_epu8( mx, _mm_shuffle_epi32( mx, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+		mn = _mm_min_epu8( mn, _mm_shuffle_epi32( mn, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+		mx = _mm_max_epu8( mx, _mm_shuffle_epi32( mx, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+		int packedLo = _mm_cvtsi128_si32( mn ), packedHi = _mm_cvtsi128_si32( mx );
+		for ( int c = 0; c < 3; ++c )
+		{
+			lo[c] = ( packedLo >> ( c * 8 ) ) & 255;
+			hi[c] = ( packedHi >> ( c * 8 ) ) & 255;
+		}
+#else
+		for ( int c = 0; c < 3; ++c )
+		{
+			lo[c] = 255;
+			hi[c] = 0;
+		}
+		for ( int t = 0; t < 16; ++t )
+		{
+			for ( int c = 0; c < 3; ++c )
+			{
+				lo[c] = std::min( lo[c], static_cast<int>( rgba[t * 4 + c] ) );
+				hi[c] = std::max( hi[c], static_cast<int>( rgba[t * 4 + c] ) );
+			}
+		}
+#endif
+	}
+
+	/*
+	 * The bounding box's main diagonal runs from (lo, lo, lo) to (hi, hi, hi), but the colors may lie
+	 * along another one; channels that fall as the widest channel rises get their ends swapped.
+	 * Both ends are then pulled in by 1/16 of the range, since the extremes are rarely the best fit.
+	 */
+	void boxEndpoints( const unsigned char rgba[64], int lo[3], int hi[3] )
+	{
+		colorBounds( rgba, lo, hi );
+
+		int widest = 0;
+		for ( int c = 1; c < 3; ++c )
+			if ( hi[c] - lo[c] > hi[widest] - lo[widest] )
+				widest = c;
+
+		int center[3] = { lo[0] + hi[0], lo[1] + hi[1], lo[2] + hi[2] }; // doubled, to stay in integers
+		int covariance[3] = { 0, 0, 0 };
+		for ( int t = 0; t < 16; ++t )
+		{
+			int reference = rgba[t * 4 + widest] * 2 - center[widest];
+			for ( int c = 0; c < 3; ++c )
+				covariance[c] += ( rgba[t * 4 + c] * 2 - center[c] ) * reference;
+		}
+		for ( int c = 0; c < 3; ++c )
+		{
+			if ( covariance[c] < 0 )
+				std::swap( lo[c], hi[c] );
+			int inset = ( hi[c] - lo[c] ) / 16;
+			lo[c] += inset;
+			hi[c] -= inset;
+		}
+	}
+
+	// least-squares endpoints for a fixed choice of four-color indexes; false if they're all the same
+	bool refineEndpoints( const unsigned char rgba[64], const unsigned char indexes[16], int lo[3], int hi[3] )
+	{
+		static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+		float aa = 0.0f, bb = 0.0f, ab = 0.0f;
+		float ax[3] = { 0.0f, 0.0f, 0.0f }, bx[3] = { 0.0f, 0.0f, 0.0f };
+		for ( int t = 0; t < 16; ++t )
+		{
+			float a = weights[indexes[t]], b = 1.0f - a;
+			aa += a * a;
+			bb += b * b;
+			ab += a * b;
+			for ( int c = 0; c < 3; ++c )
+			{
+				ax[c] += a * rgba[t * 4 + c];
+				bx[c] += b * rgba[t * 4 + c];
+			}
+		}
+
+		float det = aa * bb - ab * ab;
+		if ( std::fabs( det ) < 1e-6f )
+			return false;
+		for ( int c = 0; c < 3; ++c )
+		{
+			float c0 = ( ax[c] * bb - bx[c] * ab ) / det;
+			float c1 = ( bx[c] * aa - ax[c] * ab ) / det;
+			hi[c] = static_cast<int>( std::min( std::max( c0, 0.0f ), 255.0f ) + 0.5f );
+			lo[c] = static_cast<int>( std::min( std::max( c1, 0.0f ), 255.0f ) + 0.5f );
+		}
+		return true;
+	}
+
+	// quantizes the endpoints in four-color order and picks indexes; returns the error
+	int fitColors( const unsigned char rgba[64], const int lo[3], const int hi[3],
+				   unsigned short& c0, unsigned short& c1, unsigned char indexes[16] )
+	{
+		c0 = pack565( hi[0], hi[1], hi[2] );
+		c1 = pack565( lo[0], lo[1], lo[2] );
+		if ( c0 < c1 )
+			std::swap( c0, c1 );
+
+		int palette[4][4];
+		colorPalette( c0, c1, true, palette );
+		return selectIndexes( rgba, palette, indexes );
+	}
+
+	void encodeColor( const unsigned char rgba[64], unsigned char * block )
+	{
+		int lo[3], hi[3];
+		boxEndpoints( rgba, lo, hi );
+
+		unsigned short c0, c1;
+		unsigned char indexes[16];
+		int error = fitColors( rgba, lo, hi, c0, c1, indexes );
+
+		unsigned short r0, r1;
+		unsigned char refined[16];
+		if ( error > 0 && refineEndpoints( rgba, indexes, lo, hi ) && fitColors( rgba, lo, hi, r0, r1, refined ) < error )
+		{
+			c0 = r0;
+			c1 = r1;
+			std::memcpy( indexes, refined, sizeof( indexes ) );
+		}
+
+		// equal endpoints decode as three-color mode, where index 0 is still c0
+		if ( c0 == c1 )
+			std::memset( indexes, 0, sizeof( indexes ) );
+
+		block[0] = static_cast<unsigned char>( c0 & 255 );
+		block[1] = static_cast<unsigned char>( c0 >> 8 );
+		block[2] = static_cast<unsigned char>( c1 & 255 );
+		block[3] = static_cast<unsigned char>( c1 >> 8 );
+		for ( int r = 0; r < 4; ++r )
+			block[4 + r] = static_cast<unsigned char>( indexes[r * 4] | indexes[r * 4 + 1] << 2 | indexes[r * 4 + 2] << 4 | indexes[r * 4 + 3] << 6 );
+	}
+
+	// one channel into a BC4 block, spanning its full range with the eight-value mode
+	void encodeSingle( const unsigned char rgba[64], int channel, unsigned char * block )
+	{
+		int lo = 255, hi = 0;
+		for ( int t = 0; t < 16; ++t )
+		{
+			lo = std::min( lo, static_cast<int>( rgba[t * 4 + channel] ) );
+			hi = std::max( hi, static_cast<int>( rgba[t * 4 + channel] ) );
+		}
+
+		int palette[8];
+		singlePalette( hi, lo, palette );
+		unsigned long long bits = 0;
+		for ( int t = 0; t < 16 && hi > lo; ++t )
+		{
+			int value = rgba[t * 4 + channel], best = 0;
+			for ( int k = 1; k < 8; ++k )
+				if ( std::abs( palette[k] - value ) < std::abs( palette[best] - value ) )
+					best = k;
+			bits |= static_cast<unsigned long long>( best ) << ( t * 3 );
+		}
+
+		block[0] = static_cast<unsigned char>( hi );
+		block[1] = static_cast<unsigned char>( lo );
+		for ( int i = 0; i < 6; ++i )
+			block[2 + i] = static_cast<unsigned char>( bits >> ( i * 8 ) );
+	}
+
+	// squared error between two blocks over the first `width` x `height` texels and the given channels
+	double blockError( const unsigned char * a, const unsigned char * b, unsigned int width, unsigned int height, unsigned int channelMask )
+	{
+		double error = 0.0;
+		for ( unsigned int y = 0; y < height; ++y )
+		{
+			for ( unsigned int x = 0; x < width; ++x )
+			{
+				for ( int c = 0; c < 4; ++c )
+				{
+					if ( ( channelMask & ( 1 << c ) ) == 0 )
+						continue;
+					double d = static_cast<double>( a[( y * 4 + x ) * 4 + c] ) - b[( y * 4 + x ) * 4 + c];
+					error += d * d;
+				}
+			}
+		}
+		return error;
+	}
+}
+
+CompressedTexture::Format CompressedTexture::chooseFormat( const unsigned char * rgba, size_t pixels )
+{
+	for ( size_t i = 0; i < pixels; ++i )
+		if ( rgba[i * 4 + 3] != 255 )
+			return BC3;
+	return BC1;
+}
+
+void CompressedTexture::encodeBlock( Format format, const unsigned char rgba[64], unsigned char * block )
+{
+	switch ( format )
+	{
+		case BC1:
+			encodeColor( rgba, block );
+			break;
+		case BC3:
+			encodeSingle( rgba, 3, block );
+			encodeColor( rgba, block + 8 );
+			break;
+		case BC5:
+			encodeSingle( rgba, 0, block );
+			encodeSingle( rgba, 1, block + 8 );
+			break;
+	}
+}
+
+void CompressedTexture::decodeBlock( Format format, const unsigned char * block, unsigned char rgba[64] )
+{
+	switch ( format )
+	{
+		case BC1:
+			decodeColor( block, false, rgba );
+			break;
+		case BC3:
+			decodeColor( block + 8, true, rgba );
+			decodeSingle( block, 3, rgba );
+			break;
+		case BC5:
+			for ( int t = 0; t < 16; ++t )
+			{
+				rgba[t * 4 + 2] = 0;
+				rgba[t * 4 + 3] = 255;
+			}
+			decodeSingle( block, 0, rgba );
+			decodeSingle( block + 8, 1, rgba );
+			break;
+	}
+}
+
+bool CompressedTexture::encode( const unsigned char * rgba, unsigned int width, unsigned int height, Format format )
+{
+	std::vector<const unsigned char *> sources( 1, rgba );
+	MipChain::Level level = { width, height, 0 };
+	this->format = format;
+	return encodeLevels( sources, std::vector<MipChain::Level>( 1, level ) );
+}
+
+bool CompressedTexture::encode( const MipChain& mips, Format format )
+{
+	std::vector<const unsigned char *> sources;
+	std::vector<MipChain::Level> sizes;
+	for ( size_t i = 0; i < mips.levelCount(); ++i )
+	{
+		sources.push_back( mips.getPixels( i ) );
+		sizes.push_back( mips.getLevel( i ) );
+	}
+	this->format = format;
+	return encodeLevels( sources, sizes );
+}
+
+bool CompressedTexture::encodeLevels( const std::vector<const unsigned char *>& sources, const std::vector<MipChain::Level>& sizes )
+{
+	Format kept = format;
+	clear();
+	format = kept;
+	if ( sources.empty() || sources[0] == NULL || sizes[0].width == 0 || sizes[0].height == 0 )
+		return false;
+
+	size_t bytes = 0;
+	for ( size_t i = 0; i < sizes.size(); ++i )
+	{
+		Level level = { sizes[i].width, sizes[i].height, bytes, 0.0 };
+		levels.push_back( level );
+		bytes += ( ( level.width + 3 ) / 4 ) * ( ( level.height + 3 ) / 4 ) * blockBytes();
+	}
+	blocks.resize( bytes );
+
+	const unsigned int channelMask = format == BC1 ? 7 : format == BC3 ? 15 : 3;
+	const unsigned int channels = format == BC1 ? 3 : format == BC3 ? 4 : 2;
+	double totalError = 0.0, totalSamples = 0.0;
+
+	for ( size_t l = 0; l < levels.size(); ++l )
+	{
+		Level& level = levels[l];
+		const unsigned char * source = sources[l];
+		unsigned int blocksWide = ( level.width + 3 ) / 4, blocksHigh = ( level.height + 3 ) / 4;
+		std::vector<double> rowErrors( blocksHigh, 0.0 );
+
+		ThreadPool::shared().parallelFor( blocksHigh, [&]( size_t begin, size_t end )
+		{
+			unsigned char texels[64], decoded[64];
+			for ( size_t by = begin; by < end; ++by )
+			{
+				for ( unsigned int bx = 0; bx < blocksWide; ++bx )
+				{
+					// blocks hanging off the edge repeat the last row and column
+					for ( unsigned int y = 0; y < 4; ++y )
+					{
+						unsigned int sy = std::min<unsigned int>( static_cast<unsigned int>( by ) * 4 + y, level.height - 1 );
+						for ( unsigned int x = 0; x < 4; ++x )
+						{
+							unsigned int sx = std::min( bx * 4 + x, level.width - 1 );
+							std::memcpy( texels + ( y * 4 + x ) * 4, source + ( static_cast<size_t>( sy ) * level.width + sx ) * 4, 4 );
+						}
+					}
+
+					unsigned char * block = &blocks[level.offset + ( by * blocksWide + bx ) * blockBytes()];
+					encodeBlock( format, texels, block );
+					decodeBlock( format, block, decoded );
+					rowErrors[by] += blockError( texels, decoded, std::min( 4u, level.width - bx * 4 ),
+												 std::min<unsigned int>( 4u, level.height - static_cast<unsigned int>( by ) * 4 ), channelMask );
+				}
+			}
+		}, std::max<size_t>( 1, 256 / blocksWide ) );
+
+		double error = 0.0;
+		for ( size_t i = 0; i < rowErrors.size(); ++i )
+			error += rowErrors[i];
+		double samples = static_cast<double>( level.width ) * level.height * channels;
+		level.psnr = error == 0.0 ? std::numeric_limits<double>::infinity() : 10.0 * std::log10( 255.0 * 255.0 * samples / error );
+		totalError += error;
+		totalSamples += samples;
+	}
+
+	psnr = totalError == 0.0 ? std::numeric_limits<double>::infinity() : 10.0 * std::log10( 255.0 * 255.0 * totalSamples / totalError );
+	return true;
+}
+
+void CompressedTexture::decode( size_t level, std::vector<unsigned char>& rgba ) const
+{
+	const Level& info = levels[level];
+	unsigned int blocksWide = ( info.width + 3 ) / 4, blocksHigh = ( info.height + 3 ) / 4;
+	rgba.resize( static_cast<size_t>( info.width ) * info.height * 4 );
+
+	unsigned char texels[64];
+	for ( unsigned int by = 0; by < blocksHigh; ++by )
+	{
+		for ( unsigned int bx = 0; bx < blocksWide; ++bx )
+		{
+			decodeBlock( format, getBlocks( level ) + ( by * blocksWide + bx ) * blockBytes(), texels );
+			for ( unsigned int y = 0; y < 4 && by * 4 + y < info.height; ++y )
+			{
+				unsigned int width = std::min( 4u, info.width - bx * 4 );
+				std::memcpy( &rgba[( static_cast<size_t>( by * 4 + y ) * info.width + bx * 4 ) * 4], texels + y * 16, width * 4 );
+			}
+		}
+	}
+}
+
+void CompressedTexture::fetch( size_t level, unsigned int x, unsigned int y, unsigned char rgba[4] ) const
+{
+	const Level& info = levels[level];
+	unsigned int blocksWide = ( info.width + 3 ) / 4;
+	const unsigned char * block = getBlocks( level ) + ( ( y / 4 ) * blocksWide + x / 4 ) * blockBytes();
+	int t = ( y & 3 ) * 4 + ( x & 3 );
+
+	// only the palette and one index are decoded, not the whole block
+	if ( format == BC5 )
+	{
+		int red[8], green[8];
+		singlePalette( block[0], block[1], red );
+		singlePalette( block[8], block[9], green );
+		rgba[0] = static_cast<unsigned char>( red[singleIndex( block, t )] );
+		rgba[1] = static_cast<unsigned char>( green[singleIndex( block + 8, t )] );
+		rgba[2] = 0;
+		rgba[3] = 255;
+		return;
+	}
+
+	const unsigned char * color = format == BC3 ? block + 8 : block;
+	int palette[4][4];
+	colorPalette( read16( color ), read16( color + 2 ), format == BC3, palette );
+	const int * texel = palette[( color[4 + ( t >> 2 )] >> ( ( t & 3 ) * 2 ) ) & 3];
+	for ( int c = 0; c < 4; ++c )
+		rgba[c] = static_cast<unsigned char>( texel[c] );
+
+	if ( format == BC3 )
+	{
+		int alpha[8];
+		singlePalette( block[0], block[1], alpha );
+		rgba[3] = static_cast<unsigned char>( alpha[singleIndex( block, t )] );
+	}
+}
+
+void CompressedTexture::clear()
+{
+	format = BC1;
+	levels.clear();
+	blocks.clear();
+	psnr = 0.0;
+}
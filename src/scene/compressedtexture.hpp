@@ -0,0 +1,73 @@
+#ifndef _COMPRESSEDTEXTURE_H_
+#define _COMPRESSEDTEXTURE_H_
+
+#include <scene/mipchain.hpp>
+#include <vector>
+#include <cstddef>
+
+/*
+ * A texture and its mips stored as GPU block-compressed data, a quarter to an eighth the size of RGBA8.
+ *
+ *   BC1 - RGB in 8 bytes per 4x4 block (4 bits per texel), for opaque color maps
+ *   BC3 - BC1 color plus a separate alpha block, 16 bytes per block (8 bits per texel)
+ *   BC5 - two independent channels (red, green) in 16 bytes per block, for normal maps and masks
+ *
+ * The encoder takes the bounding box of each block's colors with SSE2, flips it onto the block's
+ * dominant diagonal and insets it, then picks indexes with SSE2 and refines the endpoints once by
+ * least squares, keeping whichever result has the lower error. The decoder is exact, so the
+ * software path can sample the compressed data with fetch() and see what the GPU would.
+ */
+class CompressedTexture
+{
+public:
+	enum Format { BC1, BC3, BC5 };
+
+	struct Level
+	{
+		unsigned int width;
+		unsigned int height;
+		size_t offset; // into the block data, in bytes
+		double psnr;   // of this level's decoded texels against the source, over the channels the format keeps
+	};
+
+	CompressedTexture() : format( BC1 ), psnr( 0.0 ) {}
+
+	// BC1 if every texel is opaque, otherwise BC3
+	static Format chooseFormat( const unsigned char * rgba, size_t pixels );
+
+	// compresses every level of a mip chain, or a single RGBA8 image; blocks are split across threads
+	bool encode( const MipChain& mips, Format format );
+	bool encode( const unsigned char * rgba, unsigned int width, unsigned int height, Format format );
+
+	void clear();
+
+	Format getFormat() const { return format; }
+	size_t levelCount() const { return levels.size(); }
+	const Level& getLevel( size_t level ) const { return levels[level]; }
+	const unsigned char * getBlocks( size_t level ) const { return &blocks[levels[level].offset]; }
+	size_t blockBytes() const { return format == BC1 ? 8 : 16; }
+	size_t byteSize() const { return blocks.size(); }
+
+	// peak signal to noise ratio over every level, in dB; higher is better, and lossless is infinite
+	double getPSNR() const { return psnr; }
+
+	// expands a whole level back to RGBA8; BC1 and BC5 have opaque alpha, and BC5 has zero blue
+	void decode( size_t level, std::vector<unsigned char>& rgba ) const;
+
+	// one texel, straight from the compressed data
+	void fetch( size_t level, unsigned int x, unsigned int y, unsigned char rgba[4] ) const;
+
+	// one 4x4 block of RGBA8 texels, in rows, to and from a block of the given format
+	static void encodeBlock( Format format, const unsigned char rgba[64], unsigned char * block );
+	static void decodeBlock( Format format, const unsigned char * block, unsigned char rgba[64] );
+
+private:
+	Format format;
+	std::vector<Level> levels;
+	std::vector<unsigned char> blocks; // all levels, largest first
+	double psnr;
+
+	bool encodeLevels( const std::vector<const unsigned char *>& sources, const std::vector<MipChain::Level>& sizes );
+};
+
+#endif // _COMPRESSEDTEXTURE_H_
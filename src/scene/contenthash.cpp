@@ -0,0 +1,75 @@
+#include "contenthash.hpp"
+#include <cstring>
+
+namespace
+{
+	typedef unsigned long long uint64;
+
+	const uint64 PRIME1 = 0x9E3779B185EBCA87ULL;
+	const uint64 PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+	const uint64 PRIME3 = 0x165667B19E3779F9ULL;
+	const uint64 PRIME4 = 0x85EBCA77C2B2AE63ULL;
+	const uint64 PRIME5 = 0x27D4EB2F165667C5ULL;
+
+	uint64 rotl( uint64 x, int r ) { return ( x << r ) | ( x >> ( 64 - r ) ); }
+
+	uint64 read64( const unsigned char * p )
+	{
+		uint64 v;
+		std::memcpy( &v, p, sizeof( v ) );
+		return v;
+	}
+
+	uint64 round( uint64 acc, uint64 lane )
+	{
+		acc += lane * PRIME2;
+		return rotl( acc, 31 ) * PRIME1;
+	}
+
+	uint64 merge( uint64 acc, uint64 lane )
+	{
+		acc ^= round( 0, lane );
+		return acc * PRIME1 + PRIME4;
+	}
+}
+
+unsigned long long hashContent( const void * data, size_t size )
+{
+	const unsigned char * p = static_cast<const unsigned char *>( data );
+	const unsigned char * end = p + size;
+	uint64 h;
+
+	if ( size >= 32 )
+	{
+		uint64 v1 = PRIME1 + PRIME2, v2 = PRIME2, v3 = 0, v4 = 0 - PRIME1;
+		for ( ; end - p >= 32; p += 32 )
+		{
+			v1 = round( v1, read64( p ) );
+			v2 = round( v2, read64( p + 8 ) );
+			v3 = round( v3, read64( p + 16 ) );
+			v4 = round( v4, read64( p + 24 ) );
+		}
+		h = rotl( v1, 1 ) + rotl( v2, 7 ) + rotl( v3, 12 ) + rotl( v4, 18 );
+		h = merge( h, v1 );
+		h = merge( h, v2 );
+		h = merge( h, v3 );
+		h = merge( h, v4 );
+	}
+	else
+	{
+		h = PRIME5;
+	}
+
+	h += static_cast<uint64>( size );
+	for ( ; end - p >= 8; p += 8 )
+		h = rotl( h ^ round( 0, read64( p ) ), 27 ) * PRIME1 + PRIME4;
+	for ( ; p < end; ++p )
+		h = rotl( h ^ ( *p * PRIME5 ), 11 ) * PRIME1;
+
+	h ^= h >> 33;
+	h *= PRIME2;
+	h ^= h >> 29;
+	h *= PRIME3;
+	h ^= h >> 32;
+	return h;
+}
@@ -0,0 +1,711 @@
+#include "instancebvh.hpp"
+#include "simd.hpp"
+#include <SFML/System/Clock.hpp>
+#include <algorithm>
+#include <limits>
+#include <cstring>
+#include <cmath>
+
+namespace
+{
+	const size_t CACHE_LINE = 64;
+
+	// SAH buckets per axis
+	const unsigned int BINS = 16;
+
+	const float EMPTY_MIN = std::numeric_limits<float>::max();
+	const float EMPTY_MAX = -std::numeric_limits<float>::max();
+
+	// a node of the binary tree the builder makes before it's collapsed; left < 0 for a leaf
+	struct BinaryNode
+	{
+		glm::vec3 min, max;
+		int left, right;
+		size_t first, count; // the node's range of the builder's instance order
+
+		BinaryNode() : min( glm::vec3( 0.0f, 0.0f, 0.0f ) ), max( glm::vec3( 0.0f, 0.0f, 0.0f ) ),
+					   left( -1 ), right( -1 ), first( 0 ), count( 0 )
+		{
+		}
+	};
+
+	float surfaceArea( const glm::vec3& min, const glm::vec3& max )
+	{
+		glm::vec3 d = max - min;
+		return 2.0f * ( d.x * d.y + d.y * d.z + d.z * d.x );
+	}
+
+	struct Bin
+	{
+		glm::vec3 min, max;
+		size_t count;
+
+		Bin() : min( EMPTY_MIN ), max( EMPTY_MAX ), count( 0 )
+		{
+		}
+
+		void add( const glm::vec3& boxMin, const glm::vec3& boxMax )
+		{
+			min = glm::min( min, boxMin );
+			max = glm::max( max, boxMax );
+		}
+	};
+
+	/*
+	 * The binary SAH build. Each node's instances are binned by centroid along every axis, and the
+	 * cheapest boundary between bins wins; a node stops being split only at one instance, so every
+	 * leaf is a single instance. Ranges whose centroids all coincide are split down the middle.
+	 * It works from a stack rather than recursing, as a badly spread scene can make it deep.
+	 */
+	void buildBinary( const std::vector<glm::vec3>& mins, const std::vector<glm::vec3>& maxs,
+					  std::vector<size_t>& order, std::vector<BinaryNode>& tree )
+	{
+		size_t count = mins.size();
+		std::vector<glm::vec3> centroids( count );
+		for ( size_t i = 0; i < count; ++i )
+		{
+			centroids[i] = ( mins[i] + maxs[i] ) * 0.5f;
+			order[i] = i;
+		}
+
+		tree.clear();
+		tree.reserve( count * 2 - 1 );
+		BinaryNode root;
+		root.first = 0;
+		root.count = count;
+		tree.push_back( root );
+
+		std::vector<int> pending( 1, 0 );
+		while ( !pending.empty() )
+		{
+			int n = pending.back();
+			pending.pop_back();
+			size_t first = tree[n].first, size = tree[n].count;
+
+			glm::vec3 boundsMin( EMPTY_MIN ), boundsMax( EMPTY_MAX ), centroidMin( EMPTY_MIN ), centroidMax( EMPTY_MAX );
+			for ( size_t k = first; k < first + size; ++k )
+			{
+				size_t i = order[k];
+				boundsMin = glm::min( boundsMin, mins[i] );
+				boundsMax = glm::max( boundsMax, maxs[i] );
+				centroidMin = glm::min( centroidMin, centroids[i] );
+				centroidMax = glm::max( centroidMax, centroids[i] );
+			}
+			tree[n].min = boundsMin;
+			tree[n].max = boundsMax;
+			tree[n].left = tree[n].right = -1;
+			if ( size == 1 )
+				continue;
+
+			// the cheapest split of any axis, as (axis, first bin of the right side)
+			int bestAxis = -1;
+			unsigned int bestSplit = 0;
+			float bestCost = std::numeric_limits<float>::max();
+			for ( int axis = 0; axis < 3; ++axis )
+			{
+				float extent = centroidMax[axis] - centroidMin[axis];
+				if ( !( extent > 0.0f ) )
+					continue;
+
+				Bin bins[BINS];
+				float scale = BINS / extent;
+				for ( size_t k = first; k < first + size; ++k )
+				{
+					size_t i = order[k];
+					unsigned int b = std::min( BINS - 1, static_cast<unsigned int>( ( centroids[i][axis] - centroidMin[axis] ) * scale ) );
+					bins[b].add( mins[i], maxs[i] );
+					bins[b].count += 1;
+				}
+
+				float rightArea[BINS];
+				size_t rightCount[BINS];
+				Bin right;
+				for ( unsigned int b = BINS - 1; b > 0; --b )
+				{
+					right.add( bins[b].min, bins[b].max );
+					right.count += bins[b].count;
+					rightArea[b] = surfaceArea( right.min, right.max );
+					rightCount[b] = right.count;
+				}
+
+				Bin left;
+				for ( unsigned int b = 1; b < BINS; ++b )
+				{
+					left.add( bins[b - 1].min, bins[b - 1].max );
+					left.count += bins[b - 1].count;
+					if ( left.count == 0 || rightCount[b] == 0 )
+						continue;
+					float cost = surfaceArea( left.min, left.max ) * left.count + rightArea[b] * rightCount[b];
+					if ( cost < bestCost )
+					{
+						bestCost = cost;
+						bestAxis = axis;
+						bestSplit = b;
+					}
+				}
+			}
+
+			size_t middle;
+			if ( bestAxis >= 0 )
+			{
+				float extent = centroidMax[bestAxis] - centroidMin[bestAxis];
+				float scale = BINS / extent, low = centroidMin[bestAxis];
+				int axis = bestAxis;
+				unsigned int split = bestSplit;
+				size_t * end = std::partition( &order[0] + first, &order[0] + first + size, [&]( size_t i ) {
+					return std::min( BINS - 1, static_cast<unsigned int>( ( centroids[i][axis] - low ) * scale ) ) < split;
+				} );
+				middle = end - &order[0];
+			}
+			else
+			{
+				middle = first + size / 2;
+			}
+
+			BinaryNode child;
+			child.first = first;
+			child.count = middle - first;
+			tree[n].left = static_cast<int>( tree.size() );
+			tree.push_back( child );
+			child.first = middle;
+			child.count = first + size - middle;
+			tree[n].right = static_cast<int>( tree.size() );
+			tree.push_back( child );
+			pending.push_back( tree[n].left );
+			pending.push_back( tree[n].right );
+		}
+	}
+
+	void setSlot( InstanceBVH::Node& node, int j, const glm::vec3& min, const glm::vec3& max )
+	{
+		node.minX[j] = min.x;
+		node.minY[j] = min.y;
+		node.minZ[j] = min.z;
+		node.maxX[j] = max.x;
+		node.maxY[j] = max.y;
+		node.maxZ[j] = max.z;
+	}
+
+	void clearNode( InstanceBVH::Node& node )
+	{
+		for ( int j = 0; j < 4; ++j )
+		{
+			setSlot( node, j, glm::vec3( EMPTY_MIN ), glm::vec3( EMPTY_MAX ) );
+			node.children[j] = -1;
+			node.instances[j] = -1;
+		}
+	}
+
+	// the box around a node's used slots
+	void nodeBounds( const InstanceBVH::Node& node, glm::vec3& min, glm::vec3& max )
+	{
+		min = glm::vec3( EMPTY_MIN );
+		max = glm::vec3( EMPTY_MAX );
+		for ( int j = 0; j < 4; ++j )
+		{
+			if ( node.children[j] >= 0 || node.instances[j] >= 0 )
+			{
+				min = glm::min( min, glm::vec3( node.minX[j], node.minY[j], node.minZ[j] ) );
+				max = glm::max( max, glm::vec3( node.maxX[j], node.maxY[j], node.maxZ[j] ) );
+			}
+		}
+	}
+
+#ifdef SCENE_SSE2
+	// which of a node's four slots are in use, as a movemask
+	unsigned int usedSlots( const InstanceBVH::Node& node )
+	{
+		__m128i none = _mm_set1_epi32( -1 );
+		__m128i children = _mm_loadu_si128( reinterpret_cast<const __m128i *>( node.children ) );
+		__m128i instances = _mm_loadu_si128( reinterpret_cast<const __m128i *>( node.instances ) );
+		__m128i unused = _mm_and_si128( _mm_cmpeq_epi32( children, none ), _mm_cmpeq_epi32( instances, none ) );
+		return ~_mm_movemask_ps( _mm_castsi128_ps( unused ) ) & 15;
+	}
+#else
+	unsigned int usedSlots( const InstanceBVH::Node& node )
+	{
+		unsigned int mask = 0;
+		for ( int j = 0; j < 4; ++j )
+			mask |= ( node.children[j] >= 0 || node.instances[j] >= 0 ) ? 1u << j : 0u;
+		return mask;
+	}
+#endif
+
+	/*
+	 * The per-node tests: each returns a mask of the slots whose boxes pass, testing all four with
+	 * SSE2 where it's there.
+	 */
+	struct BoxTest
+	{
+		glm::vec3 min, max;
+
+		unsigned int operator()( const InstanceBVH::Node& node ) const
+		{
+#ifdef SCENE_SSE2
+			__m128 overlap = _mm_and_ps( _mm_cmple_ps( _mm_load_ps( node.minX ), _mm_set1_ps( max.x ) ),
+										 _mm_cmpge_ps( _mm_load_ps( node.maxX ), _mm_set1_ps( min.x ) ) );
+			overlap = _mm_and_ps( overlap, _mm_and_ps( _mm_cmple_ps( _mm_load_ps( node.minY ), _mm_set1_ps( max.y ) ),
+													   _mm_cmpge_ps( _mm_load_ps( node.maxY ), _mm_set1_ps( min.y ) ) ) );
+			overlap = _mm_and_ps( overlap, _mm_and_ps( _mm_cmple_ps( _mm_load_ps( node.minZ ), _mm_set1_ps( max.z ) ),
+													   _mm_cmpge_ps( _mm_load_ps( node.maxZ ), _mm_set1_ps( min.z ) ) ) );
+			return _mm_movemask_ps( overlap );
+#else
+			unsigned int mask = 0;
+			for ( int j = 0; j < 4; ++j )
+			{
+				bool overlap = node.minX[j] <= max.x && node.maxX[j] >= min.x && node.minY[j] <= max.y &&
+							   node.maxY[j] >= min.y && node.minZ[j] <= max.z && node.maxZ[j] >= min.z;
+				mask |= overlap ? 1u << j : 0u;
+			}
+			return mask;
+#endif
+		}
+	};
+
+	// a box is touched when the squared distance from the center to its nearest point is within r^2
+	struct SphereTest
+	{
+		glm::vec3 center;
+		float radius;
+
+		unsigned int operator()( const InstanceBVH::Node& node ) const
+		{
+#ifdef SCENE_SSE2
+			__m128 zero = _mm_setzero_ps();
+			__m128 cx = _mm_set1_ps( center.x ), cy = _mm_set1_ps( center.y ), cz = _mm_set1_ps( center.z );
+			__m128 dx = _mm_max_ps( _mm_max_ps( _mm_sub_ps( _mm_load_ps( node.minX ), cx ), _mm_sub_ps( cx, _mm_load_ps( node.maxX ) ) ), zero );
+			__m128 dy = _mm_max_ps( _mm_max_ps( _mm_sub_ps( _mm_load_ps( node.minY ), cy ), _mm_sub_ps( cy, _mm_load_ps( node.maxY ) ) ), zero );
+			__m128 dz = _mm_max_ps( _mm_max_ps( _mm_sub_ps( _mm_load_ps( node.minZ ), cz ), _mm_sub_ps( cz, _mm_load_ps( node.maxZ ) ) ), zero );
+			__m128 distance = _mm_add_ps( _mm_add_ps( _mm_mul_ps( dx, dx ), _mm_mul_ps( dy, dy ) ), _mm_mul_ps( dz, dz ) );
+			return _mm_movemask_ps( _mm_cmple_ps( distance, _mm_set1_ps( radius * radius ) ) );
+#else
+			unsigned int mask = 0;
+			for ( int j = 0; j < 4; ++j )
+			{
+				glm::vec3 d = glm::max( glm::max( glm::vec3( node.minX[j], node.minY[j], node.minZ[j] ) - center,
+												  center - glm::vec3( node.maxX[j], node.maxY[j], node.maxZ[j] ) ), glm::vec3( 0.0f ) );
+				mask |= glm::dot( d, d ) <= radius * radius ? 1u << j : 0u;
+			}
+			return mask;
+#endif
+		}
+	};
+
+	/*
+	 * The slab test. Zero direction components get a huge finite reciprocal instead of infinity, so
+	 * a ray lying in a slab's plane gives 0 * huge rather than 0 * infinity = NaN.
+	 */
+	struct RayTest
+	{
+		glm::vec3 origin, inverse;
+		float maxDistance;
+
+		RayTest( const glm::vec3& o, const glm::vec3& direction, float distance ) : origin( o ), maxDistance( distance )
+		{
+			for ( int axis = 0; axis < 3; ++axis )
+			{
+				float d = direction[axis];
+				inverse[axis] = std::fabs( d ) > 1.0e-30f ? 1.0f / d : ( d < 0.0f ? -1.0e30f : 1.0e30f );
+			}
+		}
+
+		// entry distances go to entries, clamped to zero for a ray starting inside the box
+		unsigned int operator()( const InstanceBVH::Node& node, float entries[4] ) const
+		{
+#ifdef SCENE_SSE2
+			__m128 ox = _mm_set1_ps( origin.x ), oy = _mm_set1_ps( origin.y ), oz = _mm_set1_ps( origin.z );
+			__m128 ix = _mm_set1_ps( inverse.x ), iy = _mm_set1_ps( inverse.y ), iz = _mm_set1_ps( inverse.z );
+			__m128 x0 = _mm_mul_ps( _mm_sub_ps( _mm_load_ps( node.minX ), ox ), ix ), x1 = _mm_mul_ps( _mm_sub_ps( _mm_load_ps( node.maxX ), ox ), ix );
+			__m128 y0 = _mm_mul_ps( _mm_sub_ps( _mm_load_ps( node.minY ), oy ), iy ), y1 = _mm_mul_ps( _mm_sub_ps( _mm_load_ps( node.maxY ), oy ), iy );
+			__m128 z0 = _mm_mul_ps( _mm_sub_ps( _mm_load_ps( node.minZ ), oz ), iz ), z1 = _mm_mul_ps( _mm_sub_ps( _mm_load_ps( node.maxZ ), oz ), iz );
+			__m128 enter = _mm_max_ps( _mm_max_ps( _mm_min_ps( x0, x1 ), _mm_min_ps( y0, y1 ) ), _mm_max_ps( _mm_min_ps( z0, z1 ), _mm_setzero_ps() ) );
+			__m128 exit = _mm_min_ps( _mm_min_ps( _mm_max_ps( x0, x1 ), _mm_max_ps( y0, y1 ) ), _mm_max_ps( z0, z1 ) );
+			_mm_storeu_ps( entries, enter );
+			return _mm_movemask_ps( _mm_and_ps( _mm_cmple_ps( enter, exit ), _mm_cmple_ps( enter, _mm_set1_ps( maxDistance ) ) ) );
+#else
+			unsigned int mask = 0;
+			for ( int j = 0; j < 4; ++j )
+			{
+				glm::vec3 t0 = ( glm::vec3( node.minX[j], node.minY[j], node.minZ[j] ) - origin ) * inverse;
+				glm::vec3 t1 = ( glm::vec3( node.maxX[j], node.maxY[j], node.maxZ[j] ) - origin ) * inverse;
+				glm::vec3 low = glm::min( t0, t1 ), high = glm::max( t0, t1 );
+				float enter = std::max( std::max( low.x, low.y ), std::max( low.z, 0.0f ) );
+				float exit = std::min( std::min( high.x, high.y ), high.z );
+				entries[j] = enter;
+				mask |= enter <= exit && enter <= maxDistance ? 1u << j : 0u;
+			}
+			return mask;
+#endif
+		}
+	};
+
+	/*
+	 * Planes point into the frustum. For each plane the box corner furthest along its normal (the
+	 * p-vertex) decides whether the box is wholly outside it, and the nearest corner (the n-vertex)
+	 * whether it's wholly inside; the corners are picked per plane from the normal's signs, so
+	 * the test is three multiply-adds per plane for all four slots.
+	 */
+	struct FrustumTest
+	{
+		glm::vec4 planes[6];
+
+		// outside: slots outside some plane; inside: slots inside every plane
+		void operator()( const InstanceBVH::Node& node, unsigned int& outside, unsigned int& inside ) const
+		{
+			const float * mins[3] = { node.minX, node.minY, node.minZ };
+			const float * maxs[3] = { node.maxX, node.maxY, node.maxZ };
+#ifdef SCENE_SSE2
+			__m128 out = _mm_setzero_ps(), in = _mm_castsi128_ps( _mm_set1_epi32( -1 ) ), zero = _mm_setzero_ps();
+			for ( int p = 0; p < 6; ++p )
+			{
+				const glm::vec4& plane = planes[p];
+				__m128 outer = _mm_set1_ps( plane.w ), inner = outer;
+				for ( int axis = 0; axis < 3; ++axis )
+				{
+					__m128 n = _mm_set1_ps( plane[axis] );
+					bool positive = plane[axis] >= 0.0f;
+					outer = _mm_add_ps( outer, _mm_mul_ps( n, _mm_load_ps( positive ? maxs[axis] : mins[axis] ) ) );
+					inner = _mm_add_ps( inner, _mm_mul_ps( n, _mm_load_ps( positive ? mins[axis] : maxs[axis] ) ) );
+				}
+				out = _mm_or_ps( out, _mm_cmplt_ps( outer, zero ) );
+				in = _mm_and_ps( in, _mm_cmpge_ps( inner, zero ) );
+			}
+			outside = _mm_movemask_ps( out );
+			inside = _mm_movemask_ps( in );
+#else
+			outside = 0;
+			inside = 15;
+			for ( int p = 0; p < 6; ++p )
+			{
+				const glm::vec4& plane = planes[p];
+				for ( int j = 0; j < 4; ++j )
+				{
+					float outer = plane.w, inner = plane.w;
+					for ( int axis = 0; axis < 3; ++axis )
+					{
+						bool positive = plane[axis] >= 0.0f;
+						outer += plane[axis] * ( positive ? maxs[axis][j] : mins[axis][j] );
+						inner += plane[axis] * ( positive ? mins[axis][j] : maxs[axis][j] );
+					}
+					outside |= outer < 0.0f ? 1u << j : 0u;
+					inside &= inner >= 0.0f ? ~0u : ~( 1u << j );
+				}
+			}
+#endif
+		}
+	};
+
+	// depth-first over the slots a test passes
+	template <class Test>
+	void traverse( const InstanceBVH::Node * nodes, const Test& test, std::vector<size_t>& out )
+	{
+		std::vector<int> pending( 1, 0 );
+		while ( !pending.empty() )
+		{
+			const InstanceBVH::Node& node = nodes[pending.back()];
+			pending.pop_back();
+
+			unsigned int mask = test( node ) & usedSlots( node );
+			while ( mask != 0 )
+			{
+				unsigned int j = lowestBit( mask );
+				mask &= mask - 1;
+				if ( node.instances[j] >= 0 )
+					out.push_back( node.instances[j] );
+				else
+					pending.push_back( node.children[j] );
+			}
+		}
+	}
+
+	bool nearerHit( const InstanceBVH::RayHit& a, const InstanceBVH::RayHit& b )
+	{
+		return a.distance < b.distance || ( a.distance == b.distance && a.instance < b.instance );
+	}
+}
+
+InstanceBVH::InstanceBVH() : offset( 0 ), nodeTotal( 0 ), instanceCount( 0 )
+{
+}
+
+InstanceBVH::InstanceBVH( const InstanceBVH& other ) : offset( 0 ), nodeTotal( 0 ), instanceCount( 0 )
+{
+	*this = other;
+}
+
+// storage can't just be copied: the copy's alignment, and so its offset, may differ
+InstanceBVH& InstanceBVH::operator=( const InstanceBVH& other )
+{
+	if ( this != &other )
+	{
+		allocate( other.nodeTotal );
+		if ( nodeTotal > 0 )
+			std::memcpy( nodes(), other.nodes(), nodeTotal * sizeof( Node ) );
+		instanceCount = other.instanceCount;
+		stats = other.stats;
+	}
+	return *this;
+}
+
+InstanceBVH::Node * InstanceBVH::nodes()
+{
+	return storage.empty() ? NULL : reinterpret_cast<Node *>( &storage[offset] );
+}
+
+const InstanceBVH::Node * InstanceBVH::nodes() const
+{
+	return storage.empty() ? NULL : reinterpret_cast<const Node *>( &storage[offset] );
+}
+
+void InstanceBVH::allocate( size_t count )
+{
+	nodeTotal = count;
+	if ( count == 0 )
+	{
+		std::vector<unsigned char>().swap( storage );
+		offset = 0;
+		return;
+	}
+	storage.assign( count * sizeof( Node ) + CACHE_LINE, 0 );
+	offset = ( CACHE_LINE - reinterpret_cast<size_t>( &storage[0] ) % CACHE_LINE ) % CACHE_LINE;
+}
+
+void InstanceBVH::clear()
+{
+	allocate( 0 );
+	instanceCount = 0;
+	stats = BuildStats();
+}
+
+void InstanceBVH::build( const std::vector<glm::vec3>& boundsMin, const std::vector<glm::vec3>& boundsMax )
+{
+	sf::Clock clock;
+	clear();
+	instanceCount = std::min( boundsMin.size(), boundsMax.size() );
+	if ( instanceCount == 0 )
+		return;
+
+	std::vector<size_t> order( instanceCount );
+	std::vector<BinaryNode> tree;
+	buildBinary( boundsMin, boundsMax, order, tree );
+
+	/*
+	 * Collapse to four wide: a node's two children are opened up, the largest-area inner child first,
+	 * until it has four slots or only leaves. A tree of n single-instance leaves needs at most n - 1
+	 * such nodes; new nodes always get higher indexes than their parents.
+	 */
+	std::vector<Node> collapsed;
+	collapsed.reserve( instanceCount );
+	std::vector<std::pair<int, int> > pending; // (binary node, 4-wide node)
+	std::vector<unsigned int> depths;
+	collapsed.push_back( Node() );
+	depths.push_back( 1 );
+	pending.push_back( std::make_pair( 0, 0 ) );
+	while ( !pending.empty() )
+	{
+		int source = pending.back().first, target = pending.back().second;
+		pending.pop_back();
+
+		int slots[4] = { source, -1, -1, -1 };
+		int used = 1;
+		if ( tree[source].left >= 0 )
+		{
+			slots[0] = tree[source].left;
+			slots[1] = tree[source].right;
+			used = 2;
+		}
+		while ( used < 4 )
+		{
+			int widest = -1;
+			float widestArea = -1.0f;
+			for ( int j = 0; j < used; ++j )
+			{
+				const BinaryNode& b = tree[slots[j]];
+				float area = surfaceArea( b.min, b.max );
+				if ( b.left >= 0 && area > widestArea )
+				{
+					widest = j;
+					widestArea = area;
+				}
+			}
+			if ( widest < 0 )
+				break;
+			int opened = slots[widest];
+			slots[widest] = tree[opened].left;
+			slots[used++] = tree[opened].right;
+		}
+
+		Node node;
+		clearNode( node );
+		for ( int j = 0; j < used; ++j )
+		{
+			const BinaryNode& b = tree[slots[j]];
+			setSlot( node, j, b.min, b.max );
+			if ( b.left < 0 )
+			{
+				node.instances[j] = static_cast<int>( order[b.first] );
+			}
+			else
+			{
+				node.children[j] = static_cast<int>( collapsed.size() );
+				collapsed.push_back( Node() );
+				depths.push_back( depths[target] + 1 );
+				stats.depth = std::max( stats.depth, depths[target] + 1 );
+				pending.push_back( std::make_pair( slots[j], node.children[j] ) );
+			}
+		}
+		collapsed[target] = node;
+	}
+	stats.depth = std::max( stats.depth, 1u );
+
+	allocate( collapsed.size() );
+	std::memcpy( nodes(), &collapsed[0], nodeTotal * sizeof( Node ) );
+	stats.nodes = nodeTotal;
+	stats.seconds = clock.getElapsedTime().asSeconds();
+}
+
+void InstanceBVH::refit( const std::vector<glm::vec3>& boundsMin, const std::vector<glm::vec3>& boundsMax )
+{
+	if ( boundsMin.size() < instanceCount || boundsMax.size() < instanceCount )
+		return;
+
+	// children come after their parents, so one backwards pass sees every child before its parent
+	Node * all = nodes();
+	for ( size_t n = nodeTotal; n-- > 0; )
+	{
+		Node& node = all[n];
+		for ( int j = 0; j < 4; ++j )
+		{
+			if ( node.instances[j] >= 0 )
+			{
+				setSlot( node, j, boundsMin[node.instances[j]], boundsMax[node.instances[j]] );
+			}
+			else if ( node.children[j] >= 0 )
+			{
+				glm::vec3 min, max;
+				nodeBounds( all[node.children[j]], min, max );
+				setSlot( node, j, min, max );
+			}
+		}
+	}
+}
+
+void InstanceBVH::collectSubtree( int node, std::vector<size_t>& out ) const
+{
+	const Node * all = nodes();
+	std::vector<int> pending( 1, node );
+	while ( !pending.empty() )
+	{
+		const Node& n = all[pending.back()];
+		pending.pop_back();
+		for ( int j = 0; j < 4; ++j )
+		{
+			if ( n.instances[j] >= 0 )
+				out.push_back( n.instances[j] );
+			else if ( n.children[j] >= 0 )
+				pending.push_back( n.children[j] );
+		}
+	}
+}
+
+void InstanceBVH::queryFrustum( const glm::vec4 planes[6], std::vector<size_t>& out ) const
+{
+	if ( nodeTotal == 0 )
+		return;
+
+	FrustumTest test;
+	std::copy( planes, planes + 6, test.planes );
+
+	// a slot wholly inside the frustum takes its whole subtree without any more tests
+	const Node * all = nodes();
+	std::vector<int> pending( 1, 0 );
+	while ( !pending.empty() )
+	{
+		const Node& node = all[pending.back()];
+		pending.pop_back();
+
+		unsigned int outside, inside;
+		test( node, outside, inside );
+		unsigned int mask = ~outside & usedSlots( node );
+		while ( mask != 0 )
+		{
+			unsigned int j = lowestBit( mask );
+			mask &= mask - 1;
+			if ( node.instances[j] >= 0 )
+				out.push_back( node.instances[j] );
+			else if ( inside & ( 1u << j ) )
+				collectSubtree( node.children[j], out );
+			else
+				pending.push_back( node.children[j] );
+		}
+	}
+}
+
+void InstanceBVH::queryBox( const glm::vec3& boxMin, const glm::vec3& boxMax, std::vector<size_t>& out ) const
+{
+	if ( nodeTotal == 0 )
+		return;
+
+	BoxTest test;
+	test.min = boxMin;
+	test.max = boxMax;
+	traverse( nodes(), test, out );
+}
+
+void InstanceBVH::querySphere( const glm::vec3& center, float radius, std::vector<size_t>& out ) const
+{
+	if ( nodeTotal == 0 || radius < 0.0f )
+		return;
+
+	SphereTest test;
+	test.center = center;
+	test.radius = radius;
+	traverse( nodes(), test, out );
+}
+
+void InstanceBVH::queryRay( const glm::vec3& origin, const glm::vec3& direction, float maxDistance, std::vector<RayHit>& out ) const
+{
+	if ( nodeTotal == 0 || maxDistance < 0.0f )
+		return;
+
+	RayTest test( origin, direction, maxDistance );
+	const Node * all = nodes();
+	size_t first = out.size();
+	std::vector<int> pending( 1, 0 );
+	while ( !pending.empty() )
+	{
+		const Node& node = all[pending.back()];
+		pending.pop_back();
+
+		float entries[4];
+		unsigned int mask = test( node, entries ) & usedSlots( node );
+		while ( mask != 0 )
+		{
+			unsigned int j = lowestBit( mask );
+			mask &= mask - 1;
+			if ( node.instances[j] >= 0 )
+			{
+				RayHit hit;
+				hit.instance = node.instances[j];
+				hit.distance = entries[j];
+				out.push_back( hit );
+			}
+			else
+			{
+				pending.push_back( node.children[j] );
+			}
+		}
+	}
+	std::sort( out.begin() + first, out.end(), nearerHit );
+}
+
+void InstanceBVH::transformBounds( const glm::mat4& transform, const glm::vec3& localMin, const glm::vec3& localMax,
+								   glm::vec3& worldMin, glm::vec3& worldMax )
+{
+	glm::vec3 center = ( localMin + localMax ) * 0.5f, extent = ( localMax - localMin ) * 0.5f;
+	glm::vec3 worldCenter = glm::vec3( transform * glm::vec4( center, 1.0f ) );
+	glm::vec3 worldExtent = glm::abs( glm::vec3( transform[0] ) ) * extent.x + glm::abs( glm::vec3( transform[1] ) ) * extent.y +
+							glm::abs( glm::vec3( transform[2] ) ) * extent.z;
+	worldMin = worldCenter - worldExtent;
+	worldMax = worldCenter + worldExtent;
+}
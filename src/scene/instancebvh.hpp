@@ -0,0 +1,99 @@
+#ifndef _INSTANCEBVH_H_
+#define _INSTANCEBVH_H_
+
+#include <vector>
+#include <cstddef>
+#include <glm/glm.hpp>
+
+/*
+ * A bounding volume hierarchy over the world-space boxes of a scene's model instances, for
+ * culling and picking in O(log n) instead of testing every instance.
+ *
+ * The tree is built top-down with the surface area heuristic (binned, over all three axes) as a
+ * binary tree, then collapsed into a 4-wide tree: each node holds the boxes of up to four children
+ * as structure-of-arrays floats, so one SSE2 test checks all four. Every leaf is a single instance,
+ * so a leaf's box is exactly that instance's box. A node is 128 bytes, two cache lines, and the node
+ * array is cache-line aligned. Nodes are stored parents first, so refit() can update every box in
+ * one backwards pass when instances move, keeping the tree's shape.
+ *
+ * Queries append the indexes of the instances they find to a vector, in no particular order
+ * (except ray queries, which are sorted by distance).
+ */
+class InstanceBVH
+{
+public:
+	struct Node
+	{
+		float minX[4], minY[4], minZ[4];
+		float maxX[4], maxY[4], maxZ[4];
+		int children[4];  // a child node's index, or -1 for a leaf or an unused slot
+		int instances[4]; // a leaf's instance, or -1 for a node or an unused slot
+	};
+
+	struct RayHit
+	{
+		size_t instance;
+		float distance; // along the ray to where it enters the instance's box
+	};
+
+	struct BuildStats
+	{
+		size_t nodes;
+		unsigned int depth;
+		float seconds;
+
+		BuildStats() : nodes( 0 ), depth( 0 ), seconds( 0.0f )
+		{
+		}
+	};
+
+	InstanceBVH();
+	InstanceBVH( const InstanceBVH& other );
+	InstanceBVH& operator=( const InstanceBVH& other );
+
+	// builds the tree over one world-space box per instance
+	void build( const std::vector<glm::vec3>& boundsMin, const std::vector<glm::vec3>& boundsMax );
+
+	// updates every node's boxes for moved instances; the instance count must be the one built with
+	void refit( const std::vector<glm::vec3>& boundsMin, const std::vector<glm::vec3>& boundsMax );
+
+	void clear();
+
+	/*
+	 * Instances whose boxes are at least partly inside all six planes. Each plane is (normal, d)
+	 * with the normal pointing into the frustum, so a point p is inside when dot( normal, p ) + d >= 0
+	 * (see Camera::getFrustumPlanes). Boxes near a corner may be kept even though they're outside.
+	 */
+	void queryFrustum( const glm::vec4 planes[6], std::vector<size_t>& out ) const;
+
+	// instances whose boxes overlap a box, or a sphere
+	void queryBox( const glm::vec3& boxMin, const glm::vec3& boxMax, std::vector<size_t>& out ) const;
+	void querySphere( const glm::vec3& center, float radius, std::vector<size_t>& out ) const;
+
+	// instances whose boxes the ray enters within maxDistance, nearest first; direction needn't be unit
+	// length, and distances are in multiples of it
+	void queryRay( const glm::vec3& origin, const glm::vec3& direction, float maxDistance, std::vector<RayHit>& out ) const;
+
+	size_t size() const { return instanceCount; }
+	size_t nodeCount() const { return nodeTotal; }
+	const Node * getNodes() const { return nodes(); }
+	const BuildStats& getBuildStats() const { return stats; }
+
+	// the box around a local-space box after transform, from its center and extents
+	static void transformBounds( const glm::mat4& transform, const glm::vec3& localMin, const glm::vec3& localMax,
+								 glm::vec3& worldMin, glm::vec3& worldMax );
+
+private:
+	std::vector<unsigned char> storage; // the nodes, plus room to start them on a cache line
+	size_t offset;                      // first cache-line-aligned byte in storage
+	size_t nodeTotal;
+	size_t instanceCount;
+	BuildStats stats;
+
+	Node * nodes();
+	const Node * nodes() const;
+	void allocate( size_t count );
+	void collectSubtree( int node, std::vector<size_t>& out ) const;
+};
+
+#endif // _INSTANCEBVH_H_
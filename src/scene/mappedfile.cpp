@@ -0,0 +1,167 @@
+#include "mappedfile.hpp"
+#include <SFML/System/Err.hpp>
+#include <cctype>
+#include <cstdlib>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#endif
+
+MappedFile::MappedFile() : begin( NULL ),
+						   length( 0 )
+#ifdef _WIN32
+						   , file( INVALID_HANDLE_VALUE ),
+						   mapping( NULL )
+#endif
+{
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+bool MappedFile::open( const std::string& filename )
+{
+	close();
+
+#ifdef _WIN32
+	file = CreateFileA( filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+						FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL );
+	if ( file == INVALID_HANDLE_VALUE )
+	{
+		sf::err() << "Error opening file: " << filename << std::endl;
+		return false;
+	}
+
+	LARGE_INTEGER filesize;
+	if ( !GetFileSizeEx( file, &filesize ) )
+	{
+		sf::err() << "Error reading size of file: " << filename << std::endl;
+		close();
+		return false;
+	}
+	length = static_cast<size_t>( filesize.QuadPart );
+
+	// windows refuses to map empty files; an empty view is still a valid file
+	if ( length == 0 )
+		return true;
+
+	mapping = CreateFileMappingA( file, NULL, PAGE_READONLY, 0, 0, NULL );
+	if ( mapping != NULL )
+		begin = static_cast<const char *>( MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 ) );
+#else
+	int fd = ::open( filename.c_str(), O_RDONLY );
+	if ( fd < 0 )
+	{
+		sf::err() << "Error opening file: " << filename << std::endl;
+		return false;
+	}
+
+	struct stat info;
+	if ( fstat( fd, &info ) != 0 )
+	{
+		sf::err() << "Error reading size of file: " << filename << std::endl;
+		::close( fd );
+		return false;
+	}
+	length = static_cast<size_t>( info.st_size );
+
+	if ( length == 0 )
+	{
+		::close( fd );
+		return true;
+	}
+
+	void * view = mmap( NULL, length, PROT_READ, MAP_PRIVATE, fd, 0 );
+	if ( view != MAP_FAILED )
+	{
+		// we only ever scan front to back, so let the kernel read ahead aggressively
+		madvise( view, length, MADV_SEQUENTIAL );
+		begin = static_cast<const char *>( view );
+	}
+
+	// the mapping keeps its own reference to the file
+	::close( fd );
+#endif
+
+	if ( begin == NULL )
+	{
+		sf::err() << "Error mapping file into memory: " << filename << std::endl;
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+bool MappedFile::getFileInfo( const std::string& filename, unsigned long long& size, long long& mtime )
+{
+#ifdef _WIN32
+	WIN32_FILE_ATTRIBUTE_DATA info;
+	if ( !GetFileAttributesExA( filename.c_str(), GetFileExInfoStandard, &info ) )
+		return false;
+
+	size = ( static_cast<unsigned long long>( info.nFileSizeHigh ) << 32 ) | info.nFileSizeLow;
+	// FILETIME counts 100ns intervals
+	unsigned long long ticks = ( static_cast<unsigned long long>( info.ftLastWriteTime.dwHighDateTime ) << 32 ) |
+							   info.ftLastWriteTime.dwLowDateTime;
+	mtime = static_cast<long long>( ticks / 10000000ULL );
+#else
+	struct stat info;
+	if ( stat( filename.c_str(), &info ) != 0 )
+		return false;
+
+	size = static_cast<unsigned long long>( info.st_size );
+	mtime = static_cast<long long>( info.st_mtime );
+#endif
+	return true;
+}
+
+std::string MappedFile::canonicalPath( const std::string& filename )
+{
+#ifdef _WIN32
+	char buffer[MAX_PATH];
+	if ( _fullpath( buffer, filename.c_str(), MAX_PATH ) == NULL ||
+		 GetFileAttributesA( buffer ) == INVALID_FILE_ATTRIBUTES )
+		return std::string();
+	// paths on Windows aren't case sensitive
+	std::string path( buffer );
+	for ( size_t i = 0; i < path.size(); ++i )
+		path[i] = ( path[i] == '/' ) ? '\\' : static_cast<char>( tolower( static_cast<unsigned char>( path[i] ) ) );
+	return path;
+#else
+	char buffer[PATH_MAX];
+	if ( realpath( filename.c_str(), buffer ) == NULL )
+		return std::string();
+	return std::string( buffer );
+#endif
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+	if ( begin != NULL )
+		UnmapViewOfFile( begin );
+	if ( mapping != NULL )
+		CloseHandle( mapping );
+	if ( file != INVALID_HANDLE_VALUE )
+		CloseHandle( file );
+	mapping = NULL;
+	file = INVALID_HANDLE_VALUE;
+#else
+	if ( begin != NULL )
+		munmap( const_cast<char *>( begin ), length );
+#endif
+
+	begin = NULL;
+	length = 0;
+}
@@ -0,0 +1,44 @@
+#ifndef _MAPPEDFILE_H_
+#define _MAPPEDFILE_H_
+
+#include <string>
+#include <cstddef>
+
+/*
+ * A read-only view of an entire file on disk.
+ * The file is memory-mapped where the OS supports it, so parsers can scan the bytes in place
+ * without copying them through a stream buffer. The data is NOT null-terminated - always use size().
+ */
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	bool open( const std::string& filename );
+	void close();
+
+	const char * data() const { return begin; }
+	size_t size() const { return length; }
+
+	// size and last-modified time (in seconds) of a file on disk, without opening it
+	static bool getFileInfo( const std::string& filename, unsigned long long& size, long long& mtime );
+
+	// an absolute path with . and .. resolved, so one file always has the same name; empty if it doesn't exist
+	static std::string canonicalPath( const std::string& filename );
+
+private:
+	// a mapping owns OS handles, so it can't be copied
+	MappedFile( const MappedFile& );
+	MappedFile& operator=( const MappedFile& );
+
+	const char * begin;
+	size_t length;
+
+#ifdef _WIN32
+	void * file;
+	void * mapping;
+#endif
+};
+
+#endif // _MAPPEDFILE_H_
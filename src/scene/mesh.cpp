@@ -0,0 +1,244 @@
+#include "mesh.hpp"
+#include "threadpool.hpp"
+#include <SFML/System/Clock.hpp>
+#include <SFML/System/Err.hpp>
+#include <algorithm>
+
+namespace
+{
+	typedef ObjModel::Triangle Triangle;
+
+	// an .obj corner: indexes into the model's positions, texcoords and normals (-1 if unused)
+	struct Corner
+	{
+		int v, t, n;
+
+		bool operator==( const Corner& other ) const { return v == other.v && t == other.t && n == other.n; }
+	};
+
+	unsigned int hashCorner( const Corner& c )
+	{
+		unsigned int h = static_cast<unsigned int>( c.v ) * 0x9E3779B1u;
+		h ^= static_cast<unsigned int>( c.t ) * 0x85EBCA77u;
+		h ^= static_cast<unsigned int>( c.n ) * 0xC2B2AE3Du;
+		return h ^ ( h >> 15 );
+	}
+
+	/*
+	 * Open addressing (linear probing) map from corners to vertex indexes.
+	 * The table is sized up front for the worst case of every corner being unique, at a load factor
+	 * of at most 1/2, so it never grows and probes stay short.
+	 */
+	class CornerTable
+	{
+	public:
+		void reset( size_t maxEntries )
+		{
+			size_t capacity = 16;
+			while ( capacity < maxEntries * 2 )
+				capacity *= 2;
+			mask = capacity - 1;
+			slots.assign( capacity, -1 );
+			keys.resize( capacity );
+		}
+
+		// returns the vertex for c, adding it as vertex next if it's new
+		int insert( const Corner& c, int next, bool& added )
+		{
+			size_t slot = hashCorner( c ) & mask;
+			while ( slots[slot] >= 0 )
+			{
+				if ( keys[slot] == c )
+				{
+					added = false;
+					return slots[slot];
+				}
+				slot = ( slot + 1 ) & mask;
+			}
+			slots[slot] = next;
+			keys[slot] = c;
+			added = true;
+			return next;
+		}
+
+	private:
+		std::vector<int> slots;
+		std::vector<Corner> keys;
+		size_t mask;
+	};
+
+	// a submesh welded on its own, before it's placed into the shared arrays
+	struct LocalSubMesh
+	{
+		Mesh::SubMesh info;
+		std::vector<Mesh::Vertex> vertices;
+		std::vector<unsigned int> indices;
+	};
+
+	struct LocalGroup
+	{
+		std::vector<LocalSubMesh> submeshes;
+		bool ok;
+	};
+
+	bool hasTexcoords( Triangle::VertexType type )
+	{
+		return type == Triangle::POSITION_TEXCOORD || type == Triangle::POSITION_TEXCOORD_NORMAL;
+	}
+
+	bool hasNormals( Triangle::VertexType type )
+	{
+		return type == Triangle::POSITION_NORMAL || type == Triangle::POSITION_TEXCOORD_NORMAL;
+	}
+
+	bool inRange( int index, size_t size )
+	{
+		return index >= 0 && static_cast<size_t>( index ) < size;
+	}
+
+	bool weldGroup( const ObjModel& model, int g, LocalGroup& out )
+	{
+		const std::vector<Triangle>& triangles = model.getGroups()[g].triangles;
+		const std::vector<glm::vec3>& positions = model.getVertices();
+		const std::vector<glm::vec2>& texcoords = model.getTexcoords();
+		const std::vector<glm::vec3>& normals = model.getNormals();
+
+		// bucket triangles by material and vertex format, in order of first appearance
+		std::vector<std::vector<size_t> > buckets;
+		for ( size_t i = 0; i < triangles.size(); ++i )
+		{
+			const Triangle& tri = triangles[i];
+			size_t b = 0;
+			while ( b < out.submeshes.size() &&
+					( out.submeshes[b].info.materialID != tri.materialID || out.submeshes[b].info.vertexType != tri.vertexType ) )
+				++b;
+
+			if ( b == out.submeshes.size() )
+			{
+				LocalSubMesh submesh;
+				submesh.info.group = g;
+				submesh.info.materialID = tri.materialID;
+				submesh.info.vertexType = tri.vertexType;
+				out.submeshes.push_back( submesh );
+				buckets.push_back( std::vector<size_t>() );
+			}
+			buckets[b].push_back( i );
+		}
+
+		CornerTable table;
+		for ( size_t b = 0; b < buckets.size(); ++b )
+		{
+			LocalSubMesh& submesh = out.submeshes[b];
+			Triangle::VertexType type = submesh.info.vertexType;
+			table.reset( buckets[b].size() * 3 );
+			submesh.indices.reserve( buckets[b].size() * 3 );
+
+			for ( size_t i = 0; i < buckets[b].size(); ++i )
+			{
+				const Triangle& tri = triangles[buckets[b][i]];
+				for ( int k = 0; k < 3; ++k )
+				{
+					Corner c;
+					c.v = tri.vertices[k];
+					c.t = hasTexcoords( type ) ? tri.texcoords[k] : -1;
+					c.n = hasNormals( type ) ? tri.normals[k] : -1;
+
+					bool added;
+					int vertex = table.insert( c, static_cast<int>( submesh.vertices.size() ), added );
+					if ( added )
+					{
+						if ( !inRange( c.v, positions.size() ) ||
+							 ( hasTexcoords( type ) && !inRange( c.t, texcoords.size() ) ) ||
+							 ( hasNormals( type ) && !inRange( c.n, normals.size() ) ) )
+						{
+							sf::err() << "Error building mesh for " << model.getName() << ": face index out of range in group "
+									  << model.getGroups()[g].name << std::endl;
+							return false;
+						}
+
+						Mesh::Vertex v;
+						v.position = positions[c.v];
+						v.texcoord = c.t >= 0 ? texcoords[c.t] : glm::vec2( 0.0f );
+						v.normal = c.n >= 0 ? normals[c.n] : glm::vec3( 0.0f );
+						submesh.vertices.push_back( v );
+					}
+					submesh.indices.push_back( static_cast<unsigned int>( vertex ) );
+				}
+			}
+		}
+		return true;
+	}
+}
+
+void Mesh::clear()
+{
+	vertices.clear();
+	indices16.clear();
+	indices32.clear();
+	submeshes.clear();
+	stats = BuildStats();
+}
+
+bool Mesh::build( const ObjModel& model )
+{
+	clear();
+	sf::Clock clock;
+
+	const std::vector<ObjModel::TriangleGroup>& groups = model.getGroups();
+	std::vector<LocalGroup> welded( groups.size() );
+
+	ThreadPool::shared().parallelFor( groups.size(), [&]( size_t begin, size_t end )
+	{
+		for ( size_t g = begin; g < end; ++g )
+			welded[g].ok = weldGroup( model, static_cast<int>( g ), welded[g] );
+	} );
+
+	// lay the submeshes out in group order, and give each one its place in the shared arrays
+	std::vector<LocalSubMesh *> locals;
+	size_t vertexTotal = 0, index16Total = 0, index32Total = 0;
+	for ( size_t g = 0; g < welded.size(); ++g )
+	{
+		if ( !welded[g].ok )
+			return false;
+
+		for ( size_t s = 0; s < welded[g].submeshes.size(); ++s )
+		{
+			LocalSubMesh& local = welded[g].submeshes[s];
+			SubMesh& info = local.info;
+			info.vertexOffset = vertexTotal;
+			info.vertexCount = local.vertices.size();
+			info.indexCount = local.indices.size();
+			info.indexSize = info.vertexCount <= 65536 ? 2 : 4;
+			info.indexOffset = info.indexSize == 2 ? index16Total : index32Total;
+
+			vertexTotal += info.vertexCount;
+			( info.indexSize == 2 ? index16Total : index32Total ) += info.indexCount;
+			stats.corners += info.indexCount;
+
+			locals.push_back( &local );
+			submeshes.push_back( info );
+		}
+	}
+
+	vertices.resize( vertexTotal );
+	indices16.resize( index16Total );
+	indices32.resize( index32Total );
+
+	ThreadPool::shared().parallelFor( locals.size(), [&]( size_t begin, size_t end )
+	{
+		for ( size_t s = begin; s < end; ++s )
+		{
+			const LocalSubMesh& local = *locals[s];
+			const SubMesh& info = local.info;
+			std::copy( local.vertices.begin(), local.vertices.end(), vertices.begin() + info.vertexOffset );
+			if ( info.indexSize == 2 )
+				std::copy( local.indices.begin(), local.indices.end(), indices16.begin() + info.indexOffset );
+			else
+				std::copy( local.indices.begin(), local.indices.end(), indices32.begin() + info.indexOffset );
+		}
+	} );
+
+	stats.vertices = vertices.size();
+	stats.seconds = clock.getElapsedTime().asSeconds();
+	return true;
+}
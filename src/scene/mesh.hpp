@@ -0,0 +1,82 @@
+#ifndef _MESH_H_
+#define _MESH_H_
+
+#include <scene/objmodel.hpp>
+#include <vector>
+#include <cstddef>
+#include <glm/glm.hpp>
+
+/*
+ * Indexed triangle meshes built from an ObjModel.
+ * .obj faces index positions, texcoords and normals separately; Mesh::build welds each distinct
+ * (position, texcoord, normal) triple into a single interleaved vertex, so the result can go
+ * straight into vertex and index buffers.
+ *
+ * The mesh is split into submeshes - one per group, material and vertex format. Each submesh
+ * owns a contiguous range of vertices and its indexes are relative to the start of that range
+ * (like glDrawElementsBaseVertex), so submeshes with fewer than 65536 vertices use 16-bit indexes.
+ */
+class Mesh
+{
+public:
+
+	// attributes a submesh's vertex type doesn't have are zero
+	struct Vertex
+	{
+		glm::vec3 position;
+		glm::vec3 normal;
+		glm::vec2 texcoord;
+	};
+
+	struct SubMesh
+	{
+		int group; // index into the ObjModel's groups
+		int materialID;
+		ObjModel::Triangle::VertexType vertexType;
+
+		size_t vertexOffset;
+		size_t vertexCount;
+
+		// indexes live in indices16 or indices32, depending on indexSize (2 or 4 bytes)
+		size_t indexOffset;
+		size_t indexCount;
+		unsigned int indexSize;
+	};
+
+	struct BuildStats
+	{
+		size_t corners;  // triangle corners read from the model
+		size_t vertices; // unique vertices after welding
+		float seconds;
+
+		BuildStats() : corners( 0 ), vertices( 0 ), seconds( 0.0f )
+		{
+		}
+
+		// how many corners share each emitted vertex, on average
+		float duplicationRatio() const { return vertices > 0 ? float( corners ) / float( vertices ) : 0.0f; }
+	};
+
+	std::vector<Vertex> vertices;
+	std::vector<unsigned short> indices16;
+	std::vector<unsigned int> indices32;
+	std::vector<SubMesh> submeshes;
+
+	// rebuilds the mesh from model's raw data; groups are welded in parallel
+	bool build( const ObjModel& model );
+
+	void clear();
+
+	// the i'th index of a submesh, relative to its vertexOffset
+	unsigned int index( const SubMesh& submesh, size_t i ) const
+	{
+		return submesh.indexSize == 2 ? indices16[submesh.indexOffset + i] : indices32[submesh.indexOffset + i];
+	}
+
+	const BuildStats& getBuildStats() const { return stats; }
+
+private:
+	BuildStats stats;
+};
+
+#endif // _MESH_H_
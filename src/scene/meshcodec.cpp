@@ -0,0 +1,638 @@
+#include "meshcodec.hpp"
+#include "simd.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+	const unsigned int MESH_MAGIC = 0x4D534843; // "CHSM" in a little-endian file
+	const unsigned int MESH_VERSION = 2;
+
+	unsigned int zigzag( unsigned int delta )
+	{
+		return ( delta << 1 ) ^ static_cast<unsigned int>( static_cast<int>( delta ) >> 31 );
+	}
+
+	unsigned int unzigzag( unsigned int value )
+	{
+		return ( value >> 1 ) ^ ( 0u - ( value & 1 ) );
+	}
+
+	unsigned int popcount8( unsigned int mask )
+	{
+		mask = mask - ( ( mask >> 1 ) & 0x55 );
+		mask = ( mask & 0x33 ) + ( ( mask >> 2 ) & 0x33 );
+		return ( mask + ( mask >> 4 ) ) & 0x0F;
+	}
+
+	/*
+	 * Index stream: a code byte per triangle, the triangles' rotations at 2 bits each, then the
+	 * extra bytes some codes need, and the indexes past the last whole triangle.
+	 */
+
+	// how far back the coder looks; a code's high nibble is an edge's age, 15 meaning no edge
+	const unsigned int EDGE_FIFO = 15;
+	const unsigned int VERTEX_FIFO = 14;
+
+	// a vertex coded on its own is the next new one, a recent one (1 + its age), or explicit
+	const unsigned int VERTEX_NEXT = 0;
+	const unsigned int VERTEX_EXPLICIT = 15;
+
+	// the corner each of a coded triangle's vertexes goes back to, per rotation
+	const unsigned int CORNER[3][3] = { { 0, 1, 2 }, { 1, 2, 0 }, { 2, 0, 1 } };
+
+	// what the encoder and decoder both track, so codes mean the same thing to each
+	struct IndexState
+	{
+		unsigned int edges[16][2];
+		unsigned int vertices[16];
+		unsigned int edgeHead, vertexHead; // where the next push goes
+		unsigned int next;                 // one past the last new or explicit index
+		unsigned int last;                 // that index, which explicit ones are deltas from
+
+		IndexState() : edgeHead( 0 ), vertexHead( 0 ), next( 0 ), last( 0 )
+		{
+			std::memset( edges, 0, sizeof( edges ) );
+			std::memset( vertices, 0, sizeof( vertices ) );
+		}
+
+		// edges are kept reversed, as the neighbor across them winds them
+		void pushEdge( unsigned int a, unsigned int b )
+		{
+			edges[edgeHead][0] = a;
+			edges[edgeHead][1] = b;
+			edgeHead = ( edgeHead + 1 ) & 15;
+		}
+
+		void pushVertex( unsigned int v )
+		{
+			vertices[vertexHead] = v;
+			vertexHead = ( vertexHead + 1 ) & 15;
+		}
+
+		// age 0 is the newest
+		const unsigned int * edge( unsigned int age ) const { return edges[( edgeHead - 1 - age ) & 15]; }
+		unsigned int vertex( unsigned int age ) const { return vertices[( vertexHead - 1 - age ) & 15]; }
+
+		// after any vertex coded on its own; new and explicit ones are remembered, and runs of
+		// consecutive indexes code as "next"
+		void note( unsigned int v, unsigned int code )
+		{
+			if ( code == VERTEX_NEXT || code == VERTEX_EXPLICIT )
+			{
+				pushVertex( v );
+				last = v;
+				next = v + 1;
+			}
+		}
+	};
+
+	void putVarint( std::vector<unsigned char>& out, unsigned int value )
+	{
+		for ( ; value >= 0x80; value >>= 7 )
+			out.push_back( static_cast<unsigned char>( ( value & 0x7F ) | 0x80 ) );
+		out.push_back( static_cast<unsigned char>( value ) );
+	}
+
+	bool getVarint( const unsigned char *& p, const unsigned char * end, unsigned int& value )
+	{
+		value = 0;
+		for ( unsigned int shift = 0; shift < 35; shift += 7 )
+		{
+			if ( p >= end )
+				return false;
+			unsigned int byte = *p++;
+			value |= ( byte & 0x7F ) << shift;
+			if ( byte < 0x80 )
+				return true;
+		}
+		return false;
+	}
+
+	unsigned int vertexCode( const IndexState& state, unsigned int v )
+	{
+		if ( v == state.next )
+			return VERTEX_NEXT;
+		for ( unsigned int age = 0; age < VERTEX_FIFO; ++age )
+			if ( state.vertex( age ) == v )
+				return 1 + age;
+		return VERTEX_EXPLICIT;
+	}
+
+	// codes a vertex on its own, appending an explicit one's delta to data
+	unsigned int putVertex( IndexState& state, unsigned int v, std::vector<unsigned char>& data )
+	{
+		unsigned int code = vertexCode( state, v );
+		if ( code == VERTEX_EXPLICIT )
+			putVarint( data, zigzag( v - state.last ) );
+		state.note( v, code );
+		return code;
+	}
+
+	bool getVertex( IndexState& state, unsigned int code, const unsigned char *& p, const unsigned char * end, unsigned int& v )
+	{
+		if ( code == VERTEX_NEXT )
+		{
+			v = state.next;
+		}
+		else if ( code == VERTEX_EXPLICIT )
+		{
+			unsigned int value;
+			if ( !getVarint( p, end, value ) )
+				return false;
+			v = state.last + unzigzag( value );
+		}
+		else
+		{
+			v = state.vertex( code - 1 );
+		}
+		state.note( v, code );
+		return true;
+	}
+
+	template <typename T>
+	void encodeIndexStream( const T * indices, size_t count, std::vector<unsigned char>& out )
+	{
+		size_t triangles = count / 3;
+		size_t codes = out.size(), rotations = codes + triangles;
+		out.resize( rotations + ( triangles + 3 ) / 4, 0 );
+
+		IndexState state;
+		std::vector<unsigned char> data;
+		for ( size_t t = 0; t < triangles; ++t )
+		{
+			const unsigned int corners[3] = { indices[t * 3], indices[t * 3 + 1], indices[t * 3 + 2] };
+
+			// the rotation that starts on a remembered edge, preferring one whose third vertex isn't explicit
+			unsigned int rotation = 0, edgeAge = EDGE_FIFO;
+			bool explicitThird = true;
+			for ( unsigned int r = 0; r < 3 && explicitThird; ++r )
+			{
+				unsigned int a = corners[CORNER[r][0]], b = corners[CORNER[r][1]];
+				for ( unsigned int age = 0; age < EDGE_FIFO; ++age )
+				{
+					const unsigned int * edge = state.edge( age );
+					if ( edge[0] != a || edge[1] != b )
+						continue;
+					if ( edgeAge == EDGE_FIFO || vertexCode( state, corners[CORNER[r][2]] ) != VERTEX_EXPLICIT )
+					{
+						rotation = r;
+						edgeAge = age;
+						explicitThird = vertexCode( state, corners[CORNER[r][2]] ) == VERTEX_EXPLICIT;
+					}
+					break;
+				}
+			}
+
+			unsigned int a = corners[CORNER[rotation][0]], b = corners[CORNER[rotation][1]], c = corners[CORNER[rotation][2]];
+			if ( edgeAge < EDGE_FIFO )
+			{
+				out[codes + t] = static_cast<unsigned char>( ( edgeAge << 4 ) | putVertex( state, c, data ) );
+				state.pushEdge( c, b );
+				state.pushEdge( a, c );
+			}
+			else
+			{
+				// the second and third vertex codes share a byte, ahead of any explicit deltas
+				size_t more = data.size();
+				data.push_back( 0 );
+				unsigned int codeA = putVertex( state, a, data );
+				unsigned int codeB = putVertex( state, b, data );
+				unsigned int codeC = putVertex( state, c, data );
+				data[more] = static_cast<unsigned char>( ( codeB << 4 ) | codeC );
+				out[codes + t] = static_cast<unsigned char>( ( EDGE_FIFO << 4 ) | codeA );
+				state.pushEdge( b, a );
+				state.pushEdge( c, b );
+				state.pushEdge( a, c );
+			}
+			out[rotations + t / 4] |= static_cast<unsigned char>( rotation << ( ( t & 3 ) * 2 ) );
+		}
+
+		for ( size_t i = triangles * 3; i < count; ++i )
+		{
+			unsigned int v = indices[i];
+			putVarint( data, zigzag( v - state.last ) );
+			state.note( v, VERTEX_EXPLICIT );
+		}
+		out.insert( out.end(), data.begin(), data.end() );
+	}
+
+	template <typename T>
+	size_t decodeIndexStream( const unsigned char * data, size_t size, T * indices, size_t count )
+	{
+		size_t triangles = count / 3, rotationBytes = ( triangles + 3 ) / 4;
+		if ( size < triangles + rotationBytes )
+			return 0;
+		const unsigned char * codes = data;
+		const unsigned char * rotations = data + triangles;
+		const unsigned char * p = rotations + rotationBytes;
+		const unsigned char * end = data + size;
+
+		IndexState state;
+		for ( size_t t = 0; t < triangles; ++t )
+		{
+			unsigned int code = codes[t], a, b, c;
+			if ( ( code >> 4 ) < EDGE_FIFO )
+			{
+				const unsigned int * edge = state.edge( code >> 4 );
+				a = edge[0];
+				b = edge[1];
+				if ( !getVertex( state, code & 15, p, end, c ) )
+					return 0;
+				state.pushEdge( c, b );
+				state.pushEdge( a, c );
+			}
+			else
+			{
+				if ( p >= end )
+					return 0;
+				unsigned int more = *p++;
+				if ( !getVertex( state, code & 15, p, end, a ) || !getVertex( state, more >> 4, p, end, b ) ||
+					 !getVertex( state, more & 15, p, end, c ) )
+					return 0;
+				state.pushEdge( b, a );
+				state.pushEdge( c, b );
+				state.pushEdge( a, c );
+			}
+
+			unsigned int rotation = ( rotations[t / 4] >> ( ( t & 3 ) * 2 ) ) & 3;
+			if ( rotation > 2 )
+				return 0;
+			T * triangle = indices + t * 3;
+			triangle[CORNER[rotation][0]] = static_cast<T>( a );
+			triangle[CORNER[rotation][1]] = static_cast<T>( b );
+			triangle[CORNER[rotation][2]] = static_cast<T>( c );
+		}
+
+		for ( size_t i = triangles * 3; i < count; ++i )
+		{
+			unsigned int v;
+			if ( !getVertex( state, VERTEX_EXPLICIT, p, end, v ) )
+				return 0;
+			indices[i] = static_cast<T>( v );
+		}
+		return static_cast<size_t>( p - data );
+	}
+
+	/*
+	 * Vertex stream: for each block of 16 vertexes, for each 32-bit word, four byte planes of
+	 * a 16-bit mask and the mask's non-zero bytes.
+	 */
+
+	// decodes one block with the scalar reference; returns the end of the data read, or NULL
+	const unsigned char * decodeVertexBlock( const unsigned char * p, const unsigned char * end, unsigned char * vertices,
+											 size_t count, size_t stride, unsigned int * previous )
+	{
+		unsigned int words[16];
+		for ( size_t k = 0; k < stride / 4; ++k )
+		{
+			std::memset( words, 0, sizeof( words ) );
+			for ( unsigned int b = 0; b < 4; ++b )
+			{
+				if ( end - p < 2 )
+					return NULL;
+				unsigned int mask = p[0] | ( p[1] << 8 );
+				p += 2;
+				for ( unsigned int i = 0; i < 16; ++i )
+				{
+					if ( ( mask & ( 1 << i ) ) == 0 )
+						continue;
+					if ( p >= end )
+						return NULL;
+					words[i] |= static_cast<unsigned int>( *p++ ) << ( b * 8 );
+				}
+			}
+			for ( size_t i = 0; i < count; ++i )
+			{
+				previous[k] += unzigzag( words[i] );
+				std::memcpy( vertices + i * stride + k * 4, &previous[k], 4 );
+			}
+		}
+		return p;
+	}
+
+#ifdef SCENE_SSSE3
+	// shuffles that expand a zero-suppressed half block into place
+	struct ShuffleTables
+	{
+		unsigned char expand[256][16];
+		unsigned char bits[256];
+
+		ShuffleTables()
+		{
+			for ( unsigned int control = 0; control < 256; ++control )
+			{
+				unsigned int next = 0;
+				for ( unsigned int b = 0; b < 16; ++b )
+					expand[control][b] = static_cast<unsigned char>( b < 8 && ( control & ( 1 << b ) ) ? next++ : 0x80 );
+				bits[control] = static_cast<unsigned char>( popcount8( control ) );
+			}
+		}
+	};
+
+	const ShuffleTables& shuffleTables()
+	{
+		static const ShuffleTables tables;
+		return tables;
+	}
+
+	// zigzag decode and running sum of four lanes, continuing from the last lane of previous
+	SCENE_TARGET_SSSE3
+	inline __m128i accumulate( __m128i value, __m128i& previous )
+	{
+		__m128i delta = _mm_xor_si128( _mm_srli_epi32( value, 1 ), _mm_sub_epi32( _mm_setzero_si128(), _mm_and_si128( value, _mm_set1_epi32( 1 ) ) ) );
+		delta = _mm_add_epi32( delta, _mm_slli_si128( delta, 4 ) );
+		delta = _mm_add_epi32( delta, _mm_slli_si128( delta, 8 ) );
+		__m128i sum = _mm_add_epi32( delta, previous );
+		previous = _mm_shuffle_epi32( sum, _MM_SHUFFLE( 3, 3, 3, 3 ) );
+		return sum;
+	}
+
+	SCENE_TARGET_SSSE3
+	inline __m128i expandPlane( const unsigned char *& p, const ShuffleTables& tables )
+	{
+		unsigned int low = p[0], high = p[1];
+		p += 2;
+		__m128i first = _mm_shuffle_epi8( _mm_loadu_si128( reinterpret_cast<const __m128i *>( p ) ),
+										  _mm_loadu_si128( reinterpret_cast<const __m128i *>( tables.expand[low] ) ) );
+		p += tables.bits[low];
+		__m128i second = _mm_shuffle_epi8( _mm_loadu_si128( reinterpret_cast<const __m128i *>( p ) ),
+										   _mm_loadu_si128( reinterpret_cast<const __m128i *>( tables.expand[high] ) ) );
+		p += tables.bits[high];
+		return _mm_unpacklo_epi64( first, second );
+	}
+
+	// full blocks, while the largest possible block still fits in the data
+	SCENE_TARGET_SSSE3
+	const unsigned char * decodeVerticesSSSE3( const unsigned char * p, const unsigned char * end, unsigned char * vertices,
+											   size_t blocks, size_t stride, unsigned int * previous, size_t& decoded )
+	{
+		const ShuffleTables& tables = shuffleTables();
+		const size_t words = stride / 4;
+		const size_t worstBlock = words * 4 * 18 + 16;
+
+		unsigned int lanes[16];
+		for ( decoded = 0; decoded < blocks && static_cast<size_t>( end - p ) >= worstBlock; ++decoded )
+		{
+			unsigned char * out = vertices + decoded * 16 * stride;
+			for ( size_t k = 0; k < words; ++k )
+			{
+				__m128i b0 = expandPlane( p, tables );
+				__m128i b1 = expandPlane( p, tables );
+				__m128i b2 = expandPlane( p, tables );
+				__m128i b3 = expandPlane( p, tables );
+
+				// byte planes back into 32-bit words, four vertexes per register
+				__m128i low01 = _mm_unpacklo_epi8( b0, b1 ), high01 = _mm_unpackhi_epi8( b0, b1 );
+				__m128i low23 = _mm_unpacklo_epi8( b2, b3 ), high23 = _mm_unpackhi_epi8( b2, b3 );
+
+				__m128i sum = _mm_set1_epi32( static_cast<int>( previous[k] ) );
+				_mm_storeu_si128( reinterpret_cast<__m128i *>( lanes ), accumulate( _mm_unpacklo_epi16( low01, low23 ), sum ) );
+				_mm_storeu_si128( reinterpret_cast<__m128i *>( lanes + 4 ), accumulate( _mm_unpackhi_epi16( low01, low23 ), sum ) );
+				_mm_storeu_si128( reinterpret_cast<__m128i *>( lanes + 8 ), accumulate( _mm_unpacklo_epi16( high01, high23 ), sum ) );
+				_mm_storeu_si128( reinterpret_cast<__m128i *>( lanes + 12 ), accumulate( _mm_unpackhi_epi16( high01, high23 ), sum ) );
+				previous[k] = lanes[15];
+
+				for ( unsigned int i = 0; i < 16; ++i )
+					std::memcpy( out + i * stride + k * 4, &lanes[i], 4 );
+			}
+		}
+		return p;
+	}
+#endif
+
+	void put32( std::vector<unsigned char>& out, unsigned int value )
+	{
+		out.insert( out.end(), reinterpret_cast<const unsigned char *>( &value ), reinterpret_cast<const unsigned char *>( &value ) + 4 );
+	}
+
+	void put64( std::vector<unsigned char>& out, unsigned long long value )
+	{
+		out.insert( out.end(), reinterpret_cast<const unsigned char *>( &value ), reinterpret_cast<const unsigned char *>( &value ) + 8 );
+	}
+
+	// reads a value if there's room for it, advancing p
+	template <typename T>
+	bool get( const unsigned char *& p, const unsigned char * end, T& value )
+	{
+		if ( static_cast<size_t>( end - p ) < sizeof( T ) )
+			return false;
+		std::memcpy( &value, p, sizeof( T ) );
+		p += sizeof( T );
+		return true;
+	}
+}
+
+namespace meshcodec
+{
+	Kernel selectKernel( Kernel requested )
+	{
+#ifdef SCENE_SSSE3
+		if ( requested != SCALAR && cpuHasSSSE3() )
+			return SSSE3;
+#endif
+		return SCALAR;
+	}
+
+	void encodeIndices( const unsigned int * indices, size_t count, std::vector<unsigned char>& out )
+	{
+		encodeIndexStream( indices, count, out );
+	}
+
+	void encodeIndices( const unsigned short * indices, size_t count, std::vector<unsigned char>& out )
+	{
+		encodeIndexStream( indices, count, out );
+	}
+
+	size_t decodeIndices( const unsigned char * data, size_t size, unsigned int * indices, size_t count )
+	{
+		return decodeIndexStream( data, size, indices, count );
+	}
+
+	size_t decodeIndices( const unsigned char * data, size_t size, unsigned short * indices, size_t count )
+	{
+		return decodeIndexStream( data, size, indices, count );
+	}
+
+	void encodeVertices( const void * vertices, size_t count, size_t stride, std::vector<unsigned char>& out )
+	{
+		const unsigned char * source = static_cast<const unsigned char *>( vertices );
+		const size_t words = stride / 4;
+		std::vector<unsigned int> previous( words, 0 );
+		unsigned int values[16];
+
+		for ( size_t first = 0; first < count; first += 16 )
+		{
+			size_t block = count - first < 16 ? count - first : 16;
+			for ( size_t k = 0; k < words; ++k )
+			{
+				for ( size_t i = 0; i < 16; ++i )
+				{
+					values[i] = 0;
+					if ( i >= block )
+						continue;
+					unsigned int word;
+					std::memcpy( &word, source + ( first + i ) * stride + k * 4, 4 );
+					values[i] = zigzag( word - previous[k] );
+					previous[k] = word;
+				}
+
+				for ( unsigned int b = 0; b < 4; ++b )
+				{
+					size_t maskAt = out.size();
+					out.resize( maskAt + 2 );
+					unsigned int mask = 0;
+					for ( unsigned int i = 0; i < 16; ++i )
+					{
+						unsigned char byte = static_cast<unsigned char>( values[i] >> ( b * 8 ) );
+						if ( byte != 0 )
+						{
+							mask |= 1 << i;
+							out.push_back( byte );
+						}
+					}
+					out[maskAt] = static_cast<unsigned char>( mask );
+					out[maskAt + 1] = static_cast<unsigned char>( mask >> 8 );
+				}
+			}
+		}
+	}
+
+	size_t decodeVertices( const unsigned char * data, size_t size, void * vertices, size_t count, size_t stride, Kernel kernel )
+	{
+		unsigned char * out = static_cast<unsigned char *>( vertices );
+		const unsigned char * p = data;
+		const unsigned char * end = data + size;
+		std::vector<unsigned int> previous( stride / 4, 0 );
+
+		// the SIMD decoder takes full blocks for as long as it safely can, the reference does the rest
+		size_t block = 0;
+#ifdef SCENE_SSSE3
+		if ( selectKernel( kernel ) == SSSE3 )
+			p = decodeVerticesSSSE3( p, end, out, count / 16, stride, previous.data(), block );
+#else
+		( void )kernel;
+#endif
+		for ( ; block * 16 < count && p != NULL; ++block )
+		{
+			size_t first = block * 16;
+			p = decodeVertexBlock( p, end, out + first * stride, count - first < 16 ? count - first : 16, stride, previous.data() );
+		}
+		return p != NULL ? static_cast<size_t>( p - data ) : 0;
+	}
+
+	void encodeMesh( const Mesh& mesh, std::vector<unsigned char>& out )
+	{
+		put32( out, MESH_MAGIC );
+		put32( out, MESH_VERSION );
+		put64( out, mesh.vertices.size() );
+		put64( out, mesh.indices16.size() );
+		put64( out, mesh.indices32.size() );
+		put64( out, mesh.submeshes.size() );
+		for ( size_t s = 0; s < mesh.submeshes.size(); ++s )
+		{
+			const Mesh::SubMesh& submesh = mesh.submeshes[s];
+			put32( out, static_cast<unsigned int>( submesh.group ) );
+			put32( out, static_cast<unsigned int>( submesh.materialID ) );
+			put32( out, static_cast<unsigned int>( submesh.vertexType ) );
+			put32( out, submesh.indexSize );
+			put64( out, submesh.vertexOffset );
+			put64( out, submesh.vertexCount );
+			put64( out, submesh.indexOffset );
+			put64( out, submesh.indexCount );
+		}
+
+		// each stream is preceded by its coded size, so a reader can hand them out to separate threads
+		std::vector<unsigned char> stream;
+		encodeVertices( mesh.vertices.data(), mesh.vertices.size(), sizeof( Mesh::Vertex ), stream );
+		put64( out, stream.size() );
+		out.insert( out.end(), stream.begin(), stream.end() );
+
+		stream.clear();
+		encodeIndices( mesh.indices16.data(), mesh.indices16.size(), stream );
+		put64( out, stream.size() );
+		out.insert( out.end(), stream.begin(), stream.end() );
+
+		stream.clear();
+		encodeIndices( mesh.indices32.data(), mesh.indices32.size(), stream );
+		put64( out, stream.size() );
+		out.insert( out.end(), stream.begin(), stream.end() );
+	}
+
+	bool decodeMesh( const unsigned char * data, size_t size, Mesh& mesh, Kernel kernel )
+	{
+		mesh.clear();
+		const unsigned char * p = data;
+		const unsigned char * end = data + size;
+
+		unsigned int magic, version;
+		unsigned long long vertexCount, index16Count, index32Count, submeshCount;
+		if ( !get( p, end, magic ) || !get( p, end, version ) || magic != MESH_MAGIC || version != MESH_VERSION ||
+			 !get( p, end, vertexCount ) || !get( p, end, index16Count ) || !get( p, end, index32Count ) || !get( p, end, submeshCount ) )
+			return false;
+
+		// every submesh record is 48 bytes; checking first keeps a corrupt count from allocating
+		if ( submeshCount > static_cast<size_t>( end - p ) / 48 )
+			return false;
+		mesh.submeshes.resize( static_cast<size_t>( submeshCount ) );
+		for ( size_t s = 0; s < mesh.submeshes.size(); ++s )
+		{
+			Mesh::SubMesh& submesh = mesh.submeshes[s];
+			unsigned int group, materialID, vertexType, indexSize;
+			unsigned long long vertexOffset, submeshVertices, indexOffset, indexCount;
+			if ( !get( p, end, group ) || !get( p, end, materialID ) || !get( p, end, vertexType ) || !get( p, end, indexSize ) ||
+				 !get( p, end, vertexOffset ) || !get( p, end, submeshVertices ) || !get( p, end, indexOffset ) || !get( p, end, indexCount ) )
+				return false;
+			submesh.group = static_cast<int>( group );
+			submesh.materialID = static_cast<int>( materialID );
+			submesh.vertexType = static_cast<ObjModel::Triangle::VertexType>( vertexType );
+			submesh.indexSize = indexSize;
+			submesh.vertexOffset = static_cast<size_t>( vertexOffset );
+			submesh.vertexCount = static_cast<size_t>( submeshVertices );
+			submesh.indexOffset = static_cast<size_t>( indexOffset );
+			submesh.indexCount = static_cast<size_t>( indexCount );
+		}
+
+		// a stream can't decode to more than 64 values per byte, which bounds the allocations below
+		unsigned long long bytes;
+		if ( !get( p, end, bytes ) || bytes > static_cast<size_t>( end - p ) || vertexCount > bytes * 64 / sizeof( Mesh::Vertex ) + 16 )
+			return false;
+		mesh.vertices.resize( static_cast<size_t>( vertexCount ) );
+		if ( decodeVertices( p, static_cast<size_t>( bytes ), mesh.vertices.data(), mesh.vertices.size(), sizeof( Mesh::Vertex ), kernel ) == 0 &&
+			 vertexCount > 0 )
+			return false;
+		p += bytes;
+
+		if ( !get( p, end, bytes ) || bytes > static_cast<size_t>( end - p ) || index16Count > bytes * 4 )
+			return false;
+		mesh.indices16.resize( static_cast<size_t>( index16Count ) );
+		if ( decodeIndices( p, static_cast<size_t>( bytes ), mesh.indices16.data(), mesh.indices16.size() ) == 0 && index16Count > 0 )
+			return false;
+		p += bytes;
+
+		if ( !get( p, end, bytes ) || bytes > static_cast<size_t>( end - p ) || index32Count > bytes * 4 )
+			return false;
+		mesh.indices32.resize( static_cast<size_t>( index32Count ) );
+		if ( decodeIndices( p, static_cast<size_t>( bytes ), mesh.indices32.data(), mesh.indices32.size() ) == 0 && index32Count > 0 )
+			return false;
+
+		// the submesh table must describe the buffers it came with, and every index stay inside its
+		// submesh's vertexes
+		for ( size_t s = 0; s < mesh.submeshes.size(); ++s )
+		{
+			const Mesh::SubMesh& submesh = mesh.submeshes[s];
+			size_t indexTotal = submesh.indexSize == 2 ? mesh.indices16.size() : mesh.indices32.size();
+			if ( ( submesh.indexSize != 2 && submesh.indexSize != 4 ) ||
+				 submesh.vertexOffset > mesh.vertices.size() || submesh.vertexCount > mesh.vertices.size() - submesh.vertexOffset ||
+				 submesh.indexOffset > indexTotal || submesh.indexCount > indexTotal - submesh.indexOffset )
+				return false;
+
+			size_t largest = 0;
+			for ( size_t i = submesh.indexOffset; i < submesh.indexOffset + submesh.indexCount; ++i )
+				largest = std::max<size_t>( largest, submesh.indexSize == 2 ? mesh.indices16[i] : mesh.indices32[i] );
+			if ( submesh.indexCount > 0 && largest >= submesh.vertexCount )
+				return false;
+		}
+		return true;
+	}
+}
@@ -0,0 +1,51 @@
+#ifndef _MESHCODEC_H_
+#define _MESHCODEC_H_
+
+#include <scene/mesh.hpp>
+#include <vector>
+#include <cstddef>
+
+/*
+ * Lossless compression of welded index and vertex streams, for shipping and caching cooked meshes.
+ *
+ * Indexes are coded a triangle at a time against what the coder remembers of the last ones: the
+ * 15 most recent edges and 14 most recent new vertexes. Cache-ordered triangles (see MeshOptimizer)
+ * mostly share an edge with one just coded and add the next unused vertex or a recent one, which
+ * takes one code byte: the shared edge's age and the third vertex's code. Triangles with no
+ * remembered edge take a second byte for their other vertexes, and vertexes found nowhere are
+ * zigzagged deltas from the last such one, as varints. A triangle may start on any of its edges,
+ * so its rotation is kept in 2 more bits and it decodes exactly as it was. Every code depends on
+ * the ones before it, so indexes decode with the scalar coder alone.
+ *
+ * Vertexes are split into 32-bit words; each word is delta coded against the same word of the
+ * previous vertex and zigzagged, then the four bytes of the word go into separate byte planes.
+ * High bytes of nearby floats rarely change, so most planes are nearly all zeros. Each plane is
+ * stored in blocks of 16 vertices as a 16-bit mask of the non-zero bytes followed by those bytes.
+ *
+ * The scalar vertex decoder is the reference; the SSSE3 one is picked at runtime where the CPU has it.
+ */
+namespace meshcodec
+{
+	enum Kernel { AUTO, SCALAR, SSSE3 };
+
+	// the kernel AUTO (or an unsupported request) resolves to on this machine
+	Kernel selectKernel( Kernel requested );
+
+	// appends the coded indexes to out
+	void encodeIndices( const unsigned int * indices, size_t count, std::vector<unsigned char>& out );
+	void encodeIndices( const unsigned short * indices, size_t count, std::vector<unsigned char>& out );
+
+	// decodes count indexes; returns the number of bytes read, or 0 if data is too short
+	size_t decodeIndices( const unsigned char * data, size_t size, unsigned int * indices, size_t count );
+	size_t decodeIndices( const unsigned char * data, size_t size, unsigned short * indices, size_t count );
+
+	// vertexes are count records of stride bytes; stride must be a multiple of 4
+	void encodeVertices( const void * vertices, size_t count, size_t stride, std::vector<unsigned char>& out );
+	size_t decodeVertices( const unsigned char * data, size_t size, void * vertices, size_t count, size_t stride, Kernel kernel = AUTO );
+
+	// a whole Mesh - its submesh table, vertexes and both index buffers
+	void encodeMesh( const Mesh& mesh, std::vector<unsigned char>& out );
+	bool decodeMesh( const unsigned char * data, size_t size, Mesh& mesh, Kernel kernel = AUTO );
+}
+
+#endif // _MESHCODEC_H_
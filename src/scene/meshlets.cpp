@@ -0,0 +1,258 @@
+#include "meshlets.hpp"
+#include "threadpool.hpp"
+#include "simd.hpp"
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+namespace
+{
+	struct Bounds
+	{
+		glm::vec3 center;
+		float radius;
+		glm::vec3 coneAxis;
+		float coneCutoff;
+	};
+
+	// meshlets for one submesh, before they're placed into the shared arrays
+	struct LocalMeshlets
+	{
+		std::vector<MeshletSet::Meshlet> meshlets;
+		std::vector<unsigned int> vertices;
+		std::vector<unsigned char> triangles;
+		std::vector<Bounds> bounds;
+	};
+
+	Bounds computeBounds( const Mesh::Vertex * mesh, const unsigned int * vertices, size_t vertexCount,
+						  const unsigned char * triangles, size_t triangleCount )
+	{
+		Bounds bounds;
+
+		// sphere around the box center; loose, but quick and never smaller than the meshlet
+		glm::vec3 lo( std::numeric_limits<float>::max() ), hi( -std::numeric_limits<float>::max() );
+		for ( size_t v = 0; v < vertexCount; ++v )
+		{
+			lo = glm::min( lo, mesh[vertices[v]].position );
+			hi = glm::max( hi, mesh[vertices[v]].position );
+		}
+		bounds.center = ( lo + hi ) * 0.5f;
+		bounds.radius = 0.0f;
+		for ( size_t v = 0; v < vertexCount; ++v )
+			bounds.radius = glm::max( bounds.radius, glm::length( mesh[vertices[v]].position - bounds.center ) );
+
+		// the cone axis is the average facing; the cutoff comes from the normal furthest from it
+		glm::vec3 normals[MeshletSet::MAX_TRIANGLES];
+		size_t normalCount = 0;
+		glm::vec3 axis( 0.0f );
+		for ( size_t t = 0; t < triangleCount; ++t )
+		{
+			const glm::vec3& a = mesh[vertices[triangles[t * 3]]].position;
+			const glm::vec3& b = mesh[vertices[triangles[t * 3 + 1]]].position;
+			const glm::vec3& c = mesh[vertices[triangles[t * 3 + 2]]].position;
+			glm::vec3 n = glm::cross( b - a, c - a );
+			float length = glm::length( n );
+			if ( length > 0.0f )
+			{
+				normals[normalCount] = n / length;
+				axis += normals[normalCount++];
+			}
+		}
+
+		float axisLength = glm::length( axis );
+		bounds.coneAxis = axisLength > 0.0f ? axis / axisLength : glm::vec3( 0.0f, 0.0f, 1.0f );
+		bounds.coneCutoff = 1.0f;
+		if ( axisLength > 0.0f )
+		{
+			float minDot = 1.0f;
+			for ( size_t n = 0; n < normalCount; ++n )
+				minDot = glm::min( minDot, glm::dot( normals[n], bounds.coneAxis ) );
+
+			// the cone is only useful while it's narrower than a hemisphere
+			if ( minDot > 0.0f )
+				bounds.coneCutoff = std::sqrt( 1.0f - minDot * minDot );
+		}
+		return bounds;
+	}
+
+	// greedy scan in index order: keep adding triangles until one would overflow a limit
+	void buildSubMesh( const Mesh& mesh, unsigned int s, std::vector<unsigned char>& local, LocalMeshlets& out )
+	{
+		const Mesh::SubMesh& submesh = mesh.submeshes[s];
+		const Mesh::Vertex * base = &mesh.vertices[submesh.vertexOffset];
+
+		// local[v] is v's slot in the current meshlet, or 0xff if it's not in it
+		local.assign( submesh.vertexCount, 0xff );
+
+		MeshletSet::Meshlet current = { s, 0, 0, 0, 0 };
+		for ( size_t i = 0; i <= submesh.indexCount; i += 3 )
+		{
+			unsigned int tri[3] = { 0, 0, 0 };
+			unsigned int added = 0;
+			if ( i < submesh.indexCount )
+			{
+				for ( int k = 0; k < 3; ++k )
+				{
+					tri[k] = mesh.index( submesh, i + k );
+					added += local[tri[k]] == 0xff && ( k == 0 || tri[k] != tri[0] ) && ( k < 2 || tri[k] != tri[1] );
+				}
+			}
+
+			bool full = current.vertexCount + added > MeshletSet::MAX_VERTICES ||
+						current.triangleCount + 1u > MeshletSet::MAX_TRIANGLES;
+			if ( current.triangleCount > 0 && ( full || i == submesh.indexCount ) )
+			{
+				out.bounds.push_back( computeBounds( base, &out.vertices[current.vertexOffset], current.vertexCount,
+													 &out.triangles[current.triangleOffset], current.triangleCount ) );
+				out.meshlets.push_back( current );
+
+				for ( unsigned int v = 0; v < current.vertexCount; ++v )
+					local[out.vertices[current.vertexOffset + v]] = 0xff;
+
+				current.vertexOffset = static_cast<unsigned int>( out.vertices.size() );
+				current.triangleOffset = static_cast<unsigned int>( out.triangles.size() );
+				current.vertexCount = 0;
+				current.triangleCount = 0;
+			}
+			if ( i == submesh.indexCount )
+				break;
+
+			for ( int k = 0; k < 3; ++k )
+			{
+				if ( local[tri[k]] == 0xff )
+				{
+					local[tri[k]] = current.vertexCount++;
+					out.vertices.push_back( tri[k] );
+				}
+				out.triangles.push_back( local[tri[k]] );
+			}
+			++current.triangleCount;
+		}
+
+		// store mesh-wide vertex indexes, so meshlets don't need their submesh to be drawn
+		for ( size_t v = 0; v < out.vertices.size(); ++v )
+			out.vertices[v] += static_cast<unsigned int>( submesh.vertexOffset );
+	}
+}
+
+void MeshletSet::clear()
+{
+	meshlets.clear();
+	vertices.clear();
+	triangles.clear();
+	centerX.clear(); centerY.clear(); centerZ.clear(); radius.clear();
+	coneAxisX.clear(); coneAxisY.clear(); coneAxisZ.clear(); coneCutoff.clear();
+}
+
+void MeshletSet::build( const Mesh& mesh )
+{
+	clear();
+
+	std::vector<LocalMeshlets> locals( mesh.submeshes.size() );
+	ThreadPool::shared().parallelFor( mesh.submeshes.size(), [&]( size_t begin, size_t end )
+	{
+		std::vector<unsigned char> scratch;
+		for ( size_t s = begin; s < end; ++s )
+			buildSubMesh( mesh, static_cast<unsigned int>( s ), scratch, locals[s] );
+	} );
+
+	size_t count = 0;
+	for ( size_t s = 0; s < locals.size(); ++s )
+		count += locals[s].meshlets.size();
+
+	// pad the culling arrays to whole groups of four; padding spheres have negative radius, so they're never visible
+	size_t padded = ( count + 3 ) & ~size_t( 3 );
+	meshlets.reserve( count );
+	centerX.assign( padded, 0.0f ); centerY.assign( padded, 0.0f ); centerZ.assign( padded, 0.0f );
+	radius.assign( padded, -std::numeric_limits<float>::max() );
+	coneAxisX.assign( padded, 0.0f ); coneAxisY.assign( padded, 0.0f ); coneAxisZ.assign( padded, 1.0f );
+	coneCutoff.assign( padded, 1.0f );
+
+	for ( size_t s = 0; s < locals.size(); ++s )
+	{
+		LocalMeshlets& local = locals[s];
+		unsigned int vertexBase = static_cast<unsigned int>( vertices.size() );
+		unsigned int triangleBase = static_cast<unsigned int>( triangles.size() );
+		vertices.insert( vertices.end(), local.vertices.begin(), local.vertices.end() );
+		triangles.insert( triangles.end(), local.triangles.begin(), local.triangles.end() );
+
+		for ( size_t m = 0; m < local.meshlets.size(); ++m )
+		{
+			Meshlet meshlet = local.meshlets[m];
+			meshlet.vertexOffset += vertexBase;
+			meshlet.triangleOffset += triangleBase;
+
+			size_t i = meshlets.size();
+			const Bounds& bounds = local.bounds[m];
+			centerX[i] = bounds.center.x; centerY[i] = bounds.center.y; centerZ[i] = bounds.center.z;
+			radius[i] = bounds.radius;
+			coneAxisX[i] = bounds.coneAxis.x; coneAxisY[i] = bounds.coneAxis.y; coneAxisZ[i] = bounds.coneAxis.z;
+			coneCutoff[i] = bounds.coneCutoff;
+			meshlets.push_back( meshlet );
+		}
+	}
+}
+
+size_t MeshletSet::cull( const glm::vec3& eye, const glm::vec4 planes[6], std::vector<unsigned int>& visible ) const
+{
+	size_t before = visible.size();
+	size_t padded = centerX.size();
+
+	/*
+	 * sphere vs plane: visible if dot( plane.xyz, center ) + plane.w > -radius for all six planes
+	 * normal cone: back-facing if dot( center - eye, axis ) >= cutoff * |center - eye| + radius
+	 */
+#ifdef SCENE_SSE2
+	for ( size_t i = 0; i < padded; i += 4 )
+	{
+		__m128 cx = _mm_loadu_ps( &centerX[i] );
+		__m128 cy = _mm_loadu_ps( &centerY[i] );
+		__m128 cz = _mm_loadu_ps( &centerZ[i] );
+		__m128 r = _mm_loadu_ps( &radius[i] );
+		__m128 negr = _mm_sub_ps( _mm_setzero_ps(), r );
+
+		__m128 inside = _mm_castsi128_ps( _mm_set1_epi32( -1 ) );
+		for ( int p = 0; p < 6; ++p )
+		{
+			__m128 d = _mm_add_ps( _mm_add_ps( _mm_mul_ps( _mm_set1_ps( planes[p].x ), cx ),
+											   _mm_mul_ps( _mm_set1_ps( planes[p].y ), cy ) ),
+								   _mm_add_ps( _mm_mul_ps( _mm_set1_ps( planes[p].z ), cz ),
+											   _mm_set1_ps( planes[p].w ) ) );
+			inside = _mm_and_ps( inside, _mm_cmpgt_ps( d, negr ) );
+		}
+
+		__m128 dx = _mm_sub_ps( cx, _mm_set1_ps( eye.x ) );
+		__m128 dy = _mm_sub_ps( cy, _mm_set1_ps( eye.y ) );
+		__m128 dz = _mm_sub_ps( cz, _mm_set1_ps( eye.z ) );
+		__m128 distance = _mm_sqrt_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( dx, dx ), _mm_mul_ps( dy, dy ) ), _mm_mul_ps( dz, dz ) ) );
+		__m128 facing = _mm_add_ps( _mm_add_ps( _mm_mul_ps( dx, _mm_loadu_ps( &coneAxisX[i] ) ),
+												_mm_mul_ps( dy, _mm_loadu_ps( &coneAxisY[i] ) ) ),
+									_mm_mul_ps( dz, _mm_loadu_ps( &coneAxisZ[i] ) ) );
+		__m128 backfacing = _mm_cmpge_ps( facing, _mm_add_ps( _mm_mul_ps( _mm_loadu_ps( &coneCutoff[i] ), distance ), r ) );
+
+		int mask = _mm_movemask_ps( _mm_andnot_ps( backfacing, inside ) );
+		while ( mask != 0 )
+		{
+			unsigned int bit = lowestBit( mask );
+			visible.push_back( static_cast<unsigned int>( i + bit ) );
+			mask &= mask - 1;
+		}
+	}
+#else
+	for ( size_t i = 0; i < padded; ++i )
+	{
+		glm::vec3 center( centerX[i], centerY[i], centerZ[i] );
+		bool inside = true;
+		for ( int p = 0; p < 6; ++p )
+			inside = inside && glm::dot( glm::vec3( planes[p] ), center ) + planes[p].w > -radius[i];
+
+		glm::vec3 toCenter = center - eye;
+		glm::vec3 axis( coneAxisX[i], coneAxisY[i], coneAxisZ[i] );
+		bool backfacing = glm::dot( toCenter, axis ) >= coneCutoff[i] * glm::length( toCenter ) + radius[i];
+
+		if ( inside && !backfacing )
+			visible.push_back( static_cast<unsigned int>( i ) );
+	}
+#endif
+	return visible.size() - before;
+}
@@ -0,0 +1,58 @@
+#ifndef _MESHLETS_H_
+#define _MESHLETS_H_
+
+#include <scene/mesh.hpp>
+#include <vector>
+#include <cstddef>
+#include <glm/glm.hpp>
+
+/*
+ * Small clusters of triangles ("meshlets") cut from each Mesh submesh, for culling at a finer
+ * grain than whole models. Each meshlet has at most MAX_VERTICES vertices and MAX_TRIANGLES
+ * triangles, a bounding sphere, and a normal cone that lets back-facing clusters be rejected.
+ *
+ * Culling data is stored as structure-of-arrays, padded to a multiple of four meshlets,
+ * so cull() can test four meshlets per iteration with SSE.
+ */
+class MeshletSet
+{
+public:
+	static const unsigned int MAX_VERTICES = 64;
+	static const unsigned int MAX_TRIANGLES = 124;
+
+	struct Meshlet
+	{
+		unsigned int submesh;        // index into the Mesh's submeshes
+		unsigned int vertexOffset;   // first entry in vertices
+		unsigned int triangleOffset; // first entry in triangles (3 bytes per triangle)
+		unsigned char vertexCount;
+		unsigned char triangleCount;
+	};
+
+	std::vector<Meshlet> meshlets;
+	std::vector<unsigned int> vertices;   // meshlet-local vertex -> index into Mesh::vertices
+	std::vector<unsigned char> triangles; // meshlet-local vertex indexes, three per triangle
+
+	// bounding spheres
+	std::vector<float> centerX, centerY, centerZ, radius;
+	// normal cones: every triangle's normal lies within the cone around coneAxis;
+	// coneCutoff is 1 when the triangles face too many ways for the cone to reject anything
+	std::vector<float> coneAxisX, coneAxisY, coneAxisZ, coneCutoff;
+
+	// rebuilds the meshlets from the current index order of each submesh (run MeshOptimizer first
+	// for tighter clusters); submeshes are processed in parallel
+	void build( const Mesh& mesh );
+
+	void clear();
+
+	size_t size() const { return meshlets.size(); }
+
+	/*
+	 * Appends the meshlets that are at least partly inside the frustum and not entirely back-facing.
+	 * eye and planes must be in the mesh's space (planes are ax + by + cz + d >= 0 inside, normalized).
+	 * Returns the number of visible meshlets.
+	 */
+	size_t cull( const glm::vec3& eye, const glm::vec4 planes[6], std::vector<unsigned int>& visible ) const;
+};
+
+#endif // _MESHLETS_H_
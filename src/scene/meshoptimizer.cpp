@@ -0,0 +1,375 @@
+#include "meshoptimizer.hpp"
+#include "threadpool.hpp"
+#include <SFML/System/Clock.hpp>
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+	typedef std::vector<unsigned int> IndexList;
+
+	/*
+	 * FIFO post-transform cache, using timestamps instead of a queue:
+	 * a vertex is cached if it was inserted within the last cacheSize misses.
+	 */
+	class FifoCache
+	{
+	public:
+		FifoCache( size_t vertexCount, unsigned int size ) : stamps( vertexCount, 0 ), time( size + 1 ), size( size )
+		{
+		}
+
+		// returns true on a miss
+		bool access( unsigned int v )
+		{
+			if ( time - stamps[v] <= size )
+				return false;
+			stamps[v] = time++;
+			return true;
+		}
+
+		// empties the cache without touching every vertex
+		void flush()
+		{
+			time += size + 1;
+		}
+
+	private:
+		std::vector<unsigned int> stamps;
+		unsigned int time;
+		unsigned int size;
+	};
+
+	// LRU post-transform cache; the cache is small, so a move-to-front array is fastest
+	class LruCache
+	{
+	public:
+		explicit LruCache( unsigned int size ) : entries( size, ~0u )
+		{
+		}
+
+		bool access( unsigned int v )
+		{
+			std::vector<unsigned int>::iterator found = std::find( entries.begin(), entries.end(), v );
+			bool miss = found == entries.end();
+			if ( miss )
+				found = entries.end() - 1;
+			std::copy_backward( entries.begin(), found, found + 1 );
+			entries[0] = v;
+			return miss;
+		}
+
+	private:
+		std::vector<unsigned int> entries;
+	};
+
+	MeshOptimizer::CacheStats simulate( const IndexList& indices, size_t vertexCount, unsigned int cacheSize, bool lru )
+	{
+		MeshOptimizer::CacheStats result;
+		result.triangles = indices.size() / 3;
+
+		std::vector<char> used( vertexCount, 0 );
+		for ( size_t i = 0; i < indices.size(); ++i )
+		{
+			result.vertices += !used[indices[i]];
+			used[indices[i]] = 1;
+		}
+
+		if ( lru )
+		{
+			LruCache cache( cacheSize );
+			for ( size_t i = 0; i < indices.size(); ++i )
+				result.misses += cache.access( indices[i] );
+		}
+		else
+		{
+			FifoCache cache( vertexCount, cacheSize );
+			for ( size_t i = 0; i < indices.size(); ++i )
+				result.misses += cache.access( indices[i] );
+		}
+		return result;
+	}
+
+	/*
+	 * Tipsify: fan around a vertex, emitting all of its remaining triangles, then move to the
+	 * most recently cached neighbour that will still be in the cache after its own fan.
+	 * When there is no such neighbour, fall back to the dead-end stack (recently used vertices),
+	 * and failing that to the next vertex in index order - those jumps are the hard boundaries
+	 * the overdraw pass is allowed to cut at.
+	 */
+	void tipsify( const IndexList& in, size_t vertexCount, unsigned int cacheSize,
+				  IndexList& out, std::vector<size_t>& hardBoundaries )
+	{
+		size_t triangleCount = in.size() / 3;
+
+		// vertex -> triangle adjacency, compressed into one array
+		std::vector<unsigned int> live( vertexCount, 0 );
+		for ( size_t i = 0; i < in.size(); ++i )
+			++live[in[i]];
+
+		std::vector<size_t> offsets( vertexCount + 1, 0 );
+		for ( size_t v = 0; v < vertexCount; ++v )
+			offsets[v + 1] = offsets[v] + live[v];
+
+		std::vector<unsigned int> adjacency( in.size() );
+		std::vector<size_t> fill( offsets.begin(), offsets.end() - 1 );
+		for ( size_t i = 0; i < in.size(); ++i )
+			adjacency[fill[in[i]]++] = static_cast<unsigned int>( i / 3 );
+
+		std::vector<unsigned int> cache( vertexCount, 0 );
+		std::vector<char> emitted( triangleCount, 0 );
+		std::vector<unsigned int> deadEnd;
+		std::vector<unsigned int> candidates;
+
+		out.clear();
+		out.reserve( in.size() );
+		hardBoundaries.clear();
+
+		unsigned int time = cacheSize + 1;
+		size_t cursor = 0;
+		long fan = in.empty() ? -1 : in[0];
+
+		while ( fan >= 0 )
+		{
+			candidates.clear();
+			for ( size_t a = offsets[fan]; a < offsets[fan + 1]; ++a )
+			{
+				unsigned int t = adjacency[a];
+				if ( emitted[t] )
+					continue;
+
+				for ( int k = 0; k < 3; ++k )
+				{
+					unsigned int v = in[t * 3 + k];
+					out.push_back( v );
+					deadEnd.push_back( v );
+					candidates.push_back( v );
+					--live[v];
+					if ( time - cache[v] > cacheSize )
+						cache[v] = time++;
+				}
+				emitted[t] = 1;
+			}
+
+			// pick the candidate that entered the cache longest ago, as long as fanning around it won't evict
+			// it first (the Tipsify rule); candidates that would be evicted rank last
+			long next = -1;
+			int bestPriority = -1;
+			for ( size_t c = 0; c < candidates.size(); ++c )
+			{
+				unsigned int v = candidates[c];
+				if ( live[v] == 0 )
+					continue;
+
+				int priority = 0;
+				if ( time - cache[v] + 2 * live[v] <= cacheSize )
+					priority = static_cast<int>( time - cache[v] );
+				if ( priority > bestPriority )
+				{
+					bestPriority = priority;
+					next = v;
+				}
+			}
+
+			if ( next < 0 )
+			{
+				while ( !deadEnd.empty() && next < 0 )
+				{
+					unsigned int v = deadEnd.back();
+					deadEnd.pop_back();
+					if ( live[v] > 0 )
+						next = v;
+				}
+				while ( next < 0 && cursor < vertexCount )
+				{
+					if ( live[cursor] > 0 )
+						next = static_cast<long>( cursor );
+					++cursor;
+				}
+				if ( next >= 0 )
+					hardBoundaries.push_back( out.size() / 3 );
+			}
+			fan = next;
+		}
+	}
+
+	// splits the hard clusters further wherever the cache efficiency so far allows it
+	void softBoundaries( const IndexList& indices, size_t vertexCount, unsigned int cacheSize, float threshold,
+						 const std::vector<size_t>& hard, std::vector<size_t>& clusters )
+	{
+		size_t triangleCount = indices.size() / 3;
+		clusters.clear();
+
+		FifoCache cache( vertexCount, cacheSize );
+		for ( size_t h = 0; h <= hard.size(); ++h )
+		{
+			size_t start = h == 0 ? 0 : hard[h - 1];
+			size_t end = h < hard.size() ? hard[h] : triangleCount;
+			if ( start >= end )
+				continue;
+
+			cache.flush();
+			size_t clusterMisses = 0;
+			for ( size_t i = start * 3; i < end * 3; ++i )
+				clusterMisses += cache.access( indices[i] );
+			float limit = threshold * float( clusterMisses ) / float( end - start );
+
+			cache.flush();
+			size_t misses = 0, faces = 0;
+			clusters.push_back( start );
+			for ( size_t t = start; t < end; ++t )
+			{
+				for ( int k = 0; k < 3; ++k )
+					misses += cache.access( indices[t * 3 + k] );
+				++faces;
+
+				if ( t + 1 < end && misses <= limit * faces )
+				{
+					clusters.push_back( t + 1 );
+					cache.flush();
+					misses = faces = 0;
+				}
+			}
+		}
+	}
+
+	struct ClusterKey
+	{
+		size_t start, end;
+		float sortKey;
+
+		bool operator<( const ClusterKey& other ) const { return sortKey > other.sortKey; }
+	};
+
+	// draws clusters that face away from the middle of the mesh first, since they tend to occlude the rest
+	void sortClusters( const IndexList& indices, const Mesh::Vertex * vertices, const std::vector<size_t>& starts, IndexList& out )
+	{
+		size_t triangleCount = indices.size() / 3;
+		std::vector<ClusterKey> clusters( starts.size() );
+		std::vector<glm::vec3> centroids( starts.size() );
+		std::vector<glm::vec3> normals( starts.size() );
+
+		glm::vec3 meshCentroid( 0.0f );
+		float meshArea = 0.0f;
+		for ( size_t c = 0; c < starts.size(); ++c )
+		{
+			clusters[c].start = starts[c];
+			clusters[c].end = c + 1 < starts.size() ? starts[c + 1] : triangleCount;
+
+			glm::vec3 centroid( 0.0f ), normal( 0.0f );
+			float area = 0.0f;
+			for ( size_t t = clusters[c].start; t < clusters[c].end; ++t )
+			{
+				const glm::vec3& a = vertices[indices[t * 3]].position;
+				const glm::vec3& b = vertices[indices[t * 3 + 1]].position;
+				const glm::vec3& d = vertices[indices[t * 3 + 2]].position;
+				glm::vec3 n = glm::cross( b - a, d - a );
+				float triangleArea = glm::length( n );
+
+				centroid += ( a + b + d ) * ( triangleArea / 3.0f );
+				normal += n;
+				area += triangleArea;
+			}
+
+			meshCentroid += centroid;
+			meshArea += area;
+			centroids[c] = area > 0.0f ? centroid / area : centroid;
+			normals[c] = normal;
+		}
+		if ( meshArea > 0.0f )
+			meshCentroid /= meshArea;
+
+		for ( size_t c = 0; c < clusters.size(); ++c )
+		{
+			float length = glm::length( normals[c] );
+			clusters[c].sortKey = length > 0.0f ? glm::dot( centroids[c] - meshCentroid, normals[c] / length ) : 0.0f;
+		}
+		std::stable_sort( clusters.begin(), clusters.end() );
+
+		out.clear();
+		out.reserve( indices.size() );
+		for ( size_t c = 0; c < clusters.size(); ++c )
+			out.insert( out.end(), indices.begin() + clusters[c].start * 3, indices.begin() + clusters[c].end * 3 );
+	}
+
+	void readIndices( const Mesh& mesh, const Mesh::SubMesh& submesh, IndexList& out )
+	{
+		out.resize( submesh.indexCount );
+		for ( size_t i = 0; i < submesh.indexCount; ++i )
+			out[i] = mesh.index( submesh, i );
+	}
+
+	void writeIndices( Mesh& mesh, const Mesh::SubMesh& submesh, const IndexList& in )
+	{
+		for ( size_t i = 0; i < submesh.indexCount; ++i )
+		{
+			if ( submesh.indexSize == 2 )
+				mesh.indices16[submesh.indexOffset + i] = static_cast<unsigned short>( in[i] );
+			else
+				mesh.indices32[submesh.indexOffset + i] = in[i];
+		}
+	}
+
+	void accumulate( MeshOptimizer::CacheStats& total, const MeshOptimizer::CacheStats& part )
+	{
+		total.triangles += part.triangles;
+		total.vertices += part.vertices;
+		total.misses += part.misses;
+	}
+}
+
+MeshOptimizer::MeshOptimizer()
+{
+}
+
+MeshOptimizer::MeshOptimizer( const Options& options ) : options( options )
+{
+}
+
+MeshOptimizer::CacheStats MeshOptimizer::simulateCache( const Mesh& mesh, const Mesh::SubMesh& submesh ) const
+{
+	IndexList indices;
+	readIndices( mesh, submesh, indices );
+	return simulate( indices, submesh.vertexCount, options.cacheSize, options.lruCache );
+}
+
+void MeshOptimizer::optimize( Mesh& mesh )
+{
+	sf::Clock clock;
+	stats = Stats();
+
+	std::vector<Stats> results( mesh.submeshes.size() );
+	ThreadPool::shared().parallelFor( mesh.submeshes.size(), [&]( size_t begin, size_t end )
+	{
+		IndexList indices, ordered, sorted;
+		std::vector<size_t> hard, clusters;
+
+		for ( size_t s = begin; s < end; ++s )
+		{
+			const Mesh::SubMesh& submesh = mesh.submeshes[s];
+			readIndices( mesh, submesh, indices );
+			results[s].before = simulate( indices, submesh.vertexCount, options.cacheSize, options.lruCache );
+
+			tipsify( indices, submesh.vertexCount, options.cacheSize, ordered, hard );
+
+			if ( options.reorderForOverdraw )
+			{
+				softBoundaries( ordered, submesh.vertexCount, options.cacheSize, options.overdrawThreshold, hard, clusters );
+				sortClusters( ordered, &mesh.vertices[submesh.vertexOffset], clusters, sorted );
+				ordered.swap( sorted );
+				results[s].clusters = clusters.size();
+			}
+
+			writeIndices( mesh, submesh, ordered );
+			results[s].after = simulate( ordered, submesh.vertexCount, options.cacheSize, options.lruCache );
+		}
+	} );
+
+	for ( size_t s = 0; s < results.size(); ++s )
+	{
+		accumulate( stats.before, results[s].before );
+		accumulate( stats.after, results[s].after );
+		stats.clusters += results[s].clusters;
+	}
+	stats.seconds = clock.getElapsedTime().asSeconds();
+}
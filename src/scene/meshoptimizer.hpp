@@ -0,0 +1,80 @@
+#ifndef _MESHOPTIMIZER_H_
+#define _MESHOPTIMIZER_H_
+
+#include <scene/mesh.hpp>
+#include <cstddef>
+
+/*
+ * Load-time triangle reordering for Mesh submeshes.
+ * Triangles are first ordered for the post-transform vertex cache with Tipsify
+ * (Sander, Nehab & Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw", 2007),
+ * then the output is cut into clusters that are sorted so outward-facing parts of the mesh draw first,
+ * which helps early-z reject the rest. Vertex data is not touched, only the index buffers.
+ *
+ * Everything is linear in the number of triangles and fully deterministic.
+ */
+class MeshOptimizer
+{
+public:
+
+	struct Options
+	{
+		unsigned int cacheSize;  // vertices in the simulated post-transform cache
+		bool lruCache;           // simulate an LRU cache for the reported stats instead of FIFO
+		bool reorderForOverdraw; // run the cluster sort after the cache pass
+		float overdrawThreshold; // how much ACMR a cluster split may cost, as a fraction of the cache-optimized ACMR
+
+		Options() : cacheSize( 16 ),
+					lruCache( false ),
+					reorderForOverdraw( true ),
+					overdrawThreshold( 1.05f )
+		{
+		}
+	};
+
+	// post-transform cache efficiency of a stream of triangles
+	struct CacheStats
+	{
+		size_t triangles;
+		size_t vertices; // unique vertices referenced
+		size_t misses;   // vertex shader invocations
+
+		CacheStats() : triangles( 0 ), vertices( 0 ), misses( 0 )
+		{
+		}
+
+		// average cache miss ratio: shaded vertices per triangle, 0.5 at best and 3 at worst
+		float acmr() const { return triangles > 0 ? float( misses ) / float( triangles ) : 0.0f; }
+		// average transformed vertex ratio: shaded vertices per unique vertex, 1 is optimal
+		float atvr() const { return vertices > 0 ? float( misses ) / float( vertices ) : 0.0f; }
+	};
+
+	struct Stats
+	{
+		CacheStats before;
+		CacheStats after;
+		size_t clusters;
+		float seconds;
+
+		Stats() : clusters( 0 ), seconds( 0.0f )
+		{
+		}
+	};
+
+	MeshOptimizer();
+	explicit MeshOptimizer( const Options& options );
+
+	// reorders the triangles of every submesh in place; submeshes are processed in parallel
+	void optimize( Mesh& mesh );
+
+	// runs the cache simulation over one submesh's current index order
+	CacheStats simulateCache( const Mesh& mesh, const Mesh::SubMesh& submesh ) const;
+
+	const Stats& getStats() const { return stats; }
+
+private:
+	Options options;
+	Stats stats;
+};
+
+#endif // _MESHOPTIMIZER_H_
@@ -0,0 +1,468 @@
+#include "mipchain.hpp"
+#include "threadpool.hpp"
+#include "simd.hpp"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+namespace
+{
+	const double PI = 3.14159265358979323846;
+
+	// linear values are encoded through a table with this many steps between 0 and 1
+	const unsigned int ENCODE_STEPS = 65535;
+
+	float srgbToLinear( float c )
+	{
+		return c <= 0.04045f ? c / 12.92f : std::pow( ( c + 0.055f ) / 1.055f, 2.4f );
+	}
+
+	float linearToSrgb( float c )
+	{
+		return c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow( c, 1.0f / 2.4f ) - 0.055f;
+	}
+
+	float clamp01( float c )
+	{
+		return std::min( std::max( c, 0.0f ), 1.0f );
+	}
+
+	struct ColorTables
+	{
+		float decodeSrgb[256];
+		float decodeLinear[256];
+		unsigned char encodeSrgb[ENCODE_STEPS + 1];
+		int encodeSrgbWide[ENCODE_STEPS + 1]; // the same, 32 bits wide for AVX2 gathers
+
+		ColorTables()
+		{
+			for ( unsigned int i = 0; i < 256; ++i )
+			{
+				decodeSrgb[i] = srgbToLinear( i / 255.0f );
+				decodeLinear[i] = i / 255.0f;
+			}
+			for ( unsigned int i = 0; i <= ENCODE_STEPS; ++i )
+			{
+				encodeSrgb[i] = static_cast<unsigned char>( linearToSrgb( i / static_cast<float>( ENCODE_STEPS ) ) * 255.0f + 0.5f );
+				encodeSrgbWide[i] = encodeSrgb[i];
+			}
+		}
+	};
+
+	const ColorTables& colorTables()
+	{
+		static const ColorTables tables;
+		return tables;
+	}
+
+	// the input texels each output texel reads along one axis, padded to the same count for all of them
+	struct Taps
+	{
+		unsigned int count;
+		std::vector<int> index;    // clamped to the edge of the input
+		std::vector<float> weight; // sum to 1 for each output texel
+	};
+
+	// modified Bessel function of the first kind, order zero, for the Kaiser window
+	double besselI0( double x )
+	{
+		double sum = 1.0, term = 1.0, half = x * 0.5;
+		for ( int k = 1; k < 50 && term > sum * 1e-12; ++k )
+		{
+			term *= ( half / k ) * ( half / k );
+			sum += term;
+		}
+		return sum;
+	}
+
+	double sinc( double x )
+	{
+		return x == 0.0 ? 1.0 : std::sin( PI * x ) / ( PI * x );
+	}
+
+	void makeTaps( unsigned int src, unsigned int dst, const MipChain::Options& options, Taps& taps )
+	{
+		std::vector<std::vector<std::pair<int, float> > > texels( dst );
+		double scale = static_cast<double>( src ) / dst;
+		double norm = besselI0( options.kaiserAlpha );
+		for ( unsigned int x = 0; x < dst; ++x )
+		{
+			std::vector<std::pair<int, float> >& out = texels[x];
+			std::vector<double> weights;
+			std::vector<int> indexes;
+			if ( src == dst )
+			{
+				indexes.push_back( x );
+				weights.push_back( 1.0 );
+			}
+			else if ( options.filter == MipChain::BOX )
+			{
+				// exact coverage of the output texel's footprint, which is 2 or 3 texels wide for odd sizes
+				double lo = x * scale, hi = ( x + 1 ) * scale;
+				for ( int i = static_cast<int>( std::floor( lo ) ); i < static_cast<int>( std::ceil( hi ) ); ++i )
+				{
+					indexes.push_back( i );
+					weights.push_back( std::min( hi, i + 1.0 ) - std::max( lo, static_cast<double>( i ) ) );
+				}
+			}
+			else
+			{
+				// distances are measured in output texels, so the sinc's zeros fall between output samples
+				double center = ( x + 0.5 ) * scale;
+				double reach = options.kaiserRadius * scale;
+				for ( int i = static_cast<int>( std::floor( center - reach ) ); i <= static_cast<int>( std::ceil( center + reach ) ); ++i )
+				{
+					double d = ( i + 0.5 - center ) / scale;
+					double u = d / options.kaiserRadius;
+					if ( u * u >= 1.0 )
+						continue;
+					indexes.push_back( i );
+					weights.push_back( sinc( d ) * besselI0( options.kaiserAlpha * std::sqrt( 1.0 - u * u ) ) / norm );
+				}
+			}
+
+			double total = 0.0;
+			for ( size_t k = 0; k < weights.size(); ++k )
+				total += weights[k];
+			for ( size_t k = 0; k < weights.size(); ++k )
+			{
+				if ( weights[k] == 0.0 )
+					continue;
+				int index = std::min( std::max( indexes[k], 0 ), static_cast<int>( src ) - 1 );
+				out.push_back( std::make_pair( index, static_cast<float>( weights[k] / total ) ) );
+			}
+		}
+
+		taps.count = 0;
+		for ( unsigned int x = 0; x < dst; ++x )
+			taps.count = std::max( taps.count, static_cast<unsigned int>( texels[x].size() ) );
+
+		// padding taps read the last real texel again, with no weight
+		taps.index.resize( dst * taps.count );
+		taps.weight.resize( dst * taps.count );
+		for ( unsigned int x = 0; x < dst; ++x )
+		{
+			for ( unsigned int k = 0; k < taps.count; ++k )
+			{
+				bool real = k < texels[x].size();
+				taps.index[x * taps.count + k] = real ? texels[x][k].first : texels[x].back().first;
+				taps.weight[x * taps.count + k] = real ? texels[x][k].second : 0.0f;
+			}
+		}
+	}
+
+	/*
+	 * Kernels. Pixels are four floats (RGBA). Every kernel accumulates taps in the same order with
+	 * separate multiplies and adds, so the SIMD kernels give exactly the scalar results; only the
+	 * encoders differ, since the scalar one computes the sRGB curve instead of using the table.
+	 */
+
+	// dst[x] = sum over k of src[index[x][k]] * weight[x][k], for each output pixel x in a row
+	typedef void ( *RowFilter )( const float * src, float * dst, unsigned int width, const int * index, const float * weight, unsigned int count );
+
+	// dst[i] = sum over k of rows[k][i] * weight[k], for floats i in [0, floats)
+	typedef void ( *ColumnFilter )( const float * const * rows, const float * weight, unsigned int count, float * dst, size_t floats );
+
+	// float pixels to RGBA8, encoding color channels to sRGB if asked to
+	typedef void ( *Encoder )( const float * src, unsigned char * dst, size_t pixels, bool srgb );
+
+	void rowFilterScalar( const float * src, float * dst, unsigned int width, const int * index, const float * weight, unsigned int count )
+	{
+		for ( unsigned int x = 0; x < width; ++x, index += count, weight += count, dst += 4 )
+		{
+			float r = 0.0f, g = 0.0f, b = 0.0f, a = 0.0f;
+			for ( unsigned int k = 0; k < count; ++k )
+			{
+				const float * texel = src + index[k] * 4;
+				r = r + texel[0] * weight[k];
+				g = g + texel[1] * weight[k];
+				b = b + texel[2] * weight[k];
+				a = a + texel[3] * weight[k];
+			}
+			dst[0] = r;
+			dst[1] = g;
+			dst[2] = b;
+			dst[3] = a;
+		}
+	}
+
+	void columnFilterScalar( const float * const * rows, const float * weight, unsigned int count, float * dst, size_t floats )
+	{
+		for ( size_t i = 0; i < floats; ++i )
+		{
+			float sum = 0.0f;
+			for ( unsigned int k = 0; k < count; ++k )
+				sum = sum + rows[k][i] * weight[k];
+			dst[i] = sum;
+		}
+	}
+
+	void encodeScalar( const float * src, unsigned char * dst, size_t pixels, bool srgb )
+	{
+		for ( size_t i = 0; i < pixels * 4; ++i )
+		{
+			float c = clamp01( src[i] );
+			if ( srgb && ( i & 3 ) != 3 )
+				c = linearToSrgb( c );
+			// round to nearest even, as the SIMD conversions do
+			dst[i] = static_cast<unsigned char>( std::nearbyint( c * 255.0f ) );
+		}
+	}
+
+#ifdef SCENE_SSE2
+	void rowFilterSSE2( const float * src, float * dst, unsigned int width, const int * index, const float * weight, unsigned int count )
+	{
+		for ( unsigned int x = 0; x < width; ++x, index += count, weight += count, dst += 4 )
+		{
+			__m128 sum = _mm_setzero_ps();
+			for ( unsigned int k = 0; k < count; ++k )
+				sum = _mm_add_ps( sum, _mm_mul_ps( _mm_loadu_ps( src + index[k] * 4 ), _mm_set1_ps( weight[k] ) ) );
+			_mm_storeu_ps( dst, sum );
+		}
+	}
+
+	void columnFilterSSE2( const float * const * rows, const float * weight, unsigned int count, float * dst, size_t floats )
+	{
+		// rows are whole pixels, so floats is always a multiple of 4
+		for ( size_t i = 0; i < floats; i += 4 )
+		{
+			__m128 sum = _mm_setzero_ps();
+			for ( unsigned int k = 0; k < count; ++k )
+				sum = _mm_add_ps( sum, _mm_mul_ps( _mm_loadu_ps( rows[k] + i ), _mm_set1_ps( weight[k] ) ) );
+			_mm_storeu_ps( dst + i, sum );
+		}
+	}
+
+	// scales one pixel to table steps (color) or bytes (alpha) and rounds, then looks color up
+	inline void encodePixelSSE2( __m128 pixel, __m128 scale, unsigned char * dst, bool srgb )
+	{
+		const unsigned char * table = colorTables().encodeSrgb;
+		pixel = _mm_min_ps( _mm_max_ps( pixel, _mm_setzero_ps() ), _mm_set1_ps( 1.0f ) );
+		int values[4];
+		_mm_storeu_si128( reinterpret_cast<__m128i *>( values ), _mm_cvtps_epi32( _mm_mul_ps( pixel, scale ) ) );
+		for ( int c = 0; c < 3; ++c )
+			dst[c] = srgb ? table[values[c]] : static_cast<unsigned char>( values[c] );
+		dst[3] = static_cast<unsigned char>( values[3] );
+	}
+
+	void encodeSSE2( const float * src, unsigned char * dst, size_t pixels, bool srgb )
+	{
+		__m128 scale = srgb ? _mm_setr_ps( ENCODE_STEPS, ENCODE_STEPS, ENCODE_STEPS, 255.0f ) : _mm_set1_ps( 255.0f );
+		for ( size_t i = 0; i < pixels; ++i )
+			encodePixelSSE2( _mm_loadu_ps( src + i * 4 ), scale, dst + i * 4, srgb );
+	}
+#endif
+
+#ifdef SCENE_AVX2
+	// two output pixels per iteration, each half of the register reading its own taps
+	SCENE_TARGET_AVX2
+	void rowFilterAVX2( const float * src, float * dst, unsigned int width, const int * index, const float * weight, unsigned int count )
+	{
+		unsigned int x = 0;
+		for ( ; x + 2 <= width; x += 2, index += count * 2, weight += count * 2, dst += 8 )
+		{
+			__m256 sum = _mm256_setzero_ps();
+			for ( unsigned int k = 0; k < count; ++k )
+			{
+				__m256 texels = _mm256_insertf128_ps( _mm256_castps128_ps256( _mm_loadu_ps( src + index[k] * 4 ) ),
+													  _mm_loadu_ps( src + index[count + k] * 4 ), 1 );
+				__m256 weights = _mm256_insertf128_ps( _mm256_castps128_ps256( _mm_set1_ps( weight[k] ) ),
+													   _mm_set1_ps( weight[count + k] ), 1 );
+				sum = _mm256_add_ps( sum, _mm256_mul_ps( texels, weights ) );
+			}
+			_mm256_storeu_ps( dst, sum );
+		}
+		if ( x < width )
+			rowFilterSSE2( src, dst, width - x, index, weight, count );
+	}
+
+	SCENE_TARGET_AVX2
+	void columnFilterAVX2( const float * const * rows, const float * weight, unsigned int count, float * dst, size_t floats )
+	{
+		size_t i = 0;
+		for ( ; i + 8 <= floats; i += 8 )
+		{
+			__m256 sum = _mm256_setzero_ps();
+			for ( unsigned int k = 0; k < count; ++k )
+				sum = _mm256_add_ps( sum, _mm256_mul_ps( _mm256_loadu_ps( rows[k] + i ), _mm256_set1_ps( weight[k] ) ) );
+			_mm256_storeu_ps( dst + i, sum );
+		}
+		for ( ; i < floats; ++i )
+		{
+			float sum = 0.0f;
+			for ( unsigned int k = 0; k < count; ++k )
+				sum = sum + rows[k][i] * weight[k];
+			dst[i] = sum;
+		}
+	}
+
+	// scale, clamp and round eight channels at once, with the sRGB table lookups done by gather
+	SCENE_TARGET_AVX2
+	void encodeAVX2( const float * src, unsigned char * dst, size_t pixels, bool srgb )
+	{
+		const int * table = colorTables().encodeSrgbWide;
+		__m256 scale = srgb ? _mm256_setr_ps( ENCODE_STEPS, ENCODE_STEPS, ENCODE_STEPS, 255.0f, ENCODE_STEPS, ENCODE_STEPS, ENCODE_STEPS, 255.0f )
+							: _mm256_set1_ps( 255.0f );
+		__m256i colorMask = _mm256_setr_epi32( -1, -1, -1, 0, -1, -1, -1, 0 );
+		size_t i = 0;
+		for ( ; i + 2 <= pixels; i += 2 )
+		{
+			__m256 pixel = _mm256_loadu_ps( src + i * 4 );
+			pixel = _mm256_min_ps( _mm256_max_ps( pixel, _mm256_setzero_ps() ), _mm256_set1_ps( 1.0f ) );
+			__m256i values = _mm256_cvtps_epi32( _mm256_mul_ps( pixel, scale ) );
+			if ( srgb )
+				values = _mm256_mask_i32gather_epi32( values, table, values, colorMask, 4 );
+
+			// 8 x 32 bits -> 8 bytes
+			__m256i words = _mm256_packus_epi32( values, values );
+			__m256i bytes = _mm256_packus_epi16( words, words );
+			unsigned int lo = static_cast<unsigned int>( _mm256_extract_epi32( bytes, 0 ) );
+			unsigned int hi = static_cast<unsigned int>( _mm256_extract_epi32( bytes, 4 ) );
+			std::memcpy( dst + i * 4, &lo, 4 );
+			std::memcpy( dst + i * 4 + 4, &hi, 4 );
+		}
+		if ( i < pixels )
+			encodeSSE2( src + i * 4, dst + i * 4, pixels - i, srgb );
+	}
+#endif
+
+	struct Kernels
+	{
+		RowFilter rows;
+		ColumnFilter columns;
+		Encoder encode;
+	};
+
+	Kernels getKernels( MipChain::Kernel kernel )
+	{
+		Kernels kernels = { rowFilterScalar, columnFilterScalar, encodeScalar };
+#ifdef SCENE_SSE2
+		if ( kernel == MipChain::SSE2 )
+		{
+			Kernels sse2 = { rowFilterSSE2, columnFilterSSE2, encodeSSE2 };
+			kernels = sse2;
+		}
+#endif
+#ifdef SCENE_AVX2
+		if ( kernel == MipChain::AVX2 )
+		{
+			Kernels avx2 = { rowFilterAVX2, columnFilterAVX2, encodeAVX2 };
+			kernels = avx2;
+		}
+#endif
+		return kernels;
+	}
+
+	// runs body over [0, rows), on the thread pool if asked to, in pieces of about 64K floats
+	void forRows( size_t rows, size_t floatsPerRow, bool parallel, const std::function<void( size_t, size_t )>& body )
+	{
+		if ( parallel && rows > 1 )
+			ThreadPool::shared().parallelFor( rows, body, std::max<size_t>( 1, 65536 / std::max<size_t>( floatsPerRow, 1 ) ) );
+		else
+			body( 0, rows );
+	}
+}
+
+MipChain::Kernel MipChain::selectKernel( Kernel requested )
+{
+#ifdef SCENE_AVX2
+	if ( ( requested == AUTO || requested == AVX2 ) && cpuHasAVX2() )
+		return AVX2;
+#endif
+#ifdef SCENE_SSE2
+	if ( requested != SCALAR )
+		return SSE2;
+#endif
+	return SCALAR;
+}
+
+bool MipChain::build( const sf::Image& image, const Options& options )
+{
+	return build( image.getPixelsPtr(), image.getSize().x, image.getSize().y, options );
+}
+
+bool MipChain::build( const unsigned char * rgba, unsigned int width, unsigned int height, const Options& options )
+{
+	clear();
+	if ( rgba == NULL || width == 0 || height == 0 )
+		return false;
+
+	// lay out every level first, so the whole chain is one allocation
+	size_t bytes = 0;
+	for ( unsigned int w = width, h = height; ; w = std::max( w / 2, 1u ), h = std::max( h / 2, 1u ) )
+	{
+		Level level = { w, h, bytes };
+		levels.push_back( level );
+		bytes += static_cast<size_t>( w ) * h * 4;
+		if ( w == 1 && h == 1 )
+			break;
+	}
+	pixels.resize( bytes );
+	std::memcpy( &pixels[0], rgba, static_cast<size_t>( width ) * height * 4 );
+
+	Kernels kernels = getKernels( selectKernel( options.kernel ) );
+	const ColorTables& tables = colorTables();
+	const float * decodeColor = options.srgb ? tables.decodeSrgb : tables.decodeLinear;
+
+	// each level is filtered from the unrounded floats of the level above, not from its bytes
+	std::vector<float> current( static_cast<size_t>( width ) * height * 4 );
+	forRows( height, width * 4, options.parallel, [&]( size_t begin, size_t end )
+	{
+		for ( size_t i = begin * width * 4; i < end * width * 4; ++i )
+			current[i] = ( i & 3 ) == 3 ? tables.decodeLinear[rgba[i]] : decodeColor[rgba[i]];
+	} );
+
+	std::vector<float> filtered, next;
+	for ( size_t l = 1; l < levels.size(); ++l )
+	{
+		const Level& above = levels[l - 1];
+		const Level& level = levels[l];
+
+		Taps columns, rows;
+		makeTaps( above.width, level.width, options, columns );
+		makeTaps( above.height, level.height, options, rows );
+
+		// horizontal pass: every row of the level above, to the new width
+		filtered.resize( static_cast<size_t>( level.width ) * above.height * 4 );
+		forRows( above.height, above.width * 4, options.parallel, [&]( size_t begin, size_t end )
+		{
+			for ( size_t y = begin; y < end; ++y )
+				kernels.rows( &current[y * above.width * 4], &filtered[y * level.width * 4], level.width,
+							  &columns.index[0], &columns.weight[0], columns.count );
+		} );
+
+		// vertical pass, then encode each finished row into the chain
+		next.resize( static_cast<size_t>( level.width ) * level.height * 4 );
+		forRows( level.height, level.width * 4 * rows.count, options.parallel, [&]( size_t begin, size_t end )
+		{
+			std::vector<const float *> sources( rows.count );
+			for ( size_t y = begin; y < end; ++y )
+			{
+				for ( unsigned int k = 0; k < rows.count; ++k )
+					sources[k] = &filtered[rows.index[y * rows.count + k] * level.width * 4];
+				float * row = &next[y * level.width * 4];
+				kernels.columns( &sources[0], &rows.weight[y * rows.count], rows.count, row, level.width * 4 );
+				kernels.encode( row, &pixels[level.offset + y * level.width * 4], level.width, options.srgb );
+			}
+		} );
+
+		current.swap( next );
+	}
+	return true;
+}
+
+void MipChain::buildAll( const std::vector<const sf::Image *>& images, std::vector<MipChain>& chains, const Options& options )
+{
+	chains.resize( images.size() );
+	ThreadPool::shared().parallelFor( images.size(), [&]( size_t begin, size_t end )
+	{
+		for ( size_t i = begin; i < end; ++i )
+			chains[i].build( *images[i], options );
+	} );
+}
+
+void MipChain::clear()
+{
+	levels.clear();
+	pixels.clear();
+}
@@ -0,0 +1,80 @@
+#ifndef _MIPCHAIN_H_
+#define _MIPCHAIN_H_
+
+#include <vector>
+#include <cstddef>
+#include <SFML/Graphics/Image.hpp>
+
+/*
+ * A full chain of RGBA8 mip levels for one image, from the image itself down to 1x1.
+ *
+ * Each level is filtered from the one above it in linear light: sRGB texels are decoded to linear
+ * floats, resampled with a separable box or Kaiser-windowed sinc filter, and encoded back to sRGB,
+ * so dark and bright texels average the way they look rather than the way they're stored. Odd and
+ * non-power-of-two sizes are handled exactly; every level is half the size of the previous one,
+ * rounded down. Alpha is always filtered as linear coverage.
+ *
+ * Filtering runs on SSE2, or AVX2 where the CPU has it, with rows split across the shared
+ * ThreadPool. The scalar kernel is kept as the reference for the others.
+ */
+class MipChain
+{
+public:
+	enum Filter
+	{
+		BOX,   // the average of each level's footprint in the level above; cheap and never rings
+		KAISER // a Kaiser-windowed sinc; keeps more detail, at the cost of a little ringing
+	};
+
+	enum Kernel { AUTO, SCALAR, SSE2, AVX2 };
+
+	struct Options
+	{
+		Filter filter;
+		bool srgb;          // filter color channels in linear light
+		float kaiserRadius; // filter support, in texels of the smaller level
+		float kaiserAlpha;  // window shape; larger is smoother with less ringing
+		Kernel kernel;
+		bool parallel;      // split each level's rows between threads
+
+		Options() : filter( BOX ),
+					srgb( true ),
+					kaiserRadius( 2.0f ),
+					kaiserAlpha( 4.0f ),
+					kernel( AUTO ),
+					parallel( true )
+		{
+		}
+	};
+
+	struct Level
+	{
+		unsigned int width;
+		unsigned int height;
+		size_t offset; // into the pixel buffer, in bytes
+	};
+
+	// builds every level from RGBA8 pixels; level 0 is a copy of the input
+	bool build( const unsigned char * rgba, unsigned int width, unsigned int height, const Options& options = Options() );
+	bool build( const sf::Image& image, const Options& options = Options() );
+
+	// builds chains for a batch of images at once, an image per task
+	static void buildAll( const std::vector<const sf::Image *>& images, std::vector<MipChain>& chains,
+						  const Options& options = Options() );
+
+	void clear();
+
+	size_t levelCount() const { return levels.size(); }
+	const Level& getLevel( size_t level ) const { return levels[level]; }
+	const unsigned char * getPixels( size_t level ) const { return &pixels[levels[level].offset]; }
+	size_t byteSize() const { return pixels.size(); }
+
+	// the kernel AUTO (or an unsupported request) resolves to on this machine
+	static Kernel selectKernel( Kernel requested );
+
+private:
+	std::vector<Level> levels;
+	std::vector<unsigned char> pixels; // all levels, largest first
+};
+
+#endif // _MIPCHAIN_H_
@@ -0,0 +1,238 @@
+#include "numparse.hpp"
+#include "simd.hpp"
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <clocale>
+#include <limits>
+
+namespace
+{
+	typedef unsigned long long uint64;
+
+	// powers of ten that are exact in float / double - the precondition for the fast paths
+	const float pow10f[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+	const double pow10d[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+							  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+	bool isDigit( char c ) { return c >= '0' && c <= '9'; }
+
+	// rounding a double to float is only wrong if the double landed exactly halfway between two floats
+	// (it can't have rounded *past* a float midpoint, since midpoints are representable doubles)
+	bool isFloatMidpoint( double d )
+	{
+		uint64 bits;
+		std::memcpy( &bits, &d, sizeof( bits ) );
+		const uint64 lowBits = ( uint64( 1 ) << 29 ) - 1; // double mantissa bits below float precision
+		return ( bits & lowBits ) == ( uint64( 1 ) << 28 );
+	}
+
+	// the slow path - hand the exact digits to the C library
+	// strtof honours the C locale's decimal point, so translate ours in case someone called setlocale
+	float parseSlow( const char * begin, const char * end )
+	{
+		char buffer[128];
+		std::string longNumber;
+		char * str = buffer;
+		size_t len = end - begin;
+		if ( len >= sizeof( buffer ) )
+		{
+			longNumber.assign( begin, end );
+			str = &longNumber[0];
+		}
+		else
+		{
+			std::memcpy( buffer, begin, len );
+			buffer[len] = '\0';
+		}
+
+		char point = *std::localeconv()->decimal_point;
+		if ( point != '.' )
+		{
+			char * dot = std::strchr( str, '.' );
+			if ( dot )
+				*dot = point;
+		}
+		return std::strtof( str, NULL );
+	}
+}
+
+namespace numparse
+{
+	bool parseFloat( const char *& p, const char * end, float& value )
+	{
+		const char * s = p;
+		bool negative = false;
+		if ( s < end && ( *s == '-' || *s == '+' ) )
+			negative = ( *s++ == '-' );
+
+		// collect up to 19 significant digits, which always fit in 64 bits
+		uint64 mantissa = 0;
+		int digits = 0;
+		int exponent = 0;
+		bool truncated = false;
+		bool any = false;
+
+		while ( s < end && *s == '0' )
+		{
+			++s;
+			any = true;
+		}
+		for ( ; s < end && isDigit( *s ); ++s, any = true )
+		{
+			if ( digits < 19 )
+			{
+				mantissa = mantissa * 10 + ( *s - '0' );
+				++digits;
+			}
+			else
+			{
+				++exponent;
+				truncated |= ( *s != '0' );
+			}
+		}
+		if ( s < end && *s == '.' )
+		{
+			++s;
+			if ( mantissa == 0 )
+			{
+				// leading zeros after the point only move the exponent
+				for ( ; s < end && *s == '0'; ++s, any = true )
+					--exponent;
+			}
+			for ( ; s < end && isDigit( *s ); ++s, any = true )
+			{
+				if ( digits < 19 )
+				{
+					mantissa = mantissa * 10 + ( *s - '0' );
+					++digits;
+					--exponent;
+				}
+				else
+				{
+					truncated |= ( *s != '0' );
+				}
+			}
+		}
+		if ( !any )
+			return false;
+
+		// the exponent is only consumed if it's well formed, like strtod
+		if ( s < end && ( *s == 'e' || *s == 'E' ) )
+		{
+			const char * e = s + 1;
+			bool negativeExp = false;
+			if ( e < end && ( *e == '-' || *e == '+' ) )
+				negativeExp = ( *e++ == '-' );
+			if ( e < end && isDigit( *e ) )
+			{
+				int exp = 0;
+				for ( ; e < end && isDigit( *e ); ++e )
+				{
+					if ( exp < 100000 )
+						exp = exp * 10 + ( *e - '0' );
+				}
+				exponent += negativeExp ? -exp : exp;
+				s = e;
+			}
+		}
+
+		const char * numberEnd = s;
+		float result;
+		if ( mantissa == 0 )
+		{
+			result = 0.0f;
+		}
+		else if ( !truncated && mantissa <= ( uint64( 1 ) << 24 ) && exponent >= -10 && exponent <= 10 )
+		{
+			// both operands are exact floats, so one IEEE operation rounds correctly
+			float m = static_cast<float>( mantissa );
+			result = exponent < 0 ? m / pow10f[-exponent] : m * pow10f[exponent];
+		}
+		else if ( !truncated && mantissa <= ( uint64( 1 ) << 53 ) && exponent >= -22 && exponent <= 22 )
+		{
+			// the same argument in double, then a second rounding to float that's exact
+			// unless the double sits on a float midpoint or outside the normal float range
+			double m = static_cast<double>( mantissa );
+			double d = exponent < 0 ? m / pow10d[-exponent] : m * pow10d[exponent];
+			if ( d >= std::numeric_limits<float>::min() && d <= std::numeric_limits<float>::max() && !isFloatMidpoint( d ) )
+				result = static_cast<float>( d );
+			else
+				result = std::fabs( parseSlow( p, numberEnd ) );
+		}
+		else
+		{
+			result = std::fabs( parseSlow( p, numberEnd ) );
+		}
+
+		value = negative ? -result : result;
+		p = numberEnd;
+		return true;
+	}
+
+	bool parseInt( const char *& p, const char * end, int& value )
+	{
+		const char * s = p;
+		bool negative = false;
+		if ( s < end && ( *s == '-' || *s == '+' ) )
+			negative = ( *s++ == '-' );
+
+		if ( s >= end || !isDigit( *s ) )
+			return false;
+
+		unsigned int result = 0;
+		for ( ; s < end && isDigit( *s ); ++s )
+			result = result * 10 + ( *s - '0' );
+
+		value = negative ? -static_cast<int>( result ) : static_cast<int>( result );
+		p = s;
+		return true;
+	}
+
+	const char * findChar( const char * p, const char * end, char c )
+	{
+#ifdef SCENE_SSE2
+		const __m128i needle = _mm_set1_epi8( c );
+		while ( end - p >= 16 )
+		{
+			__m128i block = _mm_loadu_si128( reinterpret_cast<const __m128i *>( p ) );
+			int mask = _mm_movemask_epi8( _mm_cmpeq_epi8( block, needle ) );
+			if ( mask != 0 )
+				return p + lowestBit( mask );
+			p += 16;
+		}
+#endif
+		while ( p < end && *p != c )
+			++p;
+		return p;
+	}
+
+	void normalizeBatch( glm::vec3 * v, size_t count )
+	{
+		size_t i = 0;
+#ifdef SCENE_SSE2
+		// transpose four vectors into x/y/z registers, then do the math of glm::normalize in lockstep
+		// the operations (and their order) match the scalar code, so results are bit-identical
+		const __m128 one = _mm_set1_ps( 1.0f );
+		for ( ; i + 4 <= count; i += 4 )
+		{
+			__m128 x = _mm_setr_ps( v[i].x, v[i + 1].x, v[i + 2].x, v[i + 3].x );
+			__m128 y = _mm_setr_ps( v[i].y, v[i + 1].y, v[i + 2].y, v[i + 3].y );
+			__m128 z = _mm_setr_ps( v[i].z, v[i + 1].z, v[i + 2].z, v[i + 3].z );
+
+			__m128 dot = _mm_add_ps( _mm_add_ps( _mm_mul_ps( x, x ), _mm_mul_ps( y, y ) ), _mm_mul_ps( z, z ) );
+			__m128 scale = _mm_div_ps( one, _mm_sqrt_ps( dot ) );
+
+			float sx[4], sy[4], sz[4];
+			_mm_storeu_ps( sx, _mm_mul_ps( x, scale ) );
+			_mm_storeu_ps( sy, _mm_mul_ps( y, scale ) );
+			_mm_storeu_ps( sz, _mm_mul_ps( z, scale ) );
+			for ( int k = 0; k < 4; ++k )
+				v[i + k] = glm::vec3( sx[k], sy[k], sz[k] );
+		}
+#endif
+		for ( ; i < count; ++i )
+			v[i] = glm::normalize( v[i] );
+	}
+}
@@ -0,0 +1,27 @@
+#ifndef _NUMPARSE_H_
+#define _NUMPARSE_H_
+
+#include <cstddef>
+#include <glm/glm.hpp>
+
+/*
+ * Locale-independent number parsing for the text loaders.
+ * Each parser reads from p (never past end), advances p past the number on success,
+ * and leaves p untouched on failure. Input doesn't need to be null-terminated.
+ */
+namespace numparse
+{
+	// decimal or scientific notation, correctly rounded to the nearest float
+	bool parseFloat( const char *& p, const char * end, float& value );
+
+	// an optionally signed decimal integer
+	bool parseInt( const char *& p, const char * end, int& value );
+
+	// returns the first occurrence of c in [p, end), or end - 16 bytes at a time where SSE2 is available
+	const char * findChar( const char * p, const char * end, char c );
+
+	// normalizes count vectors in place, four at a time; gives the same results as glm::normalize
+	void normalizeBatch( glm::vec3 * v, size_t count );
+}
+
+#endif // _NUMPARSE_H_
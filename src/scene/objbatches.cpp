@@ -0,0 +1,281 @@
+#include "objmodel.hpp"
+#include "threadpool.hpp"
+#include <algorithm>
+#include <limits>
+
+namespace
+{
+	typedef ObjModel::Triangle Triangle;
+
+	// groups are cut into pieces of this many triangles, so one big group still uses every thread
+	const size_t CHUNK_TRIANGLES = 1 << 15;
+
+	// materials are registry handles or -1, so the sort key is one more than the handle
+	size_t materialKey( const Triangle& triangle )
+	{
+		return triangle.materialID >= 0 ? static_cast<size_t>( triangle.materialID ) + 1 : 0;
+	}
+
+	// one piece of one group: its histogram, which becomes the piece's write positions
+	struct SortChunk
+	{
+		size_t group;
+		size_t begin, end;
+		size_t minKey, maxKey;
+		size_t countBase; // counts[i] is for key countBase + i, and covers minKey..maxKey
+		std::vector<size_t> counts;
+		bool counted; // false once the piece's keys spread wider than it has triangles
+		bool sorted; // keys never decrease inside the piece
+	};
+
+	// how one group is sorted: counted when its pieces' histograms are small enough to walk, otherwise
+	// (a few triangles with far-apart handles) compared
+	struct SortGroup
+	{
+		size_t firstChunk, lastChunk;
+		size_t minKey, maxKey;
+		bool sorted;
+		bool counted;
+	};
+
+	bool keyLess( const Triangle& a, const Triangle& b )
+	{
+		return materialKey( a ) < materialKey( b );
+	}
+
+	// the part of a batch that one thread measures
+	struct BoundsPiece
+	{
+		size_t batch;
+		size_t begin, end;
+		glm::vec3 boundsMin, boundsMax;
+	};
+}
+
+/*
+ * A stable counting sort in three passes, none of which write the same memory from two threads:
+ *  1. each piece of a group counts its keys, over just the range of keys it uses
+ *  2. the counts are turned into write positions, key by key and piece by piece within the group
+ *  3. each piece scatters its triangles to those positions, in order, so equal keys keep their order
+ * Histograms only span the keys a group uses, so the work follows the group's size rather than the
+ * number of materials in the scene; a group whose keys are spread wider than it has triangles is
+ * stable-sorted by comparison instead. Groups that are already sorted (one material, or a reload of
+ * a cached, sorted model) skip the scatter.
+ */
+void ObjModel::sortByMaterial()
+{
+	ThreadPool& pool = ThreadPool::shared();
+
+	std::vector<SortChunk> chunks;
+	std::vector<SortGroup> sortGroups( groups.size() );
+	for ( size_t g = 0; g < groups.size(); ++g )
+	{
+		sortGroups[g].firstChunk = chunks.size();
+		for ( size_t begin = 0; begin < groups[g].triangles.size(); begin += CHUNK_TRIANGLES )
+		{
+			SortChunk chunk;
+			chunk.group = g;
+			chunk.begin = begin;
+			chunk.end = std::min( begin + CHUNK_TRIANGLES, groups[g].triangles.size() );
+			chunk.minKey = chunk.maxKey = chunk.countBase = 0;
+			chunk.counted = true;
+			chunk.sorted = true;
+			chunks.push_back( chunk );
+		}
+		sortGroups[g].lastChunk = chunks.size();
+	}
+
+	// 1. histograms, grown to fit each key as it turns up
+	pool.parallelFor( chunks.size(), [&]( size_t begin, size_t end )
+	{
+		for ( size_t c = begin; c < end; ++c )
+		{
+			SortChunk& chunk = chunks[c];
+			const std::vector<Triangle>& triangles = groups[chunk.group].triangles;
+			chunk.minKey = chunk.maxKey = chunk.countBase = materialKey( triangles[chunk.begin] );
+			size_t previous = 0;
+			for ( size_t t = chunk.begin; t < chunk.end; ++t )
+			{
+				size_t key = materialKey( triangles[t] );
+				chunk.sorted = chunk.sorted && key >= previous;
+				previous = key;
+				chunk.minKey = std::min( chunk.minKey, key );
+				chunk.maxKey = std::max( chunk.maxKey, key );
+				if ( !chunk.counted )
+					continue;
+				if ( chunk.maxKey - chunk.minKey >= chunk.end - chunk.begin )
+				{
+					chunk.counted = false;
+					std::vector<size_t>().swap( chunk.counts );
+					continue;
+				}
+				if ( key < chunk.countBase )
+				{
+					// grow downwards by at least the current size, so repeated growth stays linear
+					size_t grow = std::min( std::max( chunk.countBase - key, chunk.counts.size() ), chunk.countBase );
+					chunk.counts.insert( chunk.counts.begin(), grow, 0 );
+					chunk.countBase -= grow;
+				}
+				else if ( key - chunk.countBase >= chunk.counts.size() )
+					chunk.counts.resize( key - chunk.countBase + 1, 0 );
+				++chunk.counts[key - chunk.countBase];
+			}
+		}
+	} );
+
+	for ( size_t g = 0; g < groups.size(); ++g )
+	{
+		SortGroup& group = sortGroups[g];
+		group.minKey = std::numeric_limits<size_t>::max();
+		group.maxKey = 0;
+		group.sorted = true;
+		group.counted = true;
+		for ( size_t c = group.firstChunk; c < group.lastChunk; ++c )
+		{
+			group.minKey = std::min( group.minKey, chunks[c].minKey );
+			group.maxKey = std::max( group.maxKey, chunks[c].maxKey );
+			group.counted = group.counted && chunks[c].counted;
+			group.sorted = group.sorted && chunks[c].sorted &&
+						   ( c == group.firstChunk || materialKey( groups[g].triangles[chunks[c].begin - 1] ) <= materialKey( groups[g].triangles[chunks[c].begin] ) );
+		}
+		// step 2 walks every key of the group for each of its pieces
+		size_t pieces = group.lastChunk - group.firstChunk;
+		group.counted = group.counted && ( pieces == 0 || ( group.maxKey - group.minKey + 1 ) * pieces <= groups[g].triangles.size() );
+	}
+
+	// 2. write positions, and the runs they leave behind become each group's draw batches
+	std::vector<std::vector<DrawBatch> > groupBatches( groups.size() );
+	std::vector<std::vector<Triangle> > sorted( groups.size() );
+	for ( size_t g = 0; g < groups.size(); ++g )
+	{
+		const SortGroup& group = sortGroups[g];
+		if ( !group.counted || group.firstChunk == group.lastChunk )
+			continue;
+
+		size_t position = 0;
+		for ( size_t key = group.minKey; key <= group.maxKey; ++key )
+		{
+			size_t start = position;
+			for ( size_t c = group.firstChunk; c < group.lastChunk; ++c )
+			{
+				SortChunk& chunk = chunks[c];
+				if ( key < chunk.countBase || key - chunk.countBase >= chunk.counts.size() )
+					continue;
+				size_t count = chunk.counts[key - chunk.countBase];
+				chunk.counts[key - chunk.countBase] = position;
+				position += count;
+			}
+			if ( position > start )
+			{
+				DrawBatch batch;
+				batch.group = static_cast<int>( g );
+				batch.materialID = static_cast<int>( key ) - 1;
+				batch.firstTriangle = start;
+				batch.triangleCount = position - start;
+				groupBatches[g].push_back( batch );
+			}
+		}
+
+		if ( !group.sorted )
+			sorted[g].resize( groups[g].triangles.size() );
+	}
+
+	// 3. scatter the counted groups that need it...
+	pool.parallelFor( chunks.size(), [&]( size_t begin, size_t end )
+	{
+		for ( size_t c = begin; c < end; ++c )
+		{
+			SortChunk& chunk = chunks[c];
+			std::vector<Triangle>& out = sorted[chunk.group];
+			if ( out.empty() )
+				continue;
+			const std::vector<Triangle>& triangles = groups[chunk.group].triangles;
+			for ( size_t t = chunk.begin; t < chunk.end; ++t )
+				out[chunk.counts[materialKey( triangles[t] ) - chunk.countBase]++] = triangles[t];
+		}
+	} );
+	for ( size_t g = 0; g < groups.size(); ++g )
+	{
+		if ( !sorted[g].empty() )
+			groups[g].triangles.swap( sorted[g] );
+	}
+
+	// ...and sort the rest by comparison if they need it, reading their batches off the sorted runs
+	pool.parallelFor( groups.size(), [&]( size_t begin, size_t end )
+	{
+		for ( size_t g = begin; g < end; ++g )
+		{
+			if ( sortGroups[g].counted )
+				continue;
+			std::vector<Triangle>& triangles = groups[g].triangles;
+			if ( !sortGroups[g].sorted )
+				std::stable_sort( triangles.begin(), triangles.end(), keyLess );
+			for ( size_t start = 0, t = 1; t <= triangles.size(); ++t )
+			{
+				if ( t < triangles.size() && materialKey( triangles[t] ) == materialKey( triangles[start] ) )
+					continue;
+				DrawBatch batch;
+				batch.group = static_cast<int>( g );
+				batch.materialID = static_cast<int>( materialKey( triangles[start] ) ) - 1;
+				batch.firstTriangle = start;
+				batch.triangleCount = t - start;
+				groupBatches[g].push_back( batch );
+				start = t;
+			}
+		}
+	} );
+
+	drawBatches.clear();
+	for ( size_t g = 0; g < groups.size(); ++g )
+		drawBatches.insert( drawBatches.end(), groupBatches[g].begin(), groupBatches[g].end() );
+
+	// bounds of each run, in pieces of at most CHUNK_TRIANGLES; corners with bad indexes are left
+	// out here and reported when a Mesh is built
+	std::vector<BoundsPiece> pieces;
+	for ( size_t b = 0; b < drawBatches.size(); ++b )
+	{
+		const DrawBatch& batch = drawBatches[b];
+		for ( size_t begin = 0; begin < batch.triangleCount; begin += CHUNK_TRIANGLES )
+		{
+			BoundsPiece piece;
+			piece.batch = b;
+			piece.begin = batch.firstTriangle + begin;
+			piece.end = batch.firstTriangle + std::min( begin + CHUNK_TRIANGLES, batch.triangleCount );
+			pieces.push_back( piece );
+		}
+	}
+
+	pool.parallelFor( pieces.size(), [&]( size_t begin, size_t end )
+	{
+		for ( size_t p = begin; p < end; ++p )
+		{
+			BoundsPiece& piece = pieces[p];
+			const std::vector<Triangle>& triangles = groups[drawBatches[piece.batch].group].triangles;
+			piece.boundsMin = glm::vec3( std::numeric_limits<float>::max() );
+			piece.boundsMax = glm::vec3( -std::numeric_limits<float>::max() );
+			for ( size_t t = piece.begin; t < piece.end; ++t )
+			{
+				for ( int k = 0; k < 3; ++k )
+				{
+					int v = triangles[t].vertices[k];
+					if ( v < 0 || static_cast<size_t>( v ) >= vertices.size() )
+						continue;
+					piece.boundsMin = glm::min( piece.boundsMin, vertices[v] );
+					piece.boundsMax = glm::max( piece.boundsMax, vertices[v] );
+				}
+			}
+		}
+	} );
+
+	for ( size_t b = 0; b < drawBatches.size(); ++b )
+	{
+		drawBatches[b].boundsMin = glm::vec3( std::numeric_limits<float>::max() );
+		drawBatches[b].boundsMax = glm::vec3( -std::numeric_limits<float>::max() );
+	}
+	for ( size_t p = 0; p < pieces.size(); ++p )
+	{
+		DrawBatch& batch = drawBatches[pieces[p].batch];
+		batch.boundsMin = glm::min( batch.boundsMin, pieces[p].boundsMin );
+		batch.boundsMax = glm::max( batch.boundsMax, pieces[p].boundsMax );
+	}
+}
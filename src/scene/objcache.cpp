@@ -0,0 +1,367 @@
+#include "objcache.hpp"
+#include "objmodel.hpp"
+#include "mappedfile.hpp"
+#include "contenthash.hpp"
+#include <SFML/System/Err.hpp>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+using namespace objcache;
+
+namespace
+{
+	const size_t RECORD_SIZES[SECTION_COUNT] =
+	{
+		sizeof( glm::vec3 ),
+		sizeof( glm::vec2 ),
+		sizeof( glm::vec3 ),
+		sizeof( ObjModel::Triangle ),
+		sizeof( GroupRecord ),
+		sizeof( StringRef ),
+		sizeof( DependencyRecord ),
+		sizeof( char )
+	};
+
+	// the options that change what a load produces, as header flags
+	uint32_t cacheFlags( const ObjModel::LoadOptions& options )
+	{
+		return ( options.generateNormals ? FLAG_GENERATED_NORMALS : 0 ) | ( options.sortByMaterial ? FLAG_SORTED_BY_MATERIAL : 0 );
+	}
+
+	bool stampFile( const std::string& filename, const MappedFile * mapped, FileStamp& stamp )
+	{
+		unsigned long long size;
+		long long mtime;
+		if ( !MappedFile::getFileInfo( filename, size, mtime ) )
+			return false;
+
+		MappedFile file;
+		if ( mapped == NULL )
+		{
+			if ( !file.open( filename ) )
+				return false;
+			mapped = &file;
+		}
+		stamp.size = size;
+		stamp.mtime = mtime;
+		stamp.hash = hashContent( mapped->data(), mapped->size() );
+		return true;
+	}
+
+	// the size has to match; the content is only hashed when the mtime has changed, so an
+	// untouched model is validated without reading it, and a touched-but-identical one still hits
+	bool stampMatches( const std::string& filename, const MappedFile * mapped, const FileStamp& stamp )
+	{
+		unsigned long long size;
+		long long mtime;
+		if ( !MappedFile::getFileInfo( filename, size, mtime ) || size != stamp.size )
+			return false;
+		if ( mtime == stamp.mtime )
+			return true;
+
+		MappedFile file;
+		if ( mapped == NULL )
+		{
+			if ( !file.open( filename ) )
+				return false;
+			mapped = &file;
+		}
+		return hashContent( mapped->data(), mapped->size() ) == stamp.hash;
+	}
+
+	StringRef addString( std::string& strings, const std::string& str )
+	{
+		StringRef ref;
+		ref.offset = static_cast<uint32_t>( strings.size() );
+		ref.length = static_cast<uint32_t>( str.size() );
+		strings += str;
+		return ref;
+	}
+
+	// a read-only view of a validated cache mapping
+	class CacheView
+	{
+	public:
+		CacheView( const MappedFile& file ) : file( file ), header( NULL ) {}
+
+		bool validate()
+		{
+			if ( file.size() < sizeof( Header ) )
+				return false;
+			header = reinterpret_cast<const Header *>( file.data() );
+			if ( std::memcmp( header->magic, MAGIC, sizeof( MAGIC ) ) != 0 ||
+				 header->version != VERSION ||
+				 header->endian != ENDIAN_MARKER ||
+				 header->triangleSize != sizeof( ObjModel::Triangle ) )
+				return false;
+
+			// every section has to fit in the file, so a truncated cache is caught here
+			for ( unsigned i = 0; i < SECTION_COUNT; ++i )
+			{
+				const SectionRecord& section = header->sections[i];
+				if ( section.offset % SECTION_ALIGNMENT != 0 ||
+					 section.offset > file.size() ||
+					 section.count > ( file.size() - section.offset ) / RECORD_SIZES[i] )
+					return false;
+			}
+			return true;
+		}
+
+		template <typename T>
+		const T * records( Section section ) const
+		{
+			return reinterpret_cast<const T *>( file.data() + header->sections[section].offset );
+		}
+
+		size_t count( Section section ) const { return static_cast<size_t>( header->sections[section].count ); }
+
+		bool validString( const StringRef& ref ) const
+		{
+			return ref.offset <= count( STRINGS ) && ref.length <= count( STRINGS ) - ref.offset;
+		}
+
+		std::string string( const StringRef& ref ) const
+		{
+			return std::string( records<char>( STRINGS ) + ref.offset, ref.length );
+		}
+
+		const Header& getHeader() const { return *header; }
+
+	private:
+		const MappedFile& file;
+		const Header * header;
+	};
+
+	template <typename T>
+	void copySection( const CacheView& view, Section section, std::vector<T>& out )
+	{
+		const T * records = view.records<T>( section );
+		out.assign( records, records + view.count( section ) );
+	}
+}
+
+std::string objcache::cacheFilename( const std::string& source )
+{
+	size_t dot = source.find_last_of( '.' );
+	size_t slash = source.find_last_of( "\\/" );
+	if ( dot == source.npos || ( slash != source.npos && dot < slash ) )
+		return source + ".objcache";
+	return source.substr( 0, dot ) + ".objcache";
+}
+
+/*
+ * Loads the model from its .objcache, if there is one and it was built from the same .obj and .mtl
+ * files with the same options. Nothing in the model changes unless this returns true.
+ *
+ * std::vector can't adopt memory it didn't allocate, so each section is copied out of the mapping
+ * in one go rather than referenced in place - still a straight memory copy, with no parsing.
+ */
+bool ObjModel::readCache( const std::string& source, const std::string& path, const MappedFile& file, const LoadOptions& options )
+{
+	// no cache yet is the common case, not an error worth reporting
+	std::string filename = cacheFilename( source );
+	unsigned long long size;
+	long long mtime;
+	MappedFile cache;
+	if ( !MappedFile::getFileInfo( filename, size, mtime ) || !cache.open( filename ) )
+		return false;
+
+	CacheView view( cache );
+	if ( !view.validate() )
+		return false;
+
+	const Header& header = view.getHeader();
+	if ( header.flags != cacheFlags( options ) || !stampMatches( source, &file, header.source ) )
+		return false;
+
+	const DependencyRecord * dependencies = view.records<DependencyRecord>( DEPENDENCIES );
+	for ( size_t i = 0; i < view.count( DEPENDENCIES ); ++i )
+	{
+		if ( !view.validString( dependencies[i].name ) ||
+			 !stampMatches( path + view.string( dependencies[i].name ), NULL, dependencies[i].stamp ) )
+			return false;
+	}
+
+	// check every reference before touching the model
+	const GroupRecord * groupRecords = view.records<GroupRecord>( GROUPS );
+	for ( size_t i = 0; i < view.count( GROUPS ); ++i )
+	{
+		if ( !view.validString( groupRecords[i].name ) ||
+			 groupRecords[i].firstTriangle > view.count( TRIANGLES ) ||
+			 groupRecords[i].triangleCount > view.count( TRIANGLES ) - groupRecords[i].firstTriangle )
+			return false;
+	}
+	const StringRef * materialNames = view.records<StringRef>( MATERIALS );
+	for ( size_t i = 0; i < view.count( MATERIALS ); ++i )
+	{
+		if ( !view.validString( materialNames[i] ) )
+			return false;
+	}
+
+	// the .mtl files are tiny, and the registry may already have them - load them as usual,
+	// then look up the cached material names to find this scene's handles for them
+	std::unordered_map<std::string, int> previousIDs;
+	std::vector<std::string> previousLibs;
+	previousIDs.swap( materialIDs );
+	previousLibs.swap( mtllibs );
+
+	bool ok = true;
+	for ( size_t i = 0; ok && i < view.count( DEPENDENCIES ); ++i )
+		ok = loadMTL( path, view.string( dependencies[i].name ) );
+
+	std::vector<int> handles( view.count( MATERIALS ) );
+	for ( size_t i = 0; ok && i < handles.size(); ++i )
+	{
+		std::unordered_map<std::string, int>::const_iterator material = materialIDs.find( view.string( materialNames[i] ) );
+		ok = ( material != materialIDs.end() );
+		if ( ok )
+			handles[i] = material->second;
+	}
+
+	const Triangle * triangles = view.records<Triangle>( TRIANGLES );
+	std::vector<TriangleGroup> cachedGroups( ok ? view.count( GROUPS ) : 0 );
+	for ( size_t i = 0; ok && i < cachedGroups.size(); ++i )
+	{
+		const GroupRecord& record = groupRecords[i];
+		cachedGroups[i].name = view.string( record.name );
+		cachedGroups[i].triangles.assign( triangles + record.firstTriangle,
+										  triangles + record.firstTriangle + record.triangleCount );
+
+		std::vector<Triangle>& group = cachedGroups[i].triangles;
+		for ( size_t t = 0; ok && t < group.size(); ++t )
+		{
+			int local = group[t].materialID;
+			ok = ( local >= -1 && local < static_cast<int>( handles.size() ) );
+			if ( ok && local >= 0 )
+				group[t].materialID = handles[local];
+		}
+	}
+
+	if ( !ok )
+	{
+		materialIDs.swap( previousIDs );
+		mtllibs.swap( previousLibs );
+		return false;
+	}
+
+	copySection( view, VERTICES, vertices );
+	copySection( view, TEXCOORDS, texcoords );
+	copySection( view, NORMALS, normals );
+	groups.swap( cachedGroups );
+	return true;
+}
+
+/*
+ * Writes the model as it stands to its .objcache. The cache is written to a temporary file and
+ * renamed into place, so another process never maps a half-written cache.
+ */
+bool ObjModel::writeCache( const std::string& source, const std::string& path, const MappedFile& file, const LoadOptions& options ) const
+{
+	Header header;
+	std::memset( &header, 0, sizeof( header ) );
+	std::memcpy( header.magic, MAGIC, sizeof( MAGIC ) );
+	header.version = VERSION;
+	header.endian = ENDIAN_MARKER;
+	header.triangleSize = sizeof( Triangle );
+	header.flags = cacheFlags( options );
+	if ( !stampFile( source, &file, header.source ) )
+		return false;
+
+	std::string strings;
+	std::vector<DependencyRecord> dependencies( mtllibs.size() );
+	for ( size_t i = 0; i < mtllibs.size(); ++i )
+	{
+		if ( !stampFile( path + mtllibs[i], NULL, dependencies[i].stamp ) )
+			return false;
+		dependencies[i].name = addString( strings, mtllibs[i] );
+	}
+
+	size_t triangleCount = 0;
+	std::vector<GroupRecord> groupRecords( groups.size() );
+	for ( size_t i = 0; i < groups.size(); ++i )
+	{
+		groupRecords[i].firstTriangle = triangleCount;
+		groupRecords[i].triangleCount = groups[i].triangles.size();
+		groupRecords[i].name = addString( strings, groups[i].name );
+		triangleCount += groups[i].triangles.size();
+	}
+
+	// registry handles mean nothing to the next run, so triangles store an index into a list of
+	// material names instead; any name for a handle will do, since it maps back to the same one
+	std::unordered_map<int, int> locals;
+	std::vector<StringRef> materialNames;
+	for ( std::unordered_map<std::string, int>::const_iterator it = materialIDs.begin(); it != materialIDs.end(); ++it )
+	{
+		if ( locals.count( it->second ) == 0 )
+		{
+			locals[it->second] = static_cast<int>( materialNames.size() );
+			materialNames.push_back( addString( strings, it->first ) );
+		}
+	}
+
+	// triangles are translated and written a group at a time rather than gathered into one array first
+	const void * data[SECTION_COUNT] =
+	{
+		vertices.data(), texcoords.data(), normals.data(), NULL, groupRecords.data(),
+		materialNames.data(), dependencies.data(), strings.data()
+	};
+	size_t counts[SECTION_COUNT] =
+	{
+		vertices.size(), texcoords.size(), normals.size(), triangleCount, groupRecords.size(),
+		materialNames.size(), dependencies.size(), strings.size()
+	};
+
+	uint64_t offset = SECTION_ALIGNMENT;
+	for ( unsigned i = 0; i < SECTION_COUNT; ++i )
+	{
+		header.sections[i].offset = offset;
+		header.sections[i].count = counts[i];
+		offset += ( counts[i] * RECORD_SIZES[i] + SECTION_ALIGNMENT - 1 ) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+	}
+
+	std::string filename = cacheFilename( source );
+	std::string temporary = filename + ".tmp";
+	{
+		std::ofstream out( temporary.c_str(), std::ios::binary | std::ios::trunc );
+		if ( !out )
+			return false;
+
+		const std::vector<char> zeros( SECTION_ALIGNMENT, 0 );
+		out.write( reinterpret_cast<const char *>( &header ), sizeof( header ) );
+		uint64_t written = sizeof( header );
+		for ( unsigned i = 0; i < SECTION_COUNT; ++i )
+		{
+			out.write( &zeros[0], header.sections[i].offset - written );
+			if ( i == TRIANGLES )
+			{
+				for ( size_t g = 0; g < groups.size(); ++g )
+				{
+					std::vector<Triangle> triangles( groups[g].triangles );
+					for ( size_t t = 0; t < triangles.size(); ++t )
+						triangles[t].materialID = triangles[t].materialID < 0 ? -1 : locals[triangles[t].materialID];
+					out.write( reinterpret_cast<const char *>( triangles.data() ), triangles.size() * sizeof( Triangle ) );
+				}
+			}
+			else
+				out.write( static_cast<const char *>( data[i] ), counts[i] * RECORD_SIZES[i] );
+			written = header.sections[i].offset + counts[i] * RECORD_SIZES[i];
+		}
+		if ( !out )
+		{
+			out.close();
+			std::remove( temporary.c_str() );
+			return false;
+		}
+	}
+
+	// rename won't replace an existing file on Windows
+	std::remove( filename.c_str() );
+	if ( std::rename( temporary.c_str(), filename.c_str() ) != 0 )
+	{
+		sf::err() << "Error writing model cache: " << filename << std::endl;
+		std::remove( temporary.c_str() );
+		return false;
+	}
+	return true;
+}
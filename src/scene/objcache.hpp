@@ -0,0 +1,91 @@
+#ifndef _OBJCACHE_H_
+#define _OBJCACHE_H_
+
+#include <string>
+#include <cstdint>
+
+/*
+ * Layout of the binary .objcache files written next to parsed .obj files (see ObjModel::readCache).
+ *
+ * The header is followed by page-aligned sections of fixed-size records, so a cache can be mapped
+ * and copied straight into the model's arrays without any parsing. Raw structs are stored as-is,
+ * so the header records their sizes and the byte order; a cache written by a different build is
+ * simply rejected and rebuilt. Strings (names and file paths) live in one blob and are referenced
+ * by offset and length.
+ *
+ * Materials and textures belong to the scene's ResourceRegistry, so they aren't stored here. A
+ * cached model reloads its .mtl files through the registry and maps its material names back to
+ * registry handles.
+ */
+namespace objcache
+{
+	const char MAGIC[8] = { 'O', 'B', 'J', 'C', 'A', 'C', 'H', 'E' };
+	const uint32_t VERSION = 2;
+	const uint32_t ENDIAN_MARKER = 0x01020304;
+	const uint64_t SECTION_ALIGNMENT = 4096;
+
+	// header flags - the options that change what a load produces
+	const uint32_t FLAG_GENERATED_NORMALS = 1 << 0;
+	const uint32_t FLAG_SORTED_BY_MATERIAL = 1 << 1;
+
+	enum Section
+	{
+		VERTICES,       // glm::vec3
+		TEXCOORDS,      // glm::vec2
+		NORMALS,        // glm::vec3
+		TRIANGLES,      // ObjModel::Triangle, all groups back to back, with materialID indexing MATERIALS
+		GROUPS,         // GroupRecord
+		MATERIALS,      // StringRef, the name of each material the triangles use
+		DEPENDENCIES,   // DependencyRecord, one per .mtl read
+		STRINGS,        // char
+		SECTION_COUNT
+	};
+
+	struct SectionRecord
+	{
+		uint64_t offset; // from the start of the file
+		uint64_t count;  // number of records, not bytes
+	};
+
+	struct FileStamp
+	{
+		uint64_t size;
+		int64_t mtime;
+		uint64_t hash; // hashContent of the whole file
+	};
+
+	struct Header
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t endian;
+		uint32_t triangleSize;
+		uint32_t flags;
+		FileStamp source;
+		SectionRecord sections[SECTION_COUNT];
+	};
+
+	struct StringRef
+	{
+		uint32_t offset; // into the STRINGS section
+		uint32_t length;
+	};
+
+	struct GroupRecord
+	{
+		uint64_t firstTriangle;
+		uint64_t triangleCount;
+		StringRef name;
+	};
+
+	struct DependencyRecord
+	{
+		FileStamp stamp;
+		StringRef name; // relative to the model's directory
+	};
+
+	// the cache for "dir/model.obj" is "dir/model.objcache"
+	std::string cacheFilename( const std::string& source );
+}
+
+#endif // _OBJCACHE_H_
@@ -0,0 +1,124 @@
+#ifndef _OBJLEXER_H_
+#define _OBJLEXER_H_
+
+#include <string>
+#include <cstring>
+#include <cstddef>
+#include "numparse.hpp"
+
+/*
+ * A view of one whitespace-delimited token inside a source buffer.
+ * Nothing is copied - the token is only valid as long as the buffer it came from.
+ */
+struct ObjToken
+{
+	const char * str;
+	size_t len;
+
+	ObjToken() : str( NULL ), len( 0 )
+	{
+	}
+
+	ObjToken( const char * s, size_t l ) : str( s ), len( l )
+	{
+	}
+
+	bool empty() const { return len == 0; }
+
+	// compare against a null-terminated keyword, e.g. token == "usemtl"
+	bool operator==( const char * keyword ) const
+	{
+		return std::strncmp( str, keyword, len ) == 0 && keyword[len] == '\0';
+	}
+	bool operator!=( const char * keyword ) const { return !( *this == keyword ); }
+
+	// only allocates when you ask for it - use for names that are stored, not for keywords
+	std::string toString() const { return std::string( str, len ); }
+};
+
+/*
+ * A hand-written scanner for line-based text formats (.obj, .mtl).
+ * It walks a raw character range in place, so it works directly on a MappedFile and never
+ * allocates per token. Reads within a record never cross a line break; call skipLine()
+ * to move to the next record, just like SKIP_THRU_CHAR( s, '\n' ) with a stream.
+ */
+class ObjLexer
+{
+public:
+	ObjLexer( const char * begin, const char * end ) : cur( begin ), end( end )
+	{
+	}
+
+	bool atEnd() const { return cur >= end; }
+	const char * position() const { return cur; }
+
+	// skips any whitespace (including blank lines) and returns the next token; empty at end of input
+	ObjToken nextToken()
+	{
+		while ( cur < end && isSpace( *cur ) ) ++cur;
+		return readToken();
+	}
+
+	// returns the next token on the current line; empty if the line has ended
+	ObjToken lineToken()
+	{
+		skipBlanks();
+		return readToken();
+	}
+
+	// consumes c if it's the very next character
+	bool skipChar( char c )
+	{
+		if ( cur < end && *cur == c )
+		{
+			++cur;
+			return true;
+		}
+		return false;
+	}
+
+	bool peekChar( char c ) const { return cur < end && *cur == c; }
+
+	// moves just past the next newline, or to the end of input
+	void skipLine()
+	{
+		cur = numparse::findChar( cur, end, '\n' );
+		if ( cur < end )
+			++cur;
+	}
+
+	// reads a decimal integer on the current line; leading blanks are skipped
+	bool readInt( int& value )
+	{
+		skipBlanks();
+		return numparse::parseInt( cur, end, value );
+	}
+
+	// reads a floating point number on the current line; leading blanks are skipped
+	bool readFloat( float& value )
+	{
+		skipBlanks();
+		return numparse::parseFloat( cur, end, value );
+	}
+
+private:
+	const char * cur;
+	const char * end;
+
+	static bool isSpace( char c ) { return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f'; }
+	static bool isBlank( char c ) { return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f'; }
+
+	void skipBlanks()
+	{
+		while ( cur < end && isBlank( *cur ) ) ++cur;
+	}
+
+	ObjToken readToken()
+	{
+		const char * start = cur;
+		while ( cur < end && !isSpace( *cur ) ) ++cur;
+		return ObjToken( start, cur - start );
+	}
+};
+
+#endif // _OBJLEXER_H_
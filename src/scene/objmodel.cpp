@@ -1,321 +1,854 @@
 #include "objmodel.hpp"
+#include "mappedfile.hpp"
+#include "objlexer.hpp"
+#include "threadpool.hpp"
+#include "resourceregistry.hpp"
+#include "processmemory.hpp"
+#include <SFML/System/Clock.hpp>
 #include <SFML/System/Err.hpp>
-#include <fstream>
-#include <limits>
+#include <algorithm>
 
-#define SKIP_THRU_CHAR( s , x ) if ( s.good() ) s.ignore( std::numeric_limits<std::streamsize>::max(), x )
+ObjModel::ObjModel() : resources( std::make_shared<ResourceRegistry>() )
+{
+}
 
-// private helper function - reads a .mtl file and adds to the material table
+// private helper function - loads a .mtl file through the registry and adds its names to the material table
 bool ObjModel::loadMTL( std::string path, std::string filename )
 {
-	std::string token;
-	std::string mat_name;
-	std::ifstream istream( path + filename );
-	if ( !istream.good( ) )
-	{
-		sf::err( ) << std::string( "Error opening file: " ) << path + filename << std::endl;
+	const ResourceRegistry::MaterialLibrary * library = resources->loadMaterialLibrary( path, filename );
+	if ( library == NULL )
 		return false;
+	mtllibs.push_back( filename );
+
+	// a later library's names override an earlier one's, as they always have
+	for ( ResourceRegistry::MaterialLibrary::const_iterator it = library->begin(); it != library->end(); ++it )
+		materialIDs[it->first] = it->second;
+	return true;
+}
+
+namespace
+{
+	// reads the corners of an 'f' record into triangle
+	// the first corner decides the vertex type; the rest of the face is expected to match it
+	bool readFace( ObjLexer& lexer, ObjModel::Triangle& triangle )
+	{
+		typedef ObjModel::Triangle Triangle;
+
+		for ( int i = 0; i < 3; ++i )
+		{
+			int v, t, n;
+
+			// indexes a face doesn't use are left at -1, so parsing is deterministic
+			triangle.texcoords[i] = -1;
+			triangle.normals[i] = -1;
+
+			// the first index is always position
+			if ( !lexer.readInt( v ) )
+				return false;
+			triangle.vertices[i] = v - 1;
+
+			Triangle::VertexType type = Triangle::POSITION_ONLY;
+			if ( lexer.skipChar( '/' ) )
+			{
+				// two slashes for vertex // normal
+				if ( lexer.skipChar( '/' ) )
+				{
+					type = Triangle::POSITION_NORMAL;
+					if ( !lexer.readInt( n ) )
+						return false;
+					triangle.normals[i] = n - 1;
+				}
+				else // single slash for texcoord
+				{
+					type = Triangle::POSITION_TEXCOORD;
+					if ( !lexer.readInt( t ) )
+						return false;
+					triangle.texcoords[i] = t - 1;
+
+					if ( lexer.skipChar( '/' ) )
+					{
+						type = Triangle::POSITION_TEXCOORD_NORMAL;
+						if ( !lexer.readInt( n ) )
+							return false;
+						triangle.normals[i] = n - 1;
+					}
+				}
+			}
+
+			if ( i == 0 )
+				triangle.vertexType = type;
+			else if ( type != triangle.vertexType )
+				return false;
+		}
+		return true;
 	}
 
-	// find the first material
-	while ( istream.good() && token != "newmtl" ) istream >> token;
-	if ( istream.eof() ) return true; // a file with no materials??
+	bool readVec3( ObjLexer& lexer, glm::vec3& v )
+	{
+		return lexer.readFloat( v.x ) && lexer.readFloat( v.y ) && lexer.readFloat( v.z );
+	}
+
+	bool readVec2( ObjLexer& lexer, glm::vec2& v )
+	{
+		return lexer.readFloat( v.x ) && lexer.readFloat( v.y );
+	}
 
-	ObjMtl material;
-	istream >> mat_name;
-	SKIP_THRU_CHAR( istream, '\n' );
+	// how many of each record a range of the file holds, from a first pass that only reads keywords
+	struct ObjCounts
+	{
+		size_t vertices;
+		size_t texcoords;
+		size_t normals;
+		size_t triangles;
+		std::vector<size_t> groupSizes; // triangles in each non-empty group, in the order parseSerial saves them
+		std::vector<size_t> groupLines; // faces before each "g" line, empty groups included, for laying out chunks
+	};
 
-	while ( istream.good() && (istream.peek() != EOF) )
+	/*
+	 * Scans keywords with the same lexer the parsers use, without reading any numbers, so the
+	 * counts match what a successful parse will produce exactly.
+	 */
+	void countRecords( const char * begin, const char * end, ObjCounts& counts )
 	{
-		istream >> token;
+		ObjLexer lexer( begin, end );
+		ObjToken token;
+		counts.vertices = counts.texcoords = counts.normals = counts.triangles = 0;
+		counts.groupSizes.clear();
+		counts.groupLines.clear();
 
-		if ( token == "newmtl" )
+		size_t groupSize = 0;
+		while ( !( token = lexer.nextToken() ).empty() )
 		{
-			// push the latest material, begin a new one
-			materialIDs[mat_name] = materials.size( );
-			materials.push_back( material );
-			material = ObjMtl();
-			istream >> mat_name;		
+			if ( token == "v" )
+				++counts.vertices;
+			else if ( token == "vt" )
+				++counts.texcoords;
+			else if ( token == "vn" )
+				++counts.normals;
+			else if ( token == "f" )
+				++groupSize;
+			else if ( token == "g" )
+			{
+				counts.groupLines.push_back( counts.triangles + groupSize );
+				if ( groupSize > 0 )
+				{
+					counts.triangles += groupSize;
+					counts.groupSizes.push_back( groupSize );
+					groupSize = 0;
+				}
+			}
+			lexer.skipLine();
 		}
-		// these are most likely the relevent materials for your renderer
-		// you can do more with .obj files, but you are not expected to for p4
-		else if ( token == "Ka" )
-		{
-			float r, g, b;
-			istream >> r;
-			istream >> g;
-			istream >> b;
-			material.Ka = glm::vec3( glm::clamp( r, 0.0f, 1.0f ),
-									 glm::clamp( g, 0.0f, 1.0f ),
-									 glm::clamp( b, 0.0f, 1.0f ) );
+		if ( groupSize > 0 )
+		{
+			counts.triangles += groupSize;
+			counts.groupSizes.push_back( groupSize );
 		}
-		else if ( token == "Kd" )
-		{
-			float r, g, b;
-			istream >> r;
-			istream >> g;
-			istream >> b;
-			material.Kd = glm::vec3( glm::clamp( r, 0.0f, 1.0f ),
-									 glm::clamp( g, 0.0f, 1.0f ),
-									 glm::clamp( b, 0.0f, 1.0f ) );
+	}
+
+	// where a chunk puts one kind of record: straight into its counted slots in the model's array,
+	// or, without a counting pass, into an array of its own that's appended afterwards
+	template <typename T>
+	struct ObjOutput
+	{
+		std::vector<T> records;
+		bool counted;
+		T * slots;
+		size_t capacity;
+		size_t count;
+
+		ObjOutput() : counted( false ), slots( NULL ), capacity( 0 ), count( 0 )
+		{
 		}
-		else if ( token == "Ks" )
-		{
-			float r, g, b;
-			istream >> r;
-			istream >> g;
-			istream >> b;
-			material.Ks = glm::vec3( glm::clamp( r, 0.0f, 1.0f ),
-									 glm::clamp( g, 0.0f, 1.0f ),
-									 glm::clamp( b, 0.0f, 1.0f ) );
+
+		// false if the counted slots are already full, which means the passes disagree
+		bool add( const T& value )
+		{
+			if ( !counted )
+				records.push_back( value );
+			else if ( count < capacity )
+				slots[count++] = value;
+			else
+				return false;
+			return true;
 		}
-		else if ( token == "Ns" )
+
+		// every counted slot was filled
+		bool complete() const { return !counted || count == capacity; }
+
+		T * data() { return counted ? slots : records.data(); }
+		size_t size() const { return counted ? count : records.size(); }
+	};
+
+	// where a chunk puts its triangles: with a counting pass, straight into the groups they belong
+	// to, one segment of slots per stretch between "g" lines; otherwise into an array of its own
+	struct ObjTriangleOutput
+	{
+		std::vector<ObjModel::Triangle> records;
+		bool counted;
+		std::vector<ObjModel::Triangle *> segments;
+		std::vector<size_t> capacities;
+		size_t segment;
+		size_t count;   // in the current segment
+		size_t total;
+
+		ObjTriangleOutput() : counted( false ), segment( 0 ), count( 0 ), total( 0 )
 		{
-			istream >> material.Ns;
-			material.Ns = glm::clamp( material.Ns, 0.0f, 1000.0f );
 		}
-		else if ( token == "map_Kd" )
+
+		bool add( const ObjModel::Triangle& triangle )
 		{
-			istream >> token;
-			// load only one copy of each texture
-			if ( textureIDs.count( token ) == 0 )
+			if ( !counted )
+				records.push_back( triangle );
+			else if ( segment < segments.size() && count < capacities[segment] )
+				segments[segment][count++] = triangle;
+			else
+				return false;
+			++total;
+			return true;
+		}
+
+		// a "g" line; the stretch before it must have filled its slots
+		bool nextSegment()
+		{
+			if ( !counted )
+				return true;
+			if ( segment >= segments.size() || count != capacities[segment] )
+				return false;
+			++segment;
+			count = 0;
+			return true;
+		}
+
+		bool complete() const { return !counted || ( segment + 1 == segments.size() && count == capacities[segment] ); }
+
+		size_t size() const { return total; }
+	};
+
+	// a state change seen while parsing a chunk in parallel - these are replayed in file order
+	// during the merge, since a chunk can't know the group/material/smoothing state it starts in
+	struct ObjDirective
+	{
+		enum Type { GROUP, MTLLIB, USEMTL, SMOOTHING_GROUP, SMOOTHING_OFF } type;
+		size_t triangle; // the first triangle in the chunk that comes after this directive
+		std::string name;
+		int value;
+	};
+
+	// everything read from one line-aligned slice of the file
+	struct ObjChunk
+	{
+		const char * begin;
+		const char * end;
+
+		ObjOutput<glm::vec3> vertices;
+		ObjOutput<glm::vec2> texcoords;
+		ObjOutput<glm::vec3> normals;
+		ObjTriangleOutput triangles;
+		std::vector<ObjDirective> directives;
+
+		bool ok;
+		bool miscounted; // a counted output over- or underflowed
+		std::string lastToken;
+	};
+
+	// a range of chunk triangles that all share one group and one shading state
+	struct ObjRun
+	{
+		const ObjChunk * chunk;
+		size_t first, count;
+		size_t group, offset; // where the run lands in the merged groups
+		int materialID;
+		int smoothing_group;
+		bool smooth_shading;
+	};
+
+	void parseChunk( ObjChunk& chunk )
+	{
+		ObjLexer lexer( chunk.begin, chunk.end );
+		ObjToken token;
+		ObjModel::Triangle triangle;
+		triangle.materialID = -1;
+		triangle.smoothing_group = 1;
+		triangle.smooth_shading = false;
+
+		chunk.ok = true;
+		chunk.miscounted = false;
+		while ( chunk.ok && !( token = lexer.nextToken() ).empty() )
+		{
+			ObjDirective directive;
+			directive.triangle = chunk.triangles.size();
+			directive.value = 0;
+
+			if ( token == "v" )
+			{
+				glm::vec3 v;
+				chunk.ok = readVec3( lexer, v );
+				chunk.miscounted = !chunk.vertices.add( v );
+			}
+			else if ( token == "vt" )
+			{
+				glm::vec2 vt;
+				chunk.ok = readVec2( lexer, vt );
+				chunk.miscounted = !chunk.texcoords.add( vt );
+			}
+			else if ( token == "vn" )
+			{
+				glm::vec3 vn;
+				chunk.ok = readVec3( lexer, vn );
+				chunk.miscounted = !chunk.normals.add( vn );
+			}
+			else if ( token == "f" )
 			{
-				textures.push_back( sf::Image() );
-				if ( !textures.back().loadFromFile( path + token ) )
+				chunk.ok = readFace( lexer, triangle );
+				chunk.miscounted = !chunk.triangles.add( triangle );
+			}
+			else if ( token == "g" || token == "mtllib" || token == "usemtl" )
+			{
+				directive.type = token == "g" ? ObjDirective::GROUP :
+								 token == "mtllib" ? ObjDirective::MTLLIB : ObjDirective::USEMTL;
+				directive.name = lexer.lineToken().toString();
+				chunk.directives.push_back( directive );
+				if ( directive.type == ObjDirective::GROUP )
+					chunk.miscounted = !chunk.triangles.nextSegment();
+			}
+			else if ( token == "s" )
+			{
+				if ( lexer.readInt( directive.value ) )
 				{
-					sf::err() << "Error loading texture: " << token << std::endl;
-					return false;
+					directive.type = ObjDirective::SMOOTHING_GROUP;
+					chunk.directives.push_back( directive );
 				}
-				textureIDs[token] = textures.size();
+				else if ( lexer.lineToken() == "off" )
+				{
+					directive.type = ObjDirective::SMOOTHING_OFF;
+					chunk.directives.push_back( directive );
+				}
+			}
+			lexer.skipLine();
+			chunk.ok = chunk.ok && !chunk.miscounted;
+		}
+
+		if ( chunk.ok && !( chunk.vertices.complete() && chunk.texcoords.complete() && chunk.normals.complete() && chunk.triangles.complete() ) )
+			chunk.ok = false, chunk.miscounted = true;
+		if ( !chunk.ok )
+			chunk.lastToken = token.toString();
+		else
+			numparse::normalizeBatch( chunk.normals.data(), chunk.normals.size() );
+	}
+
+	template <typename T>
+	void appendChunks( std::vector<T>& out, std::vector<ObjChunk>& chunks, ObjOutput<T> ObjChunk::* member )
+	{
+		// each chunk's records land right after the previous chunk's - this is the only
+		// index fix-up needed, since face indexes in the file are already global
+		std::vector<size_t> offsets( chunks.size() );
+		size_t total = out.size();
+		for ( size_t i = 0; i < chunks.size(); ++i )
+		{
+			offsets[i] = total;
+			total += ( chunks[i].*member ).records.size();
+		}
+		out.resize( total );
+
+		ThreadPool::shared().parallelFor( chunks.size(), [&]( size_t begin, size_t end )
+		{
+			for ( size_t i = begin; i < end; ++i )
+			{
+				std::vector<T>& records = ( chunks[i].*member ).records;
+				std::copy( records.begin(), records.end(), out.begin() + offsets[i] );
+				std::vector<T>().swap( records );
 			}
-			material.map_Kd = textureIDs[token];
+		} );
+	}
+
+	// gives each chunk its slots in out, which grows to exactly fit the counted records
+	template <typename T>
+	void assignSlots( std::vector<T>& out, std::vector<ObjChunk>& chunks, const std::vector<ObjCounts>& counts,
+					  ObjOutput<T> ObjChunk::* member, size_t ObjCounts::* counted )
+	{
+		size_t total = out.size();
+		for ( size_t i = 0; i < chunks.size(); ++i )
+			total += counts[i].*counted;
+		out.resize( total );
+
+		size_t offset = total;
+		for ( size_t i = chunks.size(); i-- > 0; )
+		{
+			offset -= counts[i].*counted;
+			( chunks[i].*member ).counted = true;
+			( chunks[i].*member ).slots = out.data() + offset;
+			( chunks[i].*member ).capacity = counts[i].*counted;
 		}
-		else if ( token == "map_Ka" )
+	}
+
+	// lays the counted triangles out in the groups the merge will make, and points each chunk's
+	// stretches between "g" lines at their slots, so faces are parsed straight into place
+	void assignTriangleSlots( std::vector<ObjModel::TriangleGroup>& groups, std::vector<ObjChunk>& chunks,
+							  const std::vector<ObjCounts>& counts )
+	{
+		std::vector<size_t> sizes, segmentGroups, segmentOffsets;
+		size_t groupSize = 0;
+		for ( size_t i = 0; i < chunks.size(); ++i )
 		{
-			// this is likely the same as map_Kd, but you may want to try lightmapping
-			// or pre-computed radiance at some point
-			istream >> token;
-			if ( textureIDs.count( token ) == 0 )
+			size_t previous = 0;
+			for ( size_t s = 0; s <= counts[i].groupLines.size(); ++s )
 			{
-				textures.push_back( sf::Image( ) );
-				if ( !textures.back( ).loadFromFile( path + token ) )
+				size_t line = s < counts[i].groupLines.size() ? counts[i].groupLines[s] : counts[i].triangles;
+				segmentGroups.push_back( sizes.size() );
+				segmentOffsets.push_back( groupSize );
+				groupSize += line - previous;
+				previous = line;
+				if ( s < counts[i].groupLines.size() && groupSize > 0 )
 				{
-					sf::err( ) << "Error loading texture: " << token << std::endl;
-					return false;
+					sizes.push_back( groupSize );
+					groupSize = 0;
 				}
-				textureIDs[token] = textures.size( );
 			}
-			material.map_Ka = textureIDs[token];
 		}
-		// ignore all other parameters, and move to next line after each property read
-		SKIP_THRU_CHAR( istream, '\n' );
-	}
+		if ( groupSize > 0 )
+			sizes.push_back( groupSize );
 
-	// don't forget to save the last material
-	materialIDs[mat_name] = materials.size( );
-	materials.push_back( material );
-	return true;
+		size_t firstGroup = groups.size();
+		groups.resize( firstGroup + sizes.size() );
+		for ( size_t g = 0; g < sizes.size(); ++g )
+			groups[firstGroup + g].triangles.resize( sizes[g] );
+
+		size_t segment = 0;
+		for ( size_t i = 0; i < chunks.size(); ++i )
+		{
+			ObjTriangleOutput& output = chunks[i].triangles;
+			output.counted = true;
+			size_t previous = 0;
+			for ( size_t s = 0; s <= counts[i].groupLines.size(); ++s, ++segment )
+			{
+				size_t line = s < counts[i].groupLines.size() ? counts[i].groupLines[s] : counts[i].triangles;
+				size_t group = firstGroup + segmentGroups[segment];
+				output.segments.push_back( line > previous ? &groups[group].triangles[segmentOffsets[segment]] : NULL );
+				output.capacities.push_back( line - previous );
+				previous = line;
+			}
+		}
+	}
 }
 
 /*
  * Parses an input .obj file, loading data into memory.
  * This does not cover the entire .obj spec, just the most common cases, namely v/t/n triangles.
  * You will need to perform additional processing to generate meshes from the vectors of raw data.
+ *
+ * The file is memory-mapped and scanned in place by ObjLexer; keywords and numbers are read
+ * straight out of the mapped bytes, so the only allocations are for the output arrays and names.
+ * Large files are split at line boundaries and parsed on several threads (see parseParallel).
+ * With countFirst, a keyword-only pass sizes every output array before any numbers are read.
  */
-bool ObjModel::loadFromFile( std::string path, std::string filename )
+bool ObjModel::loadFromFile( std::string path, std::string filename, const LoadOptions& options )
 {
 	name = filename;
+	stats = LoadStats();
+	if ( options.resources )
+		resources = options.resources;
 
-	std::string token;
-	std::ifstream istream( path + filename );
-	if ( !istream.good( ) )
+	sf::Clock clock;
+	std::string source = path + filename;
+	MappedFile file;
+	if ( !file.open( source ) )
 	{
-		sf::err( ) << std::string( "Error opening file: " ) << path + filename << std::endl;
+		sf::err( ) << std::string( "Error opening file: " ) << source << std::endl;
 		return false;
 	}
+	stats.fileBytes = file.size();
+	stats.mapSeconds = clock.restart().asSeconds();
 
 	// if the .obj is in a subdirectory, .mtl files will be relative to that directory
 	size_t pathlen = filename.find_last_of( "\\/", filename.npos );
 	if ( pathlen < filename.npos )
 		path += filename.substr( 0, pathlen + 1 );
 
-	std::string mtl;
+	// a valid binary cache replaces parsing entirely
+	if ( options.useCache )
+	{
+		stats.fromCache = readCache( source, path, file, options );
+		stats.cacheSeconds = clock.restart().asSeconds();
+		if ( stats.fromCache )
+		{
+			// handles come from this run's registry, so the order may differ from the one cached
+			if ( options.sortByMaterial )
+			{
+				sortByMaterial();
+				stats.sortSeconds = clock.restart().asSeconds();
+			}
+			bool ok = options.resources || resources->waitForTextures();
+			stats.peakResidentBytes = processmemory::peakResidentBytes();
+			return ok;
+		}
+	}
+
+	// small files aren't worth waking up the thread pool for
+	unsigned threads = options.threads != 0 ? options.threads : ThreadPool::shared().concurrency();
+	size_t chunks = std::min<size_t>( threads, file.size() / options.minChunkBytes );
+	stats.chunks = static_cast<unsigned>( std::max<size_t>( chunks, 1 ) );
+
+	bool ok = chunks > 1 ? parseParallel( path, file.data(), file.data() + file.size(), chunks, options.countFirst )
+						 : parseSerial( path, file.data(), file.data() + file.size(), options.countFirst );
+
+	stats.parseSeconds = clock.restart().asSeconds() - stats.countSeconds;
+
+	// faces without vn data get normals computed from their smoothing groups
+	if ( ok && options.generateNormals )
+	{
+		generateNormals();
+		stats.normalSeconds = clock.restart().asSeconds();
+	}
+
+	if ( ok && options.sortByMaterial )
+	{
+		sortByMaterial();
+		stats.sortSeconds = clock.restart().asSeconds();
+	}
+
+	// textures decode in the background; a scene waits for them once every model is loaded,
+	// but a model with a registry of its own has to finish them itself
+	if ( ok && !options.resources )
+		ok = resources->waitForTextures();
+
+	// failing to write the cache only costs time on the next run
+	if ( ok && options.useCache )
+	{
+		writeCache( source, path, file, options );
+		stats.cacheSeconds += clock.restart().asSeconds();
+	}
+	stats.peakResidentBytes = processmemory::peakResidentBytes();
+	return ok;
+}
+
+// private helper function - the reference parser, one record at a time in file order
+bool ObjModel::parseSerial( const std::string& path, const char * begin, const char * end, bool countFirst )
+{
+	// with a counting pass first, every array and group is allocated once at its final size
+	ObjCounts counts;
+	size_t nextGroup = 0;
+	if ( countFirst )
+	{
+		sf::Clock clock;
+		countRecords( begin, end, counts );
+		vertices.reserve( vertices.size() + counts.vertices );
+		texcoords.reserve( texcoords.size() + counts.texcoords );
+		normals.reserve( normals.size() + counts.normals );
+		groups.reserve( groups.size() + counts.groupSizes.size() );
+		stats.countSeconds = clock.getElapsedTime().asSeconds();
+	}
+
+	ObjLexer lexer( begin, end );
+	ObjToken token;
 	TriangleGroup group;
 	Triangle triangle;
 	triangle.materialID = -1;
 	triangle.smoothing_group = 1;
 	triangle.smooth_shading = false;
+	if ( nextGroup < counts.groupSizes.size() )
+		group.triangles.reserve( counts.groupSizes[nextGroup] );
 
-	while ( istream.good() && (istream.peek() != EOF) )
-	{
-		istream >> token;
+	size_t firstNormal = normals.size();
 
-		if ( token == "#" ) // comment line
+	bool ok = true;
+	while ( ok && !( token = lexer.nextToken() ).empty() )
+	{
+		if ( token == "#" ) // comment line - skipped along with the rest of the line below
 		{
-			SKIP_THRU_CHAR( istream, '\n' );
 		}
 		else if ( token == "v" ) // vertex (position)
 		{
-			float x, y, z;
-			istream >> x;
-			istream >> y;
-			istream >> z;
-			vertices.push_back( glm::vec3( x, y, z ) );
+			glm::vec3 v;
+			ok = readVec3( lexer, v );
+			vertices.push_back( v );
 			// note: .obj supports a 'w' component, we're ignoring it here (it's very uncommon)
-			SKIP_THRU_CHAR( istream, '\n' );
 		}
 		else if ( token == "vt" ) // tex coord
 		{
-			float u, v;
-			istream >> u;
-			istream >> v;
-			texcoords.push_back( glm::vec2( u, v ) );
+			glm::vec2 vt;
+			ok = readVec2( lexer, vt );
+			texcoords.push_back( vt );
 			// similarly, .obj supports 3D textures with a 'w' component
-			SKIP_THRU_CHAR( istream, '\n' );
 		}
 		else if ( token == "vn" ) // vertex normal
 		{
-			float x, y, z;
-			istream >> x;
-			istream >> y;
-			istream >> z;
-			normals.push_back( glm::normalize( glm::vec3( x, y, z ) ) );
-			SKIP_THRU_CHAR( istream, '\n' );
+			// normals are stored as read, then normalized together once the file is parsed
+			glm::vec3 vn;
+			ok = readVec3( lexer, vn );
+			normals.push_back( vn );
 		}
 		else if ( token == "vp" ) // parameter space vertices, not supported
 		{
-			SKIP_THRU_CHAR( istream, '\n' );
 		}
 		else if ( token == "mtllib" )
 		{
-			istream >> token;
-			if ( !loadMTL( path, token ) )
+			std::string mtllib = lexer.lineToken().toString();
+			if ( !loadMTL( path, mtllib ) )
 			{
-				sf::err() << "Failed to load material lib: " << token << std::endl;
+				sf::err() << "Failed to load material lib: " << mtllib << std::endl;
 				return false;
 			}
-			SKIP_THRU_CHAR( istream, '\n' );
 		}
 		else if ( token == "usemtl" )
 		{
-			istream >> mtl;
-			if ( materialIDs.count( mtl ) == 0 )
+			std::string mtl = lexer.lineToken().toString();
+			std::unordered_map<std::string, int>::const_iterator material = materialIDs.find( mtl );
+			if ( material == materialIDs.end() )
 			{
 				sf::err() << "Error in .obj: material \"" << mtl << "\" not found." << std::endl;
 				return false;
 			}
-			triangle.materialID = materialIDs[mtl];
-			SKIP_THRU_CHAR( istream, '\n' );
+			triangle.materialID = material->second;
 		}
 		else if ( token == "g" ) // starts a new group of polygons
 		{
-			// push the old group into the list, if it wasn't empty
+			// move the old group into the list, if it wasn't empty
 			if ( group.triangles.size() > 0 )
 			{
-				groups.push_back( group );
-				group.triangles.clear();
+				groups.push_back( std::move( group ) );
+				group.triangles = std::vector<Triangle>();
+				if ( ++nextGroup < counts.groupSizes.size() )
+					group.triangles.reserve( counts.groupSizes[nextGroup] );
 			}
 			// save the name of the group for debugging
-			istream >> group.name;
-			SKIP_THRU_CHAR( istream, '\n' );
+			group.name = lexer.lineToken().toString();
 		}
 		else if ( token == "s" ) // smoothing group index
 		{
-			istream >> token;
-			if ( token == "off" )
+			// 's 0' is the same as 's off'
+			int s;
+			if ( lexer.readInt( s ) )
+			{
+				triangle.smoothing_group = s;
+				triangle.smooth_shading = ( s != 0 );
+			}
+			else if ( lexer.lineToken() == "off" )
 				triangle.smooth_shading = false;
-			else
-				triangle.smoothing_group = std::stoi( token );
 
 			// smooth shading groups is a feature of .obj used in some of the scenes
 			// basically, you compute normals by averaging per-triangle normals, but only
 			// for triangles in the same group. don't worry about this early on, but you may
 			// need it for scenes like sponza where pre-computed normals are not provided
-			SKIP_THRU_CHAR( istream, '\n' );
 		}
 		else if ( token == "f" ) // a face, or polygon
 		{
-			int v, t, n;
+			ok = readFace( lexer, triangle );
+			group.triangles.push_back( triangle );
+		}
+		// ignore any other lines - invalid or unsupported obj content
+		// every record is one line, so move to the next line after each one is read
+		lexer.skipLine();
+	}
 
-			// read the first vertex and detect the type		
-			// the first index is always position
-			istream >> v;
-			triangle.vertices[0] = v - 1;
-			triangle.vertexType = Triangle::POSITION_ONLY;
-			if ( istream.peek() == '/' )
+	// save the last group of polygons
+	if ( group.triangles.size( ) > 0 )
+		groups.push_back( std::move( group ) );
+
+	numparse::normalizeBatch( normals.data() + firstNormal, normals.size() - firstNormal );
+
+	if ( !ok )
+	{
+		sf::err( ) << "An error occured while reading .obj file; last token was: " << token.toString() << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Private helper function - parses [begin, end) as several chunks at once.
+ * The chunks are split at line boundaries and parsed on the thread pool. With a counting pass,
+ * each chunk writes its records straight into their final slots - faces included, since the
+ * counts say how many come before each "g" line - and a pass that disagrees with its count fails
+ * the parse; without one, chunks fill arrays of their own that are appended afterwards. Groups,
+ * materials and smoothing state can change anywhere in the file, so chunks only record where
+ * those directives appear; the merge replays them in file order and stamps the resulting state
+ * onto each run of triangles. The result is identical to parseSerial.
+ */
+bool ObjModel::parseParallel( const std::string& path, const char * begin, const char * end, size_t count, bool countFirst )
+{
+	std::vector<ObjChunk> chunks( count );
+	const char * cursor = begin;
+	for ( size_t i = 0; i < count; ++i )
+	{
+		const char * split = i + 1 < count ? begin + ( end - begin ) * ( i + 1 ) / count : end;
+		if ( split < cursor )
+			split = cursor;
+		if ( split < end )
+		{
+			// move the split just past the end of the line it landed in
+			split = numparse::findChar( split, end, '\n' );
+			if ( split < end )
+				++split;
+		}
+		chunks[i].begin = cursor;
+		chunks[i].end = split;
+		cursor = split;
+	}
+
+	// with a counting pass first, every record is parsed straight into place: v/vt/vn in the
+	// model's arrays, faces in the groups they belong to; otherwise they're appended afterwards
+	size_t firstGroup = groups.size();
+	if ( countFirst )
+	{
+		sf::Clock clock;
+		std::vector<ObjCounts> counts( count );
+		ThreadPool::shared().parallelFor( count, [&]( size_t first, size_t last )
+		{
+			for ( size_t i = first; i < last; ++i )
+				countRecords( chunks[i].begin, chunks[i].end, counts[i] );
+		} );
+		assignSlots( vertices, chunks, counts, &ObjChunk::vertices, &ObjCounts::vertices );
+		assignSlots( texcoords, chunks, counts, &ObjChunk::texcoords, &ObjCounts::texcoords );
+		assignSlots( normals, chunks, counts, &ObjChunk::normals, &ObjCounts::normals );
+		assignTriangleSlots( groups, chunks, counts );
+		stats.countSeconds = clock.getElapsedTime().asSeconds();
+	}
+
+	ThreadPool::shared().parallelFor( count, [&]( size_t first, size_t last )
+	{
+		for ( size_t i = first; i < last; ++i )
+			parseChunk( chunks[i] );
+	} );
+
+	for ( size_t i = 0; i < count; ++i )
+	{
+		if ( chunks[i].miscounted )
+		{
+			sf::err( ) << "Error reading .obj file: the counting pass and the parse found different numbers of records" << std::endl;
+			return false;
+		}
+		if ( !chunks[i].ok )
+		{
+			sf::err( ) << "An error occured while reading .obj file; last token was: " << chunks[i].lastToken << std::endl;
+			return false;
+		}
+	}
+
+	if ( !countFirst )
+	{
+		appendChunks( vertices, chunks, &ObjChunk::vertices );
+		appendChunks( texcoords, chunks, &ObjChunk::texcoords );
+		appendChunks( normals, chunks, &ObjChunk::normals );
+	}
+
+	// replay the directives in file order to find where every run of triangles belongs
+	// this mirrors the group/state handling in parseSerial exactly
+	std::vector<ObjRun> runs;
+	std::vector<size_t> groupSizes;
+	std::vector<std::string> groupNames;
+	std::string groupName;
+	size_t groupSize = 0;
+	int materialID = -1;
+	int smoothing_group = 1;
+	bool smooth_shading = false;
+
+	for ( size_t i = 0; i < count; ++i )
+	{
+		const ObjChunk& chunk = chunks[i];
+		size_t first = 0;
+		for ( size_t d = 0; d <= chunk.directives.size(); ++d )
+		{
+			size_t last = d < chunk.directives.size() ? chunk.directives[d].triangle : chunk.triangles.size();
+			if ( last > first )
 			{
-				istream.get(); // skip the slash
+				ObjRun run = { &chunk, first, last - first, groupNames.size(), groupSize,
+							   materialID, smoothing_group, smooth_shading };
+				runs.push_back( run );
+				groupSize += run.count;
+				first = last;
+			}
+			if ( d == chunk.directives.size() )
+				break;
 
-				// two slashes for vertex // normal
-				if ( istream.peek() == '/' )
-				{
-					triangle.vertexType = Triangle::POSITION_NORMAL;
-					istream.get();
-					istream >> n;
-					triangle.normals[0] = n - 1;
-
-					// read the remaining vertices
-					istream >> v; istream.get(); istream.get(); istream >> n;
-					triangle.vertices[1] = v - 1; triangle.normals[1] = n - 1;
-					istream >> v; istream.get(); istream.get(); istream >> n;
-					triangle.vertices[2] = v - 1; triangle.normals[2] = n - 1;
-				}
-				else // single slash for texcoord
-				{
-					triangle.vertexType = Triangle::POSITION_TEXCOORD;
-					istream >> t;
-					triangle.texcoords[0] = t - 1;
+			const ObjDirective& directive = chunk.directives[d];
+			switch ( directive.type )
+			{
+				case ObjDirective::GROUP:
+					if ( groupSize > 0 )
+					{
+						groupNames.push_back( groupName );
+						groupSizes.push_back( groupSize );
+						groupSize = 0;
+					}
+					groupName = directive.name;
+					break;
 
-					if ( istream.peek() != '/' )
+				case ObjDirective::MTLLIB:
+					if ( !loadMTL( path, directive.name ) )
 					{
-						// no normals, just read remaining vertices
-						istream >> v; istream.get(); istream >> t;
-						triangle.vertices[1] = v - 1; triangle.texcoords[1] = t - 1;
-						istream >> v; istream.get(); istream >> t;
-						triangle.vertices[2] = v - 1; triangle.texcoords[2] = t - 1;
+						sf::err() << "Failed to load material lib: " << directive.name << std::endl;
+						return false;
 					}
-					else
+					break;
+
+				case ObjDirective::USEMTL:
+				{
+					std::unordered_map<std::string, int>::const_iterator material = materialIDs.find( directive.name );
+					if ( material == materialIDs.end() )
 					{
-						triangle.vertexType = Triangle::POSITION_TEXCOORD_NORMAL;
-						istream.get();
-						istream >> n;
-						triangle.normals[0] = n - 1;
-
-						istream >> v; istream.get(); istream >> t; istream.get(); istream >> n;
-						triangle.vertices[1] = v - 1; triangle.texcoords[1] = t - 1; triangle.normals[1] = n - 1;
-						istream >> v; istream.get(); istream >> t; istream.get(); istream >> n;
-						triangle.vertices[2] = v - 1; triangle.texcoords[2] = t - 1; triangle.normals[2] = n - 1;
+						sf::err() << "Error in .obj: material \"" << directive.name << "\" not found." << std::endl;
+						return false;
 					}
+					materialID = material->second;
+					break;
 				}
+
+				case ObjDirective::SMOOTHING_GROUP:
+					smoothing_group = directive.value;
+					smooth_shading = ( directive.value != 0 );
+					break;
+
+				case ObjDirective::SMOOTHING_OFF:
+					smooth_shading = false;
+					break;
 			}
-			else
-			{
-				istream >> v; triangle.vertices[1] = v - 1;
-				istream >> v; triangle.vertices[2] = v - 1;
-			}
-			group.triangles.push_back( triangle );
-			SKIP_THRU_CHAR( istream, '\n' );
-		}
-		else
-		{
-			// ignore any other lines - invalid or unsupported obj content
-			SKIP_THRU_CHAR( istream, '\n' );
 		}
-		token.clear();
 	}
-
-	// save the last group of polygons
-	if ( group.triangles.size( ) > 0 )
+	if ( groupSize > 0 )
 	{
-		groups.push_back( group );
-		group.triangles.clear( );
+		groupNames.push_back( groupName );
+		groupSizes.push_back( groupSize );
 	}
 
-	if ( istream.fail( ) )
+	// counted triangles are already in their groups, which must be the ones the replay found
+	if ( !countFirst )
+		groups.resize( firstGroup + groupNames.size() );
+	if ( groups.size() != firstGroup + groupNames.size() )
 	{
-		sf::err( ) << "An error occured while reading .obj file; last token was: " << token << std::endl;
+		sf::err( ) << "Error reading .obj file: the counting pass and the parse found different groups" << std::endl;
 		return false;
 	}
+	for ( size_t g = 0; g < groupNames.size(); ++g )
+	{
+		groups[firstGroup + g].name = groupNames[g];
+		if ( !countFirst )
+			groups[firstGroup + g].triangles.resize( groupSizes[g] );
+		else if ( groups[firstGroup + g].triangles.size() != groupSizes[g] )
+		{
+			sf::err( ) << "Error reading .obj file: the counting pass and the parse found different groups" << std::endl;
+			return false;
+		}
+	}
+
+	// then each run gets the shading state it was read under, copied over first if it wasn't counted
+	ThreadPool::shared().parallelFor( runs.size(), [&]( size_t first, size_t last )
+	{
+		for ( size_t r = first; r < last; ++r )
+		{
+			const ObjRun& run = runs[r];
+			Triangle * dst = &groups[firstGroup + run.group].triangles[run.offset];
+			if ( !run.chunk->triangles.counted )
+				std::copy( run.chunk->triangles.records.begin() + run.first, run.chunk->triangles.records.begin() + run.first + run.count, dst );
+			for ( size_t t = 0; t < run.count; ++t )
+			{
+				dst[t].materialID = run.materialID;
+				dst[t].smoothing_group = run.smoothing_group;
+				dst[t].smooth_shading = run.smooth_shading;
+			}
+		}
+	}, 64 );
 
 	return true;
-}
\ No newline at end of file
+}
@@ -4,8 +4,11 @@
 #include <string>
 #include <vector>
 #include <unordered_map>
+#include <memory>
 #include <glm/glm.hpp>
-#include <SFML/Graphics/Image.hpp>
+
+class MappedFile;
+class ResourceRegistry;
 
 class ObjModel
 {
@@ -19,7 +22,7 @@ public:
 		glm::vec3 Ks;
 		float Ns; // specular exponent in [0,1000]
 		
-		// indexes into the textures array; -1 for no texture
+		// texture handles in the model's ResourceRegistry; -1 for no texture
 		int map_Kd;
 		int map_Ka;
 
@@ -42,7 +45,8 @@ public:
 		enum VertexType { POSITION_ONLY, POSITION_TEXCOORD, POSITION_NORMAL, POSITION_TEXCOORD_NORMAL } vertexType;
 
 		int materialID; // groups can contain polygons with different materials - you may want to split these
-		                // into separate meshes for rendering
+		                // into separate meshes for rendering. this is a handle in the model's ResourceRegistry,
+		                // so it's the same for every model in a scene that uses the material
 
 		bool smooth_shading;
 		int smoothing_group; // smoothing group, for computing normals
@@ -62,24 +66,142 @@ public:
 		std::vector<Triangle> triangles;
 	};
 
-	bool loadFromFile( std::string path, std::string filename );
+	// a run of one group's triangles that share a material, once the model is sorted by material
+	struct DrawBatch
+	{
+		int group;
+		int materialID;
+		size_t firstTriangle; // into the group's triangles; the first index of the run is 3 * firstTriangle
+		size_t triangleCount;
+		glm::vec3 boundsMin;
+		glm::vec3 boundsMax;
+	};
+
+	struct LoadOptions
+	{
+		// threads to parse with; 0 uses every core, 1 forces the serial parser
+		unsigned threads;
+
+		// files are only split into chunks of at least this many bytes
+		size_t minChunkBytes;
+
+		// compute normals for faces that don't have any (see generateNormals)
+		bool generateNormals;
+
+		// read and write a binary .objcache next to the .obj (see objcache.hpp); off by default,
+		// since it writes files beside the caller's models
+		bool useCache;
+
+		// count the records with a quick keyword scan before parsing, so every array is allocated
+		// once at its final size instead of growing (and briefly doubling) as records are read
+		bool countFirst;
+
+		// reorder each group's triangles by material and build the draw table (see sortByMaterial);
+		// off by default, so groups keep their file order unless a caller wants the draw table
+		bool sortByMaterial;
+
+		// materials and textures go here, so models can share them; if NULL the model keeps its own
+		// textures in a shared registry may still be decoding when loadFromFile returns - see
+		// ResourceRegistry::waitForTextures
+		std::shared_ptr<ResourceRegistry> resources;
+
+		LoadOptions() : threads( 0 ),
+						minChunkBytes( 4 << 20 ),
+						generateNormals( true ),
+						useCache( false ),
+						countFirst( true ),
+						sortByMaterial( false )
+		{
+		}
+	};
+
+	// timings from the most recent loadFromFile, useful for checking we're keeping up with the disk
+	struct LoadStats
+	{
+		size_t fileBytes;
+		unsigned chunks; // how many pieces the file was parsed in
+		float mapSeconds;
+		float countSeconds; // the counting pass, when countFirst is on
+		float parseSeconds;
+		float normalSeconds;
+		size_t generatedNormals;
+		float sortSeconds; // sorting by material and building the draw table
+		bool fromCache;     // true if the model was read from its .objcache instead of parsed
+		float cacheSeconds; // time spent validating, reading or writing the cache
+		size_t peakResidentBytes; // the process's high-water mark of physical memory once loading finished
+
+		LoadStats() : fileBytes( 0 ),
+					  chunks( 0 ),
+					  mapSeconds( 0.0f ),
+					  countSeconds( 0.0f ),
+					  parseSeconds( 0.0f ),
+					  normalSeconds( 0.0f ),
+					  generatedNormals( 0 ),
+					  sortSeconds( 0.0f ),
+					  fromCache( false ),
+					  cacheSeconds( 0.0f ),
+					  peakResidentBytes( 0 )
+		{
+		}
+	};
+
+	ObjModel();
+
+	bool loadFromFile( std::string path, std::string filename, const LoadOptions& options = LoadOptions() );
+
+	const LoadStats& getLoadStats() const { return stats; }
+
+	/*
+	 * Computes normals for every triangle that doesn't have them, and switches those triangles to
+	 * POSITION_NORMAL / POSITION_TEXCOORD_NORMAL. Corners that share a position and a smoothing group
+	 * share an area- and angle-weighted average normal; faces with smoothing off get a flat normal.
+	 * Runs on the thread pool; the result doesn't depend on the number of threads.
+	 */
+	void generateNormals();
+
+	/*
+	 * Stably sorts every group's triangles by materialID, so each material's triangles form one
+	 * contiguous run, and rebuilds the draw table: one DrawBatch per run, in group then material
+	 * order, with the run's bounding box. A renderer can then draw a group with one call per material
+	 * and never look at individual triangles. The sort is a counting sort, split across the thread pool.
+	 */
+	void sortByMaterial();
+
+	// read-only access to the raw data, for building meshes
+	const std::string& getName() const { return name; }
+	const std::vector<glm::vec3>& getVertices() const { return vertices; }
+	const std::vector<glm::vec2>& getTexcoords() const { return texcoords; }
+	const std::vector<glm::vec3>& getNormals() const { return normals; }
+	const ResourceRegistry& getResources() const { return *resources; }
+	const std::unordered_map<std::string, int>& getMaterialIDs() const { return materialIDs; }
+	const std::vector<TriangleGroup>& getGroups() const { return groups; }
+	const std::vector<DrawBatch>& getDrawBatches() const { return drawBatches; }
 
 private:
 	std::string name;
+	LoadStats stats;
 	std::vector<glm::vec3> vertices;
 	std::vector<glm::vec2> texcoords;
 	std::vector<glm::vec3> normals;
 
-	// you may want to hoist materials out of models into a global scene list
-	// that way multiple .obj's can inherit the same .mtl without duplication
-	std::vector<ObjMtl> materials;
-	std::unordered_map<std::string, int> materialIDs;
-	std::vector<sf::Image> textures; // also take a look at sf::Texture - what is different about them?
-	std::unordered_map<std::string, int> textureIDs;
+	// materials and textures live in a registry shared by every model in the scene,
+	// so multiple .obj's can inherit the same .mtl without duplication
+	std::shared_ptr<ResourceRegistry> resources;
+	std::unordered_map<std::string, int> materialIDs; // names from this model's .mtl files -> handles
 
 	std::vector<TriangleGroup> groups;
+	std::vector<DrawBatch> drawBatches; // empty until sortByMaterial runs
+
+	// .mtl files read while loading, relative to the model's directory
+	std::vector<std::string> mtllibs;
 
 	bool loadMTL( std::string path, std::string filename );
+	bool parseSerial( const std::string& path, const char * begin, const char * end, bool countFirst );
+	bool parseParallel( const std::string& path, const char * begin, const char * end, size_t chunks, bool countFirst );
+
+	// implemented in objcache.cpp
+	bool readCache( const std::string& source, const std::string& path, const MappedFile& file, const LoadOptions& options );
+	bool writeCache( const std::string& source, const std::string& path, const MappedFile& file, const LoadOptions& options ) const;
 };
 
 #endif // _OBJMODEL_H_
\ No newline at end of file
@@ -0,0 +1,199 @@
+#include "objmodel.hpp"
+#include "threadpool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <cmath>
+
+namespace
+{
+	typedef ObjModel::Triangle Triangle;
+
+	bool hasNormals( Triangle::VertexType type )
+	{
+		return type == Triangle::POSITION_NORMAL || type == Triangle::POSITION_TEXCOORD_NORMAL;
+	}
+
+	// the angle between two edges leaving a corner, 0 for degenerate edges
+	float cornerAngle( const glm::vec3& e1, const glm::vec3& e2 )
+	{
+		float l1 = glm::length( e1 ), l2 = glm::length( e2 );
+		if ( l1 <= 0.0f || l2 <= 0.0f )
+			return 0.0f;
+		return std::acos( glm::clamp( glm::dot( e1, e2 ) / ( l1 * l2 ), -1.0f, 1.0f ) );
+	}
+}
+
+/*
+ * The work is split so no two threads ever write the same value:
+ *  1. face normals and corner weights are computed per triangle
+ *  2. smooth corners are bucketed by position with atomic counters (a lock-free counting sort),
+ *     then each bucket is put back in corner order so the output is deterministic
+ *  3. each position's bucket is owned by one thread, which sorts it by smoothing group, sums each
+ *     run of corners and writes the shared normal back to exactly those corners
+ */
+void ObjModel::generateNormals()
+{
+	ThreadPool& pool = ThreadPool::shared();
+
+	std::vector<Triangle *> pending;
+	for ( size_t g = 0; g < groups.size(); ++g )
+	{
+		for ( size_t t = 0; t < groups[g].triangles.size(); ++t )
+		{
+			if ( !hasNormals( groups[g].triangles[t].vertexType ) )
+				pending.push_back( &groups[g].triangles[t] );
+		}
+	}
+	if ( pending.empty() )
+		return;
+
+	size_t triangleCount = pending.size();
+	size_t vertexCount = vertices.size();
+
+	// 1. face normals (length = twice the area) and each corner's weighted contribution
+	std::vector<glm::vec3> faceNormals( triangleCount );
+	std::vector<glm::vec3> contributions( triangleCount * 3 );
+	std::atomic<bool> validIndexes( true );
+	pool.parallelFor( triangleCount, [&]( size_t begin, size_t end )
+	{
+		for ( size_t t = begin; t < end; ++t )
+		{
+			const int * v = pending[t]->vertices;
+			if ( v[0] < 0 || v[1] < 0 || v[2] < 0 ||
+				 size_t( v[0] ) >= vertexCount || size_t( v[1] ) >= vertexCount || size_t( v[2] ) >= vertexCount )
+			{
+				validIndexes = false;
+				continue;
+			}
+
+			const glm::vec3& a = vertices[v[0]];
+			const glm::vec3& b = vertices[v[1]];
+			const glm::vec3& c = vertices[v[2]];
+			glm::vec3 n = glm::cross( b - a, c - a );
+			faceNormals[t] = n;
+			contributions[t * 3 + 0] = n * cornerAngle( b - a, c - a );
+			contributions[t * 3 + 1] = n * cornerAngle( c - b, a - b );
+			contributions[t * 3 + 2] = n * cornerAngle( a - c, b - c );
+		}
+	}, 1024 );
+
+	// bad indexes would have been caught drawing anyway; leave the model as it was
+	if ( !validIndexes )
+		return;
+
+	// 2. bucket the smooth corners by position
+	std::unique_ptr<std::atomic<unsigned int>[]> counts( new std::atomic<unsigned int>[vertexCount + 1] );
+	for ( size_t v = 0; v <= vertexCount; ++v )
+		counts[v] = 0;
+
+	pool.parallelFor( triangleCount, [&]( size_t begin, size_t end )
+	{
+		for ( size_t t = begin; t < end; ++t )
+		{
+			if ( pending[t]->smooth_shading )
+			{
+				for ( int k = 0; k < 3; ++k )
+					counts[pending[t]->vertices[k]].fetch_add( 1, std::memory_order_relaxed );
+			}
+		}
+	}, 4096 );
+
+	std::vector<unsigned int> offsets( vertexCount + 1, 0 );
+	for ( size_t v = 0; v < vertexCount; ++v )
+	{
+		offsets[v + 1] = offsets[v] + counts[v];
+		counts[v] = offsets[v]; // reused as the fill cursor
+	}
+
+	std::vector<unsigned int> buckets( offsets[vertexCount] );
+	pool.parallelFor( triangleCount, [&]( size_t begin, size_t end )
+	{
+		for ( size_t t = begin; t < end; ++t )
+		{
+			if ( pending[t]->smooth_shading )
+			{
+				for ( int k = 0; k < 3; ++k )
+					buckets[counts[pending[t]->vertices[k]].fetch_add( 1, std::memory_order_relaxed )] = static_cast<unsigned int>( t * 3 + k );
+			}
+		}
+	}, 4096 );
+
+	// 3a. order each bucket by smoothing group, then corner, and count the distinct groups -
+	// that's how many normals the position needs
+	std::vector<unsigned int> normalCounts( vertexCount + 1, 0 );
+	pool.parallelFor( vertexCount, [&]( size_t begin, size_t end )
+	{
+		for ( size_t v = begin; v < end; ++v )
+		{
+			unsigned int * first = buckets.data() + offsets[v];
+			unsigned int * last = buckets.data() + offsets[v + 1];
+			std::sort( first, last, [&]( unsigned int x, unsigned int y )
+			{
+				int gx = pending[x / 3]->smoothing_group, gy = pending[y / 3]->smoothing_group;
+				return gx != gy ? gx < gy : x < y;
+			} );
+
+			for ( unsigned int * c = first; c != last; ++c )
+				normalCounts[v] += ( c == first || pending[c[-1] / 3]->smoothing_group != pending[*c / 3]->smoothing_group );
+		}
+	}, 4096 );
+
+	// smooth normals are laid out by position, then flat normals by triangle
+	size_t base = normals.size();
+	std::vector<size_t> normalOffsets( vertexCount + 1, base );
+	for ( size_t v = 0; v < vertexCount; ++v )
+		normalOffsets[v + 1] = normalOffsets[v] + normalCounts[v];
+
+	std::vector<size_t> flatOffsets( triangleCount + 1, normalOffsets[vertexCount] );
+	for ( size_t t = 0; t < triangleCount; ++t )
+		flatOffsets[t + 1] = flatOffsets[t] + ( pending[t]->smooth_shading ? 0 : 1 );
+
+	normals.resize( flatOffsets[triangleCount] );
+	stats.generatedNormals = normals.size() - base;
+
+	// 3b. sum and normalize each (position, smoothing group), and point the corners at the result
+	pool.parallelFor( vertexCount, [&]( size_t begin, size_t end )
+	{
+		for ( size_t v = begin; v < end; ++v )
+		{
+			const unsigned int * first = buckets.data() + offsets[v];
+			const unsigned int * last = buckets.data() + offsets[v + 1];
+			size_t next = normalOffsets[v];
+
+			for ( const unsigned int * c = first; c != last; )
+			{
+				int group = pending[*c / 3]->smoothing_group;
+				const unsigned int * run = c;
+				glm::vec3 sum( 0.0f );
+				for ( ; c != last && pending[*c / 3]->smoothing_group == group; ++c )
+					sum += contributions[*c];
+
+				float length = glm::length( sum );
+				normals[next] = length > 0.0f ? sum / length : glm::vec3( 0.0f, 0.0f, 1.0f );
+
+				for ( ; run != c; ++run )
+					pending[*run / 3]->normals[*run % 3] = static_cast<int>( next );
+				++next;
+			}
+		}
+	}, 4096 );
+
+	pool.parallelFor( triangleCount, [&]( size_t begin, size_t end )
+	{
+		for ( size_t t = begin; t < end; ++t )
+		{
+			Triangle& triangle = *pending[t];
+			if ( !triangle.smooth_shading )
+			{
+				float length = glm::length( faceNormals[t] );
+				normals[flatOffsets[t]] = length > 0.0f ? faceNormals[t] / length : glm::vec3( 0.0f, 0.0f, 1.0f );
+				for ( int k = 0; k < 3; ++k )
+					triangle.normals[k] = static_cast<int>( flatOffsets[t] );
+			}
+
+			triangle.vertexType = triangle.vertexType == Triangle::POSITION_TEXCOORD ? Triangle::POSITION_TEXCOORD_NORMAL
+																					 : Triangle::POSITION_NORMAL;
+		}
+	}, 4096 );
+}
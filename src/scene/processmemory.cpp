@@ -0,0 +1,58 @@
+#include "processmemory.hpp"
+#include <cstdio>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#ifdef _MSC_VER
+#pragma comment( lib, "psapi.lib" )
+#endif
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+namespace processmemory
+{
+	size_t residentBytes()
+	{
+#ifdef _WIN32
+		PROCESS_MEMORY_COUNTERS counters;
+		if ( !GetProcessMemoryInfo( GetCurrentProcess(), &counters, sizeof( counters ) ) )
+			return 0;
+		return counters.WorkingSetSize;
+#elif defined( __linux__ )
+		// the second field of statm is the resident set, in pages
+		unsigned long size = 0, resident = 0;
+		FILE * statm = std::fopen( "/proc/self/statm", "r" );
+		if ( statm == NULL )
+			return 0;
+		int fields = std::fscanf( statm, "%lu %lu", &size, &resident );
+		std::fclose( statm );
+		return fields == 2 ? static_cast<size_t>( resident ) * sysconf( _SC_PAGESIZE ) : 0;
+#else
+		return 0;
+#endif
+	}
+
+	size_t peakResidentBytes()
+	{
+#ifdef _WIN32
+		PROCESS_MEMORY_COUNTERS counters;
+		if ( !GetProcessMemoryInfo( GetCurrentProcess(), &counters, sizeof( counters ) ) )
+			return 0;
+		return counters.PeakWorkingSetSize;
+#else
+		struct rusage usage;
+		if ( getrusage( RUSAGE_SELF, &usage ) != 0 )
+			return 0;
+#ifdef __APPLE__
+		return static_cast<size_t>( usage.ru_maxrss ); // bytes on macOS
+#else
+		return static_cast<size_t>( usage.ru_maxrss ) * 1024; // kilobytes elsewhere
+#endif
+#endif
+	}
+}
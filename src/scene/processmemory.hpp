@@ -0,0 +1,19 @@
+#ifndef _PROCESSMEMORY_H_
+#define _PROCESSMEMORY_H_
+
+#include <cstddef>
+
+/*
+ * Resident memory of the whole process, for loader and benchmark statistics.
+ * Both return 0 where the platform can't tell us.
+ */
+namespace processmemory
+{
+	// physical memory the process is using right now
+	size_t residentBytes();
+
+	// the most it has used at any one time since it started
+	size_t peakResidentBytes();
+}
+
+#endif // _PROCESSMEMORY_H_
@@ -0,0 +1,310 @@
+#include "resourceregistry.hpp"
+#include "mappedfile.hpp"
+#include "objlexer.hpp"
+#include "contenthash.hpp"
+#include "threadpool.hpp"
+#include <SFML/System/Clock.hpp>
+#include <SFML/System/Err.hpp>
+#include <cstring>
+
+// a texture being decoded by a worker; the mapping stays open until it's done
+struct ResourceRegistry::Decode
+{
+	std::string filename;
+	Texture * texture;
+	MappedFile file;
+	bool ok;
+};
+
+namespace
+{
+	// reads an r g b triple, clamped to [0,1]
+	bool readColor( ObjLexer& lexer, glm::vec3& color )
+	{
+		float r, g, b;
+		if ( !lexer.readFloat( r ) || !lexer.readFloat( g ) || !lexer.readFloat( b ) )
+			return false;
+		color = glm::vec3( glm::clamp( r, 0.0f, 1.0f ),
+						   glm::clamp( g, 0.0f, 1.0f ),
+						   glm::clamp( b, 0.0f, 1.0f ) );
+		return true;
+	}
+}
+
+ResourceRegistry::ResourceRegistry() : buildMips( true ),
+									   compress( false ),
+									   keepUncompressed( false ),
+									   stream( false ),
+									   outstanding( 0 )
+{
+}
+
+ResourceRegistry::~ResourceRegistry()
+{
+	// workers write into the texture table, so it can't go away under them
+	std::unique_lock<std::mutex> lock( mutex );
+	idle.wait( lock, [this]() { return outstanding == 0; } );
+}
+
+int ResourceRegistry::loadTexture( const std::string& filename )
+{
+	++stats.textureRequests;
+
+	std::string path = MappedFile::canonicalPath( filename );
+	std::unordered_map<std::string, int>::const_iterator known = texturesByPath.find( path );
+	if ( !path.empty() && known != texturesByPath.end() )
+	{
+		++stats.texturePathHits;
+		return known->second;
+	}
+
+	std::shared_ptr<Decode> decode = std::make_shared<Decode>();
+	if ( path.empty() || !decode->file.open( path ) )
+	{
+		sf::err() << "Error loading texture: " << filename << std::endl;
+		return -1;
+	}
+
+	// a copy of an image we already have under another name
+	unsigned long long hash = hashContent( decode->file.data(), decode->file.size() );
+	std::unordered_map<unsigned long long, int>::const_iterator same = texturesByHash.find( hash );
+	if ( same != texturesByHash.end() )
+	{
+		++stats.textureContentHits;
+		texturesByPath[path] = same->second;
+		return same->second;
+	}
+
+	int handle = static_cast<int>( textures.size() );
+	textures.push_back( Texture() );
+	textures.back().path = path;
+	textures.back().hash = hash;
+	textures.back().decodeSeconds = 0.0f;
+	textures.back().mipSeconds = 0.0f;
+	textures.back().compressSeconds = 0.0f;
+	texturesByPath[path] = handle;
+	texturesByHash[hash] = handle;
+	if ( stream )
+		return handle;
+
+	// decode straight from the mapping, on a worker, rather than have SFML read the file again here
+	decode->filename = filename;
+	decode->texture = &textures.back();
+	decode->ok = false;
+	decodes.push_back( decode );
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		++outstanding;
+	}
+	bool mips = buildMips;
+	MipChain::Options options = mipOptions;
+	bool compressed = compress, keep = keepUncompressed;
+	ThreadPool::shared().submit( [this, decode, mips, options, compressed, keep]()
+	{
+		sf::Clock clock;
+		decode->ok = decode->texture->image.loadFromMemory( decode->file.data(), decode->file.size() );
+		decode->texture->decodeSeconds = clock.restart().asSeconds();
+		decode->file.close();
+
+		// level 0 of the chain is a copy of the image, so only one of them is kept
+		if ( decode->ok && mips && decode->texture->mips.build( decode->texture->image, options ) )
+		{
+			decode->texture->mipSeconds = clock.restart().asSeconds();
+			decode->texture->image = sf::Image();
+		}
+
+		if ( decode->ok && compressed )
+		{
+			Texture& texture = *decode->texture;
+			CompressedTexture::Format format = CompressedTexture::chooseFormat( texture.basePixels(),
+																				static_cast<size_t>( texture.baseWidth() ) * texture.baseHeight() );
+			if ( texture.mips.levelCount() > 0 )
+				texture.compressed.encode( texture.mips, format );
+			else
+				texture.compressed.encode( texture.basePixels(), texture.baseWidth(), texture.baseHeight(), format );
+			texture.compressSeconds = clock.getElapsedTime().asSeconds();
+
+			if ( !keep )
+			{
+				texture.image = sf::Image();
+				texture.mips.clear();
+			}
+		}
+
+		std::lock_guard<std::mutex> lock( mutex );
+		if ( --outstanding == 0 )
+			idle.notify_all();
+	} );
+	return handle;
+}
+
+void ResourceRegistry::setMipOptions( bool build, const MipChain::Options& options )
+{
+	buildMips = build;
+	mipOptions = options;
+}
+
+void ResourceRegistry::setStreamTextures( bool stream )
+{
+	this->stream = stream;
+}
+
+void ResourceRegistry::setCompressionOptions( bool compress, bool keepUncompressed )
+{
+	this->compress = compress;
+	this->keepUncompressed = keepUncompressed;
+}
+
+bool ResourceRegistry::waitForTextures()
+{
+	sf::Clock clock;
+	{
+		std::unique_lock<std::mutex> lock( mutex );
+		idle.wait( lock, [this]() { return outstanding == 0; } );
+	}
+	stats.waitSeconds += clock.getElapsedTime().asSeconds();
+
+	// errors are reported here, on the loading thread, in the order the textures were requested
+	bool ok = true;
+	for ( size_t i = 0; i < decodes.size(); ++i )
+	{
+		const Decode& decode = *decodes[i];
+		if ( !decode.ok )
+		{
+			sf::err() << "Error loading texture: " << decode.filename << std::endl;
+			ok = false;
+			continue;
+		}
+		stats.decodeSeconds += decode.texture->decodeSeconds;
+		stats.mipSeconds += decode.texture->mipSeconds;
+		stats.compressSeconds += decode.texture->compressSeconds;
+		stats.textureBytes += decode.texture->image.getSize().x * decode.texture->image.getSize().y * 4;
+		stats.textureBytes += decode.texture->mips.byteSize();
+		stats.textureBytes += decode.texture->compressed.byteSize();
+	}
+	decodes.clear();
+	return ok;
+}
+
+int ResourceRegistry::addMaterial( const Material& material )
+{
+	++stats.materialRequests;
+
+	// ObjMtl is all floats and ints with no padding, so its bytes are its value
+	unsigned long long hash = hashContent( &material, sizeof( Material ) );
+	auto range = materialsByHash.equal_range( hash );
+	for ( auto it = range.first; it != range.second; ++it )
+	{
+		if ( std::memcmp( &materials[it->second], &material, sizeof( Material ) ) == 0 )
+		{
+			++stats.materialHits;
+			return it->second;
+		}
+	}
+
+	int handle = static_cast<int>( materials.size() );
+	materials.push_back( material );
+	materialsByHash.insert( std::make_pair( hash, handle ) );
+	return handle;
+}
+
+const ResourceRegistry::MaterialLibrary * ResourceRegistry::loadMaterialLibrary( const std::string& textureDir, const std::string& filename )
+{
+	++stats.libraryRequests;
+
+	// the same .mtl can resolve its textures differently from another directory
+	std::string path = MappedFile::canonicalPath( textureDir + filename );
+	std::string key = path + '\n' + MappedFile::canonicalPath( textureDir );
+	std::unordered_map<std::string, MaterialLibrary>::const_iterator known = libraries.find( key );
+	if ( !path.empty() && known != libraries.end() )
+	{
+		++stats.libraryHits;
+		return &known->second;
+	}
+
+	MappedFile file;
+	if ( !file.open( textureDir + filename ) )
+	{
+		sf::err( ) << std::string( "Error opening file: " ) << textureDir + filename << std::endl;
+		return NULL;
+	}
+
+	ObjLexer lexer( file.data(), file.data() + file.size() );
+	ObjToken token;
+	MaterialLibrary library;
+
+	// find the first material
+	while ( !( token = lexer.nextToken() ).empty() && token != "newmtl" ) lexer.skipLine();
+	if ( token.empty() ) return &( libraries[key] = library ); // a file with no materials??
+
+	Material material;
+	std::string mat_name = lexer.lineToken().toString();
+	lexer.skipLine();
+
+	bool ok = true;
+	while ( ok && !( token = lexer.nextToken() ).empty() )
+	{
+		if ( token == "newmtl" )
+		{
+			// push the latest material, begin a new one
+			library[mat_name] = addMaterial( material );
+			material = Material();
+			mat_name = lexer.lineToken().toString();
+		}
+		// these are most likely the relevent materials for your renderer
+		// you can do more with .obj files, but you are not expected to for p4
+		else if ( token == "Ka" )
+		{
+			ok = readColor( lexer, material.Ka );
+		}
+		else if ( token == "Kd" )
+		{
+			ok = readColor( lexer, material.Kd );
+		}
+		else if ( token == "Ks" )
+		{
+			ok = readColor( lexer, material.Ks );
+		}
+		else if ( token == "Ns" )
+		{
+			ok = lexer.readFloat( material.Ns );
+			material.Ns = glm::clamp( material.Ns, 0.0f, 1000.0f );
+		}
+		else if ( token == "map_Kd" )
+		{
+			if ( ( material.map_Kd = loadTexture( textureDir + lexer.lineToken().toString() ) ) < 0 )
+				return NULL;
+		}
+		else if ( token == "map_Ka" )
+		{
+			// this is likely the same as map_Kd, but you may want to try lightmapping
+			// or pre-computed radiance at some point
+			if ( ( material.map_Ka = loadTexture( textureDir + lexer.lineToken().toString() ) ) < 0 )
+				return NULL;
+		}
+		// ignore all other parameters, and move to next line after each property read
+		lexer.skipLine();
+	}
+
+	if ( !ok )
+	{
+		sf::err( ) << "An error occured while reading .mtl file; last token was: " << token.toString() << std::endl;
+		return NULL;
+	}
+
+	// don't forget to save the last material
+	library[mat_name] = addMaterial( material );
+	return &( libraries[key] = library );
+}
+
+void ResourceRegistry::clear()
+{
+	waitForTextures();
+	materials.clear();
+	materialsByHash.clear();
+	textures.clear();
+	texturesByPath.clear();
+	texturesByHash.clear();
+	libraries.clear();
+	stats = Stats();
+}
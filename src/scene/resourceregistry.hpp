@@ -0,0 +1,157 @@
+#ifndef _RESOURCEREGISTRY_H_
+#define _RESOURCEREGISTRY_H_
+
+#include <scene/objmodel.hpp>
+#include <scene/mipchain.hpp>
+#include <scene/compressedtexture.hpp>
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <SFML/Graphics/Image.hpp>
+
+/*
+ * Scene-wide tables of materials and textures, shared by every ObjModel loaded into a scene.
+ *
+ * Textures are interned by canonical path first, then by a hash of the encoded file, so the same
+ * image is decoded and held in memory once no matter how many .mtl files (or names) refer to it.
+ * Materials are interned by value, and .mtl files are only parsed once per canonical path.
+ * Handles are plain indexes into getMaterials() / getTextures(); -1 means none.
+ *
+ * Textures are decoded on the shared ThreadPool while parsing carries on; a handle is valid as
+ * soon as loadTexture returns, but its pixels are missing until waitForTextures. Apart from that
+ * the registry is not thread safe - models are loaded into it one at a time. In streaming mode
+ * the images are never decoded here, and a TextureStreamer loads just the levels that are drawn.
+ */
+class ResourceRegistry
+{
+public:
+	typedef ObjModel::ObjMtl Material;
+
+	// material name -> material handle, for one .mtl file
+	typedef std::unordered_map<std::string, int> MaterialLibrary;
+
+	struct Texture
+	{
+		std::string path;        // canonical path of the first file this image was read from
+		unsigned long long hash; // hashContent of the encoded file
+		sf::Image image;         // released once the mips are built, since their level 0 is the same pixels
+		MipChain mips;           // built along with the decode, unless turned off
+		CompressedTexture compressed; // the mips (or the image) block compressed, if turned on
+		float decodeSeconds;     // time a worker spent decoding the image
+		float mipSeconds;        // and building its mip chain
+		float compressSeconds;   // and compressing it
+
+		// the full-size RGBA8 pixels, from whichever of the mips and the image holds them; NULL (and
+		// a size of 0) if neither is in memory
+		const unsigned char * basePixels() const { return mips.levelCount() > 0 ? mips.getPixels( 0 ) : image.getSize().x > 0 ? image.getPixelsPtr() : NULL; }
+		unsigned int baseWidth() const { return mips.levelCount() > 0 ? mips.getLevel( 0 ).width : image.getSize().x; }
+		unsigned int baseHeight() const { return mips.levelCount() > 0 ? mips.getLevel( 0 ).height : image.getSize().y; }
+	};
+
+	// how much sharing the registry found, to see what it's saving
+	struct Stats
+	{
+		size_t textureRequests;
+		size_t texturePathHits;    // same file as an earlier request
+		size_t textureContentHits; // different file, identical bytes
+		size_t textureBytes;       // decoded pixel memory held, mips and compressed blocks included
+		size_t materialRequests;
+		size_t materialHits;       // identical to an existing material
+		size_t libraryRequests;
+		size_t libraryHits;        // .mtl files that didn't need parsing again
+		float decodeSeconds;       // total worker time spent decoding textures
+		float mipSeconds;          // and building mip chains
+		float compressSeconds;     // and block compressing them
+		float waitSeconds;         // time the loader spent blocked on decodes that hadn't finished
+
+		Stats() : textureRequests( 0 ),
+				  texturePathHits( 0 ),
+				  textureContentHits( 0 ),
+				  textureBytes( 0 ),
+				  materialRequests( 0 ),
+				  materialHits( 0 ),
+				  libraryRequests( 0 ),
+				  libraryHits( 0 ),
+				  decodeSeconds( 0.0f ),
+				  mipSeconds( 0.0f ),
+				  compressSeconds( 0.0f ),
+				  waitSeconds( 0.0f )
+		{
+		}
+	};
+
+	ResourceRegistry();
+	~ResourceRegistry();
+
+	// returns a handle to the image, or -1 if the file can't be read; decoding happens in the background
+	int loadTexture( const std::string& filename );
+
+	// blocks until every queued texture is decoded; returns false if any of them couldn't be
+	bool waitForTextures();
+
+	// how textures loaded from now on get their mip chains; on with the default options to begin with
+	void setMipOptions( bool build, const MipChain::Options& options = MipChain::Options() );
+
+	/*
+	 * Whether textures loaded from now on are block compressed, BC1 if opaque and BC3 otherwise;
+	 * off to begin with. Unless keepUncompressed is set the image and mips are dropped afterwards,
+	 * leaving only the compressed copy. BC5 is never picked here, since nothing says which
+	 * textures are normal maps - encode those with CompressedTexture directly.
+	 */
+	void setCompressionOptions( bool compress, bool keepUncompressed = false );
+
+	// textures loaded from now on are interned but left undecoded, for a TextureStreamer to load on demand
+	void setStreamTextures( bool stream );
+
+	// returns the handle of an identical material if there is one; texture handles must be from this registry
+	int addMaterial( const Material& material );
+
+	/*
+	 * Parses a .mtl file and interns its materials and textures, or returns the table from the
+	 * last time this file was loaded. Texture names are relative to textureDir (the directory of
+	 * the .obj that refers to the library). Returns NULL on error.
+	 */
+	const MaterialLibrary * loadMaterialLibrary( const std::string& textureDir, const std::string& filename );
+
+	const std::vector<Material>& getMaterials() const { return materials; }
+	const std::deque<Texture>& getTextures() const { return textures; }
+	const Stats& getStats() const { return stats; }
+
+	// forgets everything - handles held by models loaded into the registry become invalid
+	void clear();
+
+private:
+	ResourceRegistry( const ResourceRegistry& );
+	ResourceRegistry& operator=( const ResourceRegistry& );
+
+	std::vector<Material> materials;
+	std::unordered_multimap<unsigned long long, int> materialsByHash;
+
+	// a deque, so workers can decode into textures while new ones are added
+	std::deque<Texture> textures;
+	std::unordered_map<std::string, int> texturesByPath;
+	std::unordered_map<unsigned long long, int> texturesByHash;
+
+	std::unordered_map<std::string, MaterialLibrary> libraries;
+
+	bool buildMips;
+	MipChain::Options mipOptions;
+	bool compress;
+	bool keepUncompressed;
+	bool stream;
+
+	// decodes queued since the last waitForTextures
+	struct Decode;
+	std::vector<std::shared_ptr<Decode> > decodes;
+	std::mutex mutex;
+	std::condition_variable idle;
+	size_t outstanding;
+
+	Stats stats;
+};
+
+#endif // _RESOURCEREGISTRY_H_
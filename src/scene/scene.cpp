@@ -1,7 +1,10 @@
 #include "scene.hpp"
 #include <SFML/System/Err.hpp>
 #include <fstream>
+#include <algorithm>
+#include <cmath>
 #include <limits>
+#include <vector>
 
 /* Using a macro to avoid repeating excessively long, templated statement for a simple effect.
  * This takes a std::ifstream and a char and advances the ifstream until it passes the next
@@ -11,11 +14,31 @@
  */
 #define SKIP_THRU_CHAR( s , x ) if ( s.good() ) s.ignore( std::numeric_limits<std::streamsize>::max(), x )
 
-Scene::Scene()
+namespace
 {
+	// the box around a model's vertices, or a point at the origin for an empty model
+	void modelBounds( const ObjModel& model, glm::vec3& min, glm::vec3& max )
+	{
+		const std::vector<glm::vec3>& vertices = model.getVertices();
+		if ( vertices.empty() )
+		{
+			min = max = glm::vec3( 0.0f, 0.0f, 0.0f );
+			return;
+		}
+		min = max = vertices[0];
+		for ( size_t i = 1; i < vertices.size(); ++i )
+		{
+			min = glm::min( min, vertices[i] );
+			max = glm::max( max, vertices[i] );
+		}
+	}
 }
 
-bool Scene::loadFromFile( std::string filename )
+Scene::Scene() : resources( std::make_shared<ResourceRegistry>() ), lightThreshold( 1.0f / 256.0f )
+{
+}
+
+bool Scene::loadFromFile( std::string filename, const ObjModel::LoadOptions& options )
 {
 	std::string path;
 	size_t pathlen = filename.find_last_of( "\\/", filename.npos );
@@ -227,7 +250,10 @@ bool Scene::loadFromFile( std::string filename )
 					std::getline( istream, token, '\"' );
 
 					// strip duplicate objects - only one copy of the model data in memory
-					if ( objmodels.count( token ) == 0 && !objmodels[token].loadFromFile( path, token ) )
+					// and only one copy of each material and texture, across all the models
+					ObjModel::LoadOptions modelOptions = options;
+					modelOptions.resources = resources;
+					if ( objmodels.count( token ) == 0 && !objmodels[token].loadFromFile( path, token, modelOptions ) )
 					{
 						sf::err() << "Error reading .obj file: " << token << std::endl;
 						return false;
@@ -236,6 +262,7 @@ bool Scene::loadFromFile( std::string filename )
 				}
 				SKIP_THRU_CHAR( istream, '\n' );
 			}
+			model.transform = transforms.add( model.position, model.orientation, model.scale );
 			models.push_back( model );
 			SKIP_THRU_CHAR( istream, '\n' );
 		}
@@ -247,9 +274,135 @@ bool Scene::loadFromFile( std::string filename )
 		return false;
 	}
 
+	// local boxes are found once per .obj, however many instances share it
+	std::unordered_map<const ObjModel *, std::pair<glm::vec3, glm::vec3> > bounds;
+	for ( size_t i = 0; i < models.size(); ++i )
+	{
+		if ( models[i].model == NULL )
+			continue;
+		if ( bounds.count( models[i].model ) == 0 )
+			modelBounds( *models[i].model, bounds[models[i].model].first, bounds[models[i].model].second );
+		models[i].localMin = bounds[models[i].model].first;
+		models[i].localMax = bounds[models[i].model].second;
+	}
+
+	// every instance's matrices are built in one batch, instead of by each renderer every frame,
+	// and the BVH over their world boxes with them
+	rebuildBVH();
+
+	// light ranges are derived here, so culling can rely on them instead of treating lights as infinite
+	updateLights();
+
+	// textures were decoding on worker threads while the models loaded; collect them all here
+	// per-texture decode times are kept in the registry's texture table
+	if ( !resources->waitForTextures() )
+	{
+		sf::err() << "Error decoding textures for scene: " << filename << std::endl;
+		return false;
+	}
+
 	return true;
 }
 
+void Scene::computeWorldBounds( std::vector<glm::vec3>& mins, std::vector<glm::vec3>& maxs )
+{
+	transforms.update();
+	mins.resize( models.size() );
+	maxs.resize( models.size() );
+	for ( size_t i = 0; i < models.size(); ++i )
+	{
+		StaticModel& model = models[i];
+		InstanceBVH::transformBounds( transforms.getWorldMatrix( model.transform ), model.localMin, model.localMax,
+									  model.worldMin, model.worldMax );
+		mins[i] = model.worldMin;
+		maxs[i] = model.worldMax;
+	}
+}
+
+void Scene::updateBounds()
+{
+	std::vector<glm::vec3> mins, maxs;
+	computeWorldBounds( mins, maxs );
+	bvh.refit( mins, maxs );
+}
+
+void Scene::rebuildBVH()
+{
+	std::vector<glm::vec3> mins, maxs;
+	computeWorldBounds( mins, maxs );
+	bvh.build( mins, maxs );
+}
+
+void Scene::setLightThreshold( float threshold )
+{
+	lightThreshold = threshold;
+	updateLights();
+}
+
+void Scene::updateLights()
+{
+	for ( size_t i = 0; i < pointlights.size(); ++i )
+	{
+		PointLight& light = pointlights[i];
+		light.range = attenuationRange( light.color, light.Kc, light.Kl, light.Kq, lightThreshold );
+	}
+	for ( size_t i = 0; i < spotlights.size(); ++i )
+	{
+		SpotLight& light = spotlights[i];
+		light.range = attenuationRange( light.color, light.Kc, light.Kl, light.Kq, lightThreshold );
+		if ( light.length > 0.0f )
+			light.range = std::min( light.range, light.length );
+		coneBounds( light.position, light.direction, light.angle, light.range, light.boundsCenter, light.boundsRadius );
+	}
+}
+
+float Scene::attenuationRange( const glm::vec3& color, float Kc, float Kl, float Kq, float threshold )
+{
+	const float UNBOUNDED = std::numeric_limits<float>::max();
+	float brightest = std::max( std::max( color.x, color.y ), color.z );
+	if ( brightest <= 0.0f )
+		return 0.0f;
+	if ( threshold <= 0.0f )
+		return UNBOUNDED;
+	if ( Kc <= 0.0f && Kl <= 0.0f && Kq <= 0.0f )
+		Kc = 1.0f;
+
+	// solve Kc + Kl d + Kq d^2 = brightest / threshold for the positive d
+	float target = brightest / threshold - Kc;
+	if ( target <= 0.0f )
+		return 0.0f;
+	if ( Kq > 0.0f )
+		return ( 2.0f * target ) / ( Kl + std::sqrt( Kl * Kl + 4.0f * Kq * target ) );
+	if ( Kl > 0.0f )
+		return target / Kl;
+	return UNBOUNDED;
+}
+
+void Scene::coneBounds( const glm::vec3& apex, const glm::vec3& direction, float angle, float range,
+						glm::vec3& center, float& radius )
+{
+	// half-angles of 90 degrees or more hold a hemisphere, which needs the whole sphere anyway
+	float axis = glm::length( direction );
+	center = apex;
+	radius = std::max( range, 0.0f );
+	if ( angle >= 90.0f || axis <= 0.0f || range <= 0.0f || range >= std::numeric_limits<float>::max() )
+		return;
+
+	// up to 45 degrees the sphere passes through the apex and the rim of the cone's cap; past that,
+	// the rim alone is widest, and the sphere around it holds the apex and the cap too
+	float cosine = std::cos( glm::radians( std::max( angle, 0.0f ) ) );
+	if ( angle <= 45.0f )
+	{
+		radius = range / ( 2.0f * cosine );
+		center = apex + direction * ( radius / axis );
+	}
+	else
+	{
+		radius = range * std::sqrt( 1.0f - cosine * cosine );
+		center = apex + direction * ( range * cosine / axis );
+	}
+}
+
 Scene::~Scene()
 {
 }
\ No newline at end of file
@@ -3,6 +3,10 @@
 
 #include <SFML/System/String.hpp>
 #include <scene/objmodel.hpp>
+#include <scene/resourceregistry.hpp>
+#include <scene/transformtable.hpp>
+#include <scene/instancebvh.hpp>
+#include <memory>
 #include <vector>
 #include <string>
 #include <unordered_map>
@@ -14,14 +18,31 @@ public:
 	struct StaticModel
 	{
 		glm::vec3 position;
-		glm::vec3 orientation; // you may want to change this to a rotation matrix or quaternion
-		                       // if so, you can edit the scene loader to do the conversion up-front
-		                       // look through glm's docs to see what options are available!
-							   // keep in mind the values from the scene file are in degrees!
+		glm::vec3 orientation; // roll, pitch, yaw in degrees, as in the scene file; the loader converts
+		                       // these up-front to a quaternion and matrices in the scene's TransformTable
 		glm::vec3 scale;
 
 		// you may want to change this when you build meshes
 		const ObjModel * model;
+
+		// index of this instance's matrices and quaternion in the scene's TransformTable
+		size_t transform;
+
+		// the model's bounding box in its own space, and this instance's in the world
+		glm::vec3 localMin, localMax;
+		glm::vec3 worldMin, worldMax;
+
+		StaticModel() : position( glm::vec3( 0.0f, 0.0f, 0.0f ) ),
+						orientation( glm::vec3( 0.0f, 0.0f, 0.0f ) ),
+						scale( glm::vec3( 1.0f, 1.0f, 1.0f ) ),
+						model( NULL ),
+						transform( 0 ),
+						localMin( glm::vec3( 0.0f, 0.0f, 0.0f ) ),
+						localMax( glm::vec3( 0.0f, 0.0f, 0.0f ) ),
+						worldMin( glm::vec3( 0.0f, 0.0f, 0.0f ) ),
+						worldMax( glm::vec3( 0.0f, 0.0f, 0.0f ) )
+		{
+		}
 	};
 
 	struct DirectionalLight
@@ -29,6 +50,12 @@ public:
 		glm::vec3 direction;
 		glm::vec3 color;
 		float ambient;
+
+		DirectionalLight() : direction( glm::vec3( 0.0f, -1.0f, 0.0f ) ),
+							 color( glm::vec3( 0.0f, 0.0f, 0.0f ) ),
+							 ambient( 0.0f )
+		{
+		}
 	};
 
 	struct SpotLight
@@ -41,13 +68,22 @@ public:
 		float length;
 		float Kc, Kl, Kq; // attenuation constants
 
+		// derived by updateLights(): where the light falls under the scene's threshold (capped by
+		// length, if set), and the sphere around the part of the cone that close
+		float range;
+		glm::vec3 boundsCenter;
+		float boundsRadius;
+
 		SpotLight() : position( glm::vec3( 0.0f, 0.0f, 0.0f ) ),
 			          direction( glm::vec3( 0.0f, 0.0f, 0.0f ) ),
 			          color( glm::vec3( 0.0f, 0.0f, 0.0f ) ),
 			          exponent( 0.0f ),
 			          angle( 0.0f ),
 			          length( 0.0f ),
-			          Kc( 0.0f ), Kl( 0.0f ), Kq( 0.0f )
+			          Kc( 0.0f ), Kl( 0.0f ), Kq( 0.0f ),
+			          range( 0.0f ),
+			          boundsCenter( glm::vec3( 0.0f, 0.0f, 0.0f ) ),
+			          boundsRadius( 0.0f )
 		{
 		};
 	};
@@ -58,19 +94,75 @@ public:
 		glm::vec3 color;
 		float velocity;
 		float Kc, Kl, Kq;
+
+		// derived by updateLights(): where the light falls under the scene's threshold
+		float range;
+
+		PointLight() : position( glm::vec3( 0.0f, 0.0f, 0.0f ) ),
+					   color( glm::vec3( 0.0f, 0.0f, 0.0f ) ),
+					   velocity( 0.0f ),
+					   Kc( 0.0f ), Kl( 0.0f ), Kq( 0.0f ),
+					   range( 0.0f )
+		{
+		}
 	};
 
 private:
+	std::shared_ptr<ResourceRegistry> resources; // materials and textures shared by all the models
 	std::unordered_map<std::string, ObjModel> objmodels;
 	std::vector<StaticModel> models;
+	TransformTable transforms; // one entry per StaticModel, computed once the scene is read
+	InstanceBVH bvh;           // over the StaticModels' world boxes, by index into models
 	DirectionalLight sunlight;
 	std::vector<SpotLight> spotlights;
 	std::vector<PointLight> pointlights;
+	float lightThreshold; // see setLightThreshold
+
+	void computeWorldBounds( std::vector<glm::vec3>& mins, std::vector<glm::vec3>& maxs );
 	
 public:
 	Scene();
-	bool loadFromFile( std::string filename );
+	// every model is loaded with options, except that they all share the scene's registry
+	bool loadFromFile( std::string filename, const ObjModel::LoadOptions& options = ObjModel::LoadOptions() );
 	~Scene();
+
+	const ResourceRegistry& getResources() const { return *resources; }
+	const std::unordered_map<std::string, ObjModel>& getObjModels() const { return objmodels; }
+	const std::vector<StaticModel>& getModels() const { return models; }
+
+	// moving an instance means changing its transform, then calling updateBounds()
+	const TransformTable& getTransforms() const { return transforms; }
+	TransformTable& getTransforms() { return transforms; }
+
+	// updates the transform table, the instances' world boxes and the BVH after instances move;
+	// the BVH keeps its shape, so rebuild it with rebuildBVH() if they've moved far
+	void updateBounds();
+	void rebuildBVH();
+	const InstanceBVH& getBVH() const { return bvh; }
+
+	const DirectionalLight& getSunlight() const { return sunlight; }
+	const std::vector<SpotLight>& getSpotLights() const { return spotlights; }
+	const std::vector<PointLight>& getPointLights() const { return pointlights; }
+	std::vector<SpotLight>& getSpotLights() { return spotlights; }
+	std::vector<PointLight>& getPointLights() { return pointlights; }
+
+	// lights are cut off where their attenuated color (in its brightest channel) falls under the
+	// threshold, 1/256 by default; setting it recomputes every light's range, as loading does
+	void setLightThreshold( float threshold );
+	float getLightThreshold() const { return lightThreshold; }
+
+	// changing lights means calling this, so their ranges and bounding spheres follow
+	void updateLights();
+
+	// the distance at which 1 / ( Kc + Kl d + Kq d^2 ) times the brightest channel of color falls to
+	// threshold: 0 if it never reaches it, FLT_MAX if it never falls that far. With no attenuation
+	// constants at all, the light is taken as unattenuated (Kc = 1), as the renderers shade it
+	static float attenuationRange( const glm::vec3& color, float Kc, float Kl, float Kq, float threshold );
+
+	// the smallest sphere around a cone of half-angle degrees (180 for every direction) cut off
+	// at range from its apex
+	static void coneBounds( const glm::vec3& apex, const glm::vec3& direction, float angle, float range,
+							glm::vec3& center, float& radius );
 };
 
 #endif // #ifndef _SCENE_H_
\ No newline at end of file
@@ -0,0 +1,81 @@
+#ifndef _SIMD_H_
+#define _SIMD_H_
+
+/*
+ * Compile-time SIMD detection shared by the data processing code.
+ * SSE2 is always there on x64 and on x86 builds that ask for it; other targets get scalar code.
+ */
+#if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#define SCENE_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/*
+ * AVX2 kernels are compiled alongside the SSE2 ones without changing the build flags: GCC and clang
+ * get them through a function attribute, MSVC always accepts the intrinsics. They must only be
+ * called when cpuHasAVX2() says so.
+ */
+#if defined( SCENE_SSE2 ) && ( defined( __GNUC__ ) || defined( _MSC_VER ) )
+#define SCENE_AVX2
+#include <immintrin.h>
+#ifdef _MSC_VER
+#define SCENE_TARGET_AVX2
+#else
+#define SCENE_TARGET_AVX2 __attribute__(( target( "avx2" ) ))
+#endif
+
+inline bool cpuHasAVX2()
+{
+#ifdef _MSC_VER
+	// the OS has to save the ymm registers too, not just the CPU support them
+	int info[4];
+	__cpuid( info, 1 );
+	if ( ( info[2] & ( 1 << 27 ) ) == 0 || ( info[2] & ( 1 << 28 ) ) == 0 || ( _xgetbv( 0 ) & 6 ) != 6 )
+		return false;
+	__cpuidex( info, 7, 0 );
+	return ( info[1] & ( 1 << 5 ) ) != 0;
+#else
+	return __builtin_cpu_supports( "avx2" ) != 0;
+#endif
+}
+#endif
+
+// SSSE3 (pshufb) kernels work the same way, behind cpuHasSSSE3()
+#if defined( SCENE_SSE2 ) && ( defined( __GNUC__ ) || defined( _MSC_VER ) )
+#define SCENE_SSSE3
+#include <tmmintrin.h>
+#ifdef _MSC_VER
+#define SCENE_TARGET_SSSE3
+#else
+#define SCENE_TARGET_SSSE3 __attribute__(( target( "ssse3" ) ))
+#endif
+
+inline bool cpuHasSSSE3()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid( info, 1 );
+	return ( info[2] & ( 1 << 9 ) ) != 0;
+#else
+	return __builtin_cpu_supports( "ssse3" ) != 0;
+#endif
+}
+#endif
+
+// index of the lowest set bit; mask must not be zero
+inline unsigned int lowestBit( unsigned int mask )
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward( &index, mask );
+	return index;
+#else
+	return __builtin_ctz( mask );
+#endif
+}
+
+#endif // _SIMD_H_
@@ -0,0 +1,434 @@
+#include "texturestreamer.hpp"
+#include "threadpool.hpp"
+#include <SFML/Graphics/Image.hpp>
+#include <SFML/System/Err.hpp>
+#include <algorithm>
+#include <cmath>
+
+// a load in flight; the worker fills in the residency and the main thread swaps it in
+struct TextureStreamer::Load
+{
+	int texture;
+	unsigned int firstLevel; // finest level wanted, or TAIL for the first load
+	bool ok;
+	Residency residency;
+	std::shared_ptr<const MipChain> chain; // built by this load, for the cache
+};
+
+namespace
+{
+	const unsigned int TAIL = ~0u;
+
+	unsigned int levelWidth( unsigned int width, unsigned int level )
+	{
+		return std::max( 1u, width >> level );
+	}
+
+	// bytes a level takes once resident
+	size_t levelBytes( unsigned int width, unsigned int height, bool compressed, CompressedTexture::Format format )
+	{
+		if ( compressed )
+			return static_cast<size_t>( ( width + 3 ) / 4 ) * ( ( height + 3 ) / 4 ) * ( format == CompressedTexture::BC1 ? 8 : 16 );
+		return static_cast<size_t>( width ) * height * 4;
+	}
+
+	// the finest level no larger than size in either dimension
+	unsigned int tailLevel( unsigned int width, unsigned int height, unsigned int levelCount, unsigned int size )
+	{
+		unsigned int level = 0;
+		while ( level + 1 < levelCount && std::max( levelWidth( width, level ), levelWidth( height, level ) ) > size )
+			++level;
+		return level;
+	}
+}
+
+TextureStreamer::TextureStreamer( const ResourceRegistry& resources, const Options& options ) : resources( resources ),
+																								 options( options ),
+																								 frame( 0 ),
+																								 loadsInFlight( 0 ),
+																								 outstanding( 0 )
+{
+}
+
+TextureStreamer::~TextureStreamer()
+{
+	// workers write into their loads and the finished list
+	std::unique_lock<std::mutex> lock( mutex );
+	idle.wait( lock, [this]() { return outstanding == 0; } );
+}
+
+TextureStreamer::Entry& TextureStreamer::entry( int texture )
+{
+	if ( static_cast<size_t>( texture ) >= entries.size() )
+	{
+		Entry blank;
+		blank.residency.width = blank.residency.height = 0;
+		blank.residency.firstLevel = blank.residency.levelCount = 0;
+		blank.residency.compressed = false;
+		blank.residency.format = CompressedTexture::BC1;
+		blank.resident = false;
+		blank.loading = false;
+		blank.failed = false;
+		blank.wanted = 0;
+		blank.demand = -1.0f;
+		blank.usedFrame = 0;
+		blank.lru = lru.end();
+		blank.chainLru = chains.end();
+		entries.resize( texture + 1, blank );
+	}
+	return entries[texture];
+}
+
+void TextureStreamer::requestTexture( int texture, float screenSize )
+{
+	if ( texture < 0 || static_cast<size_t>( texture ) >= resources.getTextures().size() )
+		return;
+
+	Entry& e = entry( texture );
+	if ( e.demand < 0.0f )
+		requested.push_back( texture );
+	e.demand = std::max( e.demand, std::max( screenSize, 0.0f ) );
+}
+
+void TextureStreamer::requestMaterial( int material, float screenSize )
+{
+	if ( material < 0 || static_cast<size_t>( material ) >= resources.getMaterials().size() )
+		return;
+
+	const ResourceRegistry::Material& m = resources.getMaterials()[material];
+	requestTexture( m.map_Kd, screenSize );
+	requestTexture( m.map_Ka, screenSize );
+}
+
+void TextureStreamer::update()
+{
+	++frame;
+	finishLoads();
+
+	// the bytes this frame's textures need at the levels they have now; upgrades must fit beside them
+	size_t committed = 0;
+	std::vector<std::pair<unsigned int, int> > upgrades;
+	for ( size_t i = 0; i < requested.size(); ++i )
+	{
+		int texture = requested[i];
+		Entry& e = entries[texture];
+		++stats.requests;
+		e.usedFrame = frame;
+
+		if ( !e.resident )
+		{
+			++stats.misses;
+			if ( !e.loading && !e.failed )
+				startLoad( texture, TAIL );
+			continue;
+		}
+
+		// the level whose size best matches the texture's footprint on screen
+		Residency& r = e.residency;
+		float texels = static_cast<float>( std::max( r.width, r.height ) );
+		float level = e.demand > 0.0f ? std::floor( std::log( texels / e.demand ) / std::log( 2.0f ) ) : static_cast<float>( r.levelCount );
+		e.wanted = static_cast<unsigned int>( std::min( std::max( level, 0.0f ), static_cast<float>( r.levelCount - 1 ) ) );
+
+		lru.splice( lru.begin(), lru, e.lru );
+		for ( unsigned int l = std::max( e.wanted, r.firstLevel ); l < r.levelCount; ++l )
+			committed += r.levels[l - r.firstLevel].data.size();
+		if ( e.wanted < r.firstLevel )
+		{
+			++stats.misses;
+			if ( !e.loading )
+				upgrades.push_back( std::make_pair( r.firstLevel - e.wanted, texture ) );
+		}
+	}
+
+	// the largest shortfalls first, as far as the budget and the load limit allow
+	std::stable_sort( upgrades.begin(), upgrades.end(),
+					  []( const std::pair<unsigned int, int>& a, const std::pair<unsigned int, int>& b ) { return a.first > b.first; } );
+	for ( size_t i = 0; i < upgrades.size() && loadsInFlight < options.maxLoads; ++i )
+	{
+		const Entry& e = entries[upgrades[i].second];
+		const Residency& r = e.residency;
+		size_t extra = 0;
+		for ( unsigned int l = e.wanted; l < r.firstLevel; ++l )
+			extra += levelBytes( levelWidth( r.width, l ), levelWidth( r.height, l ), r.compressed, r.format );
+		if ( committed + extra > options.budget )
+			continue;
+		committed += extra;
+		startLoad( upgrades[i].second, e.wanted );
+	}
+
+	for ( size_t i = 0; i < requested.size(); ++i )
+		entries[requested[i]].demand = -1.0f;
+	requested.clear();
+
+	enforceBudget();
+}
+
+void TextureStreamer::flush()
+{
+	{
+		std::unique_lock<std::mutex> lock( mutex );
+		idle.wait( lock, [this]() { return outstanding == 0; } );
+	}
+	finishLoads();
+	enforceBudget();
+}
+
+const TextureStreamer::Residency * TextureStreamer::getResidency( int texture ) const
+{
+	if ( texture < 0 || static_cast<size_t>( texture ) >= entries.size() || !entries[texture].resident )
+		return NULL;
+	return &entries[texture].residency;
+}
+
+void TextureStreamer::setBudget( size_t budget )
+{
+	options.budget = budget;
+	enforceBudget();
+}
+
+void TextureStreamer::startLoad( int texture, unsigned int firstLevel )
+{
+	std::shared_ptr<Load> load = std::make_shared<Load>();
+	load->texture = texture;
+	load->firstLevel = firstLevel;
+	load->ok = false;
+
+	entries[texture].loading = true;
+	++loadsInFlight;
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		++outstanding;
+	}
+
+	/*
+	 * Levels come from the cached chain, or the registry's own mips or image if it kept them, and
+	 * otherwise the file is decoded again. The worker is handed everything it reads here, rather
+	 * than the registry's texture, and the registry's table can grow without moving the pixels.
+	 */
+	Entry& e = entries[texture];
+	if ( e.chain )
+		chains.splice( chains.begin(), chains, e.chainLru );
+	std::shared_ptr<const MipChain> cached = e.chain;
+	const ResourceRegistry::Texture& source = resources.getTextures()[texture];
+	const MipChain * registryMips = source.mips.levelCount() > 0 ? &source.mips : NULL;
+	const sf::Image * registryImage = source.image.getSize().x > 0 ? &source.image : NULL;
+	std::string path = source.path;
+	Options settings = options;
+	ThreadPool::shared().submit( [this, load, cached, registryMips, registryImage, path, settings]()
+	{
+		const MipChain * mips = cached ? cached.get() : registryMips;
+		if ( mips == NULL )
+		{
+			sf::Image decoded;
+			const sf::Image * image = registryImage;
+			if ( image == NULL && decoded.loadFromFile( path ) )
+				image = &decoded;
+			std::shared_ptr<MipChain> built = std::make_shared<MipChain>();
+			if ( image != NULL && built->build( *image, settings.mipOptions ) )
+			{
+				load->chain = built;
+				mips = built.get();
+			}
+		}
+
+		if ( mips != NULL )
+		{
+			Residency& r = load->residency;
+			unsigned int levelCount = static_cast<unsigned int>( mips->levelCount() );
+			r.width = mips->getLevel( 0 ).width;
+			r.height = mips->getLevel( 0 ).height;
+			r.levelCount = levelCount;
+			r.firstLevel = load->firstLevel == TAIL ? tailLevel( r.width, r.height, levelCount, settings.initialSize )
+													: std::min( load->firstLevel, levelCount - 1 );
+			r.compressed = settings.compress;
+			r.format = CompressedTexture::BC1;
+
+			const MipChain::Level& first = mips->getLevel( r.firstLevel );
+			if ( r.compressed )
+				r.format = CompressedTexture::chooseFormat( mips->getPixels( r.firstLevel ), static_cast<size_t>( first.width ) * first.height );
+
+			// the whole chain from the wanted level down is replaced, so every level shares one format
+			r.levels.resize( levelCount - r.firstLevel );
+			for ( unsigned int l = r.firstLevel; l < levelCount; ++l )
+			{
+				const MipChain::Level& info = mips->getLevel( l );
+				Level& level = r.levels[l - r.firstLevel];
+				level.width = info.width;
+				level.height = info.height;
+				if ( r.compressed )
+				{
+					CompressedTexture blocks;
+					blocks.encode( mips->getPixels( l ), info.width, info.height, r.format );
+					level.data.assign( blocks.getBlocks( 0 ), blocks.getBlocks( 0 ) + blocks.byteSize() );
+				}
+				else
+				{
+					level.data.assign( mips->getPixels( l ), mips->getPixels( l ) + static_cast<size_t>( info.width ) * info.height * 4 );
+				}
+			}
+			load->ok = true;
+		}
+
+		std::lock_guard<std::mutex> lock( mutex );
+		finished.push_back( load );
+		if ( --outstanding == 0 )
+			idle.notify_all();
+	} );
+}
+
+void TextureStreamer::finishLoads()
+{
+	std::vector<std::shared_ptr<Load> > done;
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		done.swap( finished );
+	}
+
+	for ( size_t i = 0; i < done.size(); ++i )
+	{
+		Load& load = *done[i];
+		Entry& e = entries[load.texture];
+		e.loading = false;
+		--loadsInFlight;
+
+		// a chain is only worth keeping while there are finer levels to upgrade to
+		if ( load.chain )
+			++stats.chainBuilds;
+		if ( load.ok && load.residency.firstLevel == 0 )
+			dropChain( load.texture );
+		else if ( load.chain )
+			cacheChain( load.texture, load.chain );
+
+		if ( !load.ok )
+		{
+			sf::err() << "Error streaming texture: " << resources.getTextures()[load.texture].path << std::endl;
+			e.failed = true;
+			++stats.failures;
+			continue;
+		}
+
+		if ( e.resident )
+		{
+			++stats.upgrades;
+			stats.residentBytes -= residencyBytes( e.residency );
+			stats.residentLevels -= e.residency.levels.size();
+		}
+		else
+		{
+			++stats.loads;
+			++stats.residentTextures;
+			e.resident = true;
+			lru.push_front( load.texture );
+			e.lru = lru.begin();
+		}
+		e.residency.levels.swap( load.residency.levels );
+		e.residency.width = load.residency.width;
+		e.residency.height = load.residency.height;
+		e.residency.firstLevel = load.residency.firstLevel;
+		e.residency.levelCount = load.residency.levelCount;
+		e.residency.compressed = load.residency.compressed;
+		e.residency.format = load.residency.format;
+		stats.residentBytes += residencyBytes( e.residency );
+		stats.residentLevels += e.residency.levels.size();
+		stats.peakBytes = std::max( stats.peakBytes, stats.residentBytes );
+	}
+}
+
+void TextureStreamer::dropLevels( int texture, unsigned int firstLevel )
+{
+	Residency& r = entries[texture].residency;
+	if ( firstLevel <= r.firstLevel || firstLevel >= r.levelCount )
+		return;
+
+	size_t bytes = 0;
+	unsigned int count = firstLevel - r.firstLevel;
+	for ( unsigned int i = 0; i < count; ++i )
+		bytes += r.levels[i].data.size();
+	r.levels.erase( r.levels.begin(), r.levels.begin() + count );
+	r.firstLevel = firstLevel;
+
+	++stats.downgrades;
+	stats.evictedBytes += bytes;
+	stats.residentBytes -= bytes;
+	stats.residentLevels -= count;
+}
+
+void TextureStreamer::evict( int texture )
+{
+	Entry& e = entries[texture];
+	size_t bytes = residencyBytes( e.residency );
+
+	++stats.evictions;
+	stats.evictedBytes += bytes;
+	stats.residentBytes -= bytes;
+	stats.residentLevels -= e.residency.levels.size();
+	--stats.residentTextures;
+
+	std::vector<Level>().swap( e.residency.levels );
+	lru.erase( e.lru );
+	e.lru = lru.end();
+	e.resident = false;
+}
+
+void TextureStreamer::enforceBudget()
+{
+	// levels finer than anything asked for lately
+	for ( std::list<int>::reverse_iterator i = lru.rbegin(); i != lru.rend() && stats.residentBytes > options.budget; ++i )
+	{
+		const Residency& r = entries[*i].residency;
+		dropLevels( *i, std::min( entries[*i].wanted, tailLevel( r.width, r.height, r.levelCount, options.initialSize ) ) );
+	}
+
+	// whole textures that weren't drawn in the last frame, least recently used first
+	while ( !lru.empty() && stats.residentBytes > options.budget && entries[lru.back()].usedFrame != frame )
+		evict( lru.back() );
+
+	// the finest levels of drawn textures, a level at a time, stopping at their tails
+	bool dropped = true;
+	while ( dropped && stats.residentBytes > options.budget )
+	{
+		dropped = false;
+		for ( std::list<int>::reverse_iterator i = lru.rbegin(); i != lru.rend() && stats.residentBytes > options.budget; ++i )
+		{
+			const Residency& r = entries[*i].residency;
+			if ( r.firstLevel < tailLevel( r.width, r.height, r.levelCount, options.initialSize ) )
+			{
+				dropLevels( *i, r.firstLevel + 1 );
+				dropped = true;
+			}
+		}
+	}
+}
+
+void TextureStreamer::cacheChain( int texture, const std::shared_ptr<const MipChain>& chain )
+{
+	dropChain( texture );
+	Entry& e = entries[texture];
+	e.chain = chain;
+	chains.push_front( texture );
+	e.chainLru = chains.begin();
+	stats.chainBytes += chain->byteSize();
+
+	// loads still reading an evicted chain keep it alive until they're done
+	while ( !chains.empty() && stats.chainBytes > options.chainCache )
+		dropChain( chains.back() );
+}
+
+void TextureStreamer::dropChain( int texture )
+{
+	Entry& e = entries[texture];
+	if ( !e.chain )
+		return;
+	stats.chainBytes -= e.chain->byteSize();
+	chains.erase( e.chainLru );
+	e.chainLru = chains.end();
+	e.chain.reset();
+}
+
+size_t TextureStreamer::residencyBytes( const Residency& residency )
+{
+	size_t bytes = 0;
+	for ( size_t i = 0; i < residency.levels.size(); ++i )
+		bytes += residency.levels[i].data.size();
+	return bytes;
+}
@@ -0,0 +1,172 @@
+#ifndef _TEXTURESTREAMER_H_
+#define _TEXTURESTREAMER_H_
+
+#include <scene/resourceregistry.hpp>
+#include <scene/mipchain.hpp>
+#include <scene/compressedtexture.hpp>
+#include <vector>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <cstddef>
+
+/*
+ * Keeps the mip levels the renderer actually needs resident, within a fixed byte budget.
+ *
+ * Each frame the renderer reports which textures (or materials, through map_Kd / map_Ka) it drew
+ * and how many screen pixels they spanned, then calls update(). A texture seen for the first time
+ * gets only its small tail levels (up to initialSize), so something can be drawn right away; later
+ * frames upgrade it to the level its on-screen size calls for. Loads run on the shared ThreadPool.
+ *
+ * When the budget is exceeded, levels finer than their texture's current demand go first, then
+ * textures not drawn this frame in least-recently-used order, and as a last resort the finest
+ * levels of textures that were drawn. Tail levels of drawn textures are never evicted.
+ *
+ * A load decodes the texture's file and builds its whole chain, since the tail is filtered from
+ * the levels above it; the chain is then kept in a small cache of its own (chainCache bytes, least
+ * recently used first out), so upgrades copy levels from it instead of decoding the file again.
+ *
+ * Texture handles are those of the registry; the registry should be set to stream its textures
+ * (ResourceRegistry::setStreamTextures) so it doesn't hold a decoded copy of every image as well.
+ * Loads read the registry's pixels, if it kept any, in place: its own loads have to be finished
+ * (ResourceRegistry::waitForTextures) before textures are requested, and it must not be cleared
+ * while loads run (see flush), though textures can still be added to it.
+ */
+class TextureStreamer
+{
+public:
+	struct Options
+	{
+		size_t budget;              // bytes of resident level data
+		unsigned int initialSize;   // largest dimension of the levels loaded on first use
+		unsigned int maxLoads;      // loads in flight at once
+		bool compress;              // keep levels block compressed (BC1, or BC3 with alpha)
+		size_t chainCache;          // bytes of full chains kept from loads for later upgrades, outside the budget
+		MipChain::Options mipOptions;
+
+		Options() : budget( 256 << 20 ),
+					initialSize( 64 ),
+					maxLoads( 4 ),
+					compress( false ),
+					chainCache( 64 << 20 )
+		{
+		}
+	};
+
+	struct Level
+	{
+		unsigned int width;
+		unsigned int height;
+		std::vector<unsigned char> data; // RGBA8 texels, or blocks when compressed
+	};
+
+	// what's in memory for one texture; levels[i] is mip level firstLevel + i, down to 1x1
+	struct Residency
+	{
+		unsigned int width;               // of level 0
+		unsigned int height;
+		unsigned int firstLevel;
+		unsigned int levelCount;          // of the full chain
+		bool compressed;
+		CompressedTexture::Format format; // when compressed
+		std::vector<Level> levels;
+	};
+
+	struct Stats
+	{
+		size_t residentTextures;
+		size_t residentLevels;
+		size_t residentBytes;
+		size_t peakBytes;
+		size_t requests;     // textures drawn, counted once per frame
+		size_t misses;       // of those, ones whose wanted level wasn't resident yet
+		size_t loads;        // textures made resident for the first time (or again after eviction)
+		size_t upgrades;     // loads of finer levels for a resident texture
+		size_t failures;     // loads that couldn't read their image
+		size_t downgrades;   // times a texture's finest levels were dropped to make room
+		size_t evictions;    // textures dropped entirely
+		size_t evictedBytes; // by downgrades and evictions together
+		size_t chainBuilds;  // loads that decoded the file (or read the registry's image) and built a chain
+		size_t chainBytes;   // held by the chain cache
+
+		Stats() : residentTextures( 0 ), residentLevels( 0 ), residentBytes( 0 ), peakBytes( 0 ),
+				  requests( 0 ), misses( 0 ), loads( 0 ), upgrades( 0 ), failures( 0 ),
+				  downgrades( 0 ), evictions( 0 ), evictedBytes( 0 ), chainBuilds( 0 ), chainBytes( 0 )
+		{
+		}
+	};
+
+	// the registry has to outlive the streamer
+	TextureStreamer( const ResourceRegistry& resources, const Options& options = Options() );
+	~TextureStreamer();
+
+	/*
+	 * Reports that a texture was drawn this frame, covering screenSize pixels along its longer
+	 * axis (texture repeats included). Several reports in a frame keep the largest.
+	 */
+	void requestTexture( int texture, float screenSize );
+
+	// requests a material's diffuse and ambient maps
+	void requestMaterial( int material, float screenSize );
+
+	// once per frame: takes in finished loads, starts new ones, and evicts down to the budget
+	void update();
+
+	// blocks until the loads in flight are done, then takes them in and evicts down to the budget
+	void flush();
+
+	// NULL if nothing of the texture is resident yet; valid until the next update
+	const Residency * getResidency( int texture ) const;
+
+	void setBudget( size_t budget );
+	const Stats& getStats() const { return stats; }
+
+private:
+	TextureStreamer( const TextureStreamer& );
+	TextureStreamer& operator=( const TextureStreamer& );
+
+	struct Entry
+	{
+		Residency residency;
+		bool resident;
+		bool loading;
+		bool failed;
+		unsigned int wanted;       // level the renderer last asked for
+		float demand;              // largest screen size reported this frame
+		unsigned long long usedFrame;
+		std::list<int>::iterator lru;
+		std::shared_ptr<const MipChain> chain; // cached from the last load that built one
+		std::list<int>::iterator chainLru;
+	};
+
+	struct Load;
+
+	const ResourceRegistry& resources;
+	Options options;
+	std::vector<Entry> entries;
+	std::list<int> lru; // resident textures, most recently used first
+	std::list<int> chains; // textures with a cached chain, most recently used first
+	std::vector<int> requested; // textures requested this frame
+	unsigned long long frame;
+	unsigned int loadsInFlight;
+
+	std::vector<std::shared_ptr<Load> > finished;
+	std::mutex mutex;
+	std::condition_variable idle;
+	size_t outstanding;
+
+	Stats stats;
+
+	Entry& entry( int texture );
+	void startLoad( int texture, unsigned int firstLevel );
+	void finishLoads();
+	void dropLevels( int texture, unsigned int firstLevel );
+	void evict( int texture );
+	void enforceBudget();
+	void cacheChain( int texture, const std::shared_ptr<const MipChain>& chain );
+	void dropChain( int texture );
+	static size_t residencyBytes( const Residency& residency );
+};
+
+#endif // _TEXTURESTREAMER_H_
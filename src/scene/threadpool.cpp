@@ -0,0 +1,131 @@
+#include "threadpool.hpp"
+#include <atomic>
+#include <memory>
+#include <algorithm>
+
+namespace
+{
+	// bookkeeping for one parallelFor call
+	// helpers may start after the caller has finished, so this is shared rather than on the stack
+	struct ForState
+	{
+		std::atomic<size_t> next;
+		std::atomic<size_t> done;
+		size_t count;
+		size_t grain;
+		size_t chunks;
+		const std::function<void( size_t, size_t )> * body;
+		std::mutex mutex;
+		std::condition_variable finished;
+
+		void run()
+		{
+			for ( ;; )
+			{
+				size_t chunk = next++;
+				if ( chunk >= chunks )
+					return;
+
+				size_t begin = chunk * grain;
+				( *body )( begin, std::min( count, begin + grain ) );
+
+				if ( ++done == chunks )
+				{
+					std::lock_guard<std::mutex> lock( mutex );
+					finished.notify_all();
+				}
+			}
+		}
+	};
+}
+
+ThreadPool::ThreadPool( unsigned threads ) : stopping( false )
+{
+	if ( threads == 0 )
+	{
+		unsigned cores = std::thread::hardware_concurrency();
+		threads = cores > 1 ? cores - 1 : 1;
+	}
+
+	for ( unsigned i = 0; i < threads; ++i )
+		workers.push_back( std::thread( &ThreadPool::workerLoop, this ) );
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		stopping = true;
+	}
+	wake.notify_all();
+
+	for ( size_t i = 0; i < workers.size(); ++i )
+		workers[i].join();
+}
+
+void ThreadPool::submit( const std::function<void()>& task )
+{
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		tasks.push_back( task );
+	}
+	wake.notify_one();
+}
+
+void ThreadPool::parallelFor( size_t count, const std::function<void( size_t, size_t )>& body, size_t grain )
+{
+	if ( count == 0 )
+		return;
+	if ( grain == 0 )
+		grain = 1;
+
+	size_t chunks = ( count + grain - 1 ) / grain;
+	if ( chunks == 1 )
+	{
+		body( 0, count );
+		return;
+	}
+
+	std::shared_ptr<ForState> state = std::make_shared<ForState>();
+	state->next = 0;
+	state->done = 0;
+	state->count = count;
+	state->grain = grain;
+	state->chunks = chunks;
+	state->body = &body;
+
+	size_t helpers = std::min( chunks - 1, workers.size() );
+	for ( size_t i = 0; i < helpers; ++i )
+		submit( [state]() { state->run(); } );
+
+	state->run();
+
+	std::unique_lock<std::mutex> lock( state->mutex );
+	while ( state->done < chunks )
+		state->finished.wait( lock );
+}
+
+ThreadPool& ThreadPool::shared()
+{
+	static ThreadPool pool;
+	return pool;
+}
+
+void ThreadPool::workerLoop()
+{
+	for ( ;; )
+	{
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock( mutex );
+			while ( !stopping && tasks.empty() )
+				wake.wait( lock );
+			if ( stopping && tasks.empty() )
+				return;
+
+			task = tasks.front();
+			tasks.pop_front();
+		}
+		task();
+	}
+}
@@ -0,0 +1,49 @@
+#ifndef _THREADPOOL_H_
+#define _THREADPOOL_H_
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <cstddef>
+
+/*
+ * A small fixed-size pool of worker threads.
+ * submit() queues fire-and-forget tasks; parallelFor() splits a range of work between the workers
+ * and the calling thread, and returns once all of it is done. parallelFor can safely be called
+ * from inside another task, since the caller always helps with its own work.
+ */
+class ThreadPool
+{
+public:
+	// threads = 0 picks one worker per core, minus the calling thread
+	explicit ThreadPool( unsigned threads = 0 );
+	~ThreadPool();
+
+	// number of threads that can work on a parallelFor at once, including the caller
+	unsigned concurrency() const { return static_cast<unsigned>( workers.size() ) + 1; }
+
+	void submit( const std::function<void()>& task );
+
+	// calls body( begin, end ) on sub-ranges of [0, count), each at most grain items long
+	void parallelFor( size_t count, const std::function<void( size_t, size_t )>& body, size_t grain = 1 );
+
+	// a process-wide pool, created on first use
+	static ThreadPool& shared();
+
+private:
+	ThreadPool( const ThreadPool& );
+	ThreadPool& operator=( const ThreadPool& );
+
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()> > tasks;
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool stopping;
+
+	void workerLoop();
+};
+
+#endif // _THREADPOOL_H_
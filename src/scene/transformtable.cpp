@@ -0,0 +1,401 @@
+#include "transformtable.hpp"
+#include "threadpool.hpp"
+#include "simd.hpp"
+#include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+
+#ifdef SCENE_SSE2
+#include <glm/gtx/simd_vec4.hpp>
+#include <glm/gtx/simd_mat4.hpp>
+#endif
+
+namespace
+{
+	// floats per instance in each array, and where each array starts, in units of capacity
+	const size_t WIDTHS[] = { 4, 4, 4, 4, 16, 16 };
+	const size_t STARTS[] = { 0, 4, 8, 12, 16, 32 };
+	const size_t FLOATS_PER_INSTANCE = 48;
+
+	// dirty instances are recomputed in runs of this many per task
+	const size_t BATCH_GRAIN = 1024;
+
+	// the three axis rotations, as (w, x, y, z) quaternions of half angles
+	struct EulerHalves
+	{
+		float roll[2], pitch[2], yaw[2]; // cos, sin
+	};
+
+	EulerHalves eulerHalves( const float * orientation )
+	{
+		EulerHalves halves;
+		float roll = glm::radians( orientation[0] ) * 0.5f, pitch = glm::radians( orientation[1] ) * 0.5f,
+			  yaw = glm::radians( orientation[2] ) * 0.5f;
+		halves.roll[0] = std::cos( roll );
+		halves.roll[1] = std::sin( roll );
+		halves.pitch[0] = std::cos( pitch );
+		halves.pitch[1] = std::sin( pitch );
+		halves.yaw[0] = std::cos( yaw );
+		halves.yaw[1] = std::sin( yaw );
+		return halves;
+	}
+
+	// a zero scale has no inverse; its normal column is left at zero rather than infinity
+	float inverseScale( float s )
+	{
+		return s != 0.0f ? 1.0f / s : 0.0f;
+	}
+
+	struct Arrays
+	{
+		const float * position;
+		const float * orientation;
+		const float * scale;
+		float * rotation;
+		float * world;
+		float * normal;
+	};
+
+	void updateScalar( const Arrays& arrays, const size_t * indices, size_t count )
+	{
+		for ( size_t k = 0; k < count; ++k )
+		{
+			size_t i = indices[k];
+			EulerHalves h = eulerHalves( arrays.orientation + i * 4 );
+			glm::quat q = glm::quat( h.yaw[0], 0.0f, h.yaw[1], 0.0f ) * glm::quat( h.pitch[0], h.pitch[1], 0.0f, 0.0f ) *
+						  glm::quat( h.roll[0], 0.0f, 0.0f, h.roll[1] );
+			glm::mat3 r = glm::mat3_cast( q );
+
+			const float * p = arrays.position + i * 4;
+			const float * s = arrays.scale + i * 4;
+			glm::mat4 world( glm::vec4( r[0] * s[0], 0.0f ), glm::vec4( r[1] * s[1], 0.0f ), glm::vec4( r[2] * s[2], 0.0f ),
+							 glm::vec4( p[0], p[1], p[2], 1.0f ) );
+			glm::mat4 normal( glm::vec4( r[0] * inverseScale( s[0] ), 0.0f ), glm::vec4( r[1] * inverseScale( s[1] ), 0.0f ),
+							  glm::vec4( r[2] * inverseScale( s[2] ), 0.0f ), glm::vec4( 0.0f, 0.0f, 0.0f, 1.0f ) );
+
+			float * rotation = arrays.rotation + i * 4;
+			rotation[0] = q.x;
+			rotation[1] = q.y;
+			rotation[2] = q.z;
+			rotation[3] = q.w;
+			std::memcpy( arrays.world + i * 16, glm::value_ptr( world ), sizeof( world ) );
+			std::memcpy( arrays.normal + i * 16, glm::value_ptr( normal ), sizeof( normal ) );
+		}
+	}
+
+#ifdef SCENE_SSE2
+	typedef glm::simdVec4 Lanes;
+
+	// sine and cosine of four angles: reduced to [-pi/4, pi/4] by quarter turns, then the
+	// polynomials of the Cephes sinf and cosf; within a couple of ulps of the C library
+	void sinCos( __m128 x, __m128& sine, __m128& cosine )
+	{
+		__m128i quadrant = _mm_cvtps_epi32( _mm_mul_ps( x, _mm_set1_ps( 0.636619772f ) ) );
+		__m128 j = _mm_cvtepi32_ps( quadrant );
+		__m128 r = _mm_sub_ps( x, _mm_mul_ps( j, _mm_set1_ps( 1.5703125f ) ) );
+		r = _mm_sub_ps( r, _mm_mul_ps( j, _mm_set1_ps( 4.837512969970703125e-4f ) ) );
+		r = _mm_sub_ps( r, _mm_mul_ps( j, _mm_set1_ps( 7.54978995489188216e-8f ) ) );
+
+		Lanes r1( r ), r2 = r1 * r1;
+		Lanes s = r1 + r1 * r2 * ( -1.6666654611e-1f + r2 * ( 8.3321608736e-3f + r2 * -1.9515295891e-4f ) );
+		Lanes c = 1.0f - 0.5f * r2 + r2 * r2 * ( 4.166664568298827e-2f + r2 * ( -1.388731625493765e-3f + r2 * 2.443315711809948e-5f ) );
+
+		// odd quarter turns swap sine and cosine; the signs follow the quadrant
+		__m128 swap = _mm_castsi128_ps( _mm_cmpeq_epi32( _mm_and_si128( quadrant, _mm_set1_epi32( 1 ) ), _mm_set1_epi32( 1 ) ) );
+		__m128 sineSign = _mm_castsi128_ps( _mm_slli_epi32( _mm_and_si128( quadrant, _mm_set1_epi32( 2 ) ), 30 ) );
+		__m128 cosineSign = _mm_castsi128_ps( _mm_slli_epi32( _mm_and_si128( _mm_add_epi32( quadrant, _mm_set1_epi32( 1 ) ), _mm_set1_epi32( 2 ) ), 30 ) );
+		sine = _mm_xor_ps( _mm_or_ps( _mm_and_ps( swap, c.Data ), _mm_andnot_ps( swap, s.Data ) ), sineSign );
+		cosine = _mm_xor_ps( _mm_or_ps( _mm_and_ps( swap, s.Data ), _mm_andnot_ps( swap, c.Data ) ), cosineSign );
+	}
+
+	// four instances' 4-float records, transposed to one component per register
+	void gather( const float * records, const size_t * lane, __m128& x, __m128& y, __m128& z, __m128& w )
+	{
+		x = _mm_load_ps( records + lane[0] * 4 );
+		y = _mm_load_ps( records + lane[1] * 4 );
+		z = _mm_load_ps( records + lane[2] * 4 );
+		w = _mm_load_ps( records + lane[3] * 4 );
+		_MM_TRANSPOSE4_PS( x, y, z, w );
+	}
+
+	// the reverse: one column (or quaternion) per instance from component registers
+	void scatter( glm::simdMat4 * matrices, int column, const size_t * lane, __m128 x, __m128 y, __m128 z, __m128 w )
+	{
+		_MM_TRANSPOSE4_PS( x, y, z, w );
+		matrices[lane[0]][column].Data = x;
+		matrices[lane[1]][column].Data = y;
+		matrices[lane[2]][column].Data = z;
+		matrices[lane[3]][column].Data = w;
+	}
+
+	/*
+	 * Four instances at a time, structure-of-arrays style: the inputs are transposed so each register
+	 * holds one value of four instances, the trig, quaternion and matrix math run on those, and the
+	 * results are transposed back into fmat4x4SIMD matrices.
+	 */
+	void updateSSE2( const Arrays& arrays, const size_t * indices, size_t count )
+	{
+		glm::simdMat4 * worlds = reinterpret_cast<glm::simdMat4 *>( arrays.world );
+		glm::simdMat4 * normals = reinterpret_cast<glm::simdMat4 *>( arrays.normal );
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 halfRadians = _mm_set1_ps( 3.14159265f / 360.0f );
+
+		for ( size_t k = 0; k < count; k += 4 )
+		{
+			// a short last step repeats its last instance
+			size_t lane[4];
+			for ( size_t l = 0; l < 4; ++l )
+				lane[l] = indices[std::min( k + l, count - 1 )];
+
+			__m128 roll, pitch, yaw, unused;
+			gather( arrays.orientation, lane, roll, pitch, yaw, unused );
+			__m128 sr, cr, sp, cp, sy, cy;
+			sinCos( _mm_mul_ps( roll, halfRadians ), sr, cr );
+			sinCos( _mm_mul_ps( pitch, halfRadians ), sp, cp );
+			sinCos( _mm_mul_ps( yaw, halfRadians ), sy, cy );
+
+			// yaw * pitch * roll, multiplied out for the axis quaternions
+			Lanes aw = Lanes( cy ) * Lanes( cp ), ax = Lanes( cy ) * Lanes( sp ), ay = Lanes( sy ) * Lanes( cp ), az = -( Lanes( sy ) * Lanes( sp ) );
+			Lanes w = aw * Lanes( cr ) - az * Lanes( sr );
+			Lanes x = ax * Lanes( cr ) + ay * Lanes( sr );
+			Lanes y = ay * Lanes( cr ) - ax * Lanes( sr );
+			Lanes z = aw * Lanes( sr ) + az * Lanes( cr );
+
+			Lanes x2 = x + x, y2 = y + y, z2 = z + z;
+			Lanes xx = x * x2, yy = y * y2, zz = z * z2, xy = x * y2, xz = x * z2, yz = y * z2;
+			Lanes wx = w * x2, wy = w * y2, wz = w * z2;
+			Lanes r00 = 1.0f - ( yy + zz ), r01 = xy + wz, r02 = xz - wy;
+			Lanes r10 = xy - wz, r11 = 1.0f - ( xx + zz ), r12 = yz + wx;
+			Lanes r20 = xz + wy, r21 = yz - wx, r22 = 1.0f - ( xx + yy );
+
+			// world columns are scaled by s, normal columns by 1 / s (0 where s is 0)
+			__m128 sx, sy_, sz, sw;
+			gather( arrays.scale, lane, sx, sy_, sz, sw );
+			Lanes scale[3] = { Lanes( sx ), Lanes( sy_ ), Lanes( sz ) };
+			Lanes inverse[3];
+			for ( int a = 0; a < 3; ++a )
+				inverse[a] = _mm_and_ps( _mm_div_ps( _mm_set1_ps( 1.0f ), scale[a].Data ), _mm_cmpneq_ps( scale[a].Data, zero ) );
+
+			scatter( worlds, 0, lane, ( r00 * scale[0] ).Data, ( r01 * scale[0] ).Data, ( r02 * scale[0] ).Data, zero );
+			scatter( worlds, 1, lane, ( r10 * scale[1] ).Data, ( r11 * scale[1] ).Data, ( r12 * scale[1] ).Data, zero );
+			scatter( worlds, 2, lane, ( r20 * scale[2] ).Data, ( r21 * scale[2] ).Data, ( r22 * scale[2] ).Data, zero );
+			scatter( normals, 0, lane, ( r00 * inverse[0] ).Data, ( r01 * inverse[0] ).Data, ( r02 * inverse[0] ).Data, zero );
+			scatter( normals, 1, lane, ( r10 * inverse[1] ).Data, ( r11 * inverse[1] ).Data, ( r12 * inverse[1] ).Data, zero );
+			scatter( normals, 2, lane, ( r20 * inverse[2] ).Data, ( r21 * inverse[2] ).Data, ( r22 * inverse[2] ).Data, zero );
+
+			const __m128 lastColumn = _mm_setr_ps( 0.0f, 0.0f, 0.0f, 1.0f );
+			for ( size_t l = 0; l < 4; ++l )
+			{
+				worlds[lane[l]][3].Data = _mm_load_ps( arrays.position + lane[l] * 4 ); // w is kept at 1
+				normals[lane[l]][3].Data = lastColumn;
+			}
+
+			_MM_TRANSPOSE4_PS( x.Data, y.Data, z.Data, w.Data );
+			_mm_store_ps( arrays.rotation + lane[0] * 4, x.Data );
+			_mm_store_ps( arrays.rotation + lane[1] * 4, y.Data );
+			_mm_store_ps( arrays.rotation + lane[2] * 4, z.Data );
+			_mm_store_ps( arrays.rotation + lane[3] * 4, w.Data );
+		}
+	}
+#endif
+}
+
+TransformTable::TransformTable() : offset( 0 ), capacity( 0 ), count( 0 )
+{
+}
+
+TransformTable::TransformTable( const TransformTable& other ) : offset( 0 ), capacity( 0 ), count( 0 )
+{
+	*this = other;
+}
+
+// storage can't just be copied: the copy's alignment, and so its offset, may differ
+TransformTable& TransformTable::operator=( const TransformTable& other )
+{
+	if ( this != &other )
+	{
+		clear();
+		reserve( other.count );
+		count = other.count;
+		for ( size_t a = 0; a < ARRAY_COUNT; ++a )
+			std::copy( other.array( Array( a ) ), other.array( Array( a ) ) + count * WIDTHS[a], array( Array( a ) ) );
+		dirty = other.dirty;
+		isDirty = other.isDirty;
+	}
+	return *this;
+}
+
+float * TransformTable::array( Array a )
+{
+	return storage.empty() ? NULL : &storage[offset + capacity * STARTS[a]];
+}
+
+const float * TransformTable::array( Array a ) const
+{
+	return storage.empty() ? NULL : &storage[offset + capacity * STARTS[a]];
+}
+
+void TransformTable::reserve( size_t newCapacity )
+{
+	if ( newCapacity <= capacity )
+		return;
+
+	// over-allocate by three floats and start at the first 16-byte boundary
+	std::vector<float> grown( newCapacity * FLOATS_PER_INSTANCE + 3 );
+	size_t misalignment = ( reinterpret_cast<size_t>( &grown[0] ) / sizeof( float ) ) & 3;
+	size_t grownOffset = ( 4 - misalignment ) & 3;
+	for ( size_t a = 0; a < ARRAY_COUNT && count > 0; ++a )
+		std::copy( array( Array( a ) ), array( Array( a ) ) + count * WIDTHS[a], &grown[grownOffset + newCapacity * STARTS[a]] );
+
+	storage.swap( grown );
+	offset = grownOffset;
+	capacity = newCapacity;
+}
+
+void TransformTable::clear()
+{
+	storage.clear();
+	offset = 0;
+	capacity = 0;
+	count = 0;
+	dirty.clear();
+	isDirty.clear();
+}
+
+size_t TransformTable::add( const glm::vec3& position, const glm::vec3& orientation, const glm::vec3& scale )
+{
+	if ( count == capacity )
+		reserve( std::max<size_t>( 64, capacity * 2 ) );
+	size_t i = count++;
+	isDirty.push_back( 0 );
+	set( i, position, orientation, scale );
+	return i;
+}
+
+void TransformTable::set( size_t i, const glm::vec3& position, const glm::vec3& orientation, const glm::vec3& scale )
+{
+	setPosition( i, position );
+	setOrientation( i, orientation );
+	setScale( i, scale );
+}
+
+void TransformTable::setPosition( size_t i, const glm::vec3& position )
+{
+	float * p = array( POSITION ) + i * 4;
+	p[0] = position.x;
+	p[1] = position.y;
+	p[2] = position.z;
+	p[3] = 1.0f;
+	markDirty( i );
+}
+
+void TransformTable::setOrientation( size_t i, const glm::vec3& orientation )
+{
+	float * o = array( ORIENTATION ) + i * 4;
+	o[0] = orientation.x;
+	o[1] = orientation.y;
+	o[2] = orientation.z;
+	o[3] = 0.0f;
+	markDirty( i );
+}
+
+void TransformTable::setScale( size_t i, const glm::vec3& scale )
+{
+	float * s = array( SCALE ) + i * 4;
+	s[0] = scale.x;
+	s[1] = scale.y;
+	s[2] = scale.z;
+	s[3] = 1.0f;
+	markDirty( i );
+}
+
+void TransformTable::markDirty( size_t i )
+{
+	if ( !isDirty[i] )
+	{
+		isDirty[i] = 1;
+		dirty.push_back( i );
+	}
+}
+
+void TransformTable::invalidate()
+{
+	for ( size_t i = 0; i < count; ++i )
+		markDirty( i );
+}
+
+glm::vec3 TransformTable::getPosition( size_t i ) const
+{
+	return glm::make_vec3( array( POSITION ) + i * 4 );
+}
+
+glm::vec3 TransformTable::getOrientation( size_t i ) const
+{
+	return glm::make_vec3( array( ORIENTATION ) + i * 4 );
+}
+
+glm::vec3 TransformTable::getScale( size_t i ) const
+{
+	return glm::make_vec3( array( SCALE ) + i * 4 );
+}
+
+glm::mat4 TransformTable::getWorldMatrix( size_t i ) const
+{
+	return glm::make_mat4( array( WORLD ) + i * 16 );
+}
+
+glm::mat4 TransformTable::getNormalMatrix( size_t i ) const
+{
+	return glm::make_mat4( array( NORMAL ) + i * 16 );
+}
+
+glm::quat TransformTable::getRotation( size_t i ) const
+{
+	const float * q = array( ROTATION ) + i * 4;
+	return glm::quat( q[3], q[0], q[1], q[2] );
+}
+
+TransformTable::Kernel TransformTable::selectKernel( Kernel requested )
+{
+#ifdef SCENE_SSE2
+	if ( requested != SCALAR )
+		return SSE2;
+#endif
+	return SCALAR;
+}
+
+size_t TransformTable::update( Kernel kernel )
+{
+	size_t updated = dirty.size();
+	if ( updated == 0 )
+		return 0;
+
+	Arrays arrays;
+	arrays.position = array( POSITION );
+	arrays.orientation = array( ORIENTATION );
+	arrays.scale = array( SCALE );
+	arrays.rotation = array( ROTATION );
+	arrays.world = array( WORLD );
+	arrays.normal = array( NORMAL );
+
+	void ( *body )( const Arrays&, const size_t *, size_t ) = updateScalar;
+#ifdef SCENE_SSE2
+	if ( selectKernel( kernel ) == SSE2 )
+		body = updateSSE2;
+#else
+	( void )kernel;
+#endif
+
+	size_t batches = ( updated + BATCH_GRAIN - 1 ) / BATCH_GRAIN;
+	ThreadPool::shared().parallelFor( batches, [&]( size_t begin, size_t end )
+	{
+		size_t first = begin * BATCH_GRAIN, last = std::min( end * BATCH_GRAIN, updated );
+		body( arrays, &dirty[first], last - first );
+	} );
+
+	for ( size_t k = 0; k < updated; ++k )
+		isDirty[dirty[k]] = 0;
+	dirty.clear();
+	return updated;
+}
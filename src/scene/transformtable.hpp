@@ -0,0 +1,85 @@
+#ifndef _TRANSFORMTABLE_H_
+#define _TRANSFORMTABLE_H_
+
+#include <vector>
+#include <cstddef>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+/*
+ * World transforms for a scene's model instances, kept ready for rendering.
+ *
+ * Each instance has a position, an orientation (roll, pitch, yaw in degrees - rotations about
+ * z, x and y, applied in that order) and a scale. From those the table keeps
+ *   world    - translate * rotate * scale, column-major
+ *   normal   - the inverse transpose of world's upper 3x3, as a 4x4 with no translation
+ *   rotation - the unit quaternion of the orientation, stored x, y, z, w
+ * Every attribute lives in its own array, and all of the arrays share one 16-byte-aligned block,
+ * so a renderer can upload the world matrices of every instance with one copy.
+ *
+ * Changing an instance only marks it dirty; update() recomputes the dirty instances in one batch,
+ * split across the thread pool. The SSE2 kernel does four instances at a time with glm's fvec4SIMD,
+ * sines and cosines included, and writes fmat4x4SIMD matrices; the scalar kernel is the reference.
+ */
+class TransformTable
+{
+public:
+	enum Kernel { AUTO, SCALAR, SSE2 };
+
+	TransformTable();
+	TransformTable( const TransformTable& other );
+	TransformTable& operator=( const TransformTable& other );
+
+	// adds an instance and returns its index; it's dirty until the next update
+	size_t add( const glm::vec3& position, const glm::vec3& orientation, const glm::vec3& scale );
+
+	void set( size_t i, const glm::vec3& position, const glm::vec3& orientation, const glm::vec3& scale );
+	void setPosition( size_t i, const glm::vec3& position );
+	void setOrientation( size_t i, const glm::vec3& orientation );
+	void setScale( size_t i, const glm::vec3& scale );
+
+	// recomputes every dirty instance; returns how many there were
+	size_t update( Kernel kernel = AUTO );
+
+	// marks every instance dirty, for timing and testing a full rebuild
+	void invalidate();
+
+	void reserve( size_t capacity );
+	void clear();
+
+	size_t size() const { return count; }
+	size_t dirtyCount() const { return dirty.size(); }
+
+	glm::vec3 getPosition( size_t i ) const;
+	glm::vec3 getOrientation( size_t i ) const;
+	glm::vec3 getScale( size_t i ) const;
+	glm::mat4 getWorldMatrix( size_t i ) const;
+	glm::mat4 getNormalMatrix( size_t i ) const;
+	glm::quat getRotation( size_t i ) const;
+
+	// the whole arrays, 16 floats per matrix and 4 per quaternion, one entry per instance
+	const float * getWorldMatrices() const { return array( WORLD ); }
+	const float * getNormalMatrices() const { return array( NORMAL ); }
+	const float * getRotations() const { return array( ROTATION ); }
+
+	// the kernel AUTO (or an unsupported request) resolves to on this machine
+	static Kernel selectKernel( Kernel requested );
+
+private:
+	// the arrays, in order, and how many floats each takes per instance
+	enum Array { POSITION, ORIENTATION, SCALE, ROTATION, WORLD, NORMAL, ARRAY_COUNT };
+
+	std::vector<float> storage; // capacity instances of every array, plus room to align them
+	size_t offset;              // first 16-byte-aligned float in storage
+	size_t capacity;
+	size_t count;
+
+	std::vector<size_t> dirty;
+	std::vector<unsigned char> isDirty;
+
+	float * array( Array a );
+	const float * array( Array a ) const;
+	void markDirty( size_t i );
+};
+
+#endif // _TRANSFORMTABLE_H_